@@ -0,0 +1,464 @@
+/**
+ * bench_run.c - Benchmark driver for static2jxl
+ *
+ * Runs static2jxl over a fresh copy of a corpus (see gen_corpus.c) for
+ * every combination of -j, effort and encoder backend, a few times each,
+ * and reports the median run of each configuration:
+ *
+ *   - files/s and MB/s of input, from the wall time
+ *   - peak RSS of static2jxl or its largest encoder child (wait4)
+ *   - CPU seconds and utilisation of the available cores
+ *   - time per stage, summed over files from --stats-json
+ *
+ * Results are written as JSON, one result object per line, so a later run
+ * can be compared against them with --baseline.
+ *
+ * Usage: bench_run --corpus <dir> --binary <static2jxl> [options]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+
+#define PATH_LEN 1024
+#define MAX_LIST 16
+#define MAX_RUNS 15
+#define MAX_STAGES 16
+#define STAGE_NAME_LEN 24
+#define STAMP_FILE ".bench_corpus"
+
+typedef struct {
+    int jobs;
+    int effort;
+    const char *encoder;
+} BenchConfig;
+
+typedef struct {
+    int exit_status;
+    double wall;
+    double cpu;
+    double rss_mb;
+    uint64_t files;
+    uint64_t converted;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    double stage_s[MAX_STAGES];
+} RunResult;
+
+static char g_stages[MAX_STAGES][STAGE_NAME_LEN];
+static int g_stage_count = 0;
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int split_list(char *s, char **out) {
+    int n = 0;
+    for (char *tok = strtok(s, ","); tok && n < MAX_LIST; tok = strtok(NULL, ",")) out[n++] = tok;
+    return n;
+}
+
+// Run argv with stdout/stderr to `log`; resource usage of it and its children in *ru
+static int run_command(char *const argv[], const char *log, struct rusage *ru) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        if (log) {
+            int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd >= 0) {
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+            }
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage unused;
+    while (wait4(pid, &status, 0, ru ? ru : &unused) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static bool read_stamp(const char *corpus, char *out, size_t size) {
+    char path[PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s", corpus, STAMP_FILE);
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fgets(out, (int)size, f) != NULL;
+    fclose(f);
+    out[strcspn(out, "\n")] = '\0';
+    return ok;
+}
+
+// Number after "key": in a line of our own JSON
+static double json_number(const char *line, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(line, pattern);
+    return p ? strtod(p + strlen(pattern), NULL) : 0;
+}
+
+static bool json_string_value(const char *line, const char *key, char *out, size_t size) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    const char *p = strstr(line, pattern);
+    if (!p) return false;
+    p += strlen(pattern);
+    size_t n = strcspn(p, "\"");
+    if (n >= size) n = size - 1;
+    memcpy(out, p, n);
+    out[n] = '\0';
+    return true;
+}
+
+static int stage_index(const char *name, size_t len) {
+    for (int i = 0; i < g_stage_count; i++) {
+        if (strlen(g_stages[i]) == len && strncmp(g_stages[i], name, len) == 0) return i;
+    }
+    if (g_stage_count == MAX_STAGES || len >= STAGE_NAME_LEN) return -1;
+    memcpy(g_stages[g_stage_count], name, len);
+    g_stages[g_stage_count][len] = '\0';
+    return g_stage_count++;
+}
+
+// ============================================================================
+// One run
+// ============================================================================
+
+// Per-file lines of --stats-json: counts, bytes and the phases_ms object
+static void parse_stats(const char *path, RunResult *r) {
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) > 0) {
+        if (strncmp(line, "{\"file\":", 8) != 0) continue;
+        r->files++;
+        r->bytes_in += (uint64_t)json_number(line, "bytes_in");
+        r->bytes_out += (uint64_t)json_number(line, "bytes_out");
+        if (strstr(line, "\"outcome\":\"converted\"")) r->converted++;
+
+        const char *p = strstr(line, "\"phases_ms\":{");
+        if (!p) continue;
+        p += 13;
+        while (*p == '"') {
+            const char *name = p + 1;
+            const char *end = strchr(name, '"');
+            if (!end || end[1] != ':') break;
+            char *next;
+            double ms = strtod(end + 2, &next);
+            int i = stage_index(name, (size_t)(end - name));
+            if (i >= 0) r->stage_s[i] += ms / 1e3;
+            p = next;
+            if (*p == ',') p++;
+        }
+    }
+    free(line);
+    fclose(f);
+}
+
+static bool run_once(const char *binary, const char *corpus, const char *work,
+                     const BenchConfig *cfg, RunResult *r) {
+    char tree[PATH_LEN + 32], stats[PATH_LEN + 32], log[PATH_LEN + 32], stamp[PATH_LEN + 64];
+    snprintf(tree, sizeof(tree), "%s/tree", work);
+    snprintf(stats, sizeof(stats), "%s/stats.jsonl", work);
+    snprintf(log, sizeof(log), "%s/static2jxl.log", work);
+    snprintf(stamp, sizeof(stamp), "%s/%s", tree, STAMP_FILE);
+
+    // Fresh copy every run: outputs are written beside the sources
+    char *rm[] = { "rm", "-rf", tree, NULL };
+    char *cp[] = { "cp", "-pR", (char *)corpus, tree, NULL };
+    if (run_command(rm, NULL, NULL) != 0 || run_command(cp, NULL, NULL) != 0) {
+        fprintf(stderr, "❌ Cannot copy the corpus to %s\n", tree);
+        return false;
+    }
+    unlink(stamp);
+
+    char jobs[16], effort[16];
+    snprintf(jobs, sizeof(jobs), "%d", cfg->jobs);
+    snprintf(effort, sizeof(effort), "%d", cfg->effort);
+    char *argv[] = {
+        (char *)binary, "-j", jobs, "-e", effort, "--encoder", (char *)cfg->encoder,
+        "--stats-json", stats, tree, NULL
+    };
+
+    memset(r, 0, sizeof(*r));
+    struct rusage ru;
+    double start = now_seconds();
+    r->exit_status = run_command(argv, log, &ru);
+    r->wall = now_seconds() - start;
+    r->cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+             ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+    r->rss_mb = ru.ru_maxrss / (1024.0 * 1024.0);          // bytes
+#else
+    r->rss_mb = ru.ru_maxrss / 1024.0;                     // kilobytes
+#endif
+    parse_stats(stats, r);
+    return r->exit_status >= 0 && r->exit_status != 127;
+}
+
+// ============================================================================
+// Report
+// ============================================================================
+
+static int compare_wall(const void *a, const void *b) {
+    double x = ((const RunResult *)a)->wall, y = ((const RunResult *)b)->wall;
+    return (x > y) - (x < y);
+}
+
+static void write_result(FILE *f, const BenchConfig *cfg, const RunResult *runs, int n,
+                         int cores, bool first) {
+    const RunResult *m = &runs[n / 2];
+    double util = m->wall > 0 ? 100.0 * m->cpu / (m->wall * cores) : 0;
+    fprintf(f, "%s    {\"jobs\":%d,\"effort\":%d,\"encoder\":\"%s\",\"exit_status\":%d,"
+            "\"wall_s\":%.3f,\"wall_min_s\":%.3f,\"wall_max_s\":%.3f,"
+            "\"files\":%llu,\"converted\":%llu,\"bytes_in\":%llu,\"bytes_out\":%llu,"
+            "\"files_per_s\":%.2f,\"mb_per_s\":%.2f,\"peak_rss_mb\":%.1f,"
+            "\"cpu_s\":%.2f,\"cpu_util\":%.1f,\"stages_s\":{",
+            first ? "" : ",\n", cfg->jobs, cfg->effort, cfg->encoder, m->exit_status,
+            m->wall, runs[0].wall, runs[n - 1].wall,
+            (unsigned long long)m->files, (unsigned long long)m->converted,
+            (unsigned long long)m->bytes_in, (unsigned long long)m->bytes_out,
+            m->wall > 0 ? m->files / m->wall : 0,
+            m->wall > 0 ? m->bytes_in / (1024.0 * 1024.0) / m->wall : 0,
+            m->rss_mb, m->cpu, util);
+    for (int i = 0; i < g_stage_count; i++) {
+        fprintf(f, "%s\"%s\":%.3f", i ? "," : "", g_stages[i], m->stage_s[i]);
+    }
+    fputs("}}", f);
+}
+
+static double change_pct(double base, double now) {
+    return base > 0 ? 100.0 * (now - base) / base : 0;
+}
+
+// Compare each result line of `out_path` with the same configuration in
+// `baseline`; true unless files/s dropped by more than max_regression percent
+static bool compare_baseline(const char *baseline, const char *out_path, double max_regression) {
+    FILE *base = fopen(baseline, "r");
+    if (!base) {
+        fprintf(stderr, "❌ Cannot read baseline: %s\n", baseline);
+        return false;
+    }
+    char *lines[MAX_LIST * MAX_LIST * MAX_LIST];
+    int count = 0;
+    char *line = NULL, base_stamp[256] = "", stamp[256] = "";
+    size_t cap = 0;
+    while (getline(&line, &cap, base) > 0) {
+        json_string_value(line, "stamp", base_stamp, sizeof(base_stamp));
+        if (strstr(line, "{\"jobs\":") && count < (int)(sizeof(lines) / sizeof(lines[0]))) {
+            lines[count++] = strdup(line);
+        }
+    }
+    fclose(base);
+
+    FILE *out = fopen(out_path, "r");
+    if (!out) {
+        for (int i = 0; i < count; i++) free(lines[i]);
+        free(line);
+        return false;
+    }
+    bool ok = true;
+    printf("\n📊 Against baseline %s:\n", baseline);
+    while (getline(&line, &cap, out) > 0) {
+        json_string_value(line, "stamp", stamp, sizeof(stamp));
+        if (!strstr(line, "{\"jobs\":")) continue;
+        char encoder[32] = "", base_encoder[32] = "";
+        json_string_value(line, "encoder", encoder, sizeof(encoder));
+        int jobs = (int)json_number(line, "jobs"), effort = (int)json_number(line, "effort");
+
+        const char *match = NULL;
+        for (int i = 0; i < count && !match; i++) {
+            json_string_value(lines[i], "encoder", base_encoder, sizeof(base_encoder));
+            if ((int)json_number(lines[i], "jobs") == jobs &&
+                (int)json_number(lines[i], "effort") == effort &&
+                strcmp(base_encoder, encoder) == 0) match = lines[i];
+        }
+        if (!match) {
+            printf("   -j %-3d -e %d %-7s  (not in baseline)\n", jobs, effort, encoder);
+            continue;
+        }
+        double fps = json_number(line, "files_per_s"), base_fps = json_number(match, "files_per_s");
+        double rss = json_number(line, "peak_rss_mb"), base_rss = json_number(match, "peak_rss_mb");
+        double fps_change = change_pct(base_fps, fps);
+        bool regressed = max_regression >= 0 && fps_change < -max_regression;
+        printf("   -j %-3d -e %d %-7s  files/s %8.2f → %8.2f (%+.1f%%)  RSS %6.1f → %6.1f MB (%+.1f%%)%s\n",
+               jobs, effort, encoder, base_fps, fps, fps_change, base_rss, rss,
+               change_pct(base_rss, rss), regressed ? "  ❌" : "");
+        if (regressed) ok = false;
+    }
+    if (base_stamp[0] && strcmp(base_stamp, stamp) != 0) {
+        printf("⚠️  Baseline used a different corpus (%s)\n", base_stamp);
+    }
+    fclose(out);
+    for (int i = 0; i < count; i++) free(lines[i]);
+    free(line);
+    return ok;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s --corpus <dir> --binary <static2jxl> [options]\n", prog);
+    printf("  --jobs <list>        -j values, comma-separated (default: 1,<cores>)\n");
+    printf("  --efforts <list>     Effort values (default: 7)\n");
+    printf("  --encoders <list>    Encoder backends: auto, libjxl, cjxl (default: auto)\n");
+    printf("  --runs <N>           Runs per configuration, median reported (default: 3)\n");
+    printf("  --work <dir>         Scratch directory (default: a new one under /tmp)\n");
+    printf("  -o <file>            Results JSON (default: bench-results.json)\n");
+    printf("  --baseline <file>    Compare with an earlier results file\n");
+    printf("  --max-regression <P> With --baseline: fail if files/s drops more than P%%\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *corpus = NULL, *binary = NULL, *work = NULL, *baseline = NULL;
+    const char *out_path = "bench-results.json";
+    char jobs_arg[256] = "", efforts_arg[256] = "7", encoders_arg[256] = "auto";
+    int runs = 3;
+    double max_regression = -1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+            corpus = argv[++i];
+        } else if (strcmp(argv[i], "--binary") == 0 && i + 1 < argc) {
+            binary = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            snprintf(jobs_arg, sizeof(jobs_arg), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--efforts") == 0 && i + 1 < argc) {
+            snprintf(efforts_arg, sizeof(efforts_arg), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--encoders") == 0 && i + 1 < argc) {
+            snprintf(encoders_arg, sizeof(encoders_arg), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--work") == 0 && i + 1 < argc) {
+            work = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--max-regression") == 0 && i + 1 < argc) {
+            max_regression = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!corpus || !binary) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (runs < 1) runs = 1;
+    if (runs > MAX_RUNS) runs = MAX_RUNS;
+
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    int cores = n > 0 ? (int)n : 1;
+    if (!jobs_arg[0]) {
+        if (cores > 1) snprintf(jobs_arg, sizeof(jobs_arg), "1,%d", cores);
+        else snprintf(jobs_arg, sizeof(jobs_arg), "1");
+    }
+    char *jobs[MAX_LIST], *efforts[MAX_LIST], *encoders[MAX_LIST];
+    int njobs = split_list(jobs_arg, jobs);
+    int nefforts = split_list(efforts_arg, efforts);
+    int nencoders = split_list(encoders_arg, encoders);
+
+    char stamp[256] = "";
+    if (!read_stamp(corpus, stamp, sizeof(stamp))) {
+        fprintf(stderr, "⚠️  %s has no %s: not a generated corpus, results are not reproducible\n",
+                corpus, STAMP_FILE);
+    }
+
+    char scratch[PATH_LEN];
+    bool own_work = !work;
+    if (own_work) {
+        snprintf(scratch, sizeof(scratch), "/tmp/static2jxl-bench.XXXXXX");
+        if (!mkdtemp(scratch)) {
+            fprintf(stderr, "❌ Cannot create a scratch directory: %s\n", strerror(errno));
+            return 1;
+        }
+        work = scratch;
+    } else if (mkdir(work, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "❌ Cannot create %s: %s\n", work, strerror(errno));
+        return 1;
+    }
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+        fprintf(stderr, "❌ Cannot write %s: %s\n", out_path, strerror(errno));
+        return 1;
+    }
+    struct utsname un;
+    uname(&un);
+    char date[32];
+    time_t t = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+    fprintf(out, "{\n  \"version\":1,\n  \"date\":\"%s\",\n", date);
+    fprintf(out, "  \"host\":{\"os\":\"%s\",\"machine\":\"%s\",\"cores\":%d},\n", un.sysname, un.machine, cores);
+    fprintf(out, "  \"binary\":\"%s\",\n  \"corpus\":{\"path\":\"%s\",\"stamp\":\"%s\"},\n", binary, corpus, stamp);
+    fprintf(out, "  \"runs_per_config\":%d,\n  \"results\":[\n", runs);
+
+    printf("🏁 Benchmark: %d configuration(s) x %d run(s) on %s\n",
+           njobs * nefforts * nencoders, runs, corpus);
+    fflush(stdout);
+    bool all_ok = true;
+    bool first = true;
+    for (int e = 0; e < nencoders; e++) {
+        for (int f = 0; f < nefforts; f++) {
+            for (int j = 0; j < njobs; j++) {
+                BenchConfig cfg = { atoi(jobs[j]), atoi(efforts[f]), encoders[e] };
+                RunResult results[MAX_RUNS];
+                bool ok = true;
+                for (int r = 0; r < runs && ok; r++) {
+                    ok = run_once(binary, corpus, work, &cfg, &results[r]) && results[r].exit_status == 0;
+                }
+                if (!ok) {
+                    fprintf(stderr, "⚠️  -j %d -e %d --encoder %s failed (see %s/static2jxl.log)\n",
+                            cfg.jobs, cfg.effort, cfg.encoder, work);
+                    all_ok = false;        // Keep going with the other configurations
+                    continue;
+                }
+                qsort(results, (size_t)runs, sizeof(RunResult), compare_wall);
+                const RunResult *m = &results[runs / 2];
+                printf("   -j %-3d -e %d %-7s %8.2fs  %8.2f files/s  %7.2f MB/s  RSS %7.1f MB  CPU %5.1f%%\n",
+                       cfg.jobs, cfg.effort, cfg.encoder, m->wall,
+                       m->wall > 0 ? m->files / m->wall : 0,
+                       m->wall > 0 ? m->bytes_in / (1024.0 * 1024.0) / m->wall : 0,
+                       m->rss_mb, m->wall > 0 ? 100.0 * m->cpu / (m->wall * cores) : 0);
+                fflush(stdout);
+                write_result(out, &cfg, results, runs, cores, first);
+                first = false;
+            }
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+    printf("💾 Results: %s\n", out_path);
+
+    if (own_work && all_ok) {
+        char *rm[] = { "rm", "-rf", (char *)work, NULL };
+        run_command(rm, NULL, NULL);
+    }
+    if (baseline && !compare_baseline(baseline, out_path, max_regression)) return 1;
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,833 @@
+/**
+ * gen_corpus.c - Deterministic synthetic corpus for the benchmark suite
+ *
+ * Writes a mixed tree of baseline JPEG, PNG, TIFF and BMP files from a
+ * seeded PRNG, so the same seed/files/scale always gives a byte-identical
+ * corpus on every machine (integer DCT, no libm, no zlib, fixed mtimes):
+ *
+ *   - sizes skewed towards small files with a long tail of large ones
+ *   - flat/    one wide directory holding most of the files
+ *   - deep/    a single chain of nested directories
+ *   - sparse/  many directories with one to three files each
+ *   - ~5% byte-identical copies of earlier files (for --dedup)
+ *   - ~10% metadata-heavy files (large Exif/XMP, PNG text chunks, TIFF tags)
+ *
+ * A stamp file records the parameters; an existing corpus with the same
+ * stamp is reused instead of regenerated.
+ *
+ * Usage: gen_corpus [--seed N] [--files N] [--scale P] [--force] <dir>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define STAMP_FILE ".bench_corpus"
+#define MTIME_BASE 1577836800          // 2020-01-01 00:00:00 UTC
+#define PATH_LEN 1024
+#define DEEP_LEVELS 12
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} Buf;
+
+typedef struct {
+    char path[PATH_LEN];
+    size_t size;
+} Written;
+
+static uint64_t g_rng;
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+// SplitMix64: tiny, fast and identical everywhere
+static uint64_t rnd(void) {
+    uint64_t z = (g_rng += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int rnd_range(int lo, int hi) {
+    return lo + (int)(rnd() % (uint64_t)(hi - lo + 1));
+}
+
+static void buf_reserve(Buf *b, size_t n) {
+    if (b->size + n <= b->capacity) return;
+    size_t cap = b->capacity ? b->capacity : 4096;
+    while (cap < b->size + n) cap *= 2;
+    b->data = realloc(b->data, cap);
+    if (!b->data) {
+        fprintf(stderr, "❌ Out of memory\n");
+        exit(1);
+    }
+    b->capacity = cap;
+}
+
+static void put(Buf *b, const void *p, size_t n) {
+    buf_reserve(b, n);
+    memcpy(b->data + b->size, p, n);
+    b->size += n;
+}
+
+static void put8(Buf *b, unsigned v) {
+    uint8_t c = (uint8_t)v;
+    put(b, &c, 1);
+}
+
+static void put16be(Buf *b, unsigned v) { put8(b, v >> 8); put8(b, v); }
+static void put16le(Buf *b, unsigned v) { put8(b, v); put8(b, v >> 8); }
+static void put32be(Buf *b, uint32_t v) { put16be(b, v >> 16); put16be(b, v & 0xFFFF); }
+static void put32le(Buf *b, uint32_t v) { put16le(b, v & 0xFFFF); put16le(b, v >> 16); }
+
+static void put_str(Buf *b, const char *s) { put(b, s, strlen(s)); }
+
+static bool mkdirs(const char *path) {
+    char tmp[PATH_LEN];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) != 0 && errno != EEXIST) return false;
+        *p = '/';
+    }
+    return mkdir(tmp, 0755) == 0 || errno == EEXIST;
+}
+
+static bool write_file(const char *path, const uint8_t *data, size_t size, int index) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "❌ Cannot write %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, f) == size;
+    if (fclose(f) != 0) ok = false;
+
+    // Fixed mtimes: manifest and timestamp paths behave the same every run
+    struct timespec times[2] = { { MTIME_BASE + index, 0 }, { MTIME_BASE + index, 0 } };
+    utimensat(AT_FDCWD, path, times, 0);
+    return ok;
+}
+
+// ============================================================================
+// Pixels
+// ============================================================================
+
+// Smooth value noise plus grain: compresses like a photo, not like static
+static uint8_t *make_pixels(int w, int h) {
+    int cell = rnd_range(16, 96);
+    int gw = w / cell + 2, gh = h / cell + 2;
+    uint8_t *grid = malloc((size_t)gw * gh * 3);
+    uint8_t *px = malloc((size_t)w * h * 3);
+    if (!grid || !px) {
+        fprintf(stderr, "❌ Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < gw * gh * 3; i++) grid[i] = (uint8_t)rnd();
+    int grain = rnd_range(0, 12);
+
+    for (int y = 0; y < h; y++) {
+        int gy = y / cell, fy = (y % cell) * 256 / cell;
+        for (int x = 0; x < w; x++) {
+            int gx = x / cell, fx = (x % cell) * 256 / cell;
+            for (int c = 0; c < 3; c++) {
+                int a = grid[((gy * gw) + gx) * 3 + c];
+                int b = grid[((gy * gw) + gx + 1) * 3 + c];
+                int d = grid[(((gy + 1) * gw) + gx) * 3 + c];
+                int e = grid[(((gy + 1) * gw) + gx + 1) * 3 + c];
+                int top = a * (256 - fx) + b * fx;
+                int bottom = d * (256 - fx) + e * fx;
+                int v = (top * (256 - fy) + bottom * fy) >> 16;
+                if (grain) v += (int)(rnd() % (uint64_t)(2 * grain + 1)) - grain;
+                px[((size_t)y * w + x) * 3 + c] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+            }
+        }
+    }
+    free(grid);
+    return px;
+}
+
+// Filler text for metadata-heavy files
+static void put_words(Buf *b, size_t bytes) {
+    static const char *WORDS[] = {
+        "harbour", "sunrise", "archive", "scan", "portrait", "landscape", "film",
+        "negative", "restored", "family", "travel", "museum", "catalogue", "plate"
+    };
+    size_t start = b->size;
+    while (b->size - start < bytes) {
+        put_str(b, WORDS[rnd() % (sizeof(WORDS) / sizeof(WORDS[0]))]);
+        put8(b, ' ');
+    }
+}
+
+// ============================================================================
+// Baseline JPEG (YCbCr 4:4:4, Annex K tables, integer DCT)
+// ============================================================================
+
+static const uint8_t ZIGZAG[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static const uint8_t QUANT_LUMA[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,   12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,   14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,   24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,   72, 92, 95, 98, 112, 100, 103,  99
+};
+
+static const uint8_t DC_BITS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t DC_VALS[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const uint8_t AC_BITS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t AC_VALS[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// round(4096 * cos(k*pi/16)), k = 0..8
+static const int COS16[9] = { 4096, 4017, 3784, 3406, 2896, 2276, 1567, 799, 0 };
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t length[256];
+} HuffTable;
+
+typedef struct {
+    Buf *out;
+    uint32_t bits;
+    int count;
+} BitWriter;
+
+static int g_dct[8][8];                 // c(u) * cos((2x+1)u*pi/16), scaled by 4096
+
+static void dct_init(void) {
+    for (int u = 0; u < 8; u++) {
+        for (int x = 0; x < 8; x++) {
+            int m = ((2 * x + 1) * u) % 32;
+            int sign = 1;
+            if (m > 16) m = 32 - m;
+            if (m > 8) {
+                m = 16 - m;
+                sign = -1;
+            }
+            int v = sign * COS16[m];
+            g_dct[u][x] = u == 0 ? 2896 : v;    // c(0) = 1/sqrt(2)
+        }
+    }
+}
+
+static void huff_build(HuffTable *t, const uint8_t *bits, const uint8_t *vals) {
+    int code = 0, k = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++, k++) {
+            t->code[vals[k]] = (uint16_t)code++;
+            t->length[vals[k]] = (uint8_t)len;
+        }
+        code <<= 1;
+    }
+}
+
+static void bits_put(BitWriter *w, uint32_t value, int n) {
+    w->bits = (w->bits << n) | (value & ((1u << n) - 1));
+    w->count += n;
+    while (w->count >= 8) {
+        uint8_t byte = (uint8_t)(w->bits >> (w->count - 8));
+        put8(w->out, byte);
+        if (byte == 0xFF) put8(w->out, 0);      // Byte stuffing
+        w->count -= 8;
+    }
+}
+
+static void bits_flush(BitWriter *w) {
+    if (w->count > 0) bits_put(w, 0x7F, 8 - w->count);
+}
+
+static int bit_length(int v) {
+    int n = 0;
+    for (v = v < 0 ? -v : v; v; v >>= 1) n++;
+    return n;
+}
+
+static void put_coefficient(BitWriter *w, int v, int n) {
+    bits_put(w, (uint32_t)(v < 0 ? v - 1 : v), n);
+}
+
+static void encode_block(BitWriter *w, const int *samples, const int *quant, int *dc_pred,
+                         const HuffTable *dc, const HuffTable *ac) {
+    int64_t tmp[8][8];
+    int coef[64];
+    for (int u = 0; u < 8; u++) {
+        for (int y = 0; y < 8; y++) {
+            int64_t s = 0;
+            for (int x = 0; x < 8; x++) s += (int64_t)g_dct[u][x] * samples[y * 8 + x];
+            tmp[u][y] = s;
+        }
+    }
+    for (int v = 0; v < 8; v++) {
+        for (int u = 0; u < 8; u++) {
+            int64_t s = 0;
+            for (int y = 0; y < 8; y++) s += g_dct[v][y] * tmp[u][y];
+            // F = s / (4 * 4096^2); quantised with rounding to nearest
+            int64_t d = (int64_t)4 * 4096 * 4096 * quant[v * 8 + u];
+            coef[v * 8 + u] = (int)(s >= 0 ? (s + d / 2) / d : -((-s + d / 2) / d));
+        }
+    }
+
+    int diff = coef[0] - *dc_pred;
+    *dc_pred = coef[0];
+    int n = bit_length(diff);
+    bits_put(w, dc->code[n], dc->length[n]);
+    if (n) put_coefficient(w, diff, n);
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int v = coef[ZIGZAG[k]];
+        if (v == 0) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            bits_put(w, ac->code[0xF0], ac->length[0xF0]);
+            run -= 16;
+        }
+        n = bit_length(v);
+        int symbol = (run << 4) | n;
+        bits_put(w, ac->code[symbol], ac->length[symbol]);
+        put_coefficient(w, v, n);
+        run = 0;
+    }
+    if (run) bits_put(w, ac->code[0x00], ac->length[0x00]);
+}
+
+static void put_exif(Buf *b, bool heavy) {
+    Buf tiff = { 0 };
+    const char *make = "BenchCam";
+    const char *model = "Synthetic 1";
+    const char *date = "2020:01:01 12:00:00";
+    Buf desc = { 0 };
+    put_words(&desc, heavy ? 12000 : 40);
+    put8(&desc, 0);
+
+    // IFD0: ImageDescription, Make, Model, DateTime (values after the IFD)
+    uint32_t values = 8 + 2 + 4 * 12 + 4;
+    put_str(&tiff, "II");
+    put16le(&tiff, 42);
+    put32le(&tiff, 8);
+    put16le(&tiff, 4);
+    const struct { uint16_t tag; const char *value; size_t len; } entries[4] = {
+        { 0x010E, (const char *)desc.data, desc.size },
+        { 0x010F, make, strlen(make) + 1 },
+        { 0x0110, model, strlen(model) + 1 },
+        { 0x0132, date, strlen(date) + 1 },
+    };
+    uint32_t offset = values;
+    for (int i = 0; i < 4; i++) {
+        put16le(&tiff, entries[i].tag);
+        put16le(&tiff, 2);                  // ASCII
+        put32le(&tiff, (uint32_t)entries[i].len);
+        put32le(&tiff, offset);
+        offset += (uint32_t)((entries[i].len + 1) & ~(size_t)1);
+    }
+    put32le(&tiff, 0);
+    for (int i = 0; i < 4; i++) {
+        put(&tiff, entries[i].value, entries[i].len);
+        if (entries[i].len & 1) put8(&tiff, 0);
+    }
+
+    put16be(b, 0xFFE1);
+    put16be(b, (unsigned)(2 + 6 + tiff.size));
+    put(b, "Exif\0\0", 6);
+    put(b, tiff.data, tiff.size);
+    free(tiff.data);
+    free(desc.data);
+}
+
+static void put_xmp_packet(Buf *b, size_t filler) {
+    put_str(b, "<?xpacket begin=\"\xEF\xBB\xBF\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>"
+               "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\"><rdf:RDF "
+               "xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">"
+               "<rdf:Description xmlns:dc=\"http://purl.org/dc/elements/1.1/\">"
+               "<dc:subject><rdf:Bag>");
+    size_t start = b->size;
+    while (b->size - start < filler) {
+        put_str(b, "<rdf:li>");
+        put_words(b, 24);
+        put_str(b, "</rdf:li>");
+    }
+    put_str(b, "</rdf:Bag></dc:subject></rdf:Description></rdf:RDF></x:xmpmeta>"
+               "<?xpacket end=\"w\"?>");
+}
+
+static void make_jpeg(Buf *b, const uint8_t *px, int w, int h, bool heavy) {
+    static HuffTable dc, ac;
+    static bool tables = false;
+    if (!tables) {
+        huff_build(&dc, DC_BITS, DC_VALS);
+        huff_build(&ac, AC_BITS, AC_VALS);
+        dct_init();
+        tables = true;
+    }
+
+    int quality = rnd_range(70, 95);
+    int scale = 200 - 2 * quality;
+    int quant[64];
+    for (int i = 0; i < 64; i++) {
+        int q = (QUANT_LUMA[i] * scale + 50) / 100;
+        quant[i] = q < 1 ? 1 : q > 255 ? 255 : q;
+    }
+
+    put16be(b, 0xFFD8);
+    put16be(b, 0xFFE0);                     // JFIF
+    put16be(b, 16);
+    put(b, "JFIF\0", 5);
+    put16be(b, 0x0101);
+    put8(b, 0);
+    put16be(b, 1);
+    put16be(b, 1);
+    put16be(b, 0);
+    put_exif(b, heavy);
+    if (heavy) {
+        Buf xmp = { 0 };
+        put_xmp_packet(&xmp, 20000);
+        put16be(b, 0xFFE1);
+        put16be(b, (unsigned)(2 + 29 + xmp.size));
+        put(b, "http://ns.adobe.com/xap/1.0/\0", 29);
+        put(b, xmp.data, xmp.size);
+        free(xmp.data);
+    }
+
+    put16be(b, 0xFFDB);                     // One 8-bit table for all components
+    put16be(b, 67);
+    put8(b, 0);
+    for (int k = 0; k < 64; k++) put8(b, (unsigned)quant[ZIGZAG[k]]);
+
+    put16be(b, 0xFFC0);
+    put16be(b, 17);
+    put8(b, 8);
+    put16be(b, (unsigned)h);
+    put16be(b, (unsigned)w);
+    put8(b, 3);
+    for (int c = 1; c <= 3; c++) {
+        put8(b, (unsigned)c);
+        put8(b, 0x11);
+        put8(b, 0);
+    }
+
+    put16be(b, 0xFFC4);
+    put16be(b, 2 + 17 + 12 + 17 + 162);
+    put8(b, 0x00);
+    put(b, DC_BITS, 16);
+    put(b, DC_VALS, 12);
+    put8(b, 0x10);
+    put(b, AC_BITS, 16);
+    put(b, AC_VALS, 162);
+
+    put16be(b, 0xFFDA);
+    put16be(b, 12);
+    put8(b, 3);
+    for (int c = 1; c <= 3; c++) {
+        put8(b, (unsigned)c);
+        put8(b, 0x00);
+    }
+    put8(b, 0);
+    put8(b, 63);
+    put8(b, 0);
+
+    BitWriter bw = { b, 0, 0 };
+    int pred[3] = { 0, 0, 0 };
+    int block[3][64];
+    for (int by = 0; by < h; by += 8) {
+        for (int bx = 0; bx < w; bx += 8) {
+            for (int y = 0; y < 8; y++) {
+                int sy = by + y < h ? by + y : h - 1;       // Replicate the edge
+                for (int x = 0; x < 8; x++) {
+                    int sx = bx + x < w ? bx + x : w - 1;
+                    const uint8_t *p = px + ((size_t)sy * w + sx) * 3;
+                    // JFIF RGB -> YCbCr, 16.16 fixed point
+                    int r = p[0], g = p[1], bl = p[2];
+                    int yy = (19595 * r + 38470 * g + 7471 * bl + 32768) >> 16;
+                    int cb = ((-11059 * r - 21709 * g + 32768 * bl + 32768) >> 16) + 128;
+                    int cr = ((32768 * r - 27439 * g - 5329 * bl + 32768) >> 16) + 128;
+                    block[0][y * 8 + x] = yy - 128;
+                    block[1][y * 8 + x] = cb - 128;
+                    block[2][y * 8 + x] = cr - 128;
+                }
+            }
+            for (int c = 0; c < 3; c++) encode_block(&bw, block[c], quant, &pred[c], &dc, &ac);
+        }
+    }
+    bits_flush(&bw);
+    put16be(b, 0xFFD9);
+}
+
+// ============================================================================
+// PNG (stored deflate blocks: no zlib, same bytes everywhere)
+// ============================================================================
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t n) {
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    while (n--) crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void png_chunk(Buf *b, const char *type, const uint8_t *data, size_t len) {
+    put32be(b, (uint32_t)len);
+    size_t start = b->size;
+    put(b, type, 4);
+    if (len) put(b, data, len);
+    put32be(b, crc32_update(0, b->data + start, len + 4));
+}
+
+static void make_png(Buf *b, const uint8_t *px, int w, int h, bool heavy) {
+    put(b, "\x89PNG\r\n\x1a\n", 8);
+    Buf ihdr = { 0 };
+    put32be(&ihdr, (uint32_t)w);
+    put32be(&ihdr, (uint32_t)h);
+    put8(&ihdr, 8);
+    put8(&ihdr, 2);                         // RGB
+    put8(&ihdr, 0);
+    put8(&ihdr, 0);
+    put8(&ihdr, 0);
+    png_chunk(b, "IHDR", ihdr.data, ihdr.size);
+    free(ihdr.data);
+
+    Buf text = { 0 };
+    put(&text, "Software\0static2jxl bench", 25);
+    png_chunk(b, "tEXt", text.data, text.size);
+    if (heavy) {
+        text.size = 0;
+        put(&text, "XML:com.adobe.xmp\0\0\0\0\0", 22);
+        put_xmp_packet(&text, 20000);
+        png_chunk(b, "iTXt", text.data, text.size);
+        text.size = 0;
+        put(&text, "Comment\0", 8);
+        put_words(&text, 8000);
+        png_chunk(b, "tEXt", text.data, text.size);
+    }
+    free(text.data);
+
+    // Raw scanlines (filter 0), wrapped in a zlib stream of stored blocks
+    size_t row = (size_t)w * 3 + 1;
+    size_t raw_size = row * h;
+    uint8_t *raw = malloc(raw_size);
+    for (int y = 0; y < h; y++) {
+        raw[y * row] = 0;
+        memcpy(raw + y * row + 1, px + (size_t)y * w * 3, (size_t)w * 3);
+    }
+    uint32_t s1 = 1, s2 = 0;
+    for (size_t i = 0; i < raw_size; i++) {
+        s1 = (s1 + raw[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+
+    Buf z = { 0 };
+    put8(&z, 0x78);
+    put8(&z, 0x01);
+    for (size_t off = 0; off < raw_size; ) {
+        size_t n = raw_size - off > 65535 ? 65535 : raw_size - off;
+        put8(&z, off + n == raw_size ? 1 : 0);
+        put16le(&z, (unsigned)n);
+        put16le(&z, (unsigned)(~n & 0xFFFF));
+        put(&z, raw + off, n);
+        off += n;
+    }
+    put32be(&z, (s2 << 16) | s1);
+    png_chunk(b, "IDAT", z.data, z.size);
+    png_chunk(b, "IEND", NULL, 0);
+    free(z.data);
+    free(raw);
+}
+
+// ============================================================================
+// TIFF (uncompressed RGB, one strip) and BMP (24-bit)
+// ============================================================================
+
+static void tiff_entry(Buf *b, uint16_t tag, uint16_t type, uint32_t count, uint32_t value) {
+    put16le(b, tag);
+    put16le(b, type);
+    put32le(b, count);
+    if (type == 3 && count == 1) {
+        put16le(b, value);
+        put16le(b, 0);
+    } else {
+        put32le(b, value);
+    }
+}
+
+static void make_tiff(Buf *b, const uint8_t *px, int w, int h, bool heavy) {
+    Buf desc = { 0 };
+    put_words(&desc, heavy ? 16000 : 32);
+    put8(&desc, 0);
+    const char *artist = "static2jxl bench";
+    size_t artist_len = strlen(artist) + 1;
+
+    int entries = 12;
+    uint32_t ifd_end = 8 + 2 + 12 * entries + 4;
+    uint32_t bps = ifd_end;
+    uint32_t desc_off = bps + 6;
+    uint32_t artist_off = desc_off + (uint32_t)((desc.size + 1) & ~(size_t)1);
+    uint32_t strip = artist_off + (uint32_t)((artist_len + 1) & ~(size_t)1);
+    uint32_t strip_size = (uint32_t)w * h * 3;
+
+    put_str(b, "II");
+    put16le(b, 42);
+    put32le(b, 8);
+    put16le(b, (unsigned)entries);
+    tiff_entry(b, 256, 4, 1, (uint32_t)w);
+    tiff_entry(b, 257, 4, 1, (uint32_t)h);
+    tiff_entry(b, 258, 3, 3, bps);
+    tiff_entry(b, 259, 3, 1, 1);            // No compression
+    tiff_entry(b, 262, 3, 1, 2);            // RGB
+    tiff_entry(b, 270, 2, (uint32_t)desc.size, desc_off);
+    tiff_entry(b, 273, 4, 1, strip);
+    tiff_entry(b, 277, 3, 1, 3);
+    tiff_entry(b, 278, 4, 1, (uint32_t)h);
+    tiff_entry(b, 279, 4, 1, strip_size);
+    tiff_entry(b, 284, 3, 1, 1);            // Chunky
+    tiff_entry(b, 315, 2, (uint32_t)artist_len, artist_off);
+    put32le(b, 0);
+
+    put16le(b, 8);
+    put16le(b, 8);
+    put16le(b, 8);
+    put(b, desc.data, desc.size);
+    if (desc.size & 1) put8(b, 0);
+    put(b, artist, artist_len);
+    if (artist_len & 1) put8(b, 0);
+    put(b, px, strip_size);
+    free(desc.data);
+}
+
+static void make_bmp(Buf *b, const uint8_t *px, int w, int h) {
+    uint32_t stride = ((uint32_t)w * 3 + 3) & ~3u;
+    uint32_t image = stride * (uint32_t)h;
+    put_str(b, "BM");
+    put32le(b, 54 + image);
+    put32le(b, 0);
+    put32le(b, 54);
+    put32le(b, 40);
+    put32le(b, (uint32_t)w);
+    put32le(b, (uint32_t)h);
+    put16le(b, 1);
+    put16le(b, 24);
+    put32le(b, 0);
+    put32le(b, image);
+    put32le(b, 2835);                       // 72 dpi
+    put32le(b, 2835);
+    put32le(b, 0);
+    put32le(b, 0);
+    for (int y = h - 1; y >= 0; y--) {      // Bottom-up, BGR
+        for (int x = 0; x < w; x++) {
+            const uint8_t *p = px + ((size_t)y * w + x) * 3;
+            put8(b, p[2]);
+            put8(b, p[1]);
+            put8(b, p[0]);
+        }
+        for (uint32_t pad = (uint32_t)w * 3; pad < stride; pad++) put8(b, 0);
+    }
+}
+
+// ============================================================================
+// Layout
+// ============================================================================
+
+// Mostly small files, a long tail of large ones
+static void pick_size(int scale, int *w, int *h) {
+    int r = rnd_range(0, 99);
+    int side = r < 60 ? rnd_range(64, 320)
+             : r < 90 ? rnd_range(320, 1024)
+             : r < 98 ? rnd_range(1024, 2048)
+             :          rnd_range(2048, 4096);
+    side = side * scale / 100;
+    if (side < 16) side = 16;
+    *w = side;
+    *h = side * rnd_range(50, 150) / 100;
+    if (*h < 16) *h = 16;
+}
+
+static void pick_dir(const char *root, char *out, size_t size) {
+    int r = rnd_range(0, 99);
+    if (r < 40) {
+        snprintf(out, size, "%s/flat", root);
+    } else if (r < 70) {
+        int depth = rnd_range(1, DEEP_LEVELS);
+        int n = snprintf(out, size, "%s/deep", root);
+        for (int d = 1; d <= depth && n < (int)size; d++) {
+            n += snprintf(out + n, size - (size_t)n, "/level%02d", d);
+        }
+    } else {
+        static int dir_id = 0, dir_left = 0;
+        if (dir_left-- <= 0) {
+            dir_id++;
+            dir_left = rnd_range(1, 3) - 1;
+        }
+        snprintf(out, size, "%s/sparse/d%04d", root, dir_id);
+    }
+}
+
+static bool stamp_matches(const char *root, const char *stamp) {
+    char path[PATH_LEN], existing[256] = { 0 };
+    snprintf(path, sizeof(path), "%s/%s", root, STAMP_FILE);
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    bool same = fgets(existing, sizeof(existing), f) && strcmp(existing, stamp) == 0;
+    fclose(f);
+    return same;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--seed N] [--files N] [--scale P] [--force] <dir>\n", prog);
+    printf("  --seed <N>    PRNG seed (default: 1)\n");
+    printf("  --files <N>   Number of files, copies included (default: 200)\n");
+    printf("  --scale <P>   Scale image sides by P%% (default: 100)\n");
+    printf("  --force       Regenerate even if the stamp matches\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t seed = 1;
+    int files = 200, scale = 100;
+    bool force = false;
+    const char *root = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--files") == 0 && i + 1 < argc) {
+            files = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            scale = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--force") == 0) {
+            force = true;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-' && !root) {
+            root = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!root || files < 1 || scale < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char stamp[256];
+    snprintf(stamp, sizeof(stamp), "seed=%llu files=%d scale=%d version=1\n",
+             (unsigned long long)seed, files, scale);
+    if (!force && stamp_matches(root, stamp)) {
+        printf("📦 Corpus up to date: %s", stamp);
+        return 0;
+    }
+    if (!mkdirs(root)) {
+        fprintf(stderr, "❌ Cannot create %s: %s\n", root, strerror(errno));
+        return 1;
+    }
+
+    g_rng = seed;
+    Written *written = calloc((size_t)files, sizeof(Written));
+    Buf b = { 0 };
+    uint64_t total = 0;
+    int counts[5] = { 0 };      // jpeg, png, tiff, bmp, copies
+    int heavy_count = 0;
+
+    for (int i = 0; i < files; i++) {
+        char dir[PATH_LEN / 2];
+        pick_dir(root, dir, sizeof(dir));
+        if (!mkdirs(dir)) {
+            fprintf(stderr, "❌ Cannot create %s: %s\n", dir, strerror(errno));
+            return 1;
+        }
+
+        b.size = 0;
+        Written *w = &written[i];
+        if (i > 0 && rnd_range(0, 99) < 5) {
+            // Byte-identical copy of an earlier file, elsewhere in the tree
+            const Written *src = &written[rnd_range(0, i - 1)];
+            const char *name = strrchr(src->path, '/') + 1;
+            snprintf(w->path, sizeof(w->path), "%s/copy%05d_%s", dir, i, name);
+            FILE *f = fopen(src->path, "rb");
+            if (f) {
+                buf_reserve(&b, src->size);
+                b.size = fread(b.data, 1, src->size, f);
+                fclose(f);
+            }
+            counts[4]++;
+        } else {
+            int width, height;
+            pick_size(scale, &width, &height);
+            bool heavy = rnd_range(0, 99) < 10;
+            int r = rnd_range(0, 99);
+            uint8_t *px = make_pixels(width, height);
+            const char *ext;
+            if (r < 55) {
+                make_jpeg(&b, px, width, height, heavy);
+                ext = "jpg";
+                counts[0]++;
+            } else if (r < 80) {
+                make_png(&b, px, width, height, heavy);
+                ext = "png";
+                counts[1]++;
+            } else if (r < 90) {
+                make_tiff(&b, px, width, height, heavy);
+                ext = "tif";
+                counts[2]++;
+            } else {
+                make_bmp(&b, px, width, height);
+                ext = "bmp";
+                counts[3]++;
+            }
+            free(px);
+            if (heavy) heavy_count++;
+            snprintf(w->path, sizeof(w->path), "%s/img%05d%s.%s", dir, i, heavy ? "_meta" : "", ext);
+        }
+        w->size = b.size;
+        if (!write_file(w->path, b.data, b.size, i)) return 1;
+        total += b.size;
+    }
+
+    char path[PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s", root, STAMP_FILE);
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fputs(stamp, f);
+        fprintf(f, "bytes=%llu\n", (unsigned long long)total);
+        fclose(f);
+    }
+
+    printf("📦 Corpus: %d files, %.1f MB in %s\n", files, total / (1024.0 * 1024.0), root);
+    printf("   JPEG %d, PNG %d, TIFF %d, BMP %d, copies %d, metadata-heavy %d\n",
+           counts[0], counts[1], counts[2], counts[3], counts[4], heavy_count);
+    free(written);
+    free(b.data);
+    return 0;
+}
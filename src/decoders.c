@@ -0,0 +1,691 @@
+/**
+ * decoders.c - Native source decoders for the in-process encoder
+ *
+ * Turns the ingested bytes of a lossless source into a JxlImage without
+ * temporary files or a round trip through cjxl:
+ *   - binary PNM is used in place as one packed buffer
+ *   - BMP and TGA truecolor, and uncompressed chunky strip TIFF, are read
+ *     in place through a row table: one pointer per source row, so a
+ *     bottom-up BMP/TGA is flipped by indexing rather than by copying it.
+ *     BMP/TGA rows are B,G,R(,A), which libjxl can't take; the encoder
+ *     swizzles each window it pulls (image_window), never the whole image
+ *   - PNG is inflated one scanline at a time straight into the output and
+ *     unfiltered in place, SSE2 for Sub/Up and, per pixel, Average/Paeth
+ *   - every other TIFF goes through tiff_decode()
+ *
+ * Anything else (interlaced or low-bit-depth gray PNG, palette BMP, RLE
+ * TGA, ...) returns false and keeps going to cjxl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "static2jxl.h"
+
+#define IMAGE_MAX_DIMENSION (1u << 20)      // Per side, well inside JXL's limit
+
+static uint16_t le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Row table over `height` rows of `stride` bytes at `first`, bottom-up
+// when `flip` is set
+static bool build_rows(JxlImage *img, const uint8_t *first, size_t stride, bool flip) {
+    img->rows = malloc(sizeof(*img->rows) * img->height);
+    if (!img->rows) return false;
+    for (uint32_t y = 0; y < img->height; y++) {
+        img->rows[y] = first + (size_t)(flip ? img->height - 1 - y : y) * stride;
+    }
+    return true;
+}
+
+// ============================================================================
+// PNM
+// ============================================================================
+
+// Parse one decimal header field of a binary PNM, skipping whitespace and comments
+static bool pnm_read_uint(const uint8_t *buf, size_t size, size_t *pos, uint32_t *value) {
+    size_t p = *pos;
+    for (;;) {
+        while (p < size && isspace(buf[p])) p++;
+        if (p < size && buf[p] == '#') {
+            while (p < size && buf[p] != '\n') p++;
+            continue;
+        }
+        break;
+    }
+    if (p >= size || !isdigit(buf[p])) return false;
+
+    uint64_t v = 0;
+    while (p < size && isdigit(buf[p])) {
+        v = v * 10 + (buf[p] - '0');
+        if (v > UINT32_MAX) return false;
+        p++;
+    }
+    *value = (uint32_t)v;
+    *pos = p;
+    return true;
+}
+
+// Binary PGM (P5) / PPM (P6); pixels are used in place
+static bool decode_pnm(const uint8_t *buf, size_t size, JxlImage *img) {
+    if (size < 3 || buf[0] != 'P' || (buf[1] != '5' && buf[1] != '6')) return false;
+
+    size_t pos = 2;
+    uint32_t width, height, maxval;
+    if (!pnm_read_uint(buf, size, &pos, &width) ||
+        !pnm_read_uint(buf, size, &pos, &height) ||
+        !pnm_read_uint(buf, size, &pos, &maxval)) {
+        return false;
+    }
+    if (width == 0 || height == 0 || maxval == 0 || maxval > 65535) return false;
+
+    // Exactly one whitespace byte separates maxval from the raster
+    if (pos >= size || !isspace(buf[pos])) return false;
+    pos++;
+
+    uint32_t bits = 0;
+    while ((1u << bits) <= maxval) bits++;
+
+    img->width = width;
+    img->height = height;
+    img->channels = (buf[1] == '6') ? 3 : 1;
+    img->bits = bits;
+    img->bytes_per_sample = (maxval > 255) ? 2 : 1;
+    img->big_endian = true;   // 16-bit PNM samples are MSB first
+    img->pixels = buf + pos;
+    img->size = (size_t)width * height * img->channels * img->bytes_per_sample;
+
+    return size - pos >= img->size;
+}
+
+// ============================================================================
+// BMP / TGA
+// ============================================================================
+
+// Uncompressed 24/32-bit Windows bitmap (BITMAPINFOHEADER or later).
+// 32-bit pixels are BGRX unless BI_BITFIELDS declares an alpha mask.
+static bool decode_bmp(const uint8_t *buf, size_t size, JxlImage *img) {
+    if (size < 54 || buf[0] != 'B' || buf[1] != 'M') return false;
+
+    uint32_t data_offset = le32(buf + 10);
+    uint32_t header_size = le32(buf + 14);
+    int32_t width = (int32_t)le32(buf + 18);
+    int32_t height = (int32_t)le32(buf + 22);
+    uint16_t bpp = le16(buf + 28);
+    uint32_t compression = le32(buf + 30);
+    if (header_size < 40 || le16(buf + 26) != 1) return false;
+    if (width <= 0 || height == 0 || height == INT32_MIN) return false;
+
+    bool alpha = false;
+    if (bpp == 24 && compression == 0) {
+        // BGR
+    } else if (bpp == 32 && compression == 0) {
+        // BGRX: the fourth byte is unused by definition
+    } else if (bpp == 32 && (compression == 3 || compression == 6)) {
+        // BI_BITFIELDS / BI_ALPHABITFIELDS: only the byte-aligned BGRA layout
+        bool has_alpha_mask = header_size >= 56 || compression == 6;
+        if (size < (has_alpha_mask ? 70u : 66u)) return false;
+        if (le32(buf + 54) != 0x00ff0000 || le32(buf + 58) != 0x0000ff00 ||
+            le32(buf + 62) != 0x000000ff) {
+            return false;
+        }
+        uint32_t alpha_mask = has_alpha_mask ? le32(buf + 66) : 0;
+        if (alpha_mask != 0 && alpha_mask != 0xff000000) return false;
+        alpha = (alpha_mask != 0);
+    } else {
+        return false;   // Palette, 16-bit, RLE, embedded JPEG/PNG
+    }
+
+    uint32_t rows = (height < 0) ? (uint32_t)-height : (uint32_t)height;
+    if ((uint32_t)width > IMAGE_MAX_DIMENSION || rows > IMAGE_MAX_DIMENSION) return false;
+    size_t stride = ((size_t)width * bpp + 31) / 32 * 4;   // Rows pad to 4 bytes
+    if (data_offset > size || stride * rows > size - data_offset) return false;
+
+    img->width = (uint32_t)width;
+    img->height = rows;
+    img->channels = alpha ? 4 : 3;
+    img->bits = 8;
+    img->bytes_per_sample = 1;
+    img->alpha = alpha;
+    img->bgr = true;
+    img->row_pixel_bytes = bpp / 8;
+    img->size = (size_t)img->width * rows * img->channels;
+    // Positive height: bottom-up
+    return build_rows(img, buf + data_offset, stride, height > 0);
+}
+
+// Uncompressed truecolor (24/32-bit, BGR(A)) or 8-bit gray Truevision TGA.
+// TGA has no signature; every format tried before it has a nonzero second
+// byte, which TGA requires to be 0 (no color map).
+static bool decode_tga(const uint8_t *buf, size_t size, JxlImage *img) {
+    if (size < 18 || buf[1] != 0) return false;
+
+    uint8_t type = buf[2];
+    uint32_t width = le16(buf + 12);
+    uint32_t height = le16(buf + 14);
+    uint8_t depth = buf[16];
+    uint8_t descriptor = buf[17];
+    uint8_t alpha_bits = descriptor & 0x0f;
+    if (width == 0 || height == 0) return false;
+    if (descriptor & 0xd0) return false;   // Right-to-left or interleaved rows
+
+    bool gray = (type == 3 && depth == 8 && alpha_bits == 0);
+    bool rgb = (type == 2 && depth == 24 && alpha_bits == 0);
+    bool rgba = (type == 2 && depth == 32 && (alpha_bits == 0 || alpha_bits == 8));
+    if (!gray && !rgb && !rgba) return false;   // RLE, color-mapped, 15/16-bit
+
+    size_t data_offset = 18 + (size_t)buf[0];   // Image ID follows the header
+    size_t stride = (size_t)width * (depth / 8);
+    if (data_offset > size || stride * height > size - data_offset) return false;
+
+    img->width = width;
+    img->height = height;
+    img->alpha = rgba && alpha_bits == 8;
+    img->channels = gray ? 1 : img->alpha ? 4 : 3;
+    img->bits = 8;
+    img->bytes_per_sample = 1;
+    img->bgr = !gray;
+    img->row_pixel_bytes = depth / 8;
+    img->size = (size_t)width * height * img->channels;
+    // Descriptor bit 5 set: first row is the top one
+    return build_rows(img, buf + data_offset, stride, !(descriptor & 0x20));
+}
+
+// ============================================================================
+// TIFF strips
+// ============================================================================
+
+// Uncompressed chunky strip TIFF the encoder reads in place; every strip
+// must lie inside the file
+static bool map_tiff_strips(const uint8_t *buf, size_t size, JxlImage *img) {
+    TiffImage tif;
+    if (!tiff_parse(buf, size, &tif) || !tiff_streamable(&tif)) return false;
+
+    uint32_t rows_per_strip = tif.seg_height;
+    uint32_t strips = (tif.height + rows_per_strip - 1) / rows_per_strip;
+    if (tif.segments < strips) return false;
+    size_t stride = (size_t)tif.width * tif.samples * (tif.bits / 8);
+
+    for (uint32_t s = 0; s < strips; s++) {
+        uint32_t rows = (s + 1 == strips) ? tif.height - s * rows_per_strip : rows_per_strip;
+        size_t offset = tiff_segment_offset(&tif, s);
+        if (offset > size || rows * stride > size - offset) return false;
+    }
+
+    img->width = tif.width;
+    img->height = tif.height;
+    img->channels = tif.samples;
+    img->bits = tif.bits;
+    img->bytes_per_sample = tif.bits / 8;
+    img->big_endian = tif.big_endian;
+    img->row_pixel_bytes = (uint32_t)(stride / tif.width);
+    img->size = stride * tif.height;
+    img->rows = malloc(sizeof(*img->rows) * tif.height);
+    if (!img->rows) return false;
+    for (uint32_t y = 0; y < tif.height; y++) {
+        img->rows[y] = buf + tiff_segment_offset(&tif, y / rows_per_strip) +
+                       (size_t)(y % rows_per_strip) * stride;
+    }
+    return true;
+}
+
+// ============================================================================
+// Filter decoding shared by PNG (Sub) and TIFF (Predictor 2)
+// ============================================================================
+
+#ifdef __SSE2__
+// Prefix sum of each sample lane over a 16-byte block, S samples per pixel
+#define PREFIX_SUM_BLOCKS(S)                                                   \
+    for (; i + 16 <= n; i += 16) {                                             \
+        __m128i v = _mm_loadu_si128((const __m128i *)(row + i));               \
+        v = _mm_add_epi8(v, _mm_slli_si128(v, S));                             \
+        if (2 * S < 16) v = _mm_add_epi8(v, _mm_slli_si128(v, 2 * S));         \
+        if (4 * S < 16) v = _mm_add_epi8(v, _mm_slli_si128(v, 4 * S));         \
+        if (8 * S < 16) v = _mm_add_epi8(v, _mm_slli_si128(v, 8 * S));         \
+        v = _mm_add_epi8(v, carry);                                            \
+        _mm_storeu_si128((__m128i *)(row + i), v);                             \
+        uint32_t last;                                                         \
+        memcpy(&last, row + i + 12, 4);                                        \
+        carry = (S == 8) ? _mm_unpackhi_epi64(v, v)                            \
+              : (S == 4) ? _mm_set1_epi32((int)last)                           \
+              : (S == 2) ? _mm_set1_epi16((short)(last >> 16))                 \
+                         : _mm_set1_epi8((char)(last >> 24));                  \
+    }
+#endif
+
+// row[i] += row[i - stride] over `n` bytes: TIFF horizontal differencing of
+// 8-bit samples and the PNG Sub filter (stride = bytes per pixel)
+void delta_decode_8(uint8_t *row, size_t n, uint32_t stride) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // Little-endian lane extraction above; lanes line up when 16 % S == 0
+    __m128i carry = _mm_setzero_si128();
+    switch (stride) {
+        case 1: PREFIX_SUM_BLOCKS(1); break;
+        case 2: PREFIX_SUM_BLOCKS(2); break;
+        case 4: PREFIX_SUM_BLOCKS(4); break;
+        case 8: PREFIX_SUM_BLOCKS(8); break;
+    }
+#endif
+    if (i < stride) i = stride;
+    for (; i < n; i++) row[i] = (uint8_t)(row[i] + row[i - stride]);
+}
+
+// ============================================================================
+// PNG
+// ============================================================================
+
+#ifdef HAVE_ZLIB
+
+static const uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+static uint32_t be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t depth;
+    uint8_t color;                 // IHDR colour type
+    const uint8_t *palette;        // PLTE entries (RGB)
+    uint32_t palette_size;
+    const uint8_t *trns;           // tRNS alpha per palette entry
+    uint32_t trns_size;
+    size_t idat;                   // Offset of the first IDAT chunk
+} PngInfo;
+
+// Walk the chunk list: IHDR, the features the native path can take, and
+// where the image data starts
+static bool png_parse(const uint8_t *buf, size_t size, PngInfo *png) {
+    memset(png, 0, sizeof(*png));
+    if (size < 33 || memcmp(buf, PNG_SIGNATURE, 8) != 0) return false;
+    if (be32(buf + 8) != 13 || memcmp(buf + 12, "IHDR", 4) != 0) return false;
+
+    png->width = be32(buf + 16);
+    png->height = be32(buf + 20);
+    png->depth = buf[24];
+    png->color = buf[25];
+    if (buf[26] != 0 || buf[27] != 0 || buf[28] != 0) return false;   // Adam7 goes to cjxl
+    if (png->width == 0 || png->height == 0 ||
+        png->width > IMAGE_MAX_DIMENSION || png->height > IMAGE_MAX_DIMENSION) {
+        return false;
+    }
+
+    bool color_managed = false, gamma_only = false, transparent_color = false;
+    size_t pos = 33;
+    while (pos + 12 <= size) {
+        uint32_t len = be32(buf + pos);
+        const uint8_t *type = buf + pos + 4;
+        const uint8_t *data = buf + pos + 8;
+        if (len > size - pos - 12) return false;
+
+        if (!memcmp(type, "IDAT", 4)) {
+            if (!png->idat) png->idat = pos;
+        } else if (!memcmp(type, "PLTE", 4)) {
+            png->palette = data;
+            png->palette_size = len / 3;
+        } else if (!memcmp(type, "tRNS", 4)) {
+            png->trns = data;
+            png->trns_size = len;
+            transparent_color = (png->color != 3);
+        } else if (!memcmp(type, "iCCP", 4) || !memcmp(type, "sRGB", 4)) {
+            color_managed = true;
+        } else if (!memcmp(type, "gAMA", 4) || !memcmp(type, "cHRM", 4)) {
+            gamma_only = true;
+        } else if (!memcmp(type, "acTL", 4)) {
+            return false;   // APNG: cjxl keeps the animation
+        } else if (!memcmp(type, "IEND", 4)) {
+            break;
+        }
+        pos += 12 + (size_t)len;
+    }
+    if (!png->idat) return false;
+    // Only cjxl turns bare gAMA/cHRM into a colour encoding; without it
+    // the image would be tagged sRGB
+    if (gamma_only && !color_managed) return false;
+    if (transparent_color) return false;
+
+    switch (png->color) {
+        case 0: case 2: case 4: case 6:
+            return png->depth == 8 || png->depth == 16;
+        case 3:
+            return (png->depth == 1 || png->depth == 2 || png->depth == 4 || png->depth == 8) &&
+                   png->palette_size > 0;
+        default:
+            return false;
+    }
+}
+
+static void png_header(const PngInfo *png, JxlImage *img) {
+    static const uint32_t channels[7] = { 1, 0, 3, 3, 2, 0, 4 };
+    img->width = png->width;
+    img->height = png->height;
+    img->alpha = (png->color == 4 || png->color == 6 || (png->color == 3 && png->trns_size > 0));
+    img->channels = channels[png->color] + (png->color == 3 && img->alpha ? 1 : 0);
+    img->bits = (png->color == 3) ? 8 : png->depth;
+    img->bytes_per_sample = img->bits / 8;
+    img->big_endian = true;   // 16-bit PNG samples are MSB first
+    img->size = (size_t)png->width * png->height * img->channels * img->bytes_per_sample;
+}
+
+static void unfilter_up(uint8_t *row, const uint8_t *prev, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(prev + i));
+        _mm_storeu_si128((__m128i *)(row + i), _mm_add_epi8(a, b));
+    }
+#endif
+    for (; i < n; i++) row[i] = (uint8_t)(row[i] + prev[i]);
+}
+
+static uint8_t paeth(int a, int b, int c) {
+    int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+    if (pa <= pb && pa <= pc) return (uint8_t)a;
+    return (uint8_t)(pb <= pc ? b : c);
+}
+
+#ifdef __SSE2__
+// One pixel of up to 8 bytes as 16-bit lanes
+static inline __m128i load_pixel(const uint8_t *p, uint32_t bpp) {
+    uint64_t v = 0;
+    memcpy(&v, p, bpp);
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&v), _mm_setzero_si128());
+}
+
+static inline void store_pixel(uint8_t *p, __m128i v, uint32_t bpp) {
+    uint64_t out;
+    v = _mm_and_si128(v, _mm_set1_epi16(0xff));
+    _mm_storel_epi64((__m128i *)&out, _mm_packus_epi16(v, v));
+    memcpy(p, &out, bpp);
+}
+
+static inline __m128i abs_epi16(__m128i v) {
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+#endif
+
+// Average and Paeth depend on the pixel to the left; with SSE2 all bytes
+// of a pixel (3-8) go through in one step
+static void unfilter_average(uint8_t *row, const uint8_t *prev, size_t n, uint32_t bpp) {
+    size_t i = 0;
+#ifdef __SSE2__
+    if (bpp >= 3) {
+        __m128i a = _mm_setzero_si128();
+        for (; i < n; i += bpp) {
+            __m128i b = load_pixel(prev + i, bpp);
+            __m128i pred = _mm_srli_epi16(_mm_add_epi16(a, b), 1);
+            a = _mm_and_si128(_mm_add_epi16(load_pixel(row + i, bpp), pred), _mm_set1_epi16(0xff));
+            store_pixel(row + i, a, bpp);
+        }
+        return;
+    }
+#endif
+    for (; i < n; i++) {
+        int left = (i >= bpp) ? row[i - bpp] : 0;
+        row[i] = (uint8_t)(row[i] + ((left + prev[i]) >> 1));
+    }
+}
+
+static void unfilter_paeth(uint8_t *row, const uint8_t *prev, size_t n, uint32_t bpp) {
+    size_t i = 0;
+#ifdef __SSE2__
+    if (bpp >= 3) {
+        __m128i a = _mm_setzero_si128(), c = _mm_setzero_si128();
+        for (; i < n; i += bpp) {
+            __m128i b = load_pixel(prev + i, bpp);
+            __m128i bc = _mm_sub_epi16(b, c), ac = _mm_sub_epi16(a, c);
+            __m128i pa = abs_epi16(bc), pb = abs_epi16(ac), pc = abs_epi16(_mm_add_epi16(bc, ac));
+            // Not a: pa is beaten by pb or pc; then c wins over b when pb > pc
+            __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+            __m128i take_c = _mm_and_si128(not_a, _mm_cmpgt_epi16(pb, pc));
+            __m128i take_b = _mm_andnot_si128(take_c, not_a);
+            __m128i pred = _mm_or_si128(_mm_andnot_si128(not_a, a),
+                                        _mm_or_si128(_mm_and_si128(take_b, b), _mm_and_si128(take_c, c)));
+            a = _mm_and_si128(_mm_add_epi16(load_pixel(row + i, bpp), pred), _mm_set1_epi16(0xff));
+            store_pixel(row + i, a, bpp);
+            c = b;
+        }
+        return;
+    }
+#endif
+    for (; i < n; i++) {
+        int left = (i >= bpp) ? row[i - bpp] : 0;
+        int upper_left = (i >= bpp) ? prev[i - bpp] : 0;
+        row[i] = (uint8_t)(row[i] + paeth(left, prev[i], upper_left));
+    }
+}
+
+static bool png_unfilter(uint8_t filter, uint8_t *row, const uint8_t *prev, size_t n, uint32_t bpp) {
+    switch (filter) {
+        case 0: return true;
+        case 1: delta_decode_8(row, n, bpp); return true;
+        case 2: unfilter_up(row, prev, n); return true;
+        case 3: unfilter_average(row, prev, n, bpp); return true;
+        case 4: unfilter_paeth(row, prev, n, bpp); return true;
+        default: return false;
+    }
+}
+
+// Inflate state fed straight from the IDAT chunks in the source
+typedef struct {
+    z_stream zs;
+    const uint8_t *buf;
+    size_t size;
+    size_t next_chunk;             // Offset of the chunk after the current one
+} PngStream;
+
+static bool png_read(PngStream *s, uint8_t *dst, size_t n) {
+    s->zs.next_out = dst;
+    s->zs.avail_out = (uInt)n;
+    while (s->zs.avail_out > 0) {
+        if (s->zs.avail_in == 0) {
+            // Consecutive IDAT chunks form one zlib stream
+            size_t pos = s->next_chunk;
+            if (pos + 12 > s->size || memcmp(s->buf + pos + 4, "IDAT", 4) != 0) return false;
+            uint32_t len = be32(s->buf + pos);
+            if (len > s->size - pos - 12) return false;
+            s->zs.next_in = (Bytef *)(s->buf + pos + 8);
+            s->zs.avail_in = len;
+            s->next_chunk = pos + 12 + len;
+            continue;
+        }
+        int ret = inflate(&s->zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) return s->zs.avail_out == 0;
+        if (ret != Z_OK) return false;
+    }
+    return true;
+}
+
+// Scanlines inflate into the output rows and are unfiltered there, against
+// the row above. Palette images unfilter packed indices in two scratch
+// rows and expand them into the output.
+static bool png_decode(const uint8_t *buf, size_t size, const PngInfo *png, JxlImage *img) {
+    png_header(png, img);
+    bool indexed = (png->color == 3);
+    uint32_t raw_channels = indexed ? 1 : img->channels;
+    size_t row_bytes = ((size_t)png->width * raw_channels * png->depth + 7) / 8;
+    uint32_t bpp = (raw_channels * png->depth + 7) / 8;
+    size_t out_stride = (size_t)png->width * img->channels * img->bytes_per_sample;
+    // Deflate expands at most ~1032:1; rejects corrupt headers before the allocation
+    if ((uint64_t)(size - png->idat) * 1032 < (uint64_t)png->height * (row_bytes + 1)) return false;
+
+    size_t pixels_capacity, scratch_capacity;
+    uint8_t *pixels = buffer_get(img->size, &pixels_capacity);
+    uint8_t *scratch = buffer_get((indexed ? 2 : 1) * row_bytes, &scratch_capacity);
+    PngStream s = { .buf = buf, .size = size, .next_chunk = png->idat };
+    bool ok = pixels && scratch && inflateInit(&s.zs) == Z_OK;
+    if (!ok) {
+        buffer_put(pixels, pixels_capacity);
+        buffer_put(scratch, scratch_capacity);
+        return false;
+    }
+    memset(scratch, 0, (indexed ? 2 : 1) * row_bytes);   // Zero row above the first
+
+    // Expanded palette: RGB(A) per index; out-of-range indices are black
+    uint8_t lut[256][4];
+    memset(lut, 0, sizeof(lut));
+    for (uint32_t i = 0; indexed && i < 256; i++) {
+        if (i < png->palette_size) memcpy(lut[i], png->palette + i * 3, 3);
+        lut[i][3] = (i < png->trns_size) ? png->trns[i] : 255;
+    }
+
+    const uint8_t *prev = scratch;
+    for (uint32_t y = 0; ok && y < png->height; y++) {
+        uint8_t *row = indexed ? scratch + (y & 1 ? 0 : row_bytes) : pixels + y * out_stride;
+        uint8_t filter;
+        ok = png_read(&s, &filter, 1) && png_read(&s, row, row_bytes) &&
+             png_unfilter(filter, row, prev, row_bytes, bpp);
+        prev = row;
+        if (!ok || !indexed) continue;
+
+        uint8_t *dst = pixels + y * out_stride;
+        uint32_t per_byte = 8 / png->depth, mask = (1u << png->depth) - 1;
+        for (uint32_t x = 0; x < png->width; x++) {
+            uint32_t shift = 8 - png->depth * (x % per_byte + 1);
+            uint8_t index = (uint8_t)((row[x / per_byte] >> shift) & mask);
+            memcpy(dst + (size_t)x * img->channels, lut[index], img->channels);
+        }
+    }
+    inflateEnd(&s.zs);
+    buffer_put(scratch, scratch_capacity);
+
+    if (!ok) {
+        buffer_put(pixels, pixels_capacity);
+        return false;
+    }
+    img->pixels = pixels;
+    img->owned = pixels;
+    img->owned_capacity = pixels_capacity;
+    return true;
+}
+
+#endif  // HAVE_ZLIB
+
+// ============================================================================
+// Entry points
+// ============================================================================
+
+// Decode (or map) an in-memory source for the encoder. `header_only` asks
+// for dimensions and layout alone: PNG isn't inflated, compressed TIFF is
+// refused. Release with image_free().
+bool decode_image(const uint8_t *buf, size_t size, JxlImage *img, bool header_only) {
+    memset(img, 0, sizeof(*img));
+    if (decode_pnm(buf, size, img)) return true;
+    image_free(img);
+    if (decode_bmp(buf, size, img)) return true;
+    image_free(img);
+    if (map_tiff_strips(buf, size, img)) return true;
+    image_free(img);
+
+#ifdef HAVE_ZLIB
+    // IDAT is a zlib stream: without zlib PNG stays with cjxl
+    PngInfo png;
+    if (png_parse(buf, size, &png)) {
+        if (header_only) {
+            png_header(&png, img);
+            return true;
+        }
+        return png_decode(buf, size, &png, img);
+    }
+#endif
+
+    TiffImage tif;
+    if (tiff_parse(buf, size, &tif)) {
+        return !header_only && tiff_decode(&tif, img);
+    }
+
+    if (decode_tga(buf, size, img)) return true;
+    image_free(img);
+    return false;
+}
+
+// Bytes per pixel the encoder is handed (after any swizzle)
+static size_t pixel_bytes_of(const JxlImage *img) {
+    return (size_t)img->channels * img->bytes_per_sample;
+}
+
+// Copy columns [x, x + w) of rows [y, y + h) into `dst` as packed,
+// encoder-order pixels
+void image_copy_rows(const JxlImage *img, size_t x, size_t y, size_t w, size_t h, uint8_t *dst) {
+    size_t pixel_bytes = pixel_bytes_of(img);
+    size_t out_stride = w * pixel_bytes;
+
+    for (size_t r = 0; r < h; r++) {
+        uint8_t *out = dst + r * out_stride;
+        if (!img->rows) {
+            size_t stride = (size_t)img->width * pixel_bytes;
+            memcpy(out, img->pixels + (y + r) * stride + x * pixel_bytes, out_stride);
+            continue;
+        }
+        const uint8_t *src = img->rows[y + r] + x * img->row_pixel_bytes;
+        if (!img->bgr) {
+            memcpy(out, src, out_stride);
+        } else if (img->channels == 4) {
+            for (size_t i = 0; i < w; i++, src += 4, out += 4) {
+                out[0] = src[2];
+                out[1] = src[1];
+                out[2] = src[0];
+                out[3] = src[3];
+            }
+        } else {
+            uint32_t step = img->row_pixel_bytes;   // 3, or 4 for BGRX
+            for (size_t i = 0; i < w; i++, src += step, out += 3) {
+                out[0] = src[2];
+                out[1] = src[1];
+                out[2] = src[0];
+            }
+        }
+    }
+}
+
+// A window of a row-table image for the chunked encoder. Returned in place
+// when the rows are already in encoder order and evenly spaced top-down
+// (one TIFF strip, a top-down gray TGA); else copied into a buffer the
+// caller frees. Stateless, so libjxl may call it from any thread.
+const uint8_t *image_window(const JxlImage *img, size_t x, size_t y, size_t w, size_t h,
+                            size_t *row_offset) {
+    size_t pixel_bytes = pixel_bytes_of(img);
+    if (!img->bgr && img->row_pixel_bytes == pixel_bytes) {
+        bool in_place = (h == 1) || img->rows[y + 1] > img->rows[y];
+        size_t stride = (h > 1) ? (size_t)(img->rows[y + 1] - img->rows[y]) : pixel_bytes * img->width;
+        for (size_t r = 2; in_place && r < h; r++) {
+            in_place = img->rows[y + r] == img->rows[y] + r * stride;
+        }
+        if (in_place) {
+            *row_offset = stride;
+            return img->rows[y] + x * pixel_bytes;
+        }
+    }
+
+    uint8_t *copy = malloc(w * h * pixel_bytes);
+    if (!copy) return NULL;
+    image_copy_rows(img, x, y, w, h, copy);
+    *row_offset = w * pixel_bytes;
+    return copy;
+}
+
+void image_free(JxlImage *img) {
+    buffer_put(img->owned, img->owned_capacity);
+    free(img->rows);
+    memset(img, 0, sizeof(*img));
+}
@@ -0,0 +1,222 @@
+/**
+ * dedup.c - Content deduplication (--dedup)
+ *
+ * Byte-identical sources are encoded once. Each candidate is fingerprinted
+ * by its size and two XXH64s (different seeds, 128 bits together) while it
+ * is already in memory for the encode, so identical copies collide and
+ * anything else practically cannot:
+ *
+ *   - the first file of a group becomes its leader and runs the pipeline
+ *   - copies that arrive while the leader is in flight park on the group
+ *     and are handed back when it resolves
+ *   - copies that arrive later take the recorded outcome at once
+ *
+ * A converted leader's final output is cloned for every copy (FICLONE
+ * reflink, else copy_file_range(), else plain read/write) before the copy
+ * gets its own metadata and timestamps. A leader that was rolled back or
+ * failed passes that outcome on without another encode.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE                // copy_file_range()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#include "static2jxl.h"
+
+#define DEDUP_SEED_SECOND 0x5354324A584C4450ULL    // "ST2JXLDP"
+#define DEDUP_INITIAL_SLOTS 1024
+#define DEDUP_COPY_CHUNK (1024 * 1024)
+
+// Groups are allocated individually: jobs keep pointers across table growth
+static DedupGroup **g_slots = NULL;
+static size_t g_capacity = 0;
+static size_t g_live = 0;
+static pthread_mutex_t g_dedup_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// ============================================================================
+// Group table (open addressing on the first hash)
+// ============================================================================
+
+static bool same_content(const DedupGroup *g, size_t size, uint64_t hash, uint64_t hash2) {
+    return g->size == size && g->hash == hash && g->hash2 == hash2;
+}
+
+static DedupGroup **slot_find(size_t size, uint64_t hash, uint64_t hash2) {
+    size_t i = hash & (g_capacity - 1);
+    while (g_slots[i] && !same_content(g_slots[i], size, hash, hash2)) {
+        i = (i + 1) & (g_capacity - 1);
+    }
+    return &g_slots[i];
+}
+
+static bool table_grow(void) {
+    size_t capacity = g_capacity ? g_capacity * 2 : DEDUP_INITIAL_SLOTS;
+    DedupGroup **slots = calloc(capacity, sizeof(DedupGroup *));
+    if (!slots) return false;
+
+    DedupGroup **old = g_slots;
+    size_t old_capacity = g_capacity;
+    g_slots = slots;
+    g_capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i]) *slot_find(old[i]->size, old[i]->hash, old[i]->hash2) = old[i];
+    }
+    free(old);
+    return true;
+}
+
+// ============================================================================
+// Claim / resolve
+// ============================================================================
+
+// Join (or found) the group of `job`'s source. `job->content_hash` must
+// already hold XXH64(src, seed 0). DEDUP_PARKED hands the job to the
+// leader; DEDUP_RESOLVED sets *group to copy the outcome from.
+DedupRole dedup_claim(Job *job, const SourceBuffer *src, DedupGroup **group) {
+    uint64_t hash2 = xxh64(src->data, src->size, DEDUP_SEED_SECOND);
+
+    pthread_mutex_lock(&g_dedup_mutex);
+    if ((g_live + 1) * 10 > g_capacity * 7 && !table_grow()) {
+        pthread_mutex_unlock(&g_dedup_mutex);
+        return DEDUP_UNIQUE;       // Out of memory: just encode it
+    }
+
+    DedupGroup **slot = slot_find(src->size, job->content_hash, hash2);
+    DedupGroup *g = *slot;
+    if (!g) {
+        g = calloc(1, sizeof(DedupGroup));
+        if (!g) {
+            pthread_mutex_unlock(&g_dedup_mutex);
+            return DEDUP_UNIQUE;
+        }
+        g->size = src->size;
+        g->hash = job->content_hash;
+        g->hash2 = hash2;
+        *slot = g;
+        g_live++;
+        job->dedup_group = g;
+        pthread_mutex_unlock(&g_dedup_mutex);
+        return DEDUP_LEADER;
+    }
+
+    DedupRole role;
+    if (g->resolved) {
+        role = DEDUP_RESOLVED;
+    } else {
+        job->dedup_next = g->waiters;
+        g->waiters = job;
+        role = DEDUP_PARKED;
+    }
+    *group = g;
+    pthread_mutex_unlock(&g_dedup_mutex);
+    return role;
+}
+
+// The leader has left the pipeline: record how it ended and return the
+// copies parked on it (linked through dedup_next) for the caller to finish
+Job *dedup_resolve(const Job *leader) {
+    DedupGroup *g = leader->dedup_group;
+    char *output = leader->outcome == OUTCOME_CONVERTED ? strdup(leader->output) : NULL;
+
+    pthread_mutex_lock(&g_dedup_mutex);
+    g->resolved = true;
+    g->outcome = output ? OUTCOME_CONVERTED : leader->outcome;
+    g->output = output;
+    g->metadata_native = leader->metadata_native;
+    g->encode_seconds = leader->encode_seconds;
+    Job *waiters = g->waiters;
+    g->waiters = NULL;
+    pthread_mutex_unlock(&g_dedup_mutex);
+    return waiters;
+}
+
+void dedup_destroy(void) {
+    for (size_t i = 0; i < g_capacity; i++) {
+        if (!g_slots[i]) continue;
+        free(g_slots[i]->output);
+        free(g_slots[i]);
+    }
+    free(g_slots);
+    g_slots = NULL;
+    g_capacity = 0;
+    g_live = 0;
+}
+
+// ============================================================================
+// Cloning the leader's output
+// ============================================================================
+
+static bool copy_bytes(int in, int out, off_t size) {
+#ifdef __linux__
+    // Reflink: shares extents on Btrfs/XFS/bcachefs, no data is copied
+    if (ioctl(out, FICLONE, in) == 0) return true;
+
+    // In-kernel copy (server-side on NFS 4.2 / SMB3)
+    off_t done = 0;
+    while (done < size) {
+        ssize_t n = copy_file_range(in, NULL, out, NULL, (size_t)(size - done), 0);
+        if (n <= 0) break;
+        done += n;
+    }
+    if (done == size) return true;
+    if (done > 0) return false;    // Failed midway: don't mix in a second method
+#else
+    (void)size;
+#endif
+
+    uint8_t *buf = malloc(DEDUP_COPY_CHUNK);
+    if (!buf) return false;
+    bool ok = true;
+    ssize_t n;
+    while ((n = read(in, buf, DEDUP_COPY_CHUNK)) > 0) {
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                ok = false;
+                break;
+            }
+            off += w;
+        }
+        if (!ok) break;
+    }
+    free(buf);
+    return ok && n == 0;
+}
+
+// Copy the contents (not metadata or timestamps) of `source` to `dest`
+bool dedup_clone(const char *source, const char *dest) {
+    int in = open(source, O_RDONLY);
+    if (in < 0) return false;
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+        close(in);
+        return false;
+    }
+    int out = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+
+    bool ok = copy_bytes(in, out, st.st_size);
+    close(in);
+    if (close(out) != 0) ok = false;
+    if (!ok) unlink(dest);
+    return ok;
+}
@@ -0,0 +1,219 @@
+/**
+ * exiftool.c - Persistent exiftool daemons (-stay_open)
+ *
+ * Starting exiftool means starting a Perl interpreter (~150 ms), which used
+ * to happen up to three times per file. Instead a small pool of
+ *
+ *     exiftool -stay_open True -@ -
+ *
+ * processes is kept for the whole run. A command is written to the daemon's
+ * stdin one argument per line, terminated by `-execute`, and its output is
+ * read back up to the `{ready}` sentinel. A daemon that dies is restarted
+ * and the command retried once.
+ *
+ * Callers get EXIFTOOL_UNAVAILABLE when no daemon can be used (exiftool
+ * missing, argument containing a newline) and fall back to a one-shot
+ * exiftool process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+extern char **environ;
+
+typedef struct ExifToolProc {
+    pid_t pid;
+    FILE *in;                      // Commands → daemon stdin
+    FILE *out;                     // Daemon stdout → responses
+    bool in_use;
+} ExifToolProc;
+
+static ExifToolProc *g_pool = NULL;
+static int g_pool_size = 0;
+static bool g_pool_disabled = false;   // Spawning failed once - don't keep trying
+static pthread_mutex_t g_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_pool_cond = PTHREAD_COND_INITIALIZER;
+
+static bool proc_start(ExifToolProc *et) {
+    int to_child[2], from_child[2];
+    if (pipe_cloexec(to_child) != 0) return false;
+    if (pipe_cloexec(from_child) != 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, to_child[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, from_child[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addclose(&actions, to_child[0]);
+    posix_spawn_file_actions_addclose(&actions, from_child[1]);
+
+    // Own process group: Ctrl-C must not kill daemons while in-flight files finish
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+
+    char *argv[] = { "exiftool", "-stay_open", "True", "-@", "-", NULL };
+    int rc = posix_spawnp(&et->pid, "exiftool", &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    close(to_child[0]);
+    close(from_child[1]);
+    if (rc != 0) {
+        close(to_child[1]);
+        close(from_child[0]);
+        return false;
+    }
+
+    et->in = fdopen(to_child[1], "w");
+    et->out = fdopen(from_child[0], "r");
+    if (!et->in || !et->out) {
+        if (et->in) fclose(et->in); else close(to_child[1]);
+        if (et->out) fclose(et->out); else close(from_child[0]);
+        kill(et->pid, SIGKILL);
+        waitpid(et->pid, NULL, 0);
+        et->pid = 0;
+        return false;
+    }
+    return true;
+}
+
+static void proc_stop(ExifToolProc *et, bool graceful) {
+    if (et->pid <= 0) return;
+    if (graceful) {
+        fputs("-stay_open\nFalse\n", et->in);
+        fflush(et->in);
+    }
+    fclose(et->in);
+    fclose(et->out);
+    if (!graceful) kill(et->pid, SIGKILL);
+    waitpid(et->pid, NULL, 0);
+    et->pid = 0;
+    et->in = NULL;
+    et->out = NULL;
+}
+
+void exiftool_pool_init(int size) {
+    pthread_mutex_lock(&g_pool_mutex);
+    g_pool = calloc(size, sizeof(ExifToolProc));
+    g_pool_size = g_pool ? size : 0;
+    pthread_mutex_unlock(&g_pool_mutex);
+}
+
+void exiftool_pool_shutdown(void) {
+    pthread_mutex_lock(&g_pool_mutex);
+    for (int i = 0; i < g_pool_size; i++) proc_stop(&g_pool[i], true);
+    free(g_pool);
+    g_pool = NULL;
+    g_pool_size = 0;
+    pthread_mutex_unlock(&g_pool_mutex);
+}
+
+// Check out a daemon (started lazily); NULL if the pool can't be used
+static ExifToolProc *pool_acquire(void) {
+    pthread_mutex_lock(&g_pool_mutex);
+    ExifToolProc *et = NULL;
+    while (g_pool_size > 0 && !g_pool_disabled) {
+        for (int i = 0; i < g_pool_size; i++) {
+            if (!g_pool[i].in_use) {
+                et = &g_pool[i];
+                break;
+            }
+        }
+        if (et) break;
+        pthread_cond_wait(&g_pool_cond, &g_pool_mutex);
+    }
+    if (et) et->in_use = true;
+    pthread_mutex_unlock(&g_pool_mutex);
+
+    if (et && et->pid <= 0 && !proc_start(et)) {
+        pthread_mutex_lock(&g_pool_mutex);
+        g_pool_disabled = true;
+        et->in_use = false;
+        pthread_cond_broadcast(&g_pool_cond);
+        pthread_mutex_unlock(&g_pool_mutex);
+        return NULL;
+    }
+    return et;
+}
+
+static void pool_release(ExifToolProc *et) {
+    pthread_mutex_lock(&g_pool_mutex);
+    et->in_use = false;
+    pthread_cond_signal(&g_pool_cond);
+    pthread_mutex_unlock(&g_pool_mutex);
+}
+
+// One round trip: send args + -execute, read until {ready}.
+// Returns false if the daemon died (broken pipe / EOF).
+static bool proc_roundtrip(ExifToolProc *et, const char *const *args, int nargs,
+                           int *lines, bool *write_failed, bool *write_done) {
+    for (int i = 0; i < nargs; i++) {
+        if (fputs(args[i], et->in) == EOF || fputc('\n', et->in) == EOF) return false;
+    }
+    if (fputs("-execute\n", et->in) == EOF || fflush(et->in) == EOF) return false;
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    bool ready = false;
+    *lines = 0;
+    *write_failed = false;
+    *write_done = false;
+
+    while ((len = getline(&line, &cap, et->out)) != -1) {
+        if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+        if (strcmp(line, "{ready}") == 0) {
+            ready = true;
+            break;
+        }
+        (*lines)++;
+        // Write summary, e.g. "    1 image files updated" / "1 files weren't updated due to errors"
+        if (strstr(line, "weren't updated")) *write_failed = true;
+        if (strstr(line, "files updated") || strstr(line, "files unchanged")) *write_done = true;
+    }
+    free(line);
+    return ready;
+}
+
+ExifToolResult exiftool_exec(const char *const *args, int nargs, bool is_write, int *lines_out) {
+    // The -@ argument file is line based
+    for (int i = 0; i < nargs; i++) {
+        if (strchr(args[i], '\n')) return EXIFTOOL_UNAVAILABLE;
+    }
+
+    ExifToolProc *et = pool_acquire();
+    if (!et) return EXIFTOOL_UNAVAILABLE;
+
+    int lines = 0;
+    bool write_failed = false, write_done = false;
+    bool ok = proc_roundtrip(et, args, nargs, &lines, &write_failed, &write_done);
+    if (!ok) {
+        // Daemon crashed: restart it and retry once
+        proc_stop(et, false);
+        ok = proc_start(et) &&
+             proc_roundtrip(et, args, nargs, &lines, &write_failed, &write_done);
+        if (!ok) proc_stop(et, false);
+    }
+    pool_release(et);
+
+    if (!ok) return EXIFTOOL_UNAVAILABLE;
+    if (lines_out) *lines_out = lines;
+    if (is_write && (write_failed || !write_done)) return EXIFTOOL_FAILED;
+    return EXIFTOOL_OK;
+}
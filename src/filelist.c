@@ -0,0 +1,229 @@
+/**
+ * filelist.c - File-list input (--files-from)
+ *
+ * Reads paths from a file or stdin ("-") instead of walking a tree, for
+ * callers that already know what changed. Records are NUL-delimited
+ * (find -print0) or newline-delimited: the first block read decides, any
+ * NUL in it selects NUL mode. In newline mode a trailing CR is dropped and
+ * blank lines are skipped.
+ *
+ * Entries are streamed into the work queue as they are read. Nothing is
+ * opened or stat'ed here unless a manifest needs size + mtime (or sizes
+ * are needed up front); detection happens on the encode workers exactly as
+ * for scanned files. Relative paths are relative to the working directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+#define FILELIST_READ_SIZE (64 * 1024)
+
+typedef struct {
+    int fd;
+    WorkQueue *sink;               // NULL: collect into the file table only
+    bool need_sizes;
+    bool failed;                   // File table out of memory
+    int delim;                     // '\0' or '\n'; -1 until the first read
+    char record[MAX_PATH_LEN];
+    size_t record_len;
+    bool overlong;
+    int last_dir;                  // Consecutive entries usually share one
+    char last_dir_path[MAX_PATH_LEN];
+    uint8_t *dir_state;            // Per directory index: 0 unchecked, 1 ok, 2 protected
+    int dir_state_len;
+} FileList;
+
+static FileList g_list;
+static pthread_t g_thread;
+static bool g_started = false;
+
+// ============================================================================
+// Entries
+// ============================================================================
+
+// --in-place never touches a protected directory, whatever the list says
+static bool dir_allowed(FileList *l, int dir, const char *path) {
+    if (!g_config.in_place) return true;
+    if (dir >= l->dir_state_len) {
+        int len = l->dir_state_len ? l->dir_state_len * 2 : 1024;
+        while (len <= dir) len *= 2;
+        uint8_t *grown = realloc(l->dir_state, len);
+        if (!grown) return false;
+        memset(grown + l->dir_state_len, 0, len - l->dir_state_len);
+        l->dir_state = grown;
+        l->dir_state_len = len;
+    }
+    if (l->dir_state[dir] == 0) {
+        l->dir_state[dir] = is_dangerous_directory(path) ? 2 : 1;
+        if (l->dir_state[dir] == 2) log_error("🚫 SAFETY: Skipping files in protected directory: %s", path);
+    }
+    return l->dir_state[dir] == 1;
+}
+
+static void add_entry(FileList *l, const char *entry) {
+    // Spelled the way ft_path() will rebuild it, so the manifest and the
+    // ledger see one name: "x" becomes "./x", "/x" keeps an empty directory
+    char path[MAX_PATH_LEN];
+    if (strchr(entry, '/')) {
+        strcpy(path, entry);
+    } else if (snprintf(path, sizeof(path), "./%s", entry) >= (int)sizeof(path)) {
+        return;
+    }
+    const char *slash = strrchr(path, '/');
+    const char *name = slash + 1;
+    if (name[0] == '\0') return;               // "dir/": not a file
+
+    char dir[MAX_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+
+    if (l->last_dir < 0 || strcmp(dir, l->last_dir_path) != 0) {
+        l->last_dir = ft_intern_dir(dir);
+        if (l->last_dir < 0) {
+            log_error("Memory allocation failed: %s", dir);
+            l->failed = true;
+            return;
+        }
+        strcpy(l->last_dir_path, dir);
+    }
+    if (!dir_allowed(l, l->last_dir, dir[0] ? dir : "/")) return;
+
+    size_t size = 0;
+    int64_t mtime_ns = 0;
+    if (l->need_sizes) {
+        struct stat st;
+        if (stat(path, &st) == 0) {
+            if (!S_ISREG(st.st_mode)) return;  // find without -type f lists directories too
+            size = (size_t)st.st_size;
+            mtime_ns = STAT_MTIME_NS(st);
+        }
+        // Missing: queued anyway, the worker reports it like any unreadable file
+    }
+
+    if (!scan_queue_file(l->sink, l->last_dir, path, name, size, mtime_ns)) {
+        log_error("Memory allocation failed: file table is full");
+        l->failed = true;
+    }
+}
+
+static void end_record(FileList *l) {
+    size_t len = l->record_len;
+    if (l->delim == '\n' && len > 0 && l->record[len - 1] == '\r') len--;
+    l->record[len] = '\0';
+    if (l->overlong) {
+        log_warn("⚠️  File list entry longer than %d bytes skipped: %.64s...", MAX_PATH_LEN - 1, l->record);
+    } else if (len > 0) {
+        add_entry(l, l->record);
+    }
+    l->record_len = 0;
+    l->overlong = false;
+}
+
+// Split one block into records; a record may continue into the next block
+static void feed(FileList *l, const char *buf, size_t n) {
+    if (l->delim < 0) l->delim = memchr(buf, '\0', n) ? '\0' : '\n';
+    while (n > 0 && !l->failed) {
+        const char *end = memchr(buf, l->delim, n);
+        size_t take = end ? (size_t)(end - buf) : n;
+        size_t room = sizeof(l->record) - 1 - l->record_len;
+        if (take > room) l->overlong = true;
+        size_t copy = take < room ? take : room;
+        memcpy(l->record + l->record_len, buf, copy);
+        l->record_len += copy;
+        if (!end) break;
+        end_record(l);
+        buf = end + 1;
+        n -= take + 1;
+    }
+}
+
+static void read_list(FileList *l) {
+    char *buf = malloc(FILELIST_READ_SIZE);
+    if (!buf) {
+        log_error("Memory allocation failed");
+        l->failed = true;
+        return;
+    }
+    // poll() so Ctrl-C is noticed while a pipe is idle
+    struct pollfd pfd = { .fd = l->fd, .events = POLLIN };
+    while (!g_interrupted && !l->failed) {
+        if (poll(&pfd, 1, WATCH_TICK_MS) == 0) continue;
+        ssize_t n = read(l->fd, buf, FILELIST_READ_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) log_error("Cannot read file list: %s", strerror(errno));
+        if (n <= 0) break;
+        feed(l, buf, (size_t)n);
+    }
+    if (l->record_len > 0 && !g_interrupted && !l->failed) end_record(l);   // No final delimiter
+    free(buf);
+}
+
+// ============================================================================
+// Lifecycle
+// ============================================================================
+
+static bool list_open(FileList *l, const char *path, WorkQueue *sink) {
+    memset(l, 0, sizeof(*l));
+    l->sink = sink;
+    // Collect-only callers sort by size; the manifest needs size + mtime
+    l->need_sizes = (sink == NULL) || manifest_enabled();
+    l->delim = -1;
+    l->last_dir = -1;
+    l->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    if (l->fd < 0) {
+        log_error("Cannot open file list: %s", path);
+        return false;
+    }
+    return true;
+}
+
+static void list_close(FileList *l) {
+    if (l->fd > STDIN_FILENO) close(l->fd);
+    l->fd = -1;
+    free(l->dir_state);
+    l->dir_state = NULL;
+}
+
+static void *list_thread(void *arg) {
+    FileList *l = (FileList *)arg;
+    read_list(l);
+    ledger_close_sink(l->sink);    // Nothing more will be pushed
+    return NULL;
+}
+
+// Stream the list at `path` ("-" = stdin) into `sink`, closing it at the end
+bool filelist_start(const char *path, WorkQueue *sink) {
+    if (!list_open(&g_list, path, sink)) return false;
+    if (pthread_create(&g_thread, NULL, list_thread, &g_list) != 0) {
+        list_close(&g_list);
+        return false;
+    }
+    g_started = true;
+    return true;
+}
+
+// Waits for the list to be read; returns the number of files queued
+int filelist_wait(void) {
+    if (g_started) pthread_join(g_thread, NULL);
+    g_started = false;
+    list_close(&g_list);
+    return ft_count();
+}
+
+// Synchronous read into the file table (dry run, --largest-first)
+int collect_file_list(const char *path) {
+    FileList l;
+    if (!list_open(&l, path, NULL)) return -1;
+    read_list(&l);
+    list_close(&l);
+    return l.failed ? -1 : ft_count();
+}
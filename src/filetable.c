@@ -0,0 +1,201 @@
+/**
+ * filetable.c - Compact, growable table of discovered files
+ *
+ * Replaces the fixed MAX_FILES array of 4 KB-path entries:
+ *   - every directory path is interned once in a string arena
+ *   - a file is a small FileEntry holding its directory index and basename
+ *   - entries and directories live in fixed-size chunks that never move,
+ *     so a published index stays valid while the scanner keeps appending
+ *
+ * Memory therefore grows with the actual path bytes, and there is no cap
+ * short of FT_MAX_CHUNKS * FT_CHUNK_SIZE (~1 billion) files.
+ *
+ * The scanner interns each directory it walks exactly once. Feeds that see
+ * directories in any order (file lists, watch events) use ft_intern_dir(),
+ * which finds an earlier copy through a hash of the path.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+#define FT_CHUNK_SHIFT 14
+#define FT_CHUNK_SIZE (1 << FT_CHUNK_SHIFT)     // Entries per chunk
+#define FT_MAX_CHUNKS 65536
+#define FT_ARENA_BLOCK (1024 * 1024)            // String arena allocation unit
+
+// Arena block: strings are bump-allocated and freed all at once
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} ArenaBlock;
+
+static FileEntry *g_file_chunks[FT_MAX_CHUNKS];
+static const char **g_dir_chunks[FT_MAX_CHUNKS];
+static int g_file_count = 0;
+static int g_dir_count = 0;
+static ArenaBlock *g_arena = NULL;
+static int *g_dir_slots = NULL;             // ft_intern_dir(): open addressing, -1 = empty
+static size_t g_dir_slot_capacity = 0;
+static size_t g_dir_slot_used = 0;
+static pthread_mutex_t g_table_mutex = PTHREAD_MUTEX_INITIALIZER;   // Guards appends
+
+// Caller holds g_table_mutex
+static const char *arena_strdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    if (!g_arena || g_arena->capacity - g_arena->used < len) {
+        size_t capacity = len > FT_ARENA_BLOCK ? len : FT_ARENA_BLOCK;
+        ArenaBlock *block = malloc(sizeof(ArenaBlock) + capacity);
+        if (!block) return NULL;
+        block->next = g_arena;
+        block->used = 0;
+        block->capacity = capacity;
+        g_arena = block;
+    }
+    char *copy = g_arena->data + g_arena->used;
+    memcpy(copy, str, len);
+    g_arena->used += len;
+    return copy;
+}
+
+// Caller holds g_table_mutex; makes sure slot `index` of `chunks` exists
+static bool ensure_chunk(void **chunks, int index, size_t elem_size) {
+    int chunk = index >> FT_CHUNK_SHIFT;
+    if (chunk >= FT_MAX_CHUNKS) return false;
+    if (!chunks[chunk]) {
+        chunks[chunk] = calloc(FT_CHUNK_SIZE, elem_size);
+        if (!chunks[chunk]) return false;
+    }
+    return true;
+}
+
+// Caller holds g_table_mutex
+static const char *dir_at(int idx) {
+    return g_dir_chunks[idx >> FT_CHUNK_SHIFT][idx & (FT_CHUNK_SIZE - 1)];
+}
+
+// Caller holds g_table_mutex
+static int add_dir_locked(const char *path) {
+    int idx = g_dir_count;
+    const char *copy = NULL;
+    if (!ensure_chunk((void **)g_dir_chunks, idx, sizeof(char *)) || !(copy = arena_strdup(path))) {
+        return -1;
+    }
+    g_dir_chunks[idx >> FT_CHUNK_SHIFT][idx & (FT_CHUNK_SIZE - 1)] = copy;
+    g_dir_count++;
+    return idx;
+}
+
+// Intern a directory path; returns its index or -1
+int ft_add_dir(const char *path) {
+    pthread_mutex_lock(&g_table_mutex);
+    int idx = add_dir_locked(path);
+    pthread_mutex_unlock(&g_table_mutex);
+    return idx;
+}
+
+// Caller holds g_table_mutex; keeps the slot table at most half full
+static bool grow_dir_slots(void) {
+    size_t capacity = g_dir_slot_capacity ? g_dir_slot_capacity * 2 : 1024;
+    int *slots = malloc(sizeof(int) * capacity);
+    if (!slots) return false;
+    memset(slots, 0xff, sizeof(int) * capacity);
+    for (size_t i = 0; i < g_dir_slot_capacity; i++) {
+        int idx = g_dir_slots[i];
+        if (idx < 0) continue;
+        const char *dir = dir_at(idx);
+        size_t j = xxh64(dir, strlen(dir), 0) & (capacity - 1);
+        while (slots[j] >= 0) j = (j + 1) & (capacity - 1);
+        slots[j] = idx;
+    }
+    free(g_dir_slots);
+    g_dir_slots = slots;
+    g_dir_slot_capacity = capacity;
+    return true;
+}
+
+// Like ft_add_dir(), but a path interned here before gets its earlier index
+int ft_intern_dir(const char *path) {
+    uint64_t hash = xxh64(path, strlen(path), 0);
+    pthread_mutex_lock(&g_table_mutex);
+    int idx = -1;
+    if (g_dir_slot_used * 2 < g_dir_slot_capacity || grow_dir_slots()) {
+        size_t mask = g_dir_slot_capacity - 1;
+        size_t i = hash & mask;
+        while (g_dir_slots[i] >= 0 && strcmp(dir_at(g_dir_slots[i]), path) != 0) i = (i + 1) & mask;
+        idx = g_dir_slots[i];
+        if (idx < 0 && (idx = add_dir_locked(path)) >= 0) {
+            g_dir_slots[i] = idx;
+            g_dir_slot_used++;
+        }
+    }
+    pthread_mutex_unlock(&g_table_mutex);
+    return idx;
+}
+
+// Append a file; returns its index or -1 (out of memory)
+int ft_add_file(int dir, const char *name, size_t size, int64_t mtime_ns) {
+    pthread_mutex_lock(&g_table_mutex);
+    int idx = g_file_count;
+    const char *copy = NULL;
+    if (ensure_chunk((void **)g_file_chunks, idx, sizeof(FileEntry)) && (copy = arena_strdup(name))) {
+        FileEntry *fe = &g_file_chunks[idx >> FT_CHUNK_SHIFT][idx & (FT_CHUNK_SIZE - 1)];
+        fe->name = copy;
+        fe->dir = dir;
+        fe->size = size;
+        fe->mtime_ns = mtime_ns;
+        fe->type = FILE_TYPE_UNKNOWN;     // Classified by the worker
+        fe->use_lossless = false;
+        fe->prefetched = 0;
+        g_file_count++;
+    } else {
+        idx = -1;
+    }
+    pthread_mutex_unlock(&g_table_mutex);
+    return idx;
+}
+
+FileEntry *ft_get(int idx) {
+    return &g_file_chunks[idx >> FT_CHUNK_SHIFT][idx & (FT_CHUNK_SIZE - 1)];
+}
+
+int ft_count(void) {
+    pthread_mutex_lock(&g_table_mutex);
+    int count = g_file_count;
+    pthread_mutex_unlock(&g_table_mutex);
+    return count;
+}
+
+// Rebuild the full path of an entry into `buf`
+const char *ft_path(const FileEntry *entry, char *buf, size_t len) {
+    snprintf(buf, len, "%s/%s", dir_at(entry->dir), entry->name);
+    return buf;
+}
+
+void ft_destroy(void) {
+    pthread_mutex_lock(&g_table_mutex);
+    for (int i = 0; i < FT_MAX_CHUNKS && (g_file_chunks[i] || g_dir_chunks[i]); i++) {
+        free(g_file_chunks[i]);
+        free(g_dir_chunks[i]);
+        g_file_chunks[i] = NULL;
+        g_dir_chunks[i] = NULL;
+    }
+    while (g_arena) {
+        ArenaBlock *next = g_arena->next;
+        free(g_arena);
+        g_arena = next;
+    }
+    free(g_dir_slots);
+    g_dir_slots = NULL;
+    g_dir_slot_capacity = 0;
+    g_dir_slot_used = 0;
+    g_file_count = 0;
+    g_dir_count = 0;
+    pthread_mutex_unlock(&g_table_mutex);
+}
@@ -0,0 +1,156 @@
+/**
+ * ingest.c - Single-read source ingestion
+ *
+ * Every source is opened exactly once, by the encode worker that converts
+ * it. The same bytes then serve type detection, the TIFF compression probe,
+ * the native metadata reader and the in-process encoder:
+ *   - files >= INGEST_MMAP_THRESHOLD are mmap'ed read-only
+ *   - smaller files are read into a buffer from the pool below, which
+ *     avoids a mmap/munmap (and its TLB shootdown) per thumbnail-sized file
+ *
+ * The pool is size-classed (powers of two, BUFFER_CLASS_MIN to
+ * BUFFER_CLASS_MAX) and shared with the encoder and decoders: read buffers,
+ * decoded pixels and encoder output go back to it instead of to free(), so
+ * a run of small files stops paying malloc and first-touch page faults for
+ * every one. Larger requests are plain allocations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+#define INGEST_MMAP_THRESHOLD (1024 * 1024)
+
+#define BUFFER_CLASSES (BUFFER_CLASS_MAX_SHIFT - BUFFER_CLASS_MIN_SHIFT + 1)
+
+// Free list per size class; idle bytes are capped over all of them
+static void *g_buffer_pool[BUFFER_CLASSES][BUFFER_POOL_PER_CLASS];
+static int g_buffer_pool_count[BUFFER_CLASSES];
+static size_t g_buffer_pool_idle = 0;
+static pthread_mutex_t g_buffer_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Class whose buffers hold `size` bytes, -1 above the largest
+static int buffer_class(size_t size) {
+    int c = 0;
+    while (c < BUFFER_CLASSES && ((size_t)1 << (BUFFER_CLASS_MIN_SHIFT + c)) < size) c++;
+    return c < BUFFER_CLASSES ? c : -1;
+}
+
+// At least `size` bytes; `*capacity` is what buffer_put() takes back
+void *buffer_get(size_t size, size_t *capacity) {
+    int c = buffer_class(size);
+    if (c < 0) {
+        *capacity = size;
+        return malloc(size);
+    }
+    *capacity = (size_t)1 << (BUFFER_CLASS_MIN_SHIFT + c);
+    void *buf = NULL;
+    pthread_mutex_lock(&g_buffer_pool_mutex);
+    if (g_buffer_pool_count[c] > 0) {
+        buf = g_buffer_pool[c][--g_buffer_pool_count[c]];
+        g_buffer_pool_idle -= *capacity;
+    }
+    pthread_mutex_unlock(&g_buffer_pool_mutex);
+    if (buf) {
+        stat_add(STAT_BUFFERS_REUSED, 1);
+        return buf;
+    }
+    return malloc(*capacity);
+}
+
+// Keeps a class-sized buffer for reuse, frees anything else (NULL is fine)
+void buffer_put(void *buf, size_t capacity) {
+    if (!buf) return;
+    int c = buffer_class(capacity);
+    if (c >= 0 && capacity == (size_t)1 << (BUFFER_CLASS_MIN_SHIFT + c)) {
+        pthread_mutex_lock(&g_buffer_pool_mutex);
+        if (g_buffer_pool_count[c] < BUFFER_POOL_PER_CLASS &&
+            g_buffer_pool_idle + capacity <= BUFFER_POOL_IDLE_BYTES) {
+            g_buffer_pool[c][g_buffer_pool_count[c]++] = buf;
+            g_buffer_pool_idle += capacity;
+            buf = NULL;
+        }
+        pthread_mutex_unlock(&g_buffer_pool_mutex);
+    }
+    free(buf);
+}
+
+void ingest_pool_destroy(void) {
+    pthread_mutex_lock(&g_buffer_pool_mutex);
+    for (int c = 0; c < BUFFER_CLASSES; c++) {
+        while (g_buffer_pool_count[c] > 0) free(g_buffer_pool[c][--g_buffer_pool_count[c]]);
+    }
+    g_buffer_pool_idle = 0;
+    pthread_mutex_unlock(&g_buffer_pool_mutex);
+}
+
+static bool read_fully(int fd, uint8_t *buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, buf + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+bool source_open(const char *path, SourceBuffer *src) {
+    memset(src, 0, sizeof(*src));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    src->mtime_ns = STAT_MTIME_NS(st);
+    if (size == 0) {
+        close(fd);
+        return true;     // Empty: nothing to map, classified as unknown
+    }
+
+    if (size >= INGEST_MMAP_THRESHOLD) {
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);   // The mapping keeps the file referenced
+        if (map == MAP_FAILED) return false;
+        madvise(map, size, MADV_SEQUENTIAL);
+        src->data = map;
+        src->mapped = true;
+    } else {
+        size_t capacity;
+        uint8_t *buf = buffer_get(size, &capacity);
+        bool ok = buf && read_fully(fd, buf, size);
+        close(fd);
+        if (!ok) {
+            buffer_put(buf, capacity);
+            return false;
+        }
+        src->data = buf;
+        src->pooled = buf;
+        src->pooled_capacity = capacity;
+    }
+    src->size = size;
+    return true;
+}
+
+void source_close(SourceBuffer *src) {
+    if (src->mapped) {
+        munmap((void *)src->data, src->size);
+    } else if (src->pooled) {
+        buffer_put(src->pooled, src->pooled_capacity);
+    }
+    memset(src, 0, sizeof(*src));
+}
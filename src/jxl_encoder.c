@@ -0,0 +1,660 @@
+/**
+ * jxl_encoder.c - In-process libjxl encoder backend
+ *
+ * Encodes from the ingested source bytes instead of spawning
+ * /bin/sh + cjxl for every file:
+ *   - JPEG → JxlEncoderAddJPEGFrame (reversible transcode, == --lossless_jpeg=1)
+ *   - PPM/PGM, PNG and compressed TIFF → decoded by decoders.c / tiff.c,
+ *     then JxlEncoderAddImageFrame (mathematically lossless, == -d 0)
+ *   - BMP, TGA and uncompressed strip TIFF → JxlEncoderAddChunkedFrame,
+ *     fed window by window through the row table over the source mapping
+ *     and written through an output processor, so neither the decoded
+ *     image nor the codestream is ever held in memory as a whole. Images
+ *     with alpha are packed and encoded whole instead: the chunked source
+ *     would have to hand alpha over as an extra channel of its own
+ *
+ * EXIF/XMP/ICC found by metadata.c go into the output at encode time
+ * (libjxl keeps them itself for JPEG transcodes), so the exiftool pass
+ * only runs for files that carry other metadata.
+ *
+ * Encoders are recycled: each encode takes a JxlEncoder from an idle list
+ * and JxlEncoderReset()s it on the way back, and all of them run on one
+ * parallel runner whose threads are sized to the core budget. An encode
+ * granted N cores uses at most N of them (its own thread plus N - 1
+ * helpers), so the budget still holds, but no runner threads are created
+ * and joined per file. Output, box and trial-band buffers come from the
+ * pool in ingest.c.
+ *
+ * Formats without an in-tree decoder return ENCODE_UNSUPPORTED so the
+ * caller can fall back to cjxl. Built only when libjxl is found
+ * (HAVE_LIBJXL), otherwise every call reports the backend as unavailable.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+#ifdef HAVE_LIBJXL
+
+#include <jxl/encode.h>
+#include <jxl/parallel_runner.h>
+
+// Initial output buffer, grown geometrically on JXL_ENC_NEED_MORE_OUTPUT
+#define OUTPUT_CHUNK (64 * 1024)
+// Write buffer handed to libjxl by the streaming output processor
+#define STREAM_OUTPUT_BUFFER (1024 * 1024)
+
+// Row-table source handed to the chunked-input callbacks
+typedef struct {
+    const JxlImage *img;
+    const uint8_t *base;           // Source bytes: windows inside them are not ours to free
+    size_t size;
+} StreamInput;
+
+bool jxl_encoder_available(void) {
+    return true;
+}
+
+// ============================================================================
+// Shared parallel runner
+// ============================================================================
+
+// One parallel-for from an encoder. The caller works on it as thread 0;
+// idle pool threads join as 1..threads-1 while it is open.
+typedef struct RunnerJob {
+    void *opaque;
+    JxlParallelRunFunction func;
+    uint64_t next;                 // Next value to hand out (atomic)
+    uint64_t end;
+    size_t threads;                // Thread ids the job was initialized for
+    size_t next_thread;
+    int active;                    // Helpers still working on it
+    bool open;                     // Listed, taking helpers
+    struct RunnerJob *link;
+} RunnerJob;
+
+static pthread_t g_runner_threads[MAX_CORES];
+static int g_runner_count = 0;
+static RunnerJob *g_open_jobs = NULL;          // Oldest first
+static bool g_runner_stop = false;
+static pthread_mutex_t g_runner_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_runner_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_runner_done = PTHREAD_COND_INITIALIZER;
+static pthread_once_t g_runner_once = PTHREAD_ONCE_INIT;
+
+static void run_values(RunnerJob *job, size_t thread) {
+    for (;;) {
+        uint64_t value = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (value >= job->end) break;
+        job->func(job->opaque, (uint32_t)value, thread);
+    }
+}
+
+// Caller holds g_runner_mutex
+static void job_close(RunnerJob *job) {
+    RunnerJob **at = &g_open_jobs;
+    while (*at && *at != job) at = &(*at)->link;
+    if (*at) *at = job->link;
+    job->open = false;
+}
+
+static void *runner_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_runner_mutex);
+    while (!g_runner_stop) {
+        RunnerJob *job = g_open_jobs;
+        if (!job) {
+            pthread_cond_wait(&g_runner_work, &g_runner_mutex);
+            continue;
+        }
+        size_t thread = job->next_thread++;
+        if (job->next_thread == job->threads) job_close(job);
+        job->active++;
+        pthread_mutex_unlock(&g_runner_mutex);
+
+        run_values(job, thread);
+
+        pthread_mutex_lock(&g_runner_mutex);
+        if (--job->active == 0) pthread_cond_broadcast(&g_runner_done);
+    }
+    pthread_mutex_unlock(&g_runner_mutex);
+    return NULL;
+}
+
+// Helpers for the whole core budget: every encoder's own thread is one of
+// its cores, so budget - 1 helpers cover all shares at once
+static void runner_start(void) {
+    int helpers = g_budget.total - 1;
+    if (helpers > MAX_CORES) helpers = MAX_CORES;
+    for (int i = 0; i < helpers; i++) {
+        if (pthread_create(&g_runner_threads[i], NULL, runner_thread, NULL) != 0) break;
+        g_runner_count++;
+    }
+}
+
+// JxlParallelRunner over the pool; `runner_opaque` is the encode's core share
+static JxlParallelRetCode shared_runner(void *runner_opaque, void *jpegxl_opaque,
+                                        JxlParallelRunInit init, JxlParallelRunFunction func,
+                                        uint32_t start_range, uint32_t end_range) {
+    if (start_range > end_range) return JXL_PARALLEL_RET_RUNNER_ERROR;
+    if (start_range == end_range) return 0;
+
+    size_t threads = (size_t)*(const int *)runner_opaque;
+    if (threads > end_range - start_range) threads = end_range - start_range;
+    if (threads > (size_t)g_runner_count + 1) threads = (size_t)g_runner_count + 1;
+    if (threads < 1) threads = 1;
+    JxlParallelRetCode rc = init(jpegxl_opaque, threads);
+    if (rc != 0) return rc;
+
+    RunnerJob job = { .opaque = jpegxl_opaque, .func = func, .next = start_range,
+                      .end = end_range, .threads = threads, .next_thread = 1 };
+    if (threads > 1) {
+        pthread_mutex_lock(&g_runner_mutex);
+        RunnerJob **at = &g_open_jobs;
+        while (*at) at = &(*at)->link;
+        *at = &job;
+        job.open = true;
+        pthread_cond_broadcast(&g_runner_work);
+        pthread_mutex_unlock(&g_runner_mutex);
+    }
+
+    run_values(&job, 0);
+
+    if (threads > 1) {
+        // Helpers that haven't joined yet never will; wait out the rest
+        pthread_mutex_lock(&g_runner_mutex);
+        if (job.open) job_close(&job);
+        while (job.active > 0) pthread_cond_wait(&g_runner_done, &g_runner_mutex);
+        pthread_mutex_unlock(&g_runner_mutex);
+    }
+    return 0;
+}
+
+// ============================================================================
+// Recycled encoders
+// ============================================================================
+
+typedef struct EncoderContext {
+    JxlEncoder *enc;
+    int threads;                   // Core share of the current encode (runner opaque)
+    struct EncoderContext *next;   // Idle list
+} EncoderContext;
+
+static EncoderContext *g_idle_contexts = NULL;
+static pthread_mutex_t g_context_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// An encoder on the shared runner, limited to `threads` cores
+static EncoderContext *context_acquire(int threads) {
+    pthread_once(&g_runner_once, runner_start);
+
+    pthread_mutex_lock(&g_context_mutex);
+    EncoderContext *ctx = g_idle_contexts;
+    if (ctx) g_idle_contexts = ctx->next;
+    pthread_mutex_unlock(&g_context_mutex);
+
+    if (ctx) {
+        stat_add(STAT_ENCODERS_REUSED, 1);
+    } else {
+        ctx = calloc(1, sizeof(*ctx));
+        if (!ctx) return NULL;
+        ctx->enc = JxlEncoderCreate(NULL);
+        if (!ctx->enc) {
+            free(ctx);
+            return NULL;
+        }
+    }
+    // Reset clears the runner too; a per-file runner would have started `threads` threads
+    ctx->threads = threads < 1 ? 1 : threads;
+    if (JxlEncoderSetParallelRunner(ctx->enc, shared_runner, &ctx->threads) != JXL_ENC_SUCCESS) {
+        JxlEncoderDestroy(ctx->enc);
+        free(ctx);
+        return NULL;
+    }
+    stat_add(STAT_RUNNER_THREADS_SAVED, (uint64_t)ctx->threads);
+    return ctx;
+}
+
+// Reset drops the image state now, so an idle encoder holds little memory
+static void context_release(EncoderContext *ctx) {
+    if (!ctx) return;
+    JxlEncoderReset(ctx->enc);
+    pthread_mutex_lock(&g_context_mutex);
+    ctx->next = g_idle_contexts;
+    g_idle_contexts = ctx;
+    pthread_mutex_unlock(&g_context_mutex);
+}
+
+// End of the run: join the runner threads, free idle encoders
+void jxl_encoder_shutdown(void) {
+    pthread_mutex_lock(&g_runner_mutex);
+    g_runner_stop = true;
+    pthread_cond_broadcast(&g_runner_work);
+    pthread_mutex_unlock(&g_runner_mutex);
+    for (int i = 0; i < g_runner_count; i++) pthread_join(g_runner_threads[i], NULL);
+    g_runner_count = 0;
+
+    pthread_mutex_lock(&g_context_mutex);
+    while (g_idle_contexts) {
+        EncoderContext *ctx = g_idle_contexts;
+        g_idle_contexts = ctx->next;
+        JxlEncoderDestroy(ctx->enc);
+        free(ctx);
+    }
+    pthread_mutex_unlock(&g_context_mutex);
+}
+
+// ============================================================================
+// Output
+// ============================================================================
+
+static bool write_output(const char *path, const uint8_t *data, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = (fwrite(data, 1, size, f) == size);
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+// Pull the finished codestream/container out of the encoder into a pooled
+// buffer (release with buffer_put(*out, *out_capacity))
+static bool drain_output(JxlEncoder *enc, uint8_t **out, size_t *out_size, size_t *out_capacity) {
+    size_t capacity;
+    uint8_t *buf = buffer_get(OUTPUT_CHUNK, &capacity);
+    if (!buf) return false;
+
+    uint8_t *next = buf;
+    size_t avail = capacity;
+    JxlEncoderStatus status;
+
+    while ((status = JxlEncoderProcessOutput(enc, &next, &avail)) == JXL_ENC_NEED_MORE_OUTPUT) {
+        size_t used = (size_t)(next - buf);
+        size_t grown_capacity;
+        uint8_t *grown = buffer_get(capacity * 2, &grown_capacity);
+        if (!grown) {
+            buffer_put(buf, capacity);
+            return false;
+        }
+        memcpy(grown, buf, used);
+        buffer_put(buf, capacity);
+        buf = grown;
+        capacity = grown_capacity;
+        next = buf + used;
+        avail = capacity - used;
+    }
+
+    if (status != JXL_ENC_SUCCESS) {
+        buffer_put(buf, capacity);
+        return false;
+    }
+
+    *out = buf;
+    *out_size = (size_t)(next - buf);
+    *out_capacity = capacity;
+    return true;
+}
+
+static bool add_jpeg_frame(JxlEncoder *enc, JxlEncoderFrameSettings *settings,
+                           const uint8_t *data, size_t size) {
+    // Keep the JPEG bitstream reconstruction data → byte-identical round-trip
+    if (JxlEncoderStoreJPEGMetadata(enc, JXL_TRUE) != JXL_ENC_SUCCESS) return false;
+    return JxlEncoderAddJPEGFrame(settings, data, size) == JXL_ENC_SUCCESS;
+}
+
+static JxlPixelFormat pixel_format_of(const JxlImage *img) {
+    JxlPixelFormat format = {
+        .num_channels = img->channels,
+        .data_type = (img->bytes_per_sample == 2) ? JXL_TYPE_UINT16 : JXL_TYPE_UINT8,
+        .endianness = img->big_endian ? JXL_BIG_ENDIAN : JXL_LITTLE_ENDIAN,
+        .align = 0
+    };
+    return format;
+}
+
+// Basic info, color and lossless frame settings for a -d 0 encode
+static bool set_lossless_header(JxlEncoder *enc, JxlEncoderFrameSettings *settings,
+                                const JxlImage *img, const SourceMetadata *md) {
+    JxlBasicInfo info;
+    JxlEncoderInitBasicInfo(&info);
+    info.xsize = img->width;
+    info.ysize = img->height;
+    info.bits_per_sample = img->bits;
+    info.num_color_channels = img->channels - (img->alpha ? 1 : 0);
+    if (img->alpha) {
+        // Interleaved alpha becomes extra channel 0
+        info.alpha_bits = img->bits;
+        info.num_extra_channels = 1;
+        info.alpha_premultiplied = img->alpha_premultiplied;
+    }
+    info.uses_original_profile = JXL_TRUE;   // Required for -d 0
+    if (JxlEncoderSetBasicInfo(enc, &info) != JXL_ENC_SUCCESS) return false;
+
+    if (md->icc) {
+        if (JxlEncoderSetICCProfile(enc, md->icc, md->icc_size) != JXL_ENC_SUCCESS) return false;
+    } else {
+        JxlColorEncoding color;
+        JxlColorEncodingSetToSRGB(&color, info.num_color_channels == 1);
+        if (JxlEncoderSetColorEncoding(enc, &color) != JXL_ENC_SUCCESS) return false;
+    }
+
+    if (JxlEncoderSetFrameLossless(settings, JXL_TRUE) != JXL_ENC_SUCCESS) return false;
+    return JxlEncoderSetFrameDistance(settings, 0.0f) == JXL_ENC_SUCCESS;
+}
+
+static bool add_lossless_frame(JxlEncoder *enc, JxlEncoderFrameSettings *settings,
+                               const JxlImage *img, const SourceMetadata *md) {
+    if (!set_lossless_header(enc, settings, img, md)) return false;
+    JxlPixelFormat format = pixel_format_of(img);
+    return JxlEncoderAddImageFrame(settings, &format, img->pixels, img->size) == JXL_ENC_SUCCESS;
+}
+
+// EXIF / XMP as container boxes (the lossless path; JPEG frames bring their own)
+static bool add_metadata_boxes(JxlEncoder *enc, const SourceMetadata *md) {
+    if (!md->exif && !md->xmp) return true;
+    if (JxlEncoderUseBoxes(enc) != JXL_ENC_SUCCESS) return false;
+
+    if (md->exif) {
+        // Exif box = 4-byte offset to the TIFF header, then the TIFF data
+        size_t capacity;
+        uint8_t *box = buffer_get(md->exif_size + 4, &capacity);
+        if (!box) return false;
+        memset(box, 0, 4);
+        memcpy(box + 4, md->exif, md->exif_size);
+        bool ok = JxlEncoderAddBox(enc, "Exif", box, md->exif_size + 4, JXL_FALSE) == JXL_ENC_SUCCESS;
+        buffer_put(box, capacity);
+        if (!ok) return false;
+    }
+    if (md->xmp &&
+        JxlEncoderAddBox(enc, "xml ", md->xmp, md->xmp_size, JXL_FALSE) != JXL_ENC_SUCCESS) {
+        return false;
+    }
+    JxlEncoderCloseBoxes(enc);
+    return true;
+}
+
+// ============================================================================
+// Streaming TIFF encode (chunked input, output processor)
+// ============================================================================
+
+static void stream_pixel_format(void *opaque, JxlPixelFormat *format) {
+    *format = pixel_format_of(((const StreamInput *)opaque)->img);
+}
+
+// Rows [ypos, ypos + ysize) of columns [xpos, xpos + xsize), in place or
+// as a flipped / swizzled copy (see image_window)
+static const void *stream_data_at(void *opaque, size_t xpos, size_t ypos,
+                                  size_t xsize, size_t ysize, size_t *row_offset) {
+    return image_window(((const StreamInput *)opaque)->img, xpos, ypos, xsize, ysize, row_offset);
+}
+
+static void stream_release(void *opaque, const void *buf) {
+    const StreamInput *in = (const StreamInput *)opaque;
+    const uint8_t *p = (const uint8_t *)buf;
+    if (p < in->base || p >= in->base + in->size) free((void *)buf);   // A window copy
+}
+
+// Output processor: libjxl fills our buffer, we append (or seek + patch) the file
+typedef struct {
+    FILE *f;
+    uint8_t *buf;
+    bool failed;
+} StreamOutput;
+
+static void *stream_get_buffer(void *opaque, size_t *size) {
+    StreamOutput *out = (StreamOutput *)opaque;
+    *size = STREAM_OUTPUT_BUFFER;
+    return out->buf;
+}
+
+static void stream_release_buffer(void *opaque, size_t written) {
+    StreamOutput *out = (StreamOutput *)opaque;
+    if (written > 0 && fwrite(out->buf, 1, written, out->f) != written) out->failed = true;
+}
+
+static void stream_seek(void *opaque, uint64_t position) {
+    StreamOutput *out = (StreamOutput *)opaque;
+    if (fseeko(out->f, (off_t)position, SEEK_SET) != 0) out->failed = true;
+}
+
+static void stream_set_finalized(void *opaque, uint64_t position) {
+    (void)opaque;
+    (void)position;   // Everything is written in place; nothing to release early
+}
+
+static bool encode_streaming(JxlEncoder *enc, JxlEncoderFrameSettings *settings,
+                             StreamInput *source, const SourceMetadata *md, const char *output) {
+    size_t capacity;
+    StreamOutput out = { .f = fopen(output, "wb"), .buf = buffer_get(STREAM_OUTPUT_BUFFER, &capacity) };
+    bool ok = out.f && out.buf;
+
+    JxlEncoderOutputProcessor processor = {
+        .opaque = &out,
+        .get_buffer = stream_get_buffer,
+        .release_buffer = stream_release_buffer,
+        .seek = stream_seek,
+        .set_finalized_position = stream_set_finalized
+    };
+    JxlChunkedFrameInputSource input = {
+        .opaque = source,
+        .get_color_channels_pixel_format = stream_pixel_format,
+        .get_color_channel_data_at = stream_data_at,
+        .get_extra_channel_pixel_format = NULL,   // No extra channels (see image_streams)
+        .get_extra_channel_data_at = NULL,
+        .release_buffer = stream_release
+    };
+
+    ok = ok && JxlEncoderSetOutputProcessor(enc, processor) == JXL_ENC_SUCCESS;
+    ok = ok && add_metadata_boxes(enc, md) && set_lossless_header(enc, settings, source->img, md);
+    // Stream every image larger than one group (optional on older libjxl)
+    if (ok) JxlEncoderFrameSettingsSetOption(settings, JXL_ENC_FRAME_SETTING_BUFFERING, 2);
+    ok = ok && JxlEncoderAddChunkedFrame(settings, JXL_TRUE, input) == JXL_ENC_SUCCESS;
+    if (ok) {
+        JxlEncoderCloseInput(enc);
+        ok = JxlEncoderFlushInput(enc) == JXL_ENC_SUCCESS && !out.failed;
+    }
+
+    if (out.f && fclose(out.f) != 0) ok = false;
+    buffer_put(out.buf, capacity);
+    return ok;
+}
+
+// Whether `img` goes through the chunked encoder. Alpha is interleaved in
+// our windows, but the header declares it as extra channel 0, which the
+// chunked source would have to serve through its extra-channel callbacks.
+static bool image_streams(const JxlImage *img) {
+    return img->rows && !img->alpha;
+}
+
+// Row-table image → one packed, encoder-order buffer for a whole-frame encode
+static bool image_pack(JxlImage *img) {
+    size_t size = (size_t)img->width * img->height * img->channels * img->bytes_per_sample;
+    size_t capacity;
+    uint8_t *packed = buffer_get(size, &capacity);
+    if (!packed) return false;
+    image_copy_rows(img, 0, 0, img->width, img->height, packed);
+    free(img->rows);
+    img->rows = NULL;
+    img->bgr = false;
+    img->pixels = packed;
+    img->owned = packed;
+    img->owned_capacity = capacity;
+    img->size = size;
+    return true;
+}
+
+// Peak memory of an in-process encode of `in`, 0 when no in-tree decoder
+// takes it. A chunked encode keeps about one 2048-row band of 256x256
+// groups in flight; a whole-frame encode holds the decoded image too.
+size_t jxl_encode_memory(const uint8_t *in, size_t in_size) {
+    JxlImage img;
+    if (!decode_image(in, in_size, &img, true)) return 0;
+    size_t memory;
+    if (image_streams(&img)) {
+        size_t rows = img.height < STREAMING_BAND_ROWS ? img.height : STREAMING_BAND_ROWS;
+        memory = (size_t)img.width * rows * ENCODE_MEMORY_PER_PIXEL + STREAM_OUTPUT_BUFFER;
+    } else {
+        memory = (size_t)img.width * img.height * ENCODE_MEMORY_PER_PIXEL;
+    }
+    image_free(&img);
+    return memory;
+}
+
+// `in` is the ingested source (see ingest.c); it is only read
+EncodeResult jxl_encode_buffer(const uint8_t *in, size_t in_size, const char *output,
+                               bool is_jpeg, int effort, int threads, bool *metadata_native) {
+    *metadata_native = false;
+
+    // Row-table sources without alpha stream; other lossless sources are decoded whole
+    JxlImage img;
+    memset(&img, 0, sizeof(img));
+    if (!is_jpeg && !decode_image(in, in_size, &img, false)) return ENCODE_UNSUPPORTED;
+
+    SourceMetadata md;
+    parse_source_metadata(in, in_size, &md);
+
+    EncodeResult result = ENCODE_FAILED;
+    EncoderContext *ctx = context_acquire(threads);
+    JxlEncoder *enc = ctx ? ctx->enc : NULL;
+    uint8_t *out = NULL;
+    size_t out_size = 0, out_capacity = 0;
+
+    if (!enc) goto done;
+
+    JxlEncoderFrameSettings *settings = JxlEncoderFrameSettingsCreate(enc, NULL);
+    if (!settings) goto done;
+    if (JxlEncoderFrameSettingsSetOption(settings, JXL_ENC_FRAME_SETTING_EFFORT, effort) != JXL_ENC_SUCCESS) goto done;
+
+    if (image_streams(&img)) {
+        StreamInput source = { .img = &img, .base = in, .size = in_size };
+        if (encode_streaming(enc, settings, &source, &md, output)) {
+            result = ENCODE_OK;
+            *metadata_native = !md.has_other;
+        }
+        goto done;
+    }
+
+    if (img.rows && !image_pack(&img)) goto done;
+    bool added = is_jpeg ? add_jpeg_frame(enc, settings, in, in_size)
+                         : add_metadata_boxes(enc, &md) &&
+                           add_lossless_frame(enc, settings, &img, &md);
+    if (!added) goto done;
+    JxlEncoderCloseInput(enc);
+
+    if (drain_output(enc, &out, &out_size, &out_capacity) && write_output(output, out, out_size)) {
+        result = ENCODE_OK;
+        *metadata_native = !md.has_other;
+    }
+
+done:
+    free_source_metadata(&md);
+    image_free(&img);
+    buffer_put(out, out_capacity);
+    context_release(ctx);
+    return result;
+}
+
+// Lossless size estimate from an effort-1 encode of a few evenly spaced
+// row bands (the whole image when it is small). Effort 1 runs orders of
+// magnitude faster than the real encode, and bands keep it proportional.
+EncodeResult jxl_estimate_lossless(const uint8_t *in, size_t in_size, int threads,
+                                   size_t *predicted) {
+    JxlImage img;
+    if (!decode_image(in, in_size, &img, false)) return ENCODE_UNSUPPORTED;
+
+    size_t stride = (size_t)img.width * img.channels * img.bytes_per_sample;
+    JxlImage sample = img;
+    sample.rows = NULL;
+    sample.owned = NULL;
+    uint8_t *bands = NULL;
+    size_t bands_capacity = 0;
+
+    // Bands of a large image; a row-table image is packed whole when small
+    bool banded = img.height > 2 * TRIAL_BANDS * TRIAL_BAND_ROWS;
+    if (banded || img.rows) {
+        uint32_t count = banded ? TRIAL_BANDS : 1;
+        uint32_t rows = banded ? TRIAL_BAND_ROWS : img.height;
+        bands = buffer_get(stride * count * rows, &bands_capacity);
+        if (!bands) {
+            image_free(&img);
+            return ENCODE_FAILED;
+        }
+        for (uint32_t b = 0; b < count; b++) {
+            size_t first = banded ? (size_t)(img.height - rows) * b / (count - 1) : 0;
+            image_copy_rows(&img, 0, first, img.width, rows, bands + stride * rows * b);
+        }
+        sample.height = count * rows;
+        sample.pixels = bands;
+        sample.size = stride * sample.height;
+    }
+
+    EncodeResult result = ENCODE_FAILED;
+    SourceMetadata md;
+    memset(&md, 0, sizeof(md));
+    EncoderContext *ctx = context_acquire(threads);
+    JxlEncoder *enc = ctx ? ctx->enc : NULL;
+    uint8_t *out = NULL;
+    size_t out_size = 0, out_capacity = 0;
+
+    if (!enc) goto done;
+
+    JxlEncoderFrameSettings *settings = JxlEncoderFrameSettingsCreate(enc, NULL);
+    if (!settings) goto done;
+    if (JxlEncoderFrameSettingsSetOption(settings, JXL_ENC_FRAME_SETTING_EFFORT, 1) != JXL_ENC_SUCCESS) goto done;
+    if (!add_lossless_frame(enc, settings, &sample, &md)) goto done;
+    JxlEncoderCloseInput(enc);
+
+    if (drain_output(enc, &out, &out_size, &out_capacity)) {
+        // Scale the sample's output up to the full image
+        *predicted = (size_t)((double)out_size * img.height / sample.height);
+        result = ENCODE_OK;
+    }
+
+done:
+    buffer_put(out, out_capacity);
+    buffer_put(bands, bands_capacity);
+    image_free(&img);
+    context_release(ctx);
+    return result;
+}
+
+#else  // !HAVE_LIBJXL
+
+bool jxl_encoder_available(void) {
+    return false;
+}
+
+EncodeResult jxl_encode_buffer(const uint8_t *in, size_t in_size, const char *output,
+                               bool is_jpeg, int effort, int threads, bool *metadata_native) {
+    *metadata_native = false;
+    (void)in;
+    (void)in_size;
+    (void)output;
+    (void)is_jpeg;
+    (void)effort;
+    (void)threads;
+    return ENCODE_UNSUPPORTED;
+}
+
+size_t jxl_encode_memory(const uint8_t *in, size_t in_size) {
+    (void)in;
+    (void)in_size;
+    return 0;
+}
+
+void jxl_encoder_shutdown(void) {
+}
+
+EncodeResult jxl_estimate_lossless(const uint8_t *in, size_t in_size, int threads,
+                                   size_t *predicted) {
+    (void)in;
+    (void)in_size;
+    (void)threads;
+    (void)predicted;
+    return ENCODE_UNSUPPORTED;
+}
+
+#endif  // HAVE_LIBJXL
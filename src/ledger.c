@@ -0,0 +1,503 @@
+/**
+ * ledger.c - Shared work ledger for multi-host runs (--ledger)
+ *
+ * Several hosts can convert the same tree (usually an NFS share) at once.
+ * Each scans the tree as usual; before a worker reads a file it claims it
+ * in a ledger directory on the share, and skips it when another live node
+ * holds it or it is already done:
+ *
+ *   nodes/<node>             heartbeat; mtime refreshed every
+ *                            LEDGER_HEARTBEAT_SECONDS
+ *   claims/<hh>/<hash>       a claim: "<node>\n<path>\n", O_EXCL-created
+ *   claims/<hh>/<hash>.done  outcome; replaces the claim when the file ends
+ *
+ * <node> is host.pid, <hash> the XXH64 of the path relative to the target
+ * directory (hosts may mount the share in different places). A failed file
+ * only drops its claim, so a later run retries it.
+ *
+ * A node whose heartbeat is older than LEDGER_LEASE_SECONDS is dead. Ages
+ * are measured against our own heartbeat's mtime, the server's clock, so
+ * hosts need not agree on the time. A dead node's claim is taken over by
+ * renaming it aside (only one node's rename can win). Every node scans the
+ * whole tree, so it remembers the files it left to live peers; those are
+ * re-checked every LEDGER_LEASE_SECONDS, and once the scan is done the node
+ * stays until each is done or re-queued here because its holder died.
+ * Delete the ledger to start over.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+#define LEDGER_NODE_LEN 128
+
+static bool g_enabled = false;
+static char g_dir[MAX_PATH_LEN / 2];            // Room for /claims/hh/<hash>.done after it
+static char g_root[MAX_PATH_LEN];
+static size_t g_root_len = 0;
+static char g_node[LEDGER_NODE_LEN];
+static char g_heartbeat[MAX_PATH_LEN];
+static int64_t g_server_ns = 0;                // Our heartbeat's mtime: the share's clock
+static pthread_mutex_t g_clock_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// A file left to a live peer, re-checked until it is done or the peer dies
+typedef struct Deferred {
+    struct Deferred *next;
+    char rel[];
+} Deferred;
+
+static Deferred *g_deferred = NULL;
+static pthread_mutex_t g_deferred_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_recover_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static WorkQueue *g_sink = NULL;               // Where recovered files go, until closed
+static bool g_sink_closed = false;
+static bool g_draining = false;               // Scan done: close once the peers are
+static bool g_waiting_logged = false;
+static uint64_t g_decided = 0;                 // ledger_claim() calls so far
+static pthread_mutex_t g_sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t g_thread;
+static bool g_thread_running = false;
+static bool g_stop = false;
+static pthread_mutex_t g_stop_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_stop_cond = PTHREAD_COND_INITIALIZER;
+
+static const char *DONE_NAMES[] = { "none", "converted", "larger", "failed", "skipped",
+                                     "predicted" };
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+// Path relative to the target directory: the same on every host.
+// With --files-from there is no root and the listed path is the key.
+static const char *relative_path(const char *path) {
+    if (g_root_len > 0 && strncmp(path, g_root, g_root_len) == 0 && path[g_root_len] == '/') return path + g_root_len + 1;
+    return path;
+}
+
+static void claim_path(const char *rel, char *out, size_t size) {
+    uint64_t h = xxh64(rel, strlen(rel), 0);
+    snprintf(out, size, "%s/claims/%02x/%016llx", g_dir, (unsigned)(h >> 56), (unsigned long long)h);
+}
+
+static bool make_dir(const char *path) {
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+// Refresh our heartbeat (recreating it if a peer wrongly reaped us) and
+// read the server's time back from it
+static bool heartbeat(void) {
+    int fd = open(g_heartbeat, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = futimens(fd, NULL) == 0 && fstat(fd, &st) == 0;
+    close(fd);
+    if (ok) {
+        pthread_mutex_lock(&g_clock_mutex);
+        g_server_ns = STAT_MTIME_NS(st);
+        pthread_mutex_unlock(&g_clock_mutex);
+    }
+    return ok;
+}
+
+static bool node_alive(const char *node) {
+    if (strcmp(node, g_node) == 0) return true;
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/nodes/%s", g_dir, node);
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    pthread_mutex_lock(&g_clock_mutex);
+    int64_t now = g_server_ns;
+    pthread_mutex_unlock(&g_clock_mutex);
+    return STAT_MTIME_NS(st) >= now - (int64_t)LEDGER_LEASE_SECONDS * 1000000000;
+}
+
+// Owner of a claim file (first line)
+static bool read_owner(const char *claim, char *owner, size_t size) {
+    int fd = open(claim, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    char buf[LEDGER_NODE_LEN];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return false;
+    buf[n] = '\0';
+    char *newline = strchr(buf, '\n');
+    if (!newline) return false;
+    *newline = '\0';
+    snprintf(owner, size, "%s", buf);
+    return true;
+}
+
+static bool create_claim(const char *claim, const char *rel) {
+    int fd = open(claim, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    char buf[LEDGER_NODE_LEN + MAX_PATH_LEN + 2];
+    int n = snprintf(buf, sizeof(buf), "%s\n%s\n", g_node, rel);
+    bool ok = write(fd, buf, n) == n;
+    close(fd);
+    if (!ok) unlink(claim);
+    return ok;
+}
+
+// Take `claim` from dead node `owner`. Only one node's rename succeeds;
+// if a live claim slipped in after we read the owner, it is put back.
+static bool take_over(const char *claim, const char *owner, const char *rel) {
+    char moved[MAX_PATH_LEN + LEDGER_NODE_LEN + 2];
+    snprintf(moved, sizeof(moved), "%s.%s", claim, g_node);
+    if (rename(claim, moved) != 0) return false;
+
+    char now_owner[LEDGER_NODE_LEN];
+    if (!read_owner(moved, now_owner, sizeof(now_owner)) || strcmp(now_owner, owner) != 0) {
+        if (link(moved, claim) != 0 && g_config.verbose) log_warn("Ledger: lost claim %s", rel);
+        unlink(moved);
+        return false;
+    }
+    unlink(moved);
+    return create_claim(claim, rel);
+}
+
+static void defer(const char *rel) {
+    size_t len = strlen(rel);
+    Deferred *d = malloc(sizeof(Deferred) + len + 1);
+    if (!d) return;                // Not re-checked: a later run picks it up
+    memcpy(d->rel, rel, len + 1);
+    pthread_mutex_lock(&g_deferred_mutex);
+    d->next = g_deferred;
+    g_deferred = d;
+    pthread_mutex_unlock(&g_deferred_mutex);
+}
+
+// ============================================================================
+// Claims
+// ============================================================================
+
+// May this node process `path`? Claims it if so (true without --ledger).
+bool ledger_claim(const char *path) {
+    if (!g_enabled) return true;
+    __atomic_add_fetch(&g_decided, 1, __ATOMIC_RELAXED);
+    const char *rel = relative_path(path);
+    char claim[MAX_PATH_LEN], done[MAX_PATH_LEN + 8];
+    claim_path(rel, claim, sizeof(claim));
+    snprintf(done, sizeof(done), "%s.done", claim);
+
+    // Twice: a claim released between our create and read is free again
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (access(done, F_OK) == 0) break;
+        if (create_claim(claim, rel)) {
+            stat_add(STAT_LEDGER_CLAIMED, 1);
+            return true;
+        }
+        if (errno != EEXIST) {
+            log_warn("⚠️  Cannot write ledger claim for %s", rel);
+            break;
+        }
+
+        char owner[LEDGER_NODE_LEN];
+        if (!read_owner(claim, owner, sizeof(owner))) continue;
+        if (strcmp(owner, g_node) == 0) {         // Re-queued by our own recovery
+            stat_add(STAT_LEDGER_CLAIMED, 1);
+            return true;
+        }
+        if (node_alive(owner)) {
+            defer(rel);
+            break;
+        }
+        if (take_over(claim, owner, rel)) {
+            stat_add(STAT_LEDGER_CLAIMED, 1);
+            stat_add(STAT_LEDGER_RECOVERED, 1);
+            return true;
+        }
+    }
+    stat_add(STAT_LEDGER_BUSY, 1);
+    return false;
+}
+
+// A claimed file left the pipeline: record the outcome for the other nodes
+void ledger_release(const char *path, FileOutcome outcome) {
+    if (!g_enabled) return;
+    char claim[MAX_PATH_LEN], done[MAX_PATH_LEN + 8];
+    claim_path(relative_path(path), claim, sizeof(claim));
+
+    if (outcome != OUTCOME_FAILED) {
+        snprintf(done, sizeof(done), "%s.done", claim);
+        int fd = open(done, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            char buf[LEDGER_NODE_LEN + 16];
+            int n = snprintf(buf, sizeof(buf), "%s %s\n", DONE_NAMES[outcome], g_node);
+            if (write(fd, buf, n) != n) log_warn("⚠️  Cannot record ledger outcome: %s", path);
+            close(fd);
+        }
+    }
+    unlink(claim);
+}
+
+// ============================================================================
+// Dead-node recovery
+// ============================================================================
+
+static void queue_recovered(const char *rel, const char *claim) {
+    char path[MAX_PATH_LEN];
+    int n = g_root_len > 0 ? snprintf(path, sizeof(path), "%s/%s", g_root, rel)
+                           : snprintf(path, sizeof(path), "%s", rel);
+    if (n >= (int)sizeof(path)) return;
+    struct stat st;
+    const char *slash = strrchr(path, '/');         // Keys come from ft_path(): never NULL
+    if (!slash || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        unlink(claim);                             // Gone since (converted in place, deleted)
+        return;
+    }
+
+    char dir[MAX_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+    int dir_idx = ft_intern_dir(dir);
+    if (dir_idx < 0 || !scan_queue_file(g_sink, dir_idx, path, slash + 1, (size_t)st.st_size,
+                                        STAT_MTIME_NS(st))) {
+        log_error("Memory allocation failed: file table is full");
+        return;
+    }
+    stat_add(STAT_LEDGER_RECOVERED, 1);
+    if (g_config.verbose) log_info("🗂️  Recovered from a dead node: %s", rel);
+}
+
+// Re-check the files left to peers: re-queue those whose holder died.
+// Returns how many are still held by live nodes.
+static int recover_deferred(void) {
+    pthread_mutex_lock(&g_recover_mutex);
+    pthread_mutex_lock(&g_sink_mutex);
+    bool open_sink = g_sink && !g_sink_closed;
+    pthread_mutex_unlock(&g_sink_mutex);
+
+    pthread_mutex_lock(&g_deferred_mutex);
+    Deferred *list = open_sink ? g_deferred : NULL;
+    if (open_sink) g_deferred = NULL;
+    pthread_mutex_unlock(&g_deferred_mutex);
+
+    Deferred *kept = NULL;
+    int held = 0;
+    while (list) {
+        Deferred *d = list;
+        list = d->next;
+
+        char claim[MAX_PATH_LEN], done[MAX_PATH_LEN + 8], owner[LEDGER_NODE_LEN];
+        claim_path(d->rel, claim, sizeof(claim));
+        snprintf(done, sizeof(done), "%s.done", claim);
+        bool keep = false;
+        // Done, or the claim was dropped after a failure: nothing to do
+        if (access(done, F_OK) != 0 && read_owner(claim, owner, sizeof(owner)) &&
+            strcmp(owner, g_node) != 0) {
+            if (node_alive(owner)) {
+                keep = true;
+            } else if (take_over(claim, owner, d->rel)) {
+                queue_recovered(d->rel, claim);
+            } else {
+                keep = true;                       // Lost the race: look again
+            }
+        }
+        if (keep) {
+            d->next = kept;
+            kept = d;
+            held++;
+        } else {
+            free(d);
+        }
+    }
+
+    // Put the survivors back with anything deferred meanwhile
+    pthread_mutex_lock(&g_deferred_mutex);
+    while (kept) {
+        Deferred *next = kept->next;
+        kept->next = g_deferred;
+        g_deferred = kept;
+        kept = next;
+    }
+    if (!open_sink) {
+        for (Deferred *d = g_deferred; d; d = d->next) held++;
+    }
+    pthread_mutex_unlock(&g_deferred_mutex);
+    pthread_mutex_unlock(&g_recover_mutex);
+    return held;
+}
+
+static void close_sink(void) {
+    pthread_mutex_lock(&g_sink_mutex);
+    bool was_open = !g_sink_closed;
+    g_sink_closed = true;
+    pthread_mutex_unlock(&g_sink_mutex);
+    if (was_open) wq_close(g_sink);
+}
+
+// Once the scan is done: close the sink when every queued file has been
+// offered to ledger_claim() and no peer still holds one we left to it
+static void drain_step(double now, double *next_recover) {
+    if (g_interrupted) {
+        close_sink();
+        return;
+    }
+    if (__atomic_load_n(&g_decided, __ATOMIC_RELAXED) < stat_read(STAT_TOTAL)) return;
+    if (now < *next_recover) return;
+
+    int held = recover_deferred();        // May queue more: re-check before closing
+    *next_recover = now + LEDGER_HEARTBEAT_SECONDS;
+    if (held == 0) {
+        if (__atomic_load_n(&g_decided, __ATOMIC_RELAXED) >= stat_read(STAT_TOTAL)) close_sink();
+    } else if (!g_waiting_logged) {
+        log_info("🗂️  Waiting for %d files held by other nodes", held);
+        g_waiting_logged = true;
+    }
+}
+
+// Heartbeat, periodic recovery, and the end-of-run drain, on a 1 s tick
+static void *ledger_worker(void *arg) {
+    (void)arg;
+    double now = monotonic_seconds();
+    double next_beat = now + LEDGER_HEARTBEAT_SECONDS;
+    double next_recover = now + LEDGER_LEASE_SECONDS;
+    bool draining = false;
+
+    pthread_mutex_lock(&g_stop_mutex);
+    while (!g_stop) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += 1;
+        pthread_cond_timedwait(&g_stop_cond, &g_stop_mutex, &until);
+        if (g_stop) break;
+        pthread_mutex_unlock(&g_stop_mutex);
+
+        now = monotonic_seconds();
+        if (now >= next_beat) {
+            if (!heartbeat()) log_warn("⚠️  Cannot refresh ledger heartbeat: %s", g_heartbeat);
+            next_beat = now + LEDGER_HEARTBEAT_SECONDS;
+        }
+
+        pthread_mutex_lock(&g_sink_mutex);
+        bool scan_done = g_draining && !g_sink_closed;
+        pthread_mutex_unlock(&g_sink_mutex);
+        if (scan_done) {
+            if (!draining) next_recover = now;            // Check at once
+            draining = true;
+            drain_step(now, &next_recover);
+        } else if (now >= next_recover) {
+            recover_deferred();
+            next_recover = now + LEDGER_LEASE_SECONDS;
+        }
+        pthread_mutex_lock(&g_stop_mutex);
+    }
+    pthread_mutex_unlock(&g_stop_mutex);
+    return NULL;
+}
+
+// ============================================================================
+// Lifecycle
+// ============================================================================
+
+bool ledger_open(const char *dir, const char *root) {
+    if (strlen(dir) >= sizeof(g_dir)) {
+        log_error("Ledger path too long: %s", dir);
+        return false;
+    }
+    snprintf(g_dir, sizeof(g_dir), "%s", dir);
+    snprintf(g_root, sizeof(g_root), "%s", root);
+    g_root_len = strlen(g_root);
+    while (g_root_len > 1 && g_root[g_root_len - 1] == '/') g_root[--g_root_len] = '\0';
+
+    char host[64] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    snprintf(g_node, sizeof(g_node), "%s.%d", host, (int)getpid());
+
+    char path[MAX_PATH_LEN];
+    bool ok = make_dir(g_dir);
+    snprintf(path, sizeof(path), "%s/nodes", g_dir);
+    ok = ok && make_dir(path);
+    snprintf(path, sizeof(path), "%s/claims", g_dir);
+    ok = ok && make_dir(path);
+    for (int i = 0; ok && i < 256; i++) {
+        snprintf(path, sizeof(path), "%s/claims/%02x", g_dir, i);
+        ok = make_dir(path);
+    }
+    snprintf(g_heartbeat, sizeof(g_heartbeat), "%s/nodes/%s", g_dir, g_node);
+    if (!ok || !heartbeat()) {
+        log_error("Cannot use ledger directory: %s", g_dir);
+        return false;
+    }
+
+    // Forget nodes that died in earlier runs (their claims still time out)
+    snprintf(path, sizeof(path), "%s/nodes", g_dir);
+    DIR *d = opendir(path);
+    struct dirent *entry;
+    while (d && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.' || strlen(entry->d_name) >= LEDGER_NODE_LEN) continue;
+        if (!node_alive(entry->d_name)) {
+            snprintf(path, sizeof(path), "%s/nodes/%s", g_dir, entry->d_name);
+            unlink(path);
+        }
+    }
+    if (d) closedir(d);
+
+    g_stop = false;
+    g_thread_running = pthread_create(&g_thread, NULL, ledger_worker, NULL) == 0;
+    if (!g_thread_running) log_warn("⚠️  No ledger heartbeat thread: peers may take over our claims");
+    g_enabled = true;
+    return true;
+}
+
+bool ledger_enabled(void) {
+    return g_enabled;
+}
+
+const char *ledger_node(void) {
+    return g_node;
+}
+
+// Recovered files are pushed into `sink` while it is open
+void ledger_set_sink(WorkQueue *sink) {
+    pthread_mutex_lock(&g_sink_mutex);
+    g_sink = sink;
+    g_sink_closed = false;
+    pthread_mutex_unlock(&g_sink_mutex);
+}
+
+// No more files from the scan. With a ledger the sink stays open until
+// every file left to a peer is done or has been re-queued here (the ledger
+// thread closes it); safe to call more than once.
+void ledger_close_sink(WorkQueue *sink) {
+    if (!g_enabled || !g_thread_running || sink != g_sink) {
+        wq_close(sink);
+        return;
+    }
+    pthread_mutex_lock(&g_sink_mutex);
+    g_draining = true;
+    pthread_mutex_unlock(&g_sink_mutex);
+}
+
+// Every claim of ours has been released by now: leave the ledger
+void ledger_close(void) {
+    if (!g_enabled) return;
+    pthread_mutex_lock(&g_stop_mutex);
+    g_stop = true;
+    pthread_cond_signal(&g_stop_cond);
+    pthread_mutex_unlock(&g_stop_mutex);
+    if (g_thread_running) pthread_join(g_thread, NULL);
+    g_thread_running = false;
+
+    unlink(g_heartbeat);
+    while (g_deferred) {
+        Deferred *next = g_deferred->next;
+        free(g_deferred);
+        g_deferred = next;
+    }
+    g_enabled = false;
+}
@@ -16,9 +16,13 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <sys/stat.h>
-#include <sys/time.h>
+#include <sys/xattr.h>
+#ifdef __APPLE__
+#include <sys/attr.h>
+#endif
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
@@ -26,16 +30,43 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <limits.h>
-#include <strings.h>
 
 #include "static2jxl.h"
 
 // Global variables
 Config g_config;
-Stats g_stats;
-FileEntry *g_files = NULL;
-int g_file_count = 0;
 volatile bool g_interrupted = false;
+CoreBudget g_budget;
+EffortPlanner g_effort;
+MemoryBudget g_memory;
+
+// Dangerous directories (safety check)
+static const char *DANGEROUS_DIRS[] = {
+    "/",
+    "/etc",
+    "/bin",
+    "/sbin",
+    "/usr",
+    "/var",
+    "/System",
+    "/Library",
+    "/Applications",
+    "/private",
+    NULL
+};
+
+// File type names for display
+static const char *FILE_TYPE_NAMES[] = {
+    "Unknown",
+    "JPEG",
+    "PNG",
+    "BMP",
+    "TIFF",
+    "TGA",
+    "PPM/PBM/PGM",
+    "RAW",
+    "JXL"
+};
 
 // ANSI colors
 #define COLOR_RED     "\033[0;31m"
@@ -45,6 +76,13 @@ volatile bool g_interrupted = false;
 #define COLOR_CYAN    "\033[0;36m"
 #define COLOR_RESET   "\033[0m"
 
+// Seconds on a clock that never jumps (for measuring encode cost)
+double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 // Logging
 void log_info(const char *fmt, ...) {
     va_list args;
@@ -85,20 +123,35 @@ void log_error(const char *fmt, ...) {
 void init_config(Config *config) {
     memset(config, 0, sizeof(Config));
     config->in_place = false;
-    config->skip_health_check = false;
+    config->validate = VALIDATE_STRUCTURAL;
     config->recursive = true;
     config->verbose = false;
     config->dry_run = false;
     config->force_lossless = false;
-    config->num_threads = DEFAULT_THREADS;
+    config->num_threads = 0;       // Auto: one file per core
+    config->cores = 0;             // Auto: detected core count
+    config->verify_workers = 0;    // Auto: derived from the core budget
+    config->finalize_workers = 0;
+    config->queue_depth = DEFAULT_QUEUE_DEPTH;
+    config->scan_threads = 0;      // Auto: min(cores, MAX_SCAN_THREADS)
     config->jxl_distance = -1.0;  // Auto-select
     config->jxl_effort = JXL_EFFORT_DEFAULT;
-}
-
-void init_stats(Stats *stats) {
-    memset(stats, 0, sizeof(Stats));
-    stats->start_time = time(NULL);
-    pthread_mutex_init(&stats->mutex, NULL);
+    config->encoder = ENCODER_AUTO;
+    config->manifest_path[0] = '\0';  // No manifest: every run starts fresh
+    config->retry_failed = false;
+    config->predict_margin = DEFAULT_PREDICT_MARGIN;
+    config->adaptive_effort = false;
+    config->effort_low = DEFAULT_EFFORT_LOW;
+    config->escalate_margin = DEFAULT_ESCALATE_MARGIN;
+    config->escalate_size = DEFAULT_ESCALATE_SIZE;
+    config->effort_budget = 0;     // Unlimited
+    config->mem_limit = 0;         // Auto: DEFAULT_MEMORY_FRACTION of RAM
+    config->dedup = false;
+    config->durability = DURABILITY_NONE;
+    config->watch = false;
+    config->ledger_path[0] = '\0';
+    config->files_from[0] = '\0';
+    config->prefetch = DEFAULT_PREFETCH;
 }
 
 // Detect file type by magic bytes
@@ -110,55 +163,65 @@ FileType detect_file_type(const char *path) {
     size_t n = fread(buf, 1, 12, f);
     fclose(f);
     
+    return detect_file_type_mem(buf, n, path);
+}
+
+// Magic numbers as masked little-endian words of the first 8 bytes:
+// one load and a compare per format instead of a byte-by-byte chain
+#define SIG_WORD(b0, b1, b2, b3, b4, b5, b6, b7) \
+    ((uint64_t)(b0) | (uint64_t)(b1) << 8 | (uint64_t)(b2) << 16 | (uint64_t)(b3) << 24 | \
+     (uint64_t)(b4) << 32 | (uint64_t)(b5) << 40 | (uint64_t)(b6) << 48 | (uint64_t)(b7) << 56)
+
+typedef struct {
+    uint64_t magic;
+    uint64_t mask;
+    uint8_t min_len;
+    FileType type;
+} Signature;
+
+static const Signature SIGNATURES[] = {
+    { SIG_WORD(0xFF, 0xD8, 0xFF, 0, 0, 0, 0, 0), 0xFFFFFF, 3, FILE_TYPE_JPEG },
+    { SIG_WORD(0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'), UINT64_MAX, 8, FILE_TYPE_PNG },
+    { SIG_WORD('B', 'M', 0, 0, 0, 0, 0, 0), 0xFFFF, 2, FILE_TYPE_BMP },
+    { SIG_WORD('I', 'I', 0x2A, 0x00, 0, 0, 0, 0), 0xFFFFFFFF, 4, FILE_TYPE_TIFF },
+    { SIG_WORD('M', 'M', 0x00, 0x2A, 0, 0, 0, 0), 0xFFFFFFFF, 4, FILE_TYPE_TIFF },
+    { SIG_WORD(0xFF, 0x0A, 0, 0, 0, 0, 0, 0), 0xFFFF, 2, FILE_TYPE_JXL },           // Codestream
+    { SIG_WORD(0x00, 0, 0, 0, 'J', 'X', 'L', 0), 0x00FFFFFF000000FF, 12, FILE_TYPE_JXL },  // Container
+};
+
+// Formats without a usable magic number, by lower-cased extension
+static const struct { const char *ext; FileType type; } EXTENSIONS[] = {
+    { ".tga", FILE_TYPE_TGA },
+    { ".dng", FILE_TYPE_RAW }, { ".cr2", FILE_TYPE_RAW }, { ".cr3", FILE_TYPE_RAW },
+    { ".nef", FILE_TYPE_RAW }, { ".arw", FILE_TYPE_RAW }, { ".orf", FILE_TYPE_RAW },
+    { ".rw2", FILE_TYPE_RAW }, { ".raf", FILE_TYPE_RAW },
+};
+
+// Same, on bytes already in memory (`path` is only used for extensions)
+FileType detect_file_type_mem(const uint8_t *buf, size_t n, const char *path) {
     if (n < 2) return FILE_TYPE_UNKNOWN;
     
-    // JPEG: FF D8 FF
-    if (n >= 3 && buf[0] == 0xFF && buf[1] == 0xD8 && buf[2] == 0xFF) {
-        return FILE_TYPE_JPEG;
-    }
-    
-    // PNG: 89 50 4E 47 0D 0A 1A 0A
-    if (n >= 8 && buf[0] == 0x89 && buf[1] == 0x50 && buf[2] == 0x4E && buf[3] == 0x47 &&
-        buf[4] == 0x0D && buf[5] == 0x0A && buf[6] == 0x1A && buf[7] == 0x0A) {
-        return FILE_TYPE_PNG;
-    }
-    
-    // BMP: 42 4D (BM)
-    if (n >= 2 && buf[0] == 0x42 && buf[1] == 0x4D) {
-        return FILE_TYPE_BMP;
-    }
-    
-    // TIFF: 49 49 2A 00 (little-endian) or 4D 4D 00 2A (big-endian)
-    if (n >= 4 && ((buf[0] == 0x49 && buf[1] == 0x49 && buf[2] == 0x2A && buf[3] == 0x00) ||
-                   (buf[0] == 0x4D && buf[1] == 0x4D && buf[2] == 0x00 && buf[3] == 0x2A))) {
-        return FILE_TYPE_TIFF;
-    }
-    
-    // JXL: FF 0A (codestream) or 00 00 00 0C 4A 58 4C 20 (container)
-    if ((n >= 2 && buf[0] == 0xFF && buf[1] == 0x0A) ||
-        (n >= 12 && buf[0] == 0x00 && buf[4] == 0x4A && buf[5] == 0x58 && buf[6] == 0x4C)) {
-        return FILE_TYPE_JXL;
+    uint8_t head[8] = { 0 };
+    memcpy(head, buf, n < sizeof(head) ? n : sizeof(head));
+    uint64_t word = SIG_WORD(head[0], head[1], head[2], head[3], head[4], head[5], head[6], head[7]);
+    for (size_t i = 0; i < sizeof(SIGNATURES) / sizeof(SIGNATURES[0]); i++) {
+        const Signature *sig = &SIGNATURES[i];
+        if (n >= sig->min_len && (word & sig->mask) == sig->magic) return sig->type;
     }
     
     // PPM/PGM/PBM: P3, P6 (PPM), P2, P5 (PGM), P1, P4 (PBM)
-    if (n >= 2 && buf[0] == 'P' && (buf[1] >= '1' && buf[1] <= '6')) {
+    if (head[0] == 'P' && (uint8_t)(head[1] - '1') < 6) {
         return FILE_TYPE_PPM;
     }
     
-    // TGA: No reliable magic, check extension
+    // TGA and RAW: no reliable magic, lower-case the extension once
     const char *ext = strrchr(path, '.');
-    if (ext && strcasecmp(ext, ".tga") == 0) {
-        return FILE_TYPE_TGA;
-    }
-    
-    // RAW formats by extension
-    if (ext) {
-        if (strcasecmp(ext, ".dng") == 0 || strcasecmp(ext, ".cr2") == 0 ||
-            strcasecmp(ext, ".cr3") == 0 || strcasecmp(ext, ".nef") == 0 ||
-            strcasecmp(ext, ".arw") == 0 || strcasecmp(ext, ".orf") == 0 ||
-            strcasecmp(ext, ".rw2") == 0 || strcasecmp(ext, ".raf") == 0) {
-            return FILE_TYPE_RAW;
-        }
+    char lower[8] = { 0 };
+    size_t len = ext ? strlen(ext) : 0;
+    if (len == 0 || len >= sizeof(lower)) return FILE_TYPE_UNKNOWN;
+    for (size_t i = 0; i < len; i++) lower[i] = (char)tolower((unsigned char)ext[i]);
+    for (size_t i = 0; i < sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]); i++) {
+        if (strcmp(lower, EXTENSIONS[i].ext) == 0) return EXTENSIONS[i].type;
     }
     
     return FILE_TYPE_UNKNOWN;
@@ -177,79 +240,31 @@ bool is_lossless_source(FileType type) {
 }
 
 
-// Check TIFF compression type
-TiffCompression detect_tiff_compression(const char *path) {
-    FILE *f = fopen(path, "rb");
-    if (!f) return TIFF_COMPRESSION_UNKNOWN;
-    
-    unsigned char header[8];
-    if (fread(header, 1, 8, f) < 8) {
-        fclose(f);
-        return TIFF_COMPRESSION_UNKNOWN;
-    }
-    
-    bool little_endian = (header[0] == 0x49);
-    
-    // Read IFD offset
-    uint32_t ifd_offset;
-    if (little_endian) {
-        ifd_offset = header[4] | (header[5] << 8) | (header[6] << 16) | (header[7] << 24);
-    } else {
-        ifd_offset = (header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
-    }
-    
-    if (fseek(f, ifd_offset, SEEK_SET) != 0) {
-        fclose(f);
-        return TIFF_COMPRESSION_UNKNOWN;
-    }
-    
-    // Read number of directory entries
-    unsigned char count_buf[2];
-    if (fread(count_buf, 1, 2, f) < 2) {
-        fclose(f);
-        return TIFF_COMPRESSION_UNKNOWN;
+// TIFF Compression tag value → the kinds we decide on
+static TiffCompression tiff_compression_kind(uint32_t compression) {
+    switch (compression) {
+        case 1: return TIFF_COMPRESSION_NONE;
+        case 5: return TIFF_COMPRESSION_LZW;
+        case 6: case 7: return TIFF_COMPRESSION_JPEG;   // Old- and new-style JPEG
+        case 8: case 32946: return TIFF_COMPRESSION_DEFLATE;
+        case 32773: return TIFF_COMPRESSION_PACKBITS;
+        default: return TIFF_COMPRESSION_OTHER;
     }
-    
-    uint16_t num_entries;
-    if (little_endian) {
-        num_entries = count_buf[0] | (count_buf[1] << 8);
-    } else {
-        num_entries = (count_buf[0] << 8) | count_buf[1];
-    }
-    
-    // Search for Compression tag (259)
-    for (int i = 0; i < num_entries && i < 100; i++) {
-        unsigned char entry[12];
-        if (fread(entry, 1, 12, f) < 12) break;
-        
-        uint16_t tag;
-        if (little_endian) {
-            tag = entry[0] | (entry[1] << 8);
-        } else {
-            tag = (entry[0] << 8) | entry[1];
-        }
-        
-        if (tag == 259) {  // Compression tag
-            uint16_t compression;
-            if (little_endian) {
-                compression = entry[8] | (entry[9] << 8);
-            } else {
-                compression = (entry[8] << 8) | entry[9];
-            }
-            fclose(f);
-            
-            switch (compression) {
-                case 1: return TIFF_COMPRESSION_NONE;
-                case 5: return TIFF_COMPRESSION_LZW;
-                case 7: return TIFF_COMPRESSION_JPEG;
-                case 8: case 32946: return TIFF_COMPRESSION_DEFLATE;
-                default: return TIFF_COMPRESSION_OTHER;
-            }
-        }
-    }
-    
-    fclose(f);
-    return TIFF_COMPRESSION_NONE;  // Default: uncompressed
+}
+
+// Check TIFF compression type of an in-memory TIFF (IFD0, see tiff.c)
+TiffCompression detect_tiff_compression_mem(const uint8_t *buf, size_t size) {
+    TiffImage tif;
+    if (!tiff_parse(buf, size, &tif)) return TIFF_COMPRESSION_UNKNOWN;
+    return tiff_compression_kind(tif.compression);
+}
+
+TiffCompression detect_tiff_compression(const char *path) {
+    SourceBuffer src;
+    if (!source_open(path, &src)) return TIFF_COMPRESSION_UNKNOWN;
+    TiffCompression comp = detect_tiff_compression_mem(src.data, src.size);
+    source_close(&src);
+    return comp;
 }
 
 bool is_tiff_suitable_for_jxl(const char *path) {
@@ -293,16 +308,22 @@ bool file_exists(const char *path) {
     return access(path, F_OK) == 0;
 }
 
-char *get_output_path(const char *input) {
-    static char output[MAX_PATH_LEN];
-    strncpy(output, input, MAX_PATH_LEN - 5);
-    char *ext = strrchr(output, '.');
-    if (ext) {
-        strcpy(ext, ".jxl");
-    } else {
-        strcat(output, ".jxl");
-    }
-    return output;
+// `input` with its extension replaced by .jxl, into the caller's buffer
+// (workers build paths concurrently); false when it doesn't fit
+bool get_output_path(const char *input, char *output, size_t size) {
+    const char *slash = strrchr(input, '/');
+    const char *ext = strrchr(slash ? slash + 1 : input, '.');
+    int stem = ext ? (int)(ext - input) : (int)strlen(input);
+    return snprintf(output, size, "%.*s.jxl", stem, input) < (int)size;
+}
+
+// Whether conversions go through the in-process encoder
+static bool use_libjxl(void) {
+    return g_config.encoder != ENCODER_CJXL && jxl_encoder_available();
+}
+
+static const char *encoder_name(void) {
+    return use_libjxl() ? "libjxl (in-process, cjxl fallback)" : "cjxl";
 }
 
 bool is_dangerous_directory(const char *path) {
@@ -321,130 +342,191 @@ bool is_dangerous_directory(const char *path) {
 
 bool check_dependencies(void) {
     bool ok = true;
-    if (system("which cjxl > /dev/null 2>&1") != 0) {
-        log_error("cjxl not found. Install: brew install jpeg-xl");
+    if (g_config.encoder == ENCODER_LIBJXL && !jxl_encoder_available()) {
+        log_error("libjxl encoder not built in. Rebuild with libjxl installed or use --encoder cjxl");
         ok = false;
     }
-    if (system("which exiftool > /dev/null 2>&1") != 0) {
+    if (!tool_available("cjxl")) {
+        if (use_libjxl()) {
+            // Formats the native decoders read (PNG needs zlib); what they
+            // refuse (interlaced PNG, palette BMP, RLE TGA, ...) still needs cjxl
+#ifdef HAVE_ZLIB
+            const char *native = "JPEG/PNG/PPM/BMP/TGA/TIFF";
+#else
+            const char *native = "JPEG/PPM/BMP/TGA/TIFF";
+#endif
+            log_warn("cjxl not found, only %s read in process can be converted. Install: brew install jpeg-xl",
+                     native);
+        } else {
+            log_error("cjxl not found. Install: brew install jpeg-xl");
+            ok = false;
+        }
+    }
+    if (!tool_available("exiftool")) {
         log_error("exiftool not found. Install: brew install exiftool");
         ok = false;
     }
-    if (!g_config.skip_health_check && system("which djxl > /dev/null 2>&1") != 0) {
-        log_warn("djxl not found, health check will be limited");
+    // Probed once here; the health check never shells out to look for it
+    if (g_config.validate != VALIDATE_NONE) {
+        bool have_djxl = tool_available("djxl");
+        g_config.validate = validate_init(g_config.validate, have_djxl);
     }
     return ok;
 }
 
 
-int collect_files(const char *dir, bool recursive) {
-    DIR *d = opendir(dir);
-    if (!d) {
-        log_error("Cannot open directory: %s", dir);
-        return -1;
+// Decide what to do with a source from its bytes (called by the worker that
+// already holds it in memory). Returns false if the file is skipped.
+bool classify_file(FileEntry *entry, const char *path, const SourceBuffer *src) {
+    FileType type = detect_file_type_mem(src->data, src->size, path);
+    entry->type = type;
+    entry->size = src->size;
+    entry->mtime_ns = src->mtime_ns;
+    
+    // Skip unsupported types
+    if (type == FILE_TYPE_UNKNOWN || type == FILE_TYPE_RAW || type == FILE_TYPE_JXL) {
+        stat_add(STAT_SKIPPED, 1);
+        if (type == FILE_TYPE_RAW) {
+            stat_add(STAT_SKIPPED_RAW, 1);
+        } else {
+            stat_add(STAT_SKIPPED_UNSUPPORTED, 1);
+        }
+        return false;
     }
     
-    struct dirent *entry;
-    char path[MAX_PATH_LEN];
-    
-    while ((entry = readdir(d)) != NULL) {
-        if (entry->d_name[0] == '.') continue;
-        
-        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
-        
-        struct stat st;
-        if (stat(path, &st) != 0) continue;
-
-        if (S_ISDIR(st.st_mode)) {
-            if (recursive) collect_files(path, recursive);
-        } else if (S_ISREG(st.st_mode)) {
-            FileType type = detect_file_type(path);
-            
-            // Skip unsupported types
-            if (type == FILE_TYPE_UNKNOWN || type == FILE_TYPE_RAW || type == FILE_TYPE_JXL) {
-                if (type == FILE_TYPE_RAW) {
-                    pthread_mutex_lock(&g_stats.mutex);
-                    g_stats.skipped_raw++;
-                    pthread_mutex_unlock(&g_stats.mutex);
-                }
-                continue;
-            }
-            
-            // Check TIFF compression
-            if (type == FILE_TYPE_TIFF && !is_tiff_suitable_for_jxl(path)) {
-                pthread_mutex_lock(&g_stats.mutex);
-                g_stats.skipped_tiff_jpeg++;
-                pthread_mutex_unlock(&g_stats.mutex);
-                if (g_config.verbose) {
-                    log_warn("Skip TIFF (JPEG compressed): %s", path);
-                }
-                continue;
+    // Check TIFF compression
+    if (type == FILE_TYPE_TIFF) {
+        // One JXL per file would silently drop every page after the first
+        // One parse answers both the page count and the compression
+        TiffImage tif;
+        bool parsed = tiff_parse(src->data, src->size, &tif);
+        if (parsed && tif.pages > 1) {
+            stat_add(STAT_SKIPPED, 1);
+            stat_add(STAT_SKIPPED_MULTIPAGE, 1);
+            if (g_config.verbose) {
+                log_warn("Skip TIFF (%u pages): %s", tif.pages, path);
             }
-            
-            size_t size = (size_t)st.st_size;
-            
-            // For lossless sources, check size threshold
-            if (is_lossless_source(type) || type == FILE_TYPE_TIFF) {
-                if (size < MIN_LOSSLESS_SIZE) {
-                    pthread_mutex_lock(&g_stats.mutex);
-                    g_stats.skipped_small++;
-                    pthread_mutex_unlock(&g_stats.mutex);
-                    if (g_config.verbose) {
-                        log_warn("Skip (< 2MB): %s (%.2f MB)", path, size / (1024.0 * 1024.0));
-                    }
-                    continue;
-                }
-            }
-            
-            if (g_file_count >= MAX_FILES) {
-                log_warn("Maximum file limit reached (%d)", MAX_FILES);
-                break;
+            return false;
+        }
+        
+        TiffCompression comp = parsed ? tiff_compression_kind(tif.compression)
+                                      : TIFF_COMPRESSION_UNKNOWN;
+        // JPEG-compressed TIFF is already lossy, skip it
+        if (comp == TIFF_COMPRESSION_JPEG || comp == TIFF_COMPRESSION_UNKNOWN) {
+            stat_add(STAT_SKIPPED, 1);
+            stat_add(STAT_SKIPPED_TIFF_JPEG, 1);
+            if (g_config.verbose) {
+                log_warn("Skip TIFF (JPEG compressed): %s", path);
             }
-            
-            strncpy(g_files[g_file_count].path, path, MAX_PATH_LEN - 1);
-            g_files[g_file_count].size = size;
-            g_files[g_file_count].type = type;
-            g_files[g_file_count].use_lossless = (type != FILE_TYPE_JPEG);
-            
-            // Update type counters
-            pthread_mutex_lock(&g_stats.mutex);
-            switch (type) {
-                case FILE_TYPE_JPEG: g_stats.jpeg_count++; break;
-                case FILE_TYPE_PNG:  g_stats.png_count++; break;
-                case FILE_TYPE_BMP:  g_stats.bmp_count++; break;
-                case FILE_TYPE_TIFF: g_stats.tiff_count++; break;
-                case FILE_TYPE_TGA:  g_stats.tga_count++; break;
-                case FILE_TYPE_PPM:  g_stats.ppm_count++; break;
-                default: break;
+            return false;
+        }
+    }
+    
+    // For lossless sources, check size threshold
+    if (is_lossless_source(type) || type == FILE_TYPE_TIFF) {
+        if (entry->size < MIN_LOSSLESS_SIZE) {
+            stat_add(STAT_SKIPPED, 1);
+            stat_add(STAT_SKIPPED_SMALL, 1);
+            if (g_config.verbose) {
+                log_warn("Skip (< 2MB): %s (%.2f MB)", path, entry->size / (1024.0 * 1024.0));
             }
-            pthread_mutex_unlock(&g_stats.mutex);
-            
-            g_file_count++;
+            return false;
         }
     }
     
-    closedir(d);
-    return g_file_count;
+    entry->use_lossless = (type != FILE_TYPE_JPEG);
+    
+    // Update type counters
+    switch (type) {
+        case FILE_TYPE_JPEG: stat_add(STAT_JPEG, 1); break;
+        case FILE_TYPE_PNG:  stat_add(STAT_PNG, 1); break;
+        case FILE_TYPE_BMP:  stat_add(STAT_BMP, 1); break;
+        case FILE_TYPE_TIFF: stat_add(STAT_TIFF, 1); break;
+        case FILE_TYPE_TGA:  stat_add(STAT_TGA, 1); break;
+        case FILE_TYPE_PPM:  stat_add(STAT_PPM, 1); break;
+        default: break;
+    }
+    return true;
 }
 
+
 // Convert to JXL - different modes for JPEG vs lossless sources
-bool convert_to_jxl(const char *input, const char *output, bool is_jpeg) {
-    char cmd[MAX_PATH_LEN * 3];
+// `threads` comes from the core budget and is the encoder's whole share
+// `src` is the already-ingested input; cjxl still reads `input` itself
+// `metadata_native` is set when the encoder already wrote all EXIF/XMP/ICC
+bool convert_to_jxl(const char *input, const SourceBuffer *src, const char *output,
+                    bool is_jpeg, int effort, int threads, bool *metadata_native) {
+    *metadata_native = false;
+    
+    // In-process libjxl first; cjxl only for inputs it can't decode
+    if (use_libjxl()) {
+        EncodeResult result = jxl_encode_buffer(src->data, src->size, output, is_jpeg,
+                                                effort, threads, metadata_native);
+        if (result != ENCODE_UNSUPPORTED) return result == ENCODE_OK;
+    }
     
+    char num_threads[32], effort_arg[16];
+    snprintf(num_threads, sizeof(num_threads), "--num_threads=%d", threads);
+    snprintf(effort_arg, sizeof(effort_arg), "%d", effort);
     if (is_jpeg) {
         // 🔥 JPEG: Use --lossless_jpeg=1 for REVERSIBLE transcode
         // This preserves DCT coefficients - can be converted back to identical JPEG!
         // This is the BEST option for JPEG files - no quality loss at all
-        snprintf(cmd, sizeof(cmd),
-            "cjxl \"%s\" \"%s\" --lossless_jpeg=1 -j 2 2>/dev/null",
-            input, output);
-    } else {
-        // PNG/BMP/TIFF/TGA/PPM: Use -d 0 for mathematically lossless
-        snprintf(cmd, sizeof(cmd),
-            "cjxl \"%s\" \"%s\" -d 0 -e %d -j 2 2>/dev/null",
-            input, output, g_config.jxl_effort);
+        const char *argv[] = { "cjxl", input, output, "--lossless_jpeg=1", num_threads, NULL };
+        return run_tool(argv, NULL) == 0;
+    }
+    // PNG/BMP/TIFF/TGA/PPM: Use -d 0 for mathematically lossless
+    const char *argv[] = { "cjxl", input, output, "-d", "0", "-e", effort_arg, num_threads, NULL };
+    return run_tool(argv, NULL) == 0;
+}
+
+// Pixel count from the source header (JPEG frame, TIFF IFD), 0 if unknown
+size_t encode_pixels_estimate(const FileEntry *entry, const SourceBuffer *src) {
+    JpegFrame frame;
+    if (entry->type == FILE_TYPE_JPEG && jpeg_frame_info(src->data, src->size, &frame)) {
+        return (size_t)frame.width * frame.height;
+    }
+    TiffImage tif;
+    if (entry->type == FILE_TYPE_TIFF && tiff_parse(src->data, src->size, &tif)) {
+        return (size_t)tif.width * tif.height;
+    }
+    return 0;
+}
+
+// Estimated peak memory of encoding `src`: what the in-process encoder
+// reports when it can take the source, else the whole decoded frame plus
+// encoder state
+size_t encode_memory_estimate(const FileEntry *entry, const SourceBuffer *src) {
+    if (use_libjxl() && entry->type != FILE_TYPE_JPEG) {
+        size_t native = jxl_encode_memory(src->data, src->size);
+        if (native > 0) return native;
+    }
+    // The header knows the real pixel count
+    size_t pixels = encode_pixels_estimate(entry, src);
+    if (pixels > 0) {
+        return pixels * (entry->type == FILE_TYPE_JPEG ? ENCODE_MEMORY_PER_PIXEL_JPEG
+                                                       : ENCODE_MEMORY_PER_PIXEL);
+    }
+    return encode_memory_for(entry);
+}
+
+// Estimate the lossless output size with an effort-1 trial encode.
+// In-process it encodes a few row bands; with cjxl it is a whole-file -e 1
+// run into `trial_output`. False when no estimate could be made.
+bool predict_lossless_size(const char *input, const SourceBuffer *src, const char *trial_output,
+                           int threads, size_t *predicted) {
+    if (use_libjxl()) {
+        EncodeResult result = jxl_estimate_lossless(src->data, src->size, threads, predicted);
+        if (result != ENCODE_UNSUPPORTED) return result == ENCODE_OK;
     }
     
-    return (system(cmd) == 0);
+    char num_threads[32];
+    snprintf(num_threads, sizeof(num_threads), "--num_threads=%d", threads);
+    const char *argv[] = { "cjxl", input, trial_output, "-d", "0", "-e", "1", num_threads, NULL };
+    bool ok = run_tool(argv, NULL) == 0;
+    if (ok) *predicted = get_file_size(trial_output);
+    unlink(trial_output);
+    return ok && *predicted > 0;
 }
 
 // ============================================================================
@@ -460,105 +542,117 @@ bool convert_to_jxl(const char *input, const char *output, bool is_jpeg) {
 
 // Layer 1: Internal metadata via exiftool (EXIF, IPTC, XMP, ICC)
 bool migrate_internal_metadata(const char *source, const char *dest) {
-    char cmd[MAX_PATH_LEN * 3];
     // -all:all copies ALL metadata including ICC profiles
     // -overwrite_original prevents backup file creation
-    snprintf(cmd, sizeof(cmd),
-        "exiftool -tagsfromfile \"%s\" -all:all -icc_profile -overwrite_original \"%s\" 2>/dev/null",
-        source, dest);
-    return (system(cmd) == 0);
+    const char *args[] = { "-tagsfromfile", source, "-all:all", "-icc_profile",
+                           "-overwrite_original", dest };
+    ExifToolResult result = exiftool_exec(args, 6, true, NULL);
+    if (result != EXIFTOOL_UNAVAILABLE) return result == EXIFTOOL_OK;
+    
+    // No daemon available: one-shot exiftool
+    const char *argv[] = { "exiftool", "-tagsfromfile", source, "-all:all", "-icc_profile",
+                           "-overwrite_original", dest, NULL };
+    return run_tool(argv, NULL) == 0;
 }
 
-// Layer 2: macOS extended attributes (xattr)
-bool copy_xattrs(const char *source, const char *dest) {
+// Layer 2: Extended attributes, copied natively onto the output descriptor
+// macOS: com.apple.metadata:kMDItemWhereFroms (download URL),
+//        kMDItemDownloadedDate, com.apple.FinderInfo, com.apple.quarantine
+// Linux: the user.* namespace (security.* and trusted.* belong to the host)
 #ifdef __APPLE__
-    char cmd[MAX_PATH_LEN * 3];
-    // Copy all extended attributes including:
-    // - com.apple.metadata:kMDItemWhereFroms (download URL)
-    // - com.apple.metadata:kMDItemDownloadedDate
-    // - com.apple.FinderInfo
-    // - com.apple.quarantine
-    snprintf(cmd, sizeof(cmd),
-        "xattr -l \"%s\" 2>/dev/null | while read line; do "
-        "attr=$(echo \"$line\" | cut -d: -f1); "
-        "xattr -w \"$attr\" \"$(xattr -p \"$attr\" \"%s\" 2>/dev/null)\" \"%s\" 2>/dev/null; "
-        "done",
-        source, source, dest);
-    system(cmd);
-    
-    // Alternative: use copyfile for metadata only (faster)
-    // This copies ACL, xattr, but NOT file content
-    snprintf(cmd, sizeof(cmd),
-        "cp -p \"%s\" \"%s.meta.tmp\" 2>/dev/null && rm -f \"%s.meta.tmp\"",
-        source, dest, dest);
-    // Note: We don't actually use this, just showing the concept
+#define LIST_XATTRS(path, buf, size)         listxattr(path, buf, size, XATTR_NOFOLLOW)
+#define GET_XATTR(path, name, buf, size)     getxattr(path, name, buf, size, 0, XATTR_NOFOLLOW)
+#define SET_XATTR(fd, name, buf, size)       fsetxattr(fd, name, buf, size, 0, 0)
+#define XATTR_COPIED(name)                   true
+#else
+#define LIST_XATTRS(path, buf, size)         listxattr(path, buf, size)
+#define GET_XATTR(path, name, buf, size)     getxattr(path, name, buf, size)
+#define SET_XATTR(fd, name, buf, size)       fsetxattr(fd, name, buf, size, 0)
+#define XATTR_COPIED(name)                   (strncmp(name, "user.", 5) == 0)
 #endif
-    return true;
+
+bool copy_xattrs(const char *source, int dest_fd) {
+    if (dest_fd < 0) return false;
+    char names_buf[XATTR_STACK_BYTES], value_buf[XATTR_STACK_BYTES];
+    char *names = names_buf;
+    ssize_t len = LIST_XATTRS(source, names, sizeof(names_buf));
+    if (len < 0 && errno == ERANGE) {
+        // Long list: size it, then read it (it may grow in between)
+        len = LIST_XATTRS(source, NULL, 0);
+        names = len > 0 ? malloc((size_t)len) : NULL;
+        if (!names) return false;
+        len = LIST_XATTRS(source, names, (size_t)len);
+    }
+    if (len <= 0) {
+        if (names != names_buf) free(names);
+        return len == 0 || errno == ENOTSUP;   // No attributes, or none possible
+    }
+    
+    bool ok = true;
+    for (const char *name = names; name < names + len; name += strlen(name) + 1) {
+        if (!XATTR_COPIED(name)) continue;
+        char *value = value_buf;
+        ssize_t size = GET_XATTR(source, name, value, sizeof(value_buf));
+        if (size < 0 && errno == ERANGE) {
+            // Large value (resource forks): heap buffer for this one
+            size = GET_XATTR(source, name, NULL, 0);
+            value = size > 0 ? malloc((size_t)size) : NULL;
+            if (value) size = GET_XATTR(source, name, value, (size_t)size);
+        }
+        if (size < 0 || (value == NULL && size > 0) || SET_XATTR(dest_fd, name, value, (size_t)size) != 0) ok = false;
+        if (value != value_buf) free(value);
+    }
+    if (names != names_buf) free(names);
+    return ok;
 }
 
 // Layer 3: System timestamps (MUST be called LAST!)
 // 🔥 Critical: exiftool modifies file, so timestamps must be set AFTER all other operations
-bool preserve_timestamps(const char *source, const char *dest) {
-    struct stat st;
-    if (stat(source, &st) != 0) return false;
-    
-    struct timeval times[2];
-    times[0].tv_sec = st.st_atime;
-    times[0].tv_usec = 0;
-    times[1].tv_sec = st.st_mtime;
-    times[1].tv_usec = 0;
-    
-    return (utimes(dest, times) == 0);
+// Nanosecond atime/mtime, on the descriptor when there is one
+bool preserve_timestamps(const struct stat *src, const char *dest, int dest_fd) {
+#ifdef __APPLE__
+    struct timespec ts[2] = { src->st_atimespec, src->st_mtimespec };
+#else
+    struct timespec ts[2] = { src->st_atim, src->st_mtim };
+#endif
+    if (dest_fd >= 0) return futimens(dest_fd, ts) == 0;
+    return utimensat(AT_FDCWD, dest, ts, 0) == 0;
 }
 
 // Layer 4: macOS creation time (birthtime)
-bool preserve_creation_time(const char *source, const char *dest) {
+// Set after the mtime: an mtime older than the birthtime pulls it back
+bool preserve_creation_time(const struct stat *src, int dest_fd) {
 #ifdef __APPLE__
-    char cmd[MAX_PATH_LEN * 3];
-    // SetFile -d sets creation date
-    // GetFileInfo -d gets creation date
-    snprintf(cmd, sizeof(cmd),
-        "ctime=$(GetFileInfo -d \"%s\" 2>/dev/null) && "
-        "SetFile -d \"$ctime\" \"%s\" 2>/dev/null",
-        source, dest);
-    return (system(cmd) == 0);
+    if (dest_fd < 0) return false;
+    struct attrlist attrs = { .bitmapcount = ATTR_BIT_MAP_COUNT, .commonattr = ATTR_CMN_CRTIME };
+    struct timespec crtime = src->st_birthtimespec;
+    return fsetattrlist(dest_fd, &attrs, &crtime, sizeof(crtime), 0) == 0;
 #else
-    (void)source;
-    (void)dest;
+    (void)src;
+    (void)dest_fd;
     return true;
 #endif
 }
 
+// Count tags exiftool reports for a file (-1 on error)
+static int count_tags(const char *path) {
+    const char *args[] = { "-s", "-s", "-s", path };
+    int lines = 0;
+    ExifToolResult result = exiftool_exec(args, 4, false, &lines);
+    if (result == EXIFTOOL_OK) return lines;
+    if (result == EXIFTOOL_FAILED) return -1;
+    
+    // No daemon available: one-shot exiftool
+    const char *argv[] = { "exiftool", "-s", "-s", "-s", path, NULL };
+    return run_tool(argv, &lines) < 0 ? -1 : lines;
+}
+
 // Layer 5: Verify metadata was preserved (optional, for verbose mode)
 int verify_metadata(const char *source, const char *dest) {
-    char cmd[MAX_PATH_LEN * 3];
-    char result[256];
-    
-    // Count tags in source
-    snprintf(cmd, sizeof(cmd),
-        "exiftool -s -s -s \"%s\" 2>/dev/null | wc -l",
-        source);
-    FILE *fp = popen(cmd, "r");
-    if (!fp) return -1;
-    if (fgets(result, sizeof(result), fp) == NULL) {
-        pclose(fp);
-        return -1;
-    }
-    pclose(fp);
-    int src_tags = atoi(result);
-    
-    // Count tags in dest
-    snprintf(cmd, sizeof(cmd),
-        "exiftool -s -s -s \"%s\" 2>/dev/null | wc -l",
-        dest);
-    fp = popen(cmd, "r");
-    if (!fp) return -1;
-    if (fgets(result, sizeof(result), fp) == NULL) {
-        pclose(fp);
-        return -1;
-    }
-    pclose(fp);
-    int dst_tags = atoi(result);
+    int src_tags = count_tags(source);
+    if (src_tags < 0) return -1;
+    int dst_tags = count_tags(dest);
+    if (dst_tags < 0) return -1;
     
     // Return percentage preserved
     if (src_tags == 0) return 100;
@@ -568,34 +662,59 @@ int verify_metadata(const char *source, const char *dest) {
 // Master function: Complete metadata preservation
 // 🔥 Order is critical: xattr → internal → timestamps → creation time (LAST!)
 // exiftool modifies file, so creation time MUST be set AFTER all file modifications
-bool migrate_metadata(const char *source, const char *dest) {
+// `internal_done`: the encoder already wrote EXIF/XMP/ICC as JXL boxes
+// `dest_fd`: descriptor of an anonymous output (-1 when `dest` is a named file)
+// Layers 2-4 are syscalls on one descriptor; a named output is opened for them
+bool migrate_metadata(const char *source, const char *dest, int dest_fd, bool internal_done,
+                      JobTiming *timing) {
     bool success = true;
-    
-    // Step 1: Copy extended attributes (macOS)
-    copy_xattrs(source, dest);
+    double t = monotonic_seconds();
+    struct stat src_st;
+    bool have_src = stat(source, &src_st) == 0;
+    int fd = dest_fd >= 0 ? dest_fd : open(dest, O_RDONLY | O_CLOEXEC);
+    
+    // Step 1: Copy extended attributes
+    if (!copy_xattrs(source, fd) && g_config.verbose) {
+        log_warn("Extended attributes partial: %s", dest);
+    }
+    t = timing_end(timing, PHASE_XATTR, t);
     
     // Step 2: Copy internal metadata (EXIF, IPTC, XMP, ICC)
     // ⚠️ This modifies the file! All time-related operations must come AFTER
-    if (!migrate_internal_metadata(source, dest)) {
-        if (g_config.verbose) {
-            log_warn("Internal metadata migration partial: %s", dest);
+    if (internal_done) {
+        stat_add(STAT_METADATA_NATIVE, 1);
+    } else {
+        if (!migrate_internal_metadata(source, dest)) {
+            if (g_config.verbose) {
+                log_warn("Internal metadata migration partial: %s", dest);
+            }
+            // Don't fail - some formats don't support all metadata
+        }
+        stat_add(STAT_METADATA_EXIFTOOL, 1);
+        // exiftool replaced the file: reopen the new one
+        if (fd != dest_fd) {
+            if (fd >= 0) close(fd);
+            fd = open(dest, O_RDONLY | O_CLOEXEC);
         }
-        // Don't fail - some formats don't support all metadata
     }
+    t = timing_end(timing, PHASE_INTERNAL, t);
     
     // Step 3: Copy timestamps (mtime/atime)
     // Must come AFTER exiftool which modifies the file
-    if (!preserve_timestamps(source, dest)) {
+    if (!have_src || !preserve_timestamps(&src_st, dest, fd)) {
         if (g_config.verbose) {
             log_warn("Timestamp preservation failed: %s", dest);
         }
         success = false;
     }
+    t = timing_end(timing, PHASE_TIMESTAMPS, t);
     
     // Step 4: Copy creation time (macOS birthtime) - MUST BE LAST!
     // 🔥 Critical fix: exiftool's -overwrite_original resets creation time
     // So we must set creation time AFTER all other operations
-    preserve_creation_time(source, dest);
+    if (have_src) preserve_creation_time(&src_st, fd);
+    if (fd != dest_fd && fd >= 0) close(fd);
+    timing_end(timing, PHASE_CREATION_TIME, t);
     
     // Step 5: Verify (verbose mode only)
     if (g_config.verbose) {
@@ -612,38 +731,47 @@ bool migrate_metadata(const char *source, const char *dest) {
     return success;
 }
 
-bool health_check_jxl(const char *path) {
-    if (g_config.skip_health_check) return true;
-    
-    size_t size = get_file_size(path);
-    if (size == 0) return false;
-    
-    FILE *f = fopen(path, "rb");
-    if (!f) return false;
-    
-    unsigned char sig[12];
-    size_t n = fread(sig, 1, 12, f);
-    fclose(f);
-    
-    if (n < 2) return false;
-    
-    bool valid_sig = (sig[0] == 0xFF && sig[1] == 0x0A) ||
-                     (sig[0] == 0x00 && sig[1] == 0x00 && sig[2] == 0x00);
-    
-    if (!valid_sig) return false;
-    
-    if (system("which djxl > /dev/null 2>&1") == 0) {
-        char cmd[MAX_PATH_LEN + 64];
-        snprintf(cmd, sizeof(cmd), "djxl \"%s\" /dev/null 2>/dev/null", path);
-        if (system(cmd) != 0) return false;
+// "~1h 05m", "~3m 20s", "~12s"
+static void format_eta(double seconds, char *buf, size_t len) {
+    long t = (long)(seconds + 0.5);
+    if (t >= 3600) {
+        snprintf(buf, len, "~%ldh %02ldm", t / 3600, (t % 3600) / 60);
+    } else if (t >= 60) {
+        snprintf(buf, len, "~%ldm %02lds", t / 60, t % 60);
+    } else {
+        snprintf(buf, len, "~%lds", t);
     }
-    
-    return true;
 }
 
+// Lines of the last in-place redraw (cursor sits on the last one)
+static int g_progress_lines = 0;
 
-void show_progress(int current, int total, const char *filename) {
-    int percent = (current * 100) / total;
+void show_progress(const Progress *pr, const char *filename, Pipeline *pipe) {
+    int percent = pr->total > 0 ? (int)((int64_t)pr->processed * 100 / pr->total) : 0;
+    char eta[32] = "--";
+    if (pr->eta_seconds >= 0) format_eta(pr->eta_seconds, eta, sizeof(eta));
+    const char *eta_mark = pr->eta_exact || pr->eta_seconds < 0 ? "" : " (est.)";
+    
+    // Captured output: one plain line per interval, no cursor movement
+    if (!g_config.progress_tty) {
+        printf("📊 Progress: %d/%d (%d%%) | %.1f files/s | in %.1f MB/s | out %.1f MB/s | ETA %s%s",
+               pr->processed, pr->total, percent, pr->files_per_sec,
+               pr->in_per_sec / (1024 * 1024), pr->out_per_sec / (1024 * 1024), eta, eta_mark);
+        if (pipe) {
+            static const char *stage_names[STAGE_COUNT] = { "encode", "verify", "meta" };
+            for (int s = 0; s < STAGE_COUNT; s++) {
+                int busy, workers, queued;
+                pipeline_stage_status(pipe, s, &busy, &workers, &queued);
+                printf(" | %s %d/%d q=%d", stage_names[s], busy, workers, queued);
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+        return;
+    }
+    
+    // Back to the first line of the previous redraw
+    if (g_progress_lines > 1) printf("\033[%dA", g_progress_lines - 1);
     int filled = percent / 2;
     
     printf("\r\033[K");
@@ -652,18 +780,10 @@ void show_progress(int current, int total, const char *filename) {
     for (int i = 0; i < filled; i++) printf("█");
     printf(COLOR_RESET);
     for (int i = filled; i < 50; i++) printf("░");
-    printf("] %d%% (%d/%d) ", percent, current, total);
-    
-    if (current > 0) {
-        time_t elapsed = time(NULL) - g_stats.start_time;
-        int avg = (int)(elapsed / current);
-        int remaining = (total - current) * avg;
-        if (remaining > 60) {
-            printf("| ⏱️  ETA: ~%dm %ds", remaining / 60, remaining % 60);
-        } else {
-            printf("| ⏱️  ETA: ~%ds", remaining);
-        }
-    }
+    printf("] %d%% (%d/%d) | ⏱️  ETA: %s%s", percent, pr->processed, pr->total, eta, eta_mark);
+    printf("\n\033[K   ⚡ %.1f files/s │ in %.1f MB/s │ out %.1f MB/s",
+           pr->files_per_sec, pr->in_per_sec / (1024 * 1024), pr->out_per_sec / (1024 * 1024));
+    g_progress_lines = 2;
     
     if (filename) {
         char display[45];
@@ -674,14 +794,40 @@ void show_progress(int current, int total, const char *filename) {
         } else {
             strcpy(display, filename);
         }
-        printf("\n   📄 %s", display);
+        printf("\n\033[K   📄 %s", display);
+        g_progress_lines++;
     }
     
+    // Per-stage occupancy: busy/workers and queued jobs, to spot the bottleneck
+    if (pipe) {
+        static const char *stage_names[STAGE_COUNT] = { "encode", "verify", "meta" };
+        printf("\n\033[K   🧵");
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            int busy, workers, queued;
+            pipeline_stage_status(pipe, s, &busy, &workers, &queued);
+            printf(" %s %d/%d q=%d%s", stage_names[s], busy, workers, queued,
+                   s + 1 < STAGE_COUNT ? " │" : "");
+        }
+        printf("\033[K");
+        g_progress_lines++;
+    }
+    
+    fflush(stdout);
+}
+
+// Erase the in-place progress block before the summary
+void progress_clear(void) {
+    if (!g_config.progress_tty || g_progress_lines == 0) return;
+    for (int i = 1; i < g_progress_lines; i++) printf("\r\033[K\033[A");
+    printf("\r\033[K");
+    g_progress_lines = 0;
     fflush(stdout);
 }
 
 void print_summary(void) {
-    time_t elapsed = time(NULL) - g_stats.start_time;
+    Stats st;
+    stats_read(&st);
+    time_t elapsed = time(NULL) - st.start_time;
     
     printf("\n\n");
     printf("╔══════════════════════════════════════════════╗\n");
@@ -689,197 +835,132 @@ void print_summary(void) {
     printf("╚══════════════════════════════════════════════╝\n\n");
 
     printf("📈 Statistics:\n");
-    printf("   Total files:    %d\n", g_stats.total);
-    printf("   " COLOR_GREEN "✅ Success:      %d" COLOR_RESET "\n", g_stats.success);
-    printf("   " COLOR_RED "❌ Failed:       %d" COLOR_RESET "\n", g_stats.failed);
-    printf("   ⏭️  Skipped:      %d\n", g_stats.skipped);
+    printf("   Total files:    %d\n", st.total);
+    printf("   " COLOR_GREEN "✅ Success:      %d" COLOR_RESET "\n", st.success);
+    printf("   " COLOR_RED "❌ Failed:       %d" COLOR_RESET "\n", st.failed);
+    printf("   ⏭️  Skipped:      %d\n", st.skipped);
     printf("   ⏱️  Time:         %ldm %lds\n", elapsed / 60, elapsed % 60);
     
-    if (g_stats.bytes_input > 0) {
-        double in_mb = g_stats.bytes_input / (1024.0 * 1024.0);
-        double out_mb = g_stats.bytes_output / (1024.0 * 1024.0);
-        double ratio = (1.0 - (double)g_stats.bytes_output / g_stats.bytes_input) * 100;
+    if (st.bytes_input > 0) {
+        double in_mb = st.bytes_input / (1024.0 * 1024.0);
+        double out_mb = st.bytes_output / (1024.0 * 1024.0);
+        double ratio = (1.0 - (double)st.bytes_output / st.bytes_input) * 100;
         printf("   💾 Input:        %.2f MB\n", in_mb);
         printf("   💾 Output:       %.2f MB\n", out_mb);
         printf("   📉 Reduction:    %.1f%%\n", ratio);
     }
     
     printf("\n📋 By Format:\n");
-    if (g_stats.jpeg_count > 0) printf("   JPEG (reversible): %d\n", g_stats.jpeg_count);
-    if (g_stats.png_count > 0)  printf("   PNG (lossless):    %d\n", g_stats.png_count);
-    if (g_stats.bmp_count > 0)  printf("   BMP (lossless): %d\n", g_stats.bmp_count);
-    if (g_stats.tiff_count > 0) printf("   TIFF (lossless):%d\n", g_stats.tiff_count);
-    if (g_stats.tga_count > 0)  printf("   TGA (lossless): %d\n", g_stats.tga_count);
-    if (g_stats.ppm_count > 0)  printf("   PPM (lossless): %d\n", g_stats.ppm_count);
-    
-    if (g_stats.skipped_raw > 0 || g_stats.skipped_small > 0 || 
-        g_stats.skipped_tiff_jpeg > 0 || g_stats.skipped_larger > 0) {
+    if (st.jpeg_count > 0) printf("   JPEG (reversible): %d\n", st.jpeg_count);
+    if (st.png_count > 0)  printf("   PNG (lossless):    %d\n", st.png_count);
+    if (st.bmp_count > 0)  printf("   BMP (lossless): %d\n", st.bmp_count);
+    if (st.tiff_count > 0) printf("   TIFF (lossless):%d\n", st.tiff_count);
+    if (st.tga_count > 0)  printf("   TGA (lossless): %d\n", st.tga_count);
+    if (st.ppm_count > 0)  printf("   PPM (lossless): %d\n", st.ppm_count);
+    
+    if (st.skipped_raw > 0 || st.skipped_small > 0 || 
+        st.skipped_tiff_jpeg > 0 || st.skipped_larger > 0 ||
+        st.skipped_unsupported > 0 || st.skipped_manifest > 0 ||
+        st.predicted_larger > 0 || st.skipped_multipage > 0) {
         printf("\n⏭️  Skipped Details:\n");
-        if (g_stats.skipped_raw > 0)
-            printf("   RAW files:      %d (preserve flexibility)\n", g_stats.skipped_raw);
-        if (g_stats.skipped_small > 0)
-            printf("   Small files:    %d (< 2MB threshold)\n", g_stats.skipped_small);
-        if (g_stats.skipped_tiff_jpeg > 0)
-            printf("   TIFF (JPEG):    %d (already lossy)\n", g_stats.skipped_tiff_jpeg);
-        if (g_stats.skipped_larger > 0)
-            printf("   JXL larger:     %d (smart rollback)\n", g_stats.skipped_larger);
-    }
-    
-    // Metadata preservation report
-    if (g_stats.success > 0) {
-        printf("\n📋 Metadata Preservation:\n");
-        printf("   EXIF/XMP/ICC:   ✅ Preserved via exiftool\n");
-        printf("   Timestamps:     ✅ Preserved (mtime/atime)\n");
-#ifdef __APPLE__
-        printf("   macOS xattr:    ✅ Preserved (WhereFroms, etc.)\n");
-        printf("   Creation time:  ✅ Preserved (birthtime)\n");
-#endif
+        if (st.skipped_raw > 0)
+            printf("   RAW files:      %d (preserve flexibility)\n", st.skipped_raw);
+        if (st.skipped_small > 0)
+            printf("   Small files:    %d (< 2MB threshold)\n", st.skipped_small);
+        if (st.skipped_tiff_jpeg > 0)
+            printf("   TIFF (JPEG):    %d (already lossy)\n", st.skipped_tiff_jpeg);
+        if (st.skipped_multipage > 0)
+            printf("   TIFF (pages):   %d (multi-page, would lose pages)\n", st.skipped_multipage);
+        if (st.predicted_larger > 0)
+            printf("   Predicted:      %d (low-effort trial, no full encode)\n", st.predicted_larger);
+        if (st.skipped_larger > 0)
+            printf("   JXL larger:     %d (smart rollback)\n", st.skipped_larger);
+        if (st.skipped_unsupported > 0)
+            printf("   Not supported:  %d (not a convertible image)\n", st.skipped_unsupported);
+        if (st.skipped_manifest > 0)
+            printf("   Unchanged:      %d (manifest, not re-read)\n", st.skipped_manifest);
     }
     
-    if (!g_config.skip_health_check) {
-        printf("\n🏥 Health Report:\n");
-        printf("   ✅ Passed:  %d\n", g_stats.health_passed);
-        printf("   ❌ Failed:  %d\n", g_stats.health_failed);
-        int total_h = g_stats.health_passed + g_stats.health_failed;
-        if (total_h > 0) {
-            printf("   📊 Rate:    %d%%\n", (g_stats.health_passed * 100) / total_h);
-        }
+    if (g_config.adaptive_effort) {
+        printf("\n🎚️  Adaptive Effort (%d → %d):\n", g_config.effort_low, g_config.jxl_effort);
+        printf("   Escalated:      %d (kept %d)\n", st.escalated, st.escalated_kept);
+        printf("   Saved:          %.2f MB in %.1f extra CPU-seconds\n",
+               st.escalated_saved / (1024.0 * 1024.0), g_effort.spent_seconds);
     }
-}
-
-void signal_handler(int sig) {
-    (void)sig;
-    g_interrupted = true;
-    printf("\n\n⚠️  Interrupted! Finishing current file...\n");
-}
-
-bool process_file(const FileEntry *entry) {
-    const char *input = entry->path;
-    char *output = get_output_path(input);
-    char temp_output[MAX_PATH_LEN];
     
-    if (!g_config.in_place && file_exists(output)) {
-        if (g_config.verbose) log_warn("Skip: %s exists", output);
-        pthread_mutex_lock(&g_stats.mutex);
-        g_stats.skipped++;
-        pthread_mutex_unlock(&g_stats.mutex);
-        return true;
+    if (st.deduplicated > 0) {
+        printf("\n👯 Deduplication:\n");
+        printf("   Copies:         %d (encoded once, output cloned)\n", st.deduplicated);
+        printf("   Saved:          %.2f MB not re-encoded, %.1f CPU-seconds\n",
+               st.dedup_bytes / (1024.0 * 1024.0), st.dedup_seconds);
     }
     
-    if (g_config.in_place) {
-        snprintf(temp_output, sizeof(temp_output), "%s.jxl.tmp", input);
-    } else {
-        strcpy(temp_output, output);
+    if (g_config.durability != DURABILITY_NONE) {
+        printf("\n💾 Durability (%s):\n", durability_name(g_config.durability));
+        printf("   Syncs:          %d files, %d directories\n", st.file_syncs, st.dir_syncs);
     }
     
-    bool is_jpeg = (entry->type == FILE_TYPE_JPEG);
-    
-    if (g_config.verbose) {
-        if (is_jpeg) {
-            log_info("Converting [JPEG → lossless transcode]: %s", input);
-        } else {
-            log_info("Converting [%s → lossless -d 0]: %s", get_file_type_name(entry->type), input);
-        }
+    if (g_config.ledger_path[0]) {
+        printf("\n🗂️  Ledger (node %s):\n", ledger_node());
+        printf("   Claimed:        %d files (%d recovered from dead nodes)\n",
+               st.ledger_claimed, st.ledger_recovered);
+        printf("   Elsewhere:      %d files claimed or done by other nodes\n", st.ledger_busy);
     }
     
-    // Step 1: Convert
-    if (!convert_to_jxl(input, temp_output, is_jpeg)) {
-        log_error("Conversion failed: %s", input);
-        unlink(temp_output);
-        pthread_mutex_lock(&g_stats.mutex);
-        g_stats.failed++;
-        pthread_mutex_unlock(&g_stats.mutex);
-        return false;
+    if (st.prefetched > 0) {
+        printf("\n📥 Prefetch (%s):\n", prefetch_backend());
+        printf("   Read ahead:     %d sources\n", st.prefetched);
     }
     
-    // Step 2: Check output size - smart rollback if JXL is larger
-    size_t out_size = get_file_size(temp_output);
-    if (out_size > entry->size) {
-        // JXL is larger than original - rollback!
-        double increase = ((double)out_size / entry->size - 1.0) * 100;
-        if (g_config.verbose) {
-            log_warn("⏭️  Rollback: JXL larger than original (+%.1f%%): %s", increase, input);
+    if (st.encoders_reused > 0 || st.runner_threads_saved > 0 || st.buffers_reused > 0) {
+        printf("\n♻️  Reuse:\n");
+        if (st.encoders_reused > 0 || st.runner_threads_saved > 0) {
+            printf("   Encoders:       %d recycled, %d runner threads not started\n",
+                   st.encoders_reused, st.runner_threads_saved);
         }
-        unlink(temp_output);
-        pthread_mutex_lock(&g_stats.mutex);
-        g_stats.skipped++;
-        g_stats.skipped_larger++;
-        pthread_mutex_unlock(&g_stats.mutex);
-        return true;  // Not a failure, just skipped
-    }
-    
-    // Step 3: Health check BEFORE metadata (fail fast)
-    if (!health_check_jxl(temp_output)) {
-        log_error("Health check failed: %s", temp_output);
-        unlink(temp_output);
-        pthread_mutex_lock(&g_stats.mutex);
-        g_stats.failed++;
-        g_stats.health_failed++;
-        pthread_mutex_unlock(&g_stats.mutex);
-        return false;
+        printf("   Buffers:        %d from the pool\n", st.buffers_reused);
     }
     
-    // Step 4: Complete metadata preservation (5 layers)
-    // Order: xattr → internal (EXIF/XMP/ICC) → creation time → timestamps (LAST!)
-    migrate_metadata(input, temp_output);
-
-    // Step 5: In-place mode - atomic replace
-    if (g_config.in_place) {
-        if (rename(temp_output, output) != 0) {
-            log_error("Rename failed: %s", temp_output);
-            unlink(temp_output);
-            pthread_mutex_lock(&g_stats.mutex);
-            g_stats.failed++;
-            pthread_mutex_unlock(&g_stats.mutex);
-            return false;
+    timing_print_summary();
+    
+    // Metadata preservation report
+    if (st.success > 0) {
+        printf("\n📋 Metadata Preservation:\n");
+        if (st.metadata_native > 0) {
+            printf("   EXIF/XMP/ICC:   ✅ Written at encode time (%d files)\n", st.metadata_native);
         }
-        // Delete original only after successful rename
-        if (unlink(input) != 0) {
-            log_warn("Delete original failed: %s", input);
+        if (st.metadata_exiftool > 0) {
+            printf("   EXIF/XMP/ICC:   ✅ Preserved via exiftool (%d files)\n", st.metadata_exiftool);
         }
+        printf("   Timestamps:     ✅ Preserved (mtime/atime)\n");
+#ifdef __APPLE__
+        printf("   macOS xattr:    ✅ Preserved (WhereFroms, etc.)\n");
+        printf("   Creation time:  ✅ Preserved (birthtime)\n");
+#endif
     }
     
-    // Re-read output size (may have changed after metadata)
-    out_size = get_file_size(output);
-    
-    pthread_mutex_lock(&g_stats.mutex);
-    g_stats.success++;
-    g_stats.health_passed++;
-    g_stats.bytes_input += entry->size;
-    g_stats.bytes_output += out_size;
-    pthread_mutex_unlock(&g_stats.mutex);
-    
-    if (g_config.verbose) {
-        double ratio = (1.0 - (double)out_size / entry->size) * 100;
-        log_success("Done: %s (%.1f%% smaller)", output, ratio);
+    if (g_config.validate != VALIDATE_NONE) {
+        printf("\n🏥 Health Report (%s):\n", validate_level_name(g_config.validate));
+        printf("   ✅ Passed:  %d\n", st.health_passed);
+        printf("   ❌ Failed:  %d\n", st.health_failed);
+        int total_h = st.health_passed + st.health_failed;
+        if (total_h > 0) {
+            printf("   📊 Rate:    %d%%\n", (st.health_passed * 100) / total_h);
+        }
     }
-    
-    return true;
 }
 
+void signal_handler(int sig) {
+    (void)sig;
+    g_interrupted = true;
+    printf("\n\n⚠️  Interrupted! Finishing current file...\n");
+}
 
-typedef struct {
-    int start_idx;
-    int end_idx;
-} ThreadArg;
-
-void *worker_thread(void *arg) {
-    ThreadArg *targ = (ThreadArg *)arg;
-    
-    for (int i = targ->start_idx; i < targ->end_idx && !g_interrupted; i++) {
-        process_file(&g_files[i]);
-        
-        pthread_mutex_lock(&g_stats.mutex);
-        g_stats.processed++;
-        int processed = g_stats.processed;
-        pthread_mutex_unlock(&g_stats.mutex);
-        
-        if (targ->start_idx == 0) {
-            show_progress(processed, g_stats.total, g_files[i].path);
-        }
-    }
-    
-    return NULL;
+// Size-descending order so the longest encodes start first
+static int compare_size_desc(const void *a, const void *b) {
+    size_t sa = ft_get(*(const int *)a)->size;
+    size_t sb = ft_get(*(const int *)b)->size;
+    return (sa < sb) - (sa > sb);
 }
 
 void print_usage(const char *prog) {
@@ -887,19 +968,47 @@ void print_usage(const char *prog) {
     printf("Converts static images to JXL with intelligent mode selection:\n");
     printf("  • JPEG → JXL (--lossless_jpeg=1, REVERSIBLE transcode!)\n");
     printf("  • PNG/BMP/TGA/PPM (>2MB) → JXL lossless (-d 0)\n");
-    printf("  • TIFF (uncompressed/LZW, >2MB) → JXL lossless (-d 0)\n");
+    printf("  • TIFF (uncompressed/LZW/Deflate/PackBits, >2MB) → JXL lossless (-d 0)\n");
     printf("  • RAW formats → SKIP (preserve flexibility)\n\n");
     printf("Usage: %s [options] <directory>\n\n", prog);
     printf("Options:\n");
     printf("  --in-place, -i       Replace original files\n");
-    printf("  --skip-health-check  Skip health validation\n");
+    printf("  --skip-health-check  Skip health validation (same as --validate none)\n");
+    printf("  --validate <level>   Health check: none, header, structural, full (default: structural)\n");
     printf("  --no-recursive       Don't process subdirectories\n");
     printf("  --force-lossless     Force lossless for all formats\n");
     printf("  --verbose, -v        Show detailed output\n");
     printf("  --dry-run            Preview without converting\n");
-    printf("  -j <N>               Parallel threads (default: %d)\n", DEFAULT_THREADS);
+    printf("  -j <N>               Max files encoded at once (default: one per core)\n");
+    printf("  --cores <N>          Core budget shared by all encoders (default: detected)\n");
+    printf("  --largest-first      Start the biggest files first (shorter tail)\n");
+    printf("                       (waits for the full scan before encoding)\n");
+    printf("  --scan-threads <N>   Directory scanner threads (default: min(cores, 8))\n");
+    printf("  --mem-limit <MB>     Memory budget for concurrent encodes (default: 60%% of RAM)\n");
+    printf("  --manifest <file>    Remember outcomes; re-runs skip unchanged files\n");
+    printf("  --retry-failed       With --manifest: retry files that failed before\n");
+    printf("  --dedup              Encode byte-identical files once, clone the output\n");
+    printf("  --durability <mode>  fsync outputs: none, file, batch (default: none)\n");
+    printf("  --watch              Keep running, convert new files once they are complete\n");
+    printf("  --ledger <dir>       Share the work with other hosts through a ledger directory\n");
+    printf("  --files-from <file>  Convert the paths listed in <file> (- = stdin; NUL or newline)\n");
+    printf("  --prefetch <N>       Sources read ahead per encode worker, 0 = off (default: %d)\n", DEFAULT_PREFETCH);
+    printf("  --stats-json <file>  Per-file stage timings as JSONL, then a latency summary\n");
+    printf("  --trace <file>       Chrome trace-event timeline of every stage (chrome://tracing)\n");
+    printf("  --predict-margin <P> Skip lossless files whose effort-1 trial is >P%% larger (default: 25)\n");
+    printf("  --no-predict         Always run the full encode (rollback only)\n");
+    printf("  --verify-workers <N> Health check workers (default: cores/4, min 1)\n");
+    printf("  --meta-workers <N>   Metadata/finalize workers (default: cores/4, min 2)\n");
+    printf("  --queue-depth <N>    Jobs buffered between stages (default: %d)\n", DEFAULT_QUEUE_DEPTH);
     printf("  -d <distance>        Override JXL distance\n");
     printf("  -e <effort>          JXL effort 1-9 (default: %d)\n", JXL_EFFORT_DEFAULT);
+    printf("  --adaptive           Lossless: encode at a low effort, re-encode at -e where it pays\n");
+    printf("  --effort-low <N>     First-pass effort for --adaptive (default: %d)\n", DEFAULT_EFFORT_LOW);
+    printf("  --escalate-margin <P> Escalate when the first pass is within P%% of the input (default: 10)\n");
+    printf("  --escalate-size <MB> Also escalate sources at least this big (default: %d)\n",
+           DEFAULT_ESCALATE_SIZE / (1024 * 1024));
+    printf("  --effort-budget <S>  Extra CPU-seconds allowed for escalations (default: unlimited)\n");
+    printf("  --encoder <name>     Encoder backend: auto, libjxl, cjxl (default: auto)\n");
     printf("  -h, --help           Show this help\n\n");
     printf("Examples:\n");
     printf("  %s /path/to/images\n", prog);
@@ -908,13 +1017,19 @@ void print_usage(const char *prog) {
 
 int main(int argc, char *argv[]) {
     init_config(&g_config);
-    init_stats(&g_stats);
+    stats_start_clock();
     
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--in-place") == 0 || strcmp(argv[i], "-i") == 0) {
             g_config.in_place = true;
         } else if (strcmp(argv[i], "--skip-health-check") == 0) {
-            g_config.skip_health_check = true;
+            g_config.validate = VALIDATE_NONE;
+        } else if (strcmp(argv[i], "--validate") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (!validate_parse_level(name, &g_config.validate)) {
+                log_error("Unknown validation level: %s (expected none, header, structural or full)", name);
+                return 1;
+            }
         } else if (strcmp(argv[i], "--no-recursive") == 0) {
             g_config.recursive = false;
         } else if (strcmp(argv[i], "--force-lossless") == 0) {
@@ -923,14 +1038,95 @@ int main(int argc, char *argv[]) {
             g_config.verbose = true;
         } else if (strcmp(argv[i], "--dry-run") == 0) {
             g_config.dry_run = true;
+        } else if (strcmp(argv[i], "--largest-first") == 0) {
+            g_config.largest_first = true;
         } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
             g_config.num_threads = atoi(argv[++i]);
             if (g_config.num_threads < 1) g_config.num_threads = 1;
             if (g_config.num_threads > MAX_THREADS) g_config.num_threads = MAX_THREADS;
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            strncpy(g_config.manifest_path, argv[++i], MAX_PATH_LEN - 1);
+        } else if (strcmp(argv[i], "--predict-margin") == 0 && i + 1 < argc) {
+            g_config.predict_margin = atof(argv[++i]) / 100.0;
+            if (g_config.predict_margin < 0) g_config.predict_margin = 0;
+        } else if (strcmp(argv[i], "--no-predict") == 0) {
+            g_config.predict_margin = -1.0;
+        } else if (strcmp(argv[i], "--retry-failed") == 0) {
+            g_config.retry_failed = true;
+        } else if (strcmp(argv[i], "--dedup") == 0) {
+            g_config.dedup = true;
+        } else if (strcmp(argv[i], "--durability") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (!durability_parse(name, &g_config.durability)) {
+                log_error("Unknown durability: %s (expected none, file or batch)", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--ledger") == 0 && i + 1 < argc) {
+            strncpy(g_config.ledger_path, argv[++i], MAX_PATH_LEN - 1);
+        } else if (strcmp(argv[i], "--files-from") == 0 && i + 1 < argc) {
+            strncpy(g_config.files_from, argv[++i], MAX_PATH_LEN - 1);
+        } else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc) {
+            g_config.prefetch = atoi(argv[++i]);
+            if (g_config.prefetch < 0) g_config.prefetch = 0;
+            if (g_config.prefetch > MAX_PREFETCH) g_config.prefetch = MAX_PREFETCH;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            g_config.watch = true;
+        } else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            strncpy(g_config.stats_json_path, argv[++i], MAX_PATH_LEN - 1);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            strncpy(g_config.trace_path, argv[++i], MAX_PATH_LEN - 1);
+        } else if (strcmp(argv[i], "--scan-threads") == 0 && i + 1 < argc) {
+            g_config.scan_threads = atoi(argv[++i]);
+            if (g_config.scan_threads < 1) g_config.scan_threads = 1;
+            if (g_config.scan_threads > MAX_THREADS) g_config.scan_threads = MAX_THREADS;
+        } else if (strcmp(argv[i], "--verify-workers") == 0 && i + 1 < argc) {
+            g_config.verify_workers = atoi(argv[++i]);
+            if (g_config.verify_workers < 1) g_config.verify_workers = 1;
+            if (g_config.verify_workers > MAX_THREADS) g_config.verify_workers = MAX_THREADS;
+        } else if (strcmp(argv[i], "--meta-workers") == 0 && i + 1 < argc) {
+            g_config.finalize_workers = atoi(argv[++i]);
+            if (g_config.finalize_workers < 1) g_config.finalize_workers = 1;
+            if (g_config.finalize_workers > MAX_THREADS) g_config.finalize_workers = MAX_THREADS;
+        } else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+            g_config.queue_depth = atoi(argv[++i]);
+            if (g_config.queue_depth < 1) g_config.queue_depth = 1;
+        } else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {
+            g_config.cores = atoi(argv[++i]);
+            if (g_config.cores < 1) g_config.cores = 1;
+            if (g_config.cores > MAX_CORES) g_config.cores = MAX_CORES;
         } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
             g_config.jxl_distance = atof(argv[++i]);
         } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
             g_config.jxl_effort = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+            double mb = atof(argv[++i]);
+            g_config.mem_limit = mb > 0 ? (size_t)(mb * 1024 * 1024) : 0;
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            g_config.adaptive_effort = true;
+        } else if (strcmp(argv[i], "--effort-low") == 0 && i + 1 < argc) {
+            g_config.effort_low = atoi(argv[++i]);
+            if (g_config.effort_low < 1) g_config.effort_low = 1;
+        } else if (strcmp(argv[i], "--escalate-margin") == 0 && i + 1 < argc) {
+            g_config.escalate_margin = atof(argv[++i]) / 100.0;
+            if (g_config.escalate_margin < 0) g_config.escalate_margin = 0;
+        } else if (strcmp(argv[i], "--escalate-size") == 0 && i + 1 < argc) {
+            double mb = atof(argv[++i]);
+            g_config.escalate_size = mb > 0 ? (size_t)(mb * 1024 * 1024) : 0;
+        } else if (strcmp(argv[i], "--effort-budget") == 0 && i + 1 < argc) {
+            g_config.effort_budget = atof(argv[++i]);
+            if (g_config.effort_budget < 0) g_config.effort_budget = 0;
+        } else if (strcmp(argv[i], "--encoder") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "auto") == 0) {
+                g_config.encoder = ENCODER_AUTO;
+            } else if (strcmp(name, "libjxl") == 0) {
+                g_config.encoder = ENCODER_LIBJXL;
+            } else if (strcmp(name, "cjxl") == 0) {
+                g_config.encoder = ENCODER_CJXL;
+            } else {
+                log_error("Unknown encoder: %s (expected auto, libjxl or cjxl)", name);
+                return 1;
+            }
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             print_usage(argv[0]);
             return 0;
@@ -939,99 +1135,279 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (strlen(g_config.target_dir) == 0) {
+    bool listed = g_config.files_from[0] != '\0';
+    if (listed && (g_config.target_dir[0] || g_config.watch)) {
+        log_error("--files-from replaces the target directory and cannot be combined with --watch");
+        return 1;
+    }
+    
+    if (!listed && strlen(g_config.target_dir) == 0) {
         log_error("No target directory specified");
         print_usage(argv[0]);
         return 1;
     }
     
     struct stat st;
-    if (stat(g_config.target_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    if (!listed && (stat(g_config.target_dir, &st) != 0 || !S_ISDIR(st.st_mode))) {
         log_error("Directory does not exist: %s", g_config.target_dir);
         return 1;
     }
     
-    if (g_config.in_place && is_dangerous_directory(g_config.target_dir)) {
+    if (g_config.watch && (g_config.dry_run || g_config.largest_first)) {
+        log_error("--watch cannot be combined with --dry-run or --largest-first");
+        return 1;
+    }
+    
+    // Listed files are checked per directory as they are read
+    if (!listed && g_config.in_place && is_dangerous_directory(g_config.target_dir)) {
         log_error("🚫 SAFETY: Cannot operate on protected directory: %s", g_config.target_dir);
         return 1;
     }
     
     if (!check_dependencies()) return 1;
+    g_config.progress_tty = isatty(STDOUT_FILENO);
+    
+    // One budget for file workers and encoder threads together
+    if (g_config.cores == 0) g_config.cores = detect_cpu_count();
+    if (g_config.num_threads == 0) {
+        g_config.num_threads = (g_config.cores < MAX_THREADS) ? g_config.cores : MAX_THREADS;
+    }
+    budget_init(&g_budget, g_config.cores);
+    effort_plan_init(&g_effort, g_config.effort_budget);
+    if (g_config.mem_limit == 0) {
+        g_config.mem_limit = (size_t)(detect_physical_memory() * DEFAULT_MEMORY_FRACTION);
+    }
+    memory_init(&g_memory, g_config.mem_limit);
+    if (g_config.adaptive_effort && g_config.effort_low >= g_config.jxl_effort) {
+        log_warn("--adaptive needs --effort-low below -e (%d); using a single pass", g_config.jxl_effort);
+        g_config.adaptive_effort = false;
+    }
+    
+    // Directory walks are latency bound (NFS round trips), not CPU bound
+    if (g_config.scan_threads == 0) {
+        g_config.scan_threads = g_config.cores < MAX_SCAN_THREADS ? g_config.cores : MAX_SCAN_THREADS;
+    }
+    
+    // Verify/metadata stages mostly wait on exiftool/disk, keep them small
+    if (g_config.verify_workers == 0) {
+        g_config.verify_workers = g_config.cores / 4 > 1 ? g_config.cores / 4 : 1;
+    }
+    if (g_config.finalize_workers == 0) {
+        g_config.finalize_workers = g_config.cores / 4 > 2 ? g_config.cores / 4 : 2;
+    }
     
     printf("╔══════════════════════════════════════════════╗\n");
     printf("║   📷 static2jxl - Smart Image Converter      ║\n");
     printf("╚══════════════════════════════════════════════╝\n\n");
     
-    log_info("📁 Target: %s", g_config.target_dir);
+    if (listed) {
+        log_info("📄 File list: %s", strcmp(g_config.files_from, "-") == 0 ? "stdin" : g_config.files_from);
+    } else {
+        log_info("📁 Target: %s", g_config.target_dir);
+    }
     log_info("📋 Formats: JPEG, PNG, BMP, TIFF, TGA, PPM");
     log_info("🎯 Mode: JPEG→reversible(--lossless_jpeg=1), Others→lossless(-d 0, >2MB)");
-    log_info("🔧 Threads: %d, Effort: %d", g_config.num_threads, g_config.jxl_effort);
-    
-    if (g_config.in_place) log_warn("🔄 In-place mode: originals will be replaced");
-    if (g_config.dry_run) log_warn("🔍 Dry-run mode: no files will be modified");
-    printf("\n");
+    log_info("🔧 Cores: %d, Max parallel files: %d, Effort: %d",
+             g_config.cores, g_config.num_threads, g_config.jxl_effort);
+    if (g_config.adaptive_effort) {
+        if (g_config.effort_budget > 0) {
+            log_info("🎚️  Adaptive effort: %d first, %d where it pays (budget %g CPU-s)",
+                     g_config.effort_low, g_config.jxl_effort, g_config.effort_budget);
+        } else {
+            log_info("🎚️  Adaptive effort: %d first, %d where it pays",
+                     g_config.effort_low, g_config.jxl_effort);
+        }
+    }
+    log_info("🧵 Pipeline: encode ×%d → verify ×%d → metadata ×%d (queue depth %d)",
+             g_config.num_threads, g_config.verify_workers, g_config.finalize_workers,
+             g_config.queue_depth);
+    log_info("⚙️  Encoder: %s", encoder_name());
+    log_info("🩺 Health check: %s", validate_level_name(g_config.validate));
+    if (g_config.dedup) log_info("👯 Dedup: identical sources encoded once");
+    if (g_config.durability != DURABILITY_NONE) {
+        log_info("💾 Durability: %s", durability_name(g_config.durability));
+    }
+    if (g_config.mem_limit > 0) {
+        log_info("🧮 Memory budget: %zu MB for concurrent encodes", g_config.mem_limit / (1024 * 1024));
+    }
     
-    g_files = malloc(sizeof(FileEntry) * MAX_FILES);
-    if (!g_files) {
-        log_error("Memory allocation failed");
+    // Manifest before scanning: the scanner drops unchanged files
+    if (g_config.manifest_path[0] && !g_config.dry_run) {
+        if (!manifest_open(g_config.manifest_path)) return 1;
+        log_info("📒 Manifest: %s", g_config.manifest_path);
+    }
+    if (!g_config.dry_run && !timing_open(g_config.stats_json_path, g_config.trace_path)) {
+        manifest_close();
         return 1;
     }
+    if (g_config.ledger_path[0] && !g_config.dry_run) {
+        if (!ledger_open(g_config.ledger_path, g_config.target_dir)) {
+            manifest_close();
+            timing_close();
+            return 1;
+        }
+        log_info("🗂️  Ledger: %s (node %s)", g_config.ledger_path, ledger_node());
+    }
+    if (g_config.stats_json_path[0]) log_info("⏱️  Stats: %s", g_config.stats_json_path);
+    if (g_config.trace_path[0]) log_info("🧭 Trace: %s", g_config.trace_path);
     
-    log_info("📊 Scanning for images...");
-    collect_files(g_config.target_dir, g_config.recursive);
+    if (g_config.in_place) log_warn("🔄 In-place mode: originals will be replaced");
+    if (g_config.dry_run) log_warn("🔍 Dry-run mode: no files will be modified");
+    printf("\n");
     
-    if (g_file_count == 0) {
-        log_info("📂 No suitable files found");
-        free(g_files);
-        return 0;
+    // Stream files into the encoders while scanning, unless every file must
+    // be known up front (dry-run listing, global largest-first order)
+    bool streaming = !g_config.dry_run && !g_config.largest_first;
+    int file_count = 0;
+    
+    if (g_config.watch) {
+        log_info("👀 Watch mode: converting files as they arrive");
+    } else if (streaming && listed) {
+        log_info("📄 Reading file list (encoding starts immediately)...");
+    } else if (streaming) {
+        log_info("📊 Scanning for images (%d threads, encoding starts immediately)...",
+                 g_config.scan_threads);
+    } else {
+        if (listed) {
+            log_info("📄 Reading file list...");
+            file_count = collect_file_list(g_config.files_from);
+        } else {
+            log_info("📊 Scanning for images (%d threads)...", g_config.scan_threads);
+            file_count = collect_files(g_config.target_dir, g_config.recursive);
+        }
+        
+        if (file_count <= 0) {
+            log_info("📂 No suitable files found");
+            manifest_close();
+            timing_close();
+            ledger_close();
+            ft_destroy();
+            return 0;
+        }
+        
+        log_info("📁 Found: %d candidate files", file_count);
     }
-    
-    log_info("📁 Found: %d files to convert", g_file_count);
     printf("\n");
 
     if (g_config.dry_run) {
         log_info("Files that would be converted:");
-        for (int j = 0; j < g_file_count; j++) {
-            printf("   [%s] %s\n", get_file_type_name(g_files[j].type), g_files[j].path);
+        char path[MAX_PATH_LEN];
+        for (int j = 0; j < file_count; j++) {
+            FileEntry *entry = ft_get(j);
+            SourceBuffer src;
+            if (!source_open(ft_path(entry, path, sizeof(path)), &src)) continue;
+            bool convert = classify_file(entry, path, &src);
+            source_close(&src);
+            if (convert) {
+                printf("   [%s] %s\n", get_file_type_name(entry->type), path);
+            }
         }
-        free(g_files);
+        ft_destroy();
         return 0;
     }
     
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);      // A crashed exiftool daemon must not kill us
     
-    g_stats.total = g_file_count;
-    g_stats.start_time = time(NULL);
+    stats_start_clock();
     
     int num_threads = g_config.num_threads;
-    if (num_threads > g_file_count) num_threads = g_file_count;
+    if (!streaming && num_threads > file_count) num_threads = file_count;
     
-    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
-    ThreadArg *thread_args = malloc(sizeof(ThreadArg) * num_threads);
+    WorkQueue queue;
+    Scanner scanner;
+    if (!wq_init(&queue, num_threads)) {
+        log_error("Memory allocation failed");
+        return 1;
+    }
+    ledger_set_sink(&queue);
     
-    int per_thread = g_file_count / num_threads;
-    int remainder = g_file_count % num_threads;
-    int idx = 0;
+    if (g_config.watch) {
+        // The watcher queues the existing tree, then arrivals, until Ctrl-C
+        if (!watch_start(g_config.target_dir, g_config.recursive, &queue)) {
+            wq_destroy(&queue);
+            return 1;
+        }
+    } else if (streaming && listed) {
+        // Entries are queued as they are read; type detection is the workers'
+        if (!filelist_start(g_config.files_from, &queue)) {
+            wq_destroy(&queue);
+            return 1;
+        }
+    } else if (streaming) {
+        // Walkers push into the queue and close it when the tree is done
+        if (!scanner_start(&scanner, g_config.target_dir, g_config.recursive, &queue,
+                           g_config.scan_threads)) {
+            log_error("Failed to start directory scanner");
+            wq_destroy(&queue);
+            return 1;
+        }
+    } else {
+        int *order = malloc(sizeof(int) * file_count);
+        if (!order) {
+            log_error("Memory allocation failed");
+            wq_destroy(&queue);
+            return 1;
+        }
+        for (int j = 0; j < file_count; j++) order[j] = j;
+        if (g_config.largest_first) {
+            qsort(order, file_count, sizeof(int), compare_size_desc);
+        }
+        for (int j = 0; j < file_count; j++) wq_push(&queue, order[j]);
+        ledger_close_sink(&queue);
+        free(order);
+    }
     
-    for (int t = 0; t < num_threads; t++) {
-        thread_args[t].start_idx = idx;
-        thread_args[t].end_idx = idx + per_thread + (t < remainder ? 1 : 0);
-        idx = thread_args[t].end_idx;
-        pthread_create(&threads[t], NULL, worker_thread, &thread_args[t]);
+    // One exiftool daemon per metadata worker, reused for the whole run
+    exiftool_pool_init(g_config.finalize_workers);
+    prefetch_start();
+    if (g_config.prefetch > 0) {
+        log_info("📥 Prefetch: %d files ahead per worker (%s)", g_config.prefetch, prefetch_backend());
     }
     
-    for (int t = 0; t < num_threads; t++) {
-        pthread_join(threads[t], NULL);
+    bool ran = pipeline_run(&queue, num_threads, g_config.verify_workers, g_config.finalize_workers);
+    prefetch_stop();
+    if (g_config.watch) {
+        file_count = watch_wait();
+    } else if (streaming && listed) {
+        file_count = filelist_wait();
+    } else if (streaming) {
+        file_count = scanner_wait(&scanner);
+    }
+    exiftool_pool_shutdown();
+    ledger_close();
+    timing_close();
+    jxl_encoder_shutdown();
+    ingest_pool_destroy();
+    manifest_close();
+    dedup_destroy();
+    wq_destroy(&queue);
+    
+    if (!ran) {
+        log_error("Failed to start conversion pipeline");
+        return 1;
+    }
+    if (file_count == 0) {
+        int unchanged = (int)stat_read(STAT_SKIPPED_MANIFEST);
+        if (unchanged > 0) {
+            log_info("📂 Nothing new: %d files unchanged since the last run", unchanged);
+        } else {
+            log_info("📂 No suitable files found");
+        }
+        ft_destroy();
+        return 0;
     }
     
-    printf("\r\033[K\033[A\033[K");
+    progress_clear();
     print_summary();
     
-    free(threads);
-    free(thread_args);
-    free(g_files);
-    pthread_mutex_destroy(&g_stats.mutex);
+    ft_destroy();
+    budget_destroy(&g_budget);
+    effort_plan_destroy(&g_effort);
+    memory_destroy(&g_memory);
     
-    return (g_stats.failed > 0) ? 1 : 0;
+    bool failed = stat_read(STAT_FAILED) > 0;
+    stats_destroy();
+    return failed ? 1 : 0;
 }
@@ -0,0 +1,377 @@
+/**
+ * manifest.c - Incremental run manifest (--manifest)
+ *
+ * Append-only log of per-file outcomes, keyed by path and validated by
+ * size + mtime (or the XXH64 of the content when only the mtime moved):
+ *
+ *   file   = "S2JXLMF1" record*
+ *   record = magic u32 | path_len u16 | outcome u8 | pad u8 | settings u32 |
+ *            size u64 | mtime_ns i64 | content_hash u64 | path | xxh64 u64
+ *
+ * All integers are little-endian. Every record is written with a single
+ * write() and carries its own checksum, so a run killed mid-write leaves at
+ * most one torn record at the tail; it is dropped (and truncated away) on
+ * the next open. Later records for a path supersede earlier ones, and the
+ * log is compacted on open once most of it is stale.
+ *
+ * In memory only a 64-bit hash of each path is kept (open addressing), so
+ * a lookup is O(1) and costs ~48 bytes per known file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+#define MANIFEST_FILE_MAGIC "S2JXLMF1"
+#define MANIFEST_FILE_MAGIC_LEN 8
+#define MANIFEST_RECORD_MAGIC 0x4D4A3253u      // "S2JM"
+#define MANIFEST_RECORD_HEADER 36
+#define MANIFEST_RECORD_MAX (MANIFEST_RECORD_HEADER + MAX_PATH_LEN + 8)
+#define MANIFEST_SYNC_EVERY 64                 // Records between fsyncs
+#define MANIFEST_COMPACT_MIN 4096              // Don't bother below this many records
+#define MANIFEST_INITIAL_SLOTS 1024
+
+typedef struct {
+    uint64_t key;                  // xxh64(path)
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t content_hash;
+    uint32_t settings;
+    uint8_t outcome;
+    bool used;
+    size_t offset;                 // Latest record in the loaded file (compaction)
+    size_t length;
+} ManifestSlot;
+
+static int g_fd = -1;
+static ManifestSlot *g_slots = NULL;
+static size_t g_capacity = 0;
+static size_t g_live = 0;
+static int g_unsynced = 0;
+static pthread_mutex_t g_manifest_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// ============================================================================
+// Encoding helpers
+// ============================================================================
+
+static void put_le(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+// Encoder settings that change how big an output can get
+static uint32_t current_settings(void) {
+    return (uint32_t)g_config.jxl_effort |
+           (g_config.force_lossless ? 1u << 8 : 0) |
+           ((uint32_t)g_config.encoder << 9) |
+           (g_config.adaptive_effort ? 1u << 12 | (uint32_t)g_config.effort_low << 13 : 0);
+}
+
+// What a record is checked against: a predictive skip also depends on the
+// trial's margin (whole percent), so a new margin or --no-predict retries it
+static uint32_t outcome_settings(FileOutcome outcome) {
+    uint32_t settings = current_settings();
+    if (outcome == OUTCOME_PREDICTED && g_config.predict_margin >= 0) {
+        settings |= 1u << 17 | (uint32_t)(g_config.predict_margin * 100 + 0.5) << 18;
+    }
+    return settings;
+}
+
+// ============================================================================
+// In-memory index
+// ============================================================================
+
+static ManifestSlot *slot_find(uint64_t key) {
+    if (g_capacity == 0) return NULL;
+    size_t i = key & (g_capacity - 1);
+    while (g_slots[i].used) {
+        if (g_slots[i].key == key) return &g_slots[i];
+        i = (i + 1) & (g_capacity - 1);
+    }
+    return &g_slots[i];   // Empty slot where `key` would go
+}
+
+static bool index_grow(void) {
+    size_t capacity = g_capacity ? g_capacity * 2 : MANIFEST_INITIAL_SLOTS;
+    ManifestSlot *slots = calloc(capacity, sizeof(ManifestSlot));
+    if (!slots) return false;
+
+    ManifestSlot *old = g_slots;
+    size_t old_capacity = g_capacity;
+    g_slots = slots;
+    g_capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].used) *slot_find(old[i].key) = old[i];
+    }
+    free(old);
+    return true;
+}
+
+static ManifestSlot *index_upsert(uint64_t key) {
+    if ((g_live + 1) * 10 > g_capacity * 7 && !index_grow()) return NULL;
+    ManifestSlot *slot = slot_find(key);
+    if (!slot->used) {
+        memset(slot, 0, sizeof(*slot));
+        slot->used = true;
+        slot->key = key;
+        g_live++;
+    }
+    return slot;
+}
+
+// ============================================================================
+// Log file
+// ============================================================================
+
+static size_t encode_record(uint8_t *buf, const char *path, uint64_t size, int64_t mtime_ns,
+                            uint64_t content_hash, uint32_t settings, FileOutcome outcome) {
+    size_t path_len = strlen(path);
+    put_le(buf, MANIFEST_RECORD_MAGIC, 4);
+    put_le(buf + 4, path_len, 2);
+    buf[6] = (uint8_t)outcome;
+    buf[7] = 0;
+    put_le(buf + 8, settings, 4);
+    put_le(buf + 12, size, 8);
+    put_le(buf + 20, (uint64_t)mtime_ns, 8);
+    put_le(buf + 28, content_hash, 8);
+    memcpy(buf + MANIFEST_RECORD_HEADER, path, path_len);
+    size_t body = MANIFEST_RECORD_HEADER + path_len;
+    put_le(buf + body, xxh64(buf, body, 0), 8);
+    return body + 8;
+}
+
+// Parse one record at `p`; returns its length or 0 if torn/corrupt
+static size_t decode_record(const uint8_t *p, size_t avail, ManifestSlot *out) {
+    if (avail < MANIFEST_RECORD_HEADER + 8) return 0;
+    if (get_le(p, 4) != MANIFEST_RECORD_MAGIC) return 0;
+    size_t path_len = get_le(p + 4, 2);
+    size_t body = MANIFEST_RECORD_HEADER + path_len;
+    if (path_len == 0 || path_len >= MAX_PATH_LEN || avail < body + 8) return 0;
+    if (get_le(p + body, 8) != xxh64(p, body, 0)) return 0;
+
+    out->key = xxh64(p + MANIFEST_RECORD_HEADER, path_len, 0);
+    out->outcome = p[6];
+    out->settings = (uint32_t)get_le(p + 8, 4);
+    out->size = get_le(p + 12, 8);
+    out->mtime_ns = (int64_t)get_le(p + 20, 8);
+    out->content_hash = get_le(p + 28, 8);
+    return body + 8;
+}
+
+static uint8_t *read_all(int fd, size_t *size_out) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return NULL;
+    size_t size = (size_t)st.st_size;
+    uint8_t *buf = malloc(size ? size : 1);
+    if (!buf) return NULL;
+
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, buf + done, size - done, (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    *size_out = done;
+    return buf;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Rewrite the log with only the latest record per path (temp file + rename)
+static void compact(const char *path, const uint8_t *buf) {
+    char tmp[MAX_PATH_LEN];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+
+    bool ok = write_all(fd, (const uint8_t *)MANIFEST_FILE_MAGIC, MANIFEST_FILE_MAGIC_LEN);
+    size_t offset = MANIFEST_FILE_MAGIC_LEN;
+    for (size_t i = 0; ok && i < g_capacity; i++) {
+        if (!g_slots[i].used) continue;
+        ok = write_all(fd, buf + g_slots[i].offset, g_slots[i].length);
+        g_slots[i].offset = offset;
+        offset += g_slots[i].length;
+    }
+    if (ok && fsync(fd) == 0 && close(fd) == 0 && rename(tmp, path) == 0) {
+        if (g_config.verbose) log_info("📒 Manifest compacted: %zu entries", g_live);
+        return;
+    }
+    if (fd >= 0) close(fd);
+    unlink(tmp);
+}
+
+bool manifest_open(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_error("Cannot open manifest: %s (%s)", path, strerror(errno));
+        return false;
+    }
+
+    size_t size = 0;
+    uint8_t *buf = read_all(fd, &size);
+    if (!buf) {
+        close(fd);
+        return false;
+    }
+
+    bool fresh = (size == 0);
+    if (!fresh && (size < MANIFEST_FILE_MAGIC_LEN ||
+                   memcmp(buf, MANIFEST_FILE_MAGIC, MANIFEST_FILE_MAGIC_LEN) != 0)) {
+        log_error("Not a static2jxl manifest: %s", path);
+        free(buf);
+        close(fd);
+        return false;
+    }
+
+    // Replay the log; stop at the first torn/corrupt record
+    size_t pos = MANIFEST_FILE_MAGIC_LEN;
+    size_t records = 0;
+    while (!fresh && pos < size) {
+        ManifestSlot rec;
+        size_t len = decode_record(buf + pos, size - pos, &rec);
+        if (len == 0) break;
+        ManifestSlot *slot = index_upsert(rec.key);
+        if (!slot) break;
+        rec.used = true;
+        rec.offset = pos;
+        rec.length = len;
+        *slot = rec;
+        records++;
+        pos += len;
+    }
+
+    if (fresh) {
+        if (!write_all(fd, (const uint8_t *)MANIFEST_FILE_MAGIC, MANIFEST_FILE_MAGIC_LEN)) {
+            free(buf);
+            close(fd);
+            return false;
+        }
+    } else if (pos < size) {
+        log_warn("Manifest: dropping %zu bytes of incomplete records", size - pos);
+        if (ftruncate(fd, (off_t)pos) != 0) log_warn("Manifest truncate failed: %s", path);
+    }
+
+    if (records >= MANIFEST_COMPACT_MIN && records > 2 * g_live) {
+        close(fd);
+        compact(path, buf);
+        fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            free(buf);
+            return false;
+        }
+    }
+    free(buf);
+
+    // Appends only from here on
+    if (lseek(fd, 0, SEEK_END) < 0) {
+        close(fd);
+        return false;
+    }
+    g_fd = fd;
+    return true;
+}
+
+void manifest_close(void) {
+    pthread_mutex_lock(&g_manifest_mutex);
+    if (g_fd >= 0) {
+        fsync(g_fd);
+        close(g_fd);
+        g_fd = -1;
+    }
+    free(g_slots);
+    g_slots = NULL;
+    g_capacity = 0;
+    g_live = 0;
+    pthread_mutex_unlock(&g_manifest_mutex);
+}
+
+bool manifest_enabled(void) {
+    return g_fd >= 0;
+}
+
+// Outcome that lets this file be skipped, or OUTCOME_NONE.
+// With `content_hash`, a matching hash stands in for an unchanged mtime.
+FileOutcome manifest_lookup(const char *path, uint64_t size, int64_t mtime_ns,
+                            const uint64_t *content_hash) {
+    if (g_fd < 0) return OUTCOME_NONE;
+    uint64_t key = xxh64(path, strlen(path), 0);
+
+    pthread_mutex_lock(&g_manifest_mutex);
+    ManifestSlot *slot = slot_find(key);
+    ManifestSlot rec = (slot && slot->used) ? *slot : (ManifestSlot){ 0 };
+    pthread_mutex_unlock(&g_manifest_mutex);
+
+    if (!rec.used || rec.size != size) return OUTCOME_NONE;
+    if (content_hash ? (rec.content_hash == 0 || rec.content_hash != *content_hash)
+                     : rec.mtime_ns != mtime_ns) {
+        return OUTCOME_NONE;
+    }
+
+    switch (rec.outcome) {
+        case OUTCOME_CONVERTED:
+        case OUTCOME_SKIPPED:
+            return rec.outcome;
+        case OUTCOME_LARGER:
+            return rec.settings == current_settings() ? OUTCOME_LARGER : OUTCOME_NONE;
+        case OUTCOME_PREDICTED:
+            return (g_config.predict_margin >= 0 && rec.settings == outcome_settings(OUTCOME_PREDICTED))
+                   ? OUTCOME_PREDICTED : OUTCOME_NONE;
+        case OUTCOME_FAILED:
+            return (!g_config.retry_failed && rec.settings == current_settings())
+                   ? OUTCOME_FAILED : OUTCOME_NONE;
+        default:
+            return OUTCOME_NONE;
+    }
+}
+
+void manifest_record(const char *path, uint64_t size, int64_t mtime_ns,
+                     uint64_t content_hash, FileOutcome outcome) {
+    if (g_fd < 0 || strlen(path) >= MAX_PATH_LEN) return;
+
+    uint8_t buf[MANIFEST_RECORD_MAX];
+    uint32_t settings = outcome_settings(outcome);
+    size_t len = encode_record(buf, path, size, mtime_ns, content_hash, settings, outcome);
+    uint64_t key = xxh64(path, strlen(path), 0);
+
+    pthread_mutex_lock(&g_manifest_mutex);
+    // One write() per record: a crash tears at most the last one
+    if (g_fd >= 0 && write_all(g_fd, buf, len)) {
+        ManifestSlot *slot = index_upsert(key);
+        if (slot) {
+            slot->size = size;
+            slot->mtime_ns = mtime_ns;
+            slot->content_hash = content_hash;
+            slot->settings = settings;
+            slot->outcome = (uint8_t)outcome;
+        }
+        if (++g_unsynced >= MANIFEST_SYNC_EVERY) {
+            fsync(g_fd);
+            g_unsynced = 0;
+        }
+    }
+    pthread_mutex_unlock(&g_manifest_mutex);
+}
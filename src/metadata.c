@@ -0,0 +1,362 @@
+/**
+ * metadata.c - Native metadata reader for encode-time JXL boxes
+ *
+ * Extracts EXIF, XMP and ICC from the in-memory source so the in-process
+ * encoder can write them as `Exif` / `xml ` boxes and the ICC profile
+ * directly, instead of having exiftool rewrite the finished JXL:
+ *   - JPEG: APP1 Exif / APP1 XMP / APP2 ICC_PROFILE segments
+ *   - PNG:  eXIf, iTXt "XML:com.adobe.xmp" and iCCP chunks
+ *   - TIFF: XMP (700) and ICC (34675) tags of IFD0
+ *
+ * Anything else that exiftool would migrate (IPTC, comments, PNG text,
+ * EXIF-style TIFF tags, ...) sets `has_other`, which keeps the exiftool
+ * pass as a fallback for that file.
+ *
+ * The same marker walk reads a JPEG's frame header (SOFn), so the
+ * schedulers size a transcode by its real pixel count, not its file size.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "static2jxl.h"
+
+// Upper bound for inflated metadata chunks (defends against zip bombs)
+#define MAX_METADATA_SIZE (64 * 1024 * 1024)
+
+#define JPEG_EXIF_SIG "Exif\0\0"
+#define JPEG_EXIF_SIG_LEN 6
+#define JPEG_XMP_SIG "http://ns.adobe.com/xap/1.0/"
+#define JPEG_XMP_SIG_LEN 29             // Including the terminating NUL
+#define JPEG_ICC_SIG "ICC_PROFILE"
+#define JPEG_ICC_SIG_LEN 12             // Including the terminating NUL
+
+#define PNG_XMP_KEYWORD "XML:com.adobe.xmp"
+
+static uint16_t be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// ============================================================================
+// JPEG
+// ============================================================================
+
+static bool parse_jpeg(const uint8_t *buf, size_t size, SourceMetadata *md) {
+    const uint8_t *icc_chunks[256] = { NULL };
+    size_t icc_sizes[256] = { 0 };
+    int icc_count = 0;
+
+    size_t pos = 2;   // After SOI
+    while (pos + 4 <= size) {
+        if (buf[pos] != 0xFF) return false;
+        uint8_t marker = buf[pos + 1];
+        if (marker == 0xFF) {              // Fill byte
+            pos++;
+            continue;
+        }
+        if (marker == 0xDA || marker == 0xD9) break;   // Entropy-coded data follows
+
+        size_t len = be16(buf + pos + 2);
+        if (len < 2 || pos + 2 + len > size) return false;
+        const uint8_t *seg = buf + pos + 4;
+        size_t seg_len = len - 2;
+
+        if (marker == 0xE1 && seg_len >= JPEG_EXIF_SIG_LEN &&
+            memcmp(seg, JPEG_EXIF_SIG, JPEG_EXIF_SIG_LEN) == 0) {
+            md->exif = seg + JPEG_EXIF_SIG_LEN;
+            md->exif_size = seg_len - JPEG_EXIF_SIG_LEN;
+        } else if (marker == 0xE1 && seg_len >= JPEG_XMP_SIG_LEN &&
+                   memcmp(seg, JPEG_XMP_SIG, JPEG_XMP_SIG_LEN) == 0) {
+            md->xmp = seg + JPEG_XMP_SIG_LEN;
+            md->xmp_size = seg_len - JPEG_XMP_SIG_LEN;
+        } else if (marker == 0xE2 && seg_len >= JPEG_ICC_SIG_LEN + 2 &&
+                   memcmp(seg, JPEG_ICC_SIG, JPEG_ICC_SIG_LEN) == 0) {
+            // Multi-segment ICC: [sequence (1-based)][count][payload]
+            uint8_t seq = seg[JPEG_ICC_SIG_LEN];
+            icc_count = seg[JPEG_ICC_SIG_LEN + 1];
+            if (seq == 0 || seq > icc_count) return false;
+            icc_chunks[seq] = seg + JPEG_ICC_SIG_LEN + 2;
+            icc_sizes[seq] = seg_len - JPEG_ICC_SIG_LEN - 2;
+        } else if (marker == 0xE0 || marker == 0xEE) {
+            // JFIF / Adobe: structural, carried by the JPEG reconstruction data
+        } else if ((marker >= 0xE0 && marker <= 0xEF) || marker == 0xFE) {
+            md->has_other = true;          // IPTC (APP13), MPF, extended XMP, COM, ...
+        }
+        pos += 2 + len;
+    }
+
+    if (icc_count > 0) {
+        size_t total = 0;
+        for (int i = 1; i <= icc_count; i++) {
+            if (!icc_chunks[i]) return false;   // Missing segment
+            total += icc_sizes[i];
+        }
+        md->icc = malloc(total);
+        if (!md->icc) return false;
+        for (int i = 1; i <= icc_count; i++) {
+            memcpy(md->icc + md->icc_size, icc_chunks[i], icc_sizes[i]);
+            md->icc_size += icc_sizes[i];
+        }
+    }
+    return true;
+}
+
+// SOF0..SOF15 except DHT (C4), JPG (C8) and DAC (CC)
+static bool is_sof_marker(uint8_t marker) {
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+// Frame dimensions from the SOFn segment before the first scan
+bool jpeg_frame_info(const uint8_t *buf, size_t size, JpegFrame *frame) {
+    memset(frame, 0, sizeof(*frame));
+    if (size < 4 || buf[0] != 0xFF || buf[1] != 0xD8) return false;
+
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (buf[pos] != 0xFF) return false;
+        uint8_t marker = buf[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        if (marker == 0xDA || marker == 0xD9) return false;   // Scan before any frame
+
+        size_t len = be16(buf + pos + 2);
+        if (len < 2 || pos + 2 + len > size) return false;
+        if (is_sof_marker(marker)) {
+            if (len < 8) return false;
+            const uint8_t *seg = buf + pos + 4;    // [precision][height][width]
+            frame->height = be16(seg + 1);
+            frame->width = be16(seg + 3);
+            return frame->width > 0 && frame->height > 0;   // Height 0: set later by DNL
+        }
+        pos += 2 + len;
+    }
+    return false;
+}
+
+// ============================================================================
+// PNG
+// ============================================================================
+
+#ifdef HAVE_ZLIB
+static uint8_t *inflate_alloc(const uint8_t *src, size_t src_size, size_t *out_size) {
+    size_t capacity = src_size * 4 + 1024;
+    uint8_t *out = malloc(capacity);
+    if (!out) return NULL;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)src;
+    zs.avail_in = (uInt)src_size;
+
+    int rc;
+    do {
+        if (zs.total_out == capacity) {
+            if (capacity >= MAX_METADATA_SIZE) break;
+            capacity *= 2;
+            uint8_t *grown = realloc(out, capacity);
+            if (!grown) break;
+            out = grown;
+        }
+        zs.next_out = out + zs.total_out;
+        zs.avail_out = (uInt)(capacity - zs.total_out);
+        rc = inflate(&zs, Z_NO_FLUSH);
+    } while (rc == Z_OK);
+
+    *out_size = zs.total_out;
+    inflateEnd(&zs);
+    if (rc != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+#else
+static uint8_t *inflate_alloc(const uint8_t *src, size_t src_size, size_t *out_size) {
+    (void)src;
+    (void)src_size;
+    (void)out_size;
+    return NULL;   // Built without zlib: compressed chunks go through exiftool
+}
+#endif
+
+static void parse_png_itxt(const uint8_t *data, size_t len, SourceMetadata *md) {
+    const uint8_t *end = data + len;
+    const uint8_t *kw_end = memchr(data, 0, len);
+    if (!kw_end || strcmp((const char *)data, PNG_XMP_KEYWORD) != 0 || kw_end + 3 > end) {
+        md->has_other = true;
+        return;
+    }
+
+    bool compressed = kw_end[1] != 0;
+    const uint8_t *p = kw_end + 3;                       // Skip flag + method
+    const uint8_t *lang_end = memchr(p, 0, end - p);     // Language tag
+    if (!lang_end) { md->has_other = true; return; }
+    p = lang_end + 1;
+    const uint8_t *trans_end = memchr(p, 0, end - p);    // Translated keyword
+    if (!trans_end) { md->has_other = true; return; }
+    p = trans_end + 1;
+
+    if (!compressed) {
+        md->xmp = p;
+        md->xmp_size = (size_t)(end - p);
+        return;
+    }
+    md->xmp_owned = inflate_alloc(p, (size_t)(end - p), &md->xmp_size);
+    if (md->xmp_owned) {
+        md->xmp = md->xmp_owned;
+    } else {
+        md->xmp_size = 0;
+        md->has_other = true;
+    }
+}
+
+static void parse_png_iccp(const uint8_t *data, size_t len, SourceMetadata *md) {
+    const uint8_t *name_end = memchr(data, 0, len);
+    if (!name_end || name_end + 2 > data + len || name_end[1] != 0) {
+        md->has_other = true;
+        return;
+    }
+    const uint8_t *z = name_end + 2;
+    md->icc = inflate_alloc(z, (size_t)(data + len - z), &md->icc_size);
+    if (!md->icc) {
+        md->icc_size = 0;
+        md->has_other = true;
+    }
+}
+
+static bool parse_png(const uint8_t *buf, size_t size, SourceMetadata *md) {
+    size_t pos = 8;   // After signature
+    while (pos + 12 <= size) {
+        uint32_t len = be32(buf + pos);
+        const uint8_t *type = buf + pos + 4;
+        const uint8_t *data = buf + pos + 8;
+        if (len > size - pos - 12) return false;
+
+        if (memcmp(type, "IEND", 4) == 0) break;
+        if (memcmp(type, "eXIf", 4) == 0) {
+            md->exif = data;
+            md->exif_size = len;
+        } else if (memcmp(type, "iTXt", 4) == 0) {
+            parse_png_itxt(data, len, md);
+        } else if (memcmp(type, "iCCP", 4) == 0) {
+            parse_png_iccp(data, len, md);
+        } else if (memcmp(type, "tEXt", 4) == 0 || memcmp(type, "zTXt", 4) == 0 ||
+                   memcmp(type, "tIME", 4) == 0) {
+            md->has_other = true;
+        }
+        pos += 12 + (size_t)len;
+    }
+    return true;
+}
+
+// ============================================================================
+// TIFF (IFD0 only)
+// ============================================================================
+
+// Tags that only describe the raster - everything else is metadata
+static bool tiff_tag_is_structural(uint16_t tag) {
+    switch (tag) {
+        case 254: case 255: case 256: case 257: case 258: case 259: case 262:
+        case 266: case 273: case 277: case 278: case 279: case 282: case 283:
+        case 284: case 296: case 317: case 320: case 322: case 323: case 324:
+        case 325: case 338: case 339: case 340: case 341:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool parse_tiff(const uint8_t *buf, size_t size, SourceMetadata *md) {
+    if (size < 8) return false;
+    bool le = (buf[0] == 'I');
+#define TIFF16(p) (le ? (uint16_t)((p)[0] | ((p)[1] << 8)) : be16(p))
+#define TIFF32(p) (le ? ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | \
+                         ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24)) : be32(p))
+
+    uint32_t ifd = TIFF32(buf + 4);
+    if ((size_t)ifd + 2 > size) return false;
+    uint16_t count = TIFF16(buf + ifd);
+    if ((size_t)ifd + 2 + (size_t)count * 12 > size) return false;
+
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t *e = buf + ifd + 2 + (size_t)i * 12;
+        uint16_t tag = TIFF16(e);
+        uint16_t type = TIFF16(e + 2);
+        uint32_t n = TIFF32(e + 4);
+        uint32_t off = TIFF32(e + 8);
+
+        // XMP / ICC are BYTE or UNDEFINED arrays; > 4 bytes live at `off`
+        if ((tag == 700 || tag == 34675) && (type == 1 || type == 7) && n > 4 &&
+            (size_t)off + n <= size) {
+            if (tag == 700) {
+                md->xmp = buf + off;
+                md->xmp_size = n;
+            } else {
+                md->icc = malloc(n);
+                if (!md->icc) return false;
+                memcpy(md->icc, buf + off, n);
+                md->icc_size = n;
+            }
+        } else if (!tiff_tag_is_structural(tag)) {
+            md->has_other = true;          // Exif IFD, GPS, IPTC, descriptions, ...
+        }
+    }
+#undef TIFF16
+#undef TIFF32
+    return true;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+// Pointers in `md` may reference `buf`, which must outlive it
+bool parse_source_metadata(const uint8_t *buf, size_t size, SourceMetadata *md) {
+    memset(md, 0, sizeof(*md));
+    if (size < 8) return false;
+
+    bool ok;
+    if (buf[0] == 0xFF && buf[1] == 0xD8) {
+        ok = parse_jpeg(buf, size, md);
+    } else if (memcmp(buf, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        ok = parse_png(buf, size, md);
+    } else if ((buf[0] == 'I' && buf[1] == 'I') || (buf[0] == 'M' && buf[1] == 'M')) {
+        ok = parse_tiff(buf, size, md);
+    } else {
+        ok = true;    // PPM/BMP/TGA carry no embedded metadata
+    }
+
+    if (!ok) {
+        free_source_metadata(md);
+        md->has_other = true;          // Unparseable: let exiftool deal with it
+    }
+    return ok;
+}
+
+void free_source_metadata(SourceMetadata *md) {
+    free(md->icc);
+    free(md->xmp_owned);
+    md->icc = NULL;
+    md->xmp_owned = NULL;
+    md->icc_size = 0;
+    md->xmp = NULL;
+    md->xmp_size = 0;
+    md->exif = NULL;
+    md->exif_size = 0;
+}
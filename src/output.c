@@ -0,0 +1,280 @@
+/**
+ * output.c - Output placement and durability (--durability)
+ *
+ * On Linux an output starts as an anonymous O_TMPFILE inode in its final
+ * directory. The encoder, cjxl and the health check reach it through
+ * /proc/<pid>/fd/N, timestamps go on the descriptor (futimens), and
+ * linkat() names it only once it is complete: there is no temp name to
+ * create, rename and clean up, and a killed run leaves no partial .jxl.
+ * exiftool rewrites files by name (-overwrite_original), so an output that
+ * still needs it is linked under a temp name first. Without O_TMPFILE
+ * (macOS, NFS, no /proc) it is the named temp file and rename() as before.
+ *
+ * Durability, off by default:
+ *   file   fsync each output before it gets its name, then its directory
+ *   batch  fsync each output; directories are marked dirty and flushed
+ *          together every DURABILITY_BATCH_FILES files or
+ *          DURABILITY_BATCH_DIRS directories, and at the end of the run
+ * With `file` or `batch` an output's data reaches the disk before its name
+ * does: after a crash or power loss a converted file is either complete or
+ * still the original. The default (`none`) only covers the process being
+ * killed (no partial output is ever named); nothing is fsync'ed before
+ * linkat()/rename(), so after a crash or power loss a name may point at an
+ * empty or partial file.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE                // O_TMPFILE, linkat(AT_SYMLINK_FOLLOW)
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+static pthread_once_t g_proc_once = PTHREAD_ONCE_INIT;
+static bool g_proc_ok = false;
+
+// Directories with new entries not yet flushed (--durability batch).
+// Two buffers: one fills while the other is being flushed.
+static char g_dirty_a[DURABILITY_BATCH_DIRS][MAX_PATH_LEN];
+static char g_dirty_b[DURABILITY_BATCH_DIRS][MAX_PATH_LEN];
+static char (*g_dirty)[MAX_PATH_LEN] = g_dirty_a;
+static int g_dirty_count = 0;
+static int g_batch_files = 0;
+static pthread_mutex_t g_dirty_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_flush_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *DURABILITY_NAMES[] = { "none", "file", "batch" };
+
+bool durability_parse(const char *name, Durability *level) {
+    for (int i = 0; i <= DURABILITY_BATCH; i++) {
+        if (strcmp(name, DURABILITY_NAMES[i]) == 0) {
+            *level = (Durability)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *durability_name(Durability level) {
+    return DURABILITY_NAMES[level];
+}
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+static void check_proc(void) {
+    g_proc_ok = access("/proc/self/fd", X_OK) == 0;
+}
+
+static void dir_of(const char *path, char *out, size_t size) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        snprintf(out, size, ".");
+    } else if (slash == path) {
+        snprintf(out, size, "/");
+    } else {
+        snprintf(out, size, "%.*s", (int)(slash - path), path);
+    }
+}
+
+// An anonymous inode in the directory of `output`, reachable at `path`;
+// -1 where O_TMPFILE or /proc isn't available
+static int open_anonymous(const char *output, char *path, size_t size) {
+#ifdef O_TMPFILE
+    pthread_once(&g_proc_once, check_proc);
+    if (g_proc_ok) {
+        char dir[MAX_PATH_LEN];
+        dir_of(output, dir, sizeof(dir));
+        int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0666);
+        if (fd >= 0) {
+            // Our own pid, not "self": cjxl opens it from a child process
+            snprintf(path, size, "/proc/%d/fd/%d", (int)getpid(), fd);
+            return fd;
+        }
+    }
+#else
+    (void)output; (void)path; (void)size;
+#endif
+    return -1;
+}
+
+// Name an anonymous output "<output>.tmp" (replacing a leftover one)
+static bool link_named(Job *job) {
+    char name[MAX_PATH_LEN];
+    if (snprintf(name, sizeof(name), "%s.tmp", job->output) >= (int)sizeof(name)) return false;
+    unlink(name);
+    if (linkat(AT_FDCWD, job->temp_output, AT_FDCWD, name, AT_SYMLINK_FOLLOW) != 0) return false;
+    close(job->out_fd);
+    job->out_fd = -1;
+    strcpy(job->temp_output, name);
+    return true;
+}
+
+static void sync_dir_now(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    if (fsync(fd) == 0) stat_add(STAT_DIR_SYNCS, 1);
+    close(fd);
+}
+
+// ============================================================================
+// Output lifecycle
+// ============================================================================
+
+// Choose where the encoder writes `job->output` (which must be set):
+// an anonymous inode beside it where supported, else the named temp file
+void output_prepare(Job *job) {
+    job->out_fd = open_anonymous(job->output, job->temp_output, sizeof(job->temp_output));
+    if (job->out_fd >= 0) return;
+    if (g_config.in_place) {
+        snprintf(job->temp_output, sizeof(job->temp_output), "%s.jxl.tmp", job->input);
+    } else {
+        strcpy(job->temp_output, job->output);
+    }
+}
+
+// Throw the output away (an anonymous one just goes with its descriptor)
+void output_discard(Job *job) {
+    if (job->out_fd >= 0) {
+        close(job->out_fd);
+        job->out_fd = -1;
+    } else {
+        unlink(job->temp_output);
+    }
+}
+
+// Give an anonymous output a real name, for tools that rewrite it by path
+bool output_materialize(Job *job) {
+    return job->out_fd < 0 || link_named(job);
+}
+
+// A second candidate for job->output (adaptive effort's high-effort
+// encode), anonymous like output_prepare() where supported, else named
+// "<output>.hi". Returns its descriptor, -1 when named; false if it has
+// no usable name.
+bool output_candidate(const Job *job, char *path, size_t size, int *fd) {
+    *fd = open_anonymous(job->output, path, size);
+    return *fd >= 0 || snprintf(path, size, "%s.hi", job->output) < (int)size;
+}
+
+void output_candidate_discard(const char *path, int fd) {
+    if (fd >= 0) {
+        close(fd);
+    } else {
+        unlink(path);
+    }
+}
+
+// Make the candidate at `path` (descriptor `fd`) the job's output,
+// dropping the current one. On failure the candidate is left to
+// output_candidate_discard().
+bool output_adopt(Job *job, const char *path, int fd) {
+    if (fd >= 0) {
+        output_discard(job);
+        job->out_fd = fd;
+        strcpy(job->temp_output, path);
+        return true;
+    }
+    if (job->out_fd < 0) return rename(path, job->temp_output) == 0;
+
+    char name[MAX_PATH_LEN];
+    if (snprintf(name, sizeof(name), "%s.tmp", job->output) >= (int)sizeof(name)) return false;
+    if (rename(path, name) != 0) return false;
+    close(job->out_fd);
+    job->out_fd = -1;
+    strcpy(job->temp_output, name);
+    return true;
+}
+
+// Move the finished output to `job->output`, flushing its data first when
+// --durability asks for it. Sets job->out_size. On failure the output is
+// still at temp_output for output_discard().
+bool output_place(Job *job) {
+    bool sync = g_config.durability != DURABILITY_NONE;
+    int fd = job->out_fd;
+    bool own_fd = false;
+    if (fd < 0 && sync) {
+        fd = open(job->temp_output, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        own_fd = true;
+    }
+
+    struct stat st;
+    job->out_size = fd >= 0 && fstat(fd, &st) == 0 ? (size_t)st.st_size
+                                                    : get_file_size(job->temp_output);
+    if (sync) {
+        bool synced = fsync(fd) == 0;
+        if (own_fd) close(fd);
+        if (!synced) return false;
+        stat_add(STAT_FILE_SYNCS, 1);
+    }
+
+    if (job->out_fd >= 0) {
+        if (linkat(AT_FDCWD, job->temp_output, AT_FDCWD, job->output, AT_SYMLINK_FOLLOW) == 0) {
+            close(job->out_fd);
+            job->out_fd = -1;
+            return true;
+        }
+        // An older output is in the way: name it, then rename over that
+        if (errno != EEXIST || !link_named(job)) return false;
+    }
+    return strcmp(job->temp_output, job->output) == 0 || rename(job->temp_output, job->output) == 0;
+}
+
+// ============================================================================
+// Directory flushes
+// ============================================================================
+
+// The directory of `path` gained (or lost) an entry
+void output_sync_dir(const char *path) {
+    if (g_config.durability == DURABILITY_NONE) return;
+    char dir[MAX_PATH_LEN];
+    dir_of(path, dir, sizeof(dir));
+    if (g_config.durability == DURABILITY_FILE) {
+        sync_dir_now(dir);
+        return;
+    }
+
+    bool full;
+    for (;;) {
+        pthread_mutex_lock(&g_dirty_mutex);
+        bool found = false;
+        for (int i = g_dirty_count - 1; i >= 0 && !found; i--) {
+            found = strcmp(g_dirty[i], dir) == 0;
+        }
+        if (found || g_dirty_count < DURABILITY_BATCH_DIRS) {
+            if (!found) strcpy(g_dirty[g_dirty_count++], dir);
+            full = ++g_batch_files >= DURABILITY_BATCH_FILES || g_dirty_count == DURABILITY_BATCH_DIRS;
+            pthread_mutex_unlock(&g_dirty_mutex);
+            break;
+        }
+        pthread_mutex_unlock(&g_dirty_mutex);
+        output_sync_flush();       // No room: flush, then add
+    }
+    if (full) output_sync_flush();
+}
+
+// Flush every dirty directory (batch mode; also at the end of the run)
+void output_sync_flush(void) {
+    pthread_mutex_lock(&g_flush_mutex);
+    pthread_mutex_lock(&g_dirty_mutex);
+    char (*dirs)[MAX_PATH_LEN] = g_dirty;
+    int n = g_dirty_count;
+    g_dirty = dirs == g_dirty_a ? g_dirty_b : g_dirty_a;
+    g_dirty_count = 0;
+    g_batch_files = 0;
+    pthread_mutex_unlock(&g_dirty_mutex);
+
+    for (int i = 0; i < n; i++) sync_dir_now(dirs[i]);
+    pthread_mutex_unlock(&g_flush_mutex);
+}
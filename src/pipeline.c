@@ -0,0 +1,695 @@
+/**
+ * pipeline.c - Staged conversion pipeline
+ *
+ *   scan ──▶ [WorkQueue] ──▶ encode ──▶ [verify queue] ──▶ verify
+ *                                               ──▶ [finalize queue] ──▶ metadata/finalize
+ *
+ * Each stage has its own worker pool and the queues between stages are
+ * bounded, so a thread blocked in exiftool or a full decode no longer
+ * holds an encode slot, while a slow downstream stage still throttles
+ * encoding instead of piling up temp files.
+ *
+ * A reporter thread redraws progress on a timer from the summed counters,
+ * so the display never waits on whichever worker happens to be busy.
+ *
+ * A file leaves the pipeline at the first stage that decides its outcome
+ * (skip, rollback, failure) or after finalize. With --dedup, copies of a
+ * source already in flight wait for it instead of encoding, and leave
+ * with its outcome (see dedup.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+// ============================================================================
+// Bounded queue between stages
+// ============================================================================
+
+static bool sq_init(StageQueue *q, int capacity, int producers) {
+    memset(q, 0, sizeof(*q));
+    q->items = malloc(sizeof(Job *) * capacity);
+    if (!q->items) return false;
+    q->capacity = capacity;
+    q->producers = producers;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return true;
+}
+
+static void sq_destroy(StageQueue *q) {
+    free(q->items);
+    q->items = NULL;
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+// Blocks while the queue is full (backpressure on the upstream stage)
+static void sq_push(StageQueue *q, Job *job) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->count == q->capacity) {
+        pthread_cond_wait(&q->not_full, &q->mutex);
+    }
+    q->items[(q->head + q->count) % q->capacity] = job;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+// NULL once every producer has finished and the queue is drained
+static Job *sq_pop(StageQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->count == 0 && q->producers > 0) {
+        pthread_cond_wait(&q->not_empty, &q->mutex);
+    }
+    Job *job = NULL;
+    if (q->count > 0) {
+        job = q->items[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return job;
+}
+
+// Called once by each upstream worker as it exits
+static void sq_producer_done(StageQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    q->producers--;
+    if (q->producers == 0) pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+int sq_depth(StageQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    int depth = q->count;
+    pthread_mutex_unlock(&q->mutex);
+    return depth;
+}
+
+// ============================================================================
+// Stages
+// ============================================================================
+
+// Returns the number of workers inside the stage afterwards
+static int stage_busy(Pipeline *p, StageId stage, int delta) {
+    pthread_mutex_lock(&p->mutex);
+    int busy = p->busy[stage] += delta;
+    pthread_mutex_unlock(&p->mutex);
+    return busy;
+}
+
+static void stage_finalize(Job *job);
+static bool dedup_follow(Job *job, const DedupGroup *group);
+
+// A file has left the pipeline (any outcome). A dedup leader finishes the
+// copies parked on it here, so a converted group is cloned by the
+// finalize worker that placed the leader's output.
+static void job_done(Pipeline *p, Job *job) {
+    if (job->dedup_group) {
+        DedupGroup *group = job->dedup_group;
+        Job *copy = dedup_resolve(job);
+        while (copy) {
+            Job *next = copy->dedup_next;
+            if (dedup_follow(copy, group)) stage_finalize(copy);
+            job_done(p, copy);
+            copy = next;
+        }
+    }
+
+    if (job->ledger_claimed) ledger_release(job->input, job->outcome);
+
+    const FileEntry *entry = ft_get(job->file_idx);
+    stat_add(STAT_PROCESSED, 1);
+    stat_add(STAT_BYTES_DONE, entry->size);
+    timing_file_done(job, entry->type, entry->size,
+                     job->outcome == OUTCOME_CONVERTED ? job->out_size : 0);
+
+    pthread_mutex_lock(&p->mutex);
+    memcpy(p->last_input, job->input, sizeof(p->last_input));
+    pthread_mutex_unlock(&p->mutex);
+    free(job);
+}
+
+static void count_failure(bool health) {
+    stat_add(STAT_FAILED, 1);
+    if (health) stat_add(STAT_HEALTH_FAILED, 1);
+}
+
+// Remember how this file ended (manifest write is a no-op without --manifest)
+static void record_outcome(Job *job, FileOutcome outcome) {
+    job->outcome = outcome;
+    if (!manifest_enabled()) return;
+    const FileEntry *entry = ft_get(job->file_idx);
+    manifest_record(job->input, entry->size, entry->mtime_ns, job->content_hash, outcome);
+}
+
+// The source XXH64 is needed by the manifest and by dedup
+static bool content_hashed(void) {
+    return manifest_enabled() || g_config.dedup;
+}
+
+// A copy of a source whose leader has resolved: clone the leader's output
+// or take its outcome. Returns true when the clone is ready for finalize.
+static bool dedup_follow(Job *job, const DedupGroup *group) {
+    bool converted = group->outcome == OUTCOME_CONVERTED;
+    if (converted) output_prepare(job);
+    if (converted && !dedup_clone(group->output, job->temp_output)) {
+        log_error("Clone failed: %s → %s", group->output, job->output);
+        output_discard(job);
+        count_failure(false);
+        record_outcome(job, OUTCOME_FAILED);
+        return false;
+    }
+
+    stat_add(STAT_DEDUPLICATED, 1);
+    stat_add(STAT_DEDUP_BYTES, group->size);
+    stat_add(STAT_DEDUP_USEC, (uint64_t)(group->encode_seconds * 1e6));
+    if (group->outcome == OUTCOME_LARGER) {
+        stat_add(STAT_SKIPPED, 1);
+        stat_add(STAT_SKIPPED_LARGER, 1);
+    } else if (group->outcome == OUTCOME_PREDICTED) {
+        stat_add(STAT_SKIPPED, 1);
+        stat_add(STAT_PREDICTED_LARGER, 1);
+    } else if (!converted) {
+        stat_add(STAT_FAILED, 1);
+    }
+
+    if (converted) {
+        job->cloned = true;
+        job->metadata_native = group->metadata_native;
+        job->out_size = get_file_size(job->temp_output);
+        if (g_config.verbose) log_info("👯 Duplicate, cloned %s: %s", group->output, job->input);
+    } else if (group->outcome == OUTCOME_LARGER || group->outcome == OUTCOME_PREDICTED) {
+        record_outcome(job, group->outcome);
+        if (g_config.verbose) log_warn("⏭️  Duplicate of a rolled-back file: %s", job->input);
+    } else {
+        record_outcome(job, OUTCOME_FAILED);
+        log_error("Conversion failed (identical to a failed source): %s", job->input);
+    }
+    return converted;
+}
+
+// Adaptive mode: re-encode at the full effort when the planner expects it
+// to pay, keeping whichever output is smaller. Costs are in CPU-seconds
+// (wall time x encoder threads).
+static void escalate_effort(Job *job, const FileEntry *entry, const SourceBuffer *src,
+                            int threads, double low_cost) {
+    size_t low_out = get_file_size(job->temp_output);
+    double reserved;
+    if (low_out == 0 || !effort_plan_escalate(&g_effort, entry->size, low_out, low_cost, &reserved)) {
+        return;
+    }
+
+    char high[MAX_PATH_LEN];
+    int high_fd;
+    if (!output_candidate(job, high, sizeof(high), &high_fd)) {
+        effort_plan_record(&g_effort, reserved, 0, 0, 0, 0);   // Hand back the reservation
+        return;
+    }
+    bool native = false;
+    double started = monotonic_seconds();
+    bool ok = convert_to_jxl(job->input, src, high, false, g_config.jxl_effort, threads, &native);
+    double cost = (monotonic_seconds() - started) * threads;
+
+    size_t high_out = ok ? get_file_size(high) : 0;
+    bool keep = high_out > 0 && high_out < low_out && output_adopt(job, high, high_fd);
+    if (keep) {
+        job->metadata_native = native;
+    } else {
+        output_candidate_discard(high, high_fd);
+    }
+    effort_plan_record(&g_effort, reserved, cost, low_cost, keep ? low_out - high_out : 0, low_out);
+
+    if (g_config.verbose) {
+        log_info("🎚️  Effort %d → %d: %s (%s)", g_config.effort_low, g_config.jxl_effort,
+                 keep ? "kept" : "no gain", job->input);
+    }
+    stat_add(STAT_ESCALATED, 1);
+    if (keep) {
+        stat_add(STAT_ESCALATED_KEPT, 1);
+        stat_add(STAT_ESCALATED_SAVED, low_out - high_out);
+    }
+}
+
+// Encode one classified source held in memory (+ smart rollback).
+// With --dedup a copy of a source seen before is cloned or takes its
+// outcome instead; *parked means its leader is in flight and owns the
+// job from now on.
+static bool stage_encode_source(Job *job, const FileEntry *entry, const SourceBuffer *src,
+                                bool *parked) {
+    const char *input = job->input;
+
+    if (!get_output_path(input, job->output, sizeof(job->output))) {
+        log_warn("⚠️  Output path too long, skipped: %s", input);
+        stat_add(STAT_SKIPPED, 1);
+        job->outcome = OUTCOME_SKIPPED;
+        return false;
+    }
+
+    if (!g_config.in_place && file_exists(job->output)) {
+        if (g_config.verbose) log_warn("Skip: %s exists", job->output);
+        stat_add(STAT_SKIPPED, 1);
+        job->outcome = OUTCOME_SKIPPED;
+        return false;
+    }
+
+    bool is_jpeg = (entry->type == FILE_TYPE_JPEG);
+    job->jpeg_transcode = is_jpeg;
+    if (is_jpeg && g_config.validate == VALIDATE_FULL) {
+        // The reconstruction must be these exact bytes
+        job->jpeg_size = src->size;
+        job->jpeg_hash = content_hashed() ? job->content_hash : xxh64(src->data, src->size, 0);
+    }
+
+    if (g_config.dedup) {
+        DedupGroup *group = NULL;
+        switch (dedup_claim(job, src, &group)) {
+            case DEDUP_PARKED:   *parked = true; return false;
+            case DEDUP_RESOLVED: return dedup_follow(job, group);
+            default:             break;
+        }
+    }
+    output_prepare(job);
+
+    if (g_config.verbose) {
+        if (is_jpeg) {
+            log_info("Converting [JPEG → lossless transcode]: %s", input);
+        } else {
+            log_info("Converting [%s → lossless -d 0]: %s", get_file_type_name(entry->type), input);
+        }
+    }
+
+    // Convert (holding this file's share of the memory and core budgets).
+    // Memory first: a file waiting for RAM must not sit on idle cores.
+    double waited = monotonic_seconds();
+    size_t memory = memory_acquire(&g_memory, encode_memory_estimate(entry, src));
+    size_t pixels = encode_pixels_estimate(entry, src);
+    int threads = budget_acquire(&g_budget, encoder_threads_for(entry, pixels, g_budget.total,
+                                                                job->core_share));
+    if (g_config.verbose && threads > encoder_threads_for(entry, pixels, g_budget.total, 0)) {
+        log_info("🚀 Tail of the run: %d encoder threads for %s", threads, input);
+    }
+    double began = timing_end(&job->timing, PHASE_ADMIT, waited);
+
+    // Predictive skip: a cheap trial instead of a full encode + rollback
+    // (not tried when the trial's name doesn't fit)
+    char trial[MAX_PATH_LEN];
+    if (!is_jpeg && g_config.predict_margin >= 0 &&
+        snprintf(trial, sizeof(trial), "%s.trial", job->output) < (int)sizeof(trial)) {
+        size_t predicted = 0;
+        bool predicted_ok = predict_lossless_size(input, src, trial, threads, &predicted);
+        double tried = timing_end(&job->timing, PHASE_PREDICT, began);
+        if (predicted_ok && predicted > entry->size * (1.0 + g_config.predict_margin)) {
+            job->encode_seconds = (tried - began) * threads;
+            output_discard(job);
+            budget_release(&g_budget, threads);
+            memory_release(&g_memory, memory);
+            if (g_config.verbose) {
+                log_warn("⏭️  Predicted larger (+%.1f%% at effort 1): %s",
+                         ((double)predicted / entry->size - 1.0) * 100, input);
+            }
+            stat_add(STAT_SKIPPED, 1);
+            stat_add(STAT_PREDICTED_LARGER, 1);
+            record_outcome(job, OUTCOME_PREDICTED);
+            return false;
+        }
+    }
+
+    // Adaptive mode: lossless sources start at the low effort
+    bool adaptive = !is_jpeg && g_config.adaptive_effort;
+    int effort = adaptive ? g_config.effort_low : g_config.jxl_effort;
+    double started = monotonic_seconds();
+    bool converted = convert_to_jxl(input, src, job->temp_output, is_jpeg, effort, threads,
+                                   &job->metadata_native);
+    if (converted && adaptive) {
+        escalate_effort(job, entry, src, threads, (monotonic_seconds() - started) * threads);
+    }
+    double encoded = timing_end(&job->timing, PHASE_ENCODE, started);
+    job->encode_seconds = (encoded - began) * threads;
+    budget_release(&g_budget, threads);
+    memory_release(&g_memory, memory);
+    if (!converted) {
+        log_error("Conversion failed: %s", input);
+        output_discard(job);
+        count_failure(false);
+        record_outcome(job, OUTCOME_FAILED);
+        return false;
+    }
+
+    // Check output size - smart rollback if JXL is larger
+    job->out_size = get_file_size(job->temp_output);
+    bool larger = job->out_size > entry->size;
+    timing_end(&job->timing, PHASE_SIZE_CHECK, encoded);
+    if (larger) {
+        double increase = ((double)job->out_size / entry->size - 1.0) * 100;
+        if (g_config.verbose) {
+            log_warn("⏭️  Rollback: JXL larger than original (+%.1f%%): %s", increase, input);
+        }
+        output_discard(job);
+        stat_add(STAT_SKIPPED, 1);
+        stat_add(STAT_SKIPPED_LARGER, 1);
+        record_outcome(job, OUTCOME_LARGER);
+        return false;  // Not a failure, just skipped
+    }
+
+    return true;
+}
+
+// Ingest + encode + smart rollback. Returns true if the job moves on to verify
+// (false with *parked: a dedup leader took it over).
+static bool stage_encode(Job *job, bool *parked) {
+    FileEntry *entry = ft_get(job->file_idx);
+    const char *input = ft_path(entry, job->input, sizeof(job->input));
+
+    // Another host has it (--ledger): don't even read it
+    if (ledger_enabled()) {
+        if (!ledger_claim(input)) {
+            if (g_config.verbose) log_info("🗂️  Claimed by another node: %s", input);
+            stat_add(STAT_SKIPPED, 1);
+            job->outcome = OUTCOME_SKIPPED;
+            return false;
+        }
+        job->ledger_claimed = true;
+    }
+
+    // The only read of the source: detection, probing and encoding share it
+    SourceBuffer src;
+    double t = monotonic_seconds();
+    bool opened = source_open(input, &src);
+    t = timing_end(&job->timing, PHASE_READ, t);
+    if (!opened) {
+        log_error("Cannot read: %s", input);
+        count_failure(false);
+        job->outcome = OUTCOME_FAILED;
+        return false;
+    }
+
+    if (content_hashed()) job->content_hash = xxh64(src.data, src.size, 0);
+
+    // Touched but byte-identical since the last run: keep that decision
+    if (manifest_enabled()) {
+        FileOutcome known = manifest_lookup(input, src.size, 0, &job->content_hash);
+        if (known != OUTCOME_NONE) {
+            stat_add(STAT_SKIPPED, 1);
+            stat_add(STAT_SKIPPED_MANIFEST, 1);
+            // Refresh the mtime so the next scan skips it without a read
+            manifest_record(input, src.size, src.mtime_ns, job->content_hash, known);
+            source_close(&src);
+            job->outcome = OUTCOME_SKIPPED;
+            timing_end(&job->timing, PHASE_DETECT, t);
+            return false;
+        }
+    }
+
+    bool encoded = false;
+    bool candidate = classify_file(entry, input, &src);
+    timing_end(&job->timing, PHASE_DETECT, t);
+    if (candidate) {
+        encoded = stage_encode_source(job, entry, &src, parked);
+    } else {
+        record_outcome(job, OUTCOME_SKIPPED);
+    }
+    source_close(&src);
+    return encoded;
+}
+
+// Health check BEFORE metadata (fail fast). A clone copies an output that
+// already passed.
+static bool stage_verify(Job *job) {
+    if (job->cloned) return true;
+    double t = monotonic_seconds();
+    bool healthy = health_check_jxl(job);
+    timing_end(&job->timing, PHASE_VERIFY, t);
+    if (!healthy) {
+        log_error("Health check failed: %s", job->output);
+        output_discard(job);
+        count_failure(true);
+        record_outcome(job, OUTCOME_FAILED);
+        return false;
+    }
+    return true;
+}
+
+// Metadata layers, then the output takes its final name (replacing the
+// original in in-place mode)
+static void stage_finalize(Job *job) {
+    const FileEntry *entry = ft_get(job->file_idx);
+    const char *input = job->input;
+
+    // exiftool rewrites the output by name
+    if (!job->metadata_native && !output_materialize(job)) {
+        log_error("Cannot link output: %s", job->output);
+        output_discard(job);
+        count_failure(false);
+        record_outcome(job, OUTCOME_FAILED);
+        return;
+    }
+
+    // Order: xattr → internal (EXIF/XMP/ICC) → creation time → timestamps (LAST!)
+    migrate_metadata(input, job->temp_output, job->out_fd, job->metadata_native, &job->timing);
+
+    double t = monotonic_seconds();
+    if (!output_place(job)) {
+        timing_end(&job->timing, PHASE_RENAME, t);
+        log_error("Rename failed: %s", job->output);
+        output_discard(job);
+        count_failure(false);
+        record_outcome(job, OUTCOME_FAILED);
+        return;
+    }
+    // Delete original only after the output is in place
+    if (g_config.in_place && unlink(input) != 0) {
+        log_warn("Delete original failed: %s", input);
+    }
+    output_sync_dir(job->output);
+    timing_end(&job->timing, PHASE_RENAME, t);
+    size_t out_size = job->out_size;
+
+    stat_add(STAT_SUCCESS, 1);
+    if (!job->cloned) stat_add(STAT_HEALTH_PASSED, 1);
+    stat_add(STAT_BYTES_INPUT, entry->size);
+    stat_add(STAT_BYTES_OUTPUT, out_size);
+    record_outcome(job, OUTCOME_CONVERTED);
+
+    if (g_config.verbose) {
+        double ratio = (1.0 - (double)out_size / entry->size) * 100;
+        log_success("Done: %s (%.1f%% smaller)", job->output, ratio);
+    }
+}
+
+// ============================================================================
+// Stage workers
+// ============================================================================
+
+typedef struct {
+    Pipeline *pipe;
+    int worker_id;
+} StageArg;
+
+// Read ahead the files this worker is due to take next (--prefetch)
+static void prefetch_ahead(WorkQueue *q, int worker) {
+    int next[MAX_PREFETCH];
+    char path[MAX_PATH_LEN];
+    int n = wq_peek(q, worker, next, g_config.prefetch);
+    for (int i = 0; i < n; i++) {
+        FileEntry *entry = ft_get(next[i]);
+        if (__atomic_exchange_n(&entry->prefetched, 1, __ATOMIC_RELAXED)) continue;
+        prefetch_hint(ft_path(entry, path, sizeof(path)));
+    }
+}
+
+static void *encode_worker(void *arg) {
+    StageArg *sarg = (StageArg *)arg;
+    Pipeline *p = sarg->pipe;
+    int idx;
+
+    while (!g_interrupted && wq_pop(p->source, sarg->worker_id, &idx)) {
+        if (g_config.prefetch > 0) prefetch_ahead(p->source, sarg->worker_id);
+        Job *job = calloc(1, sizeof(Job));
+        if (!job) {
+            log_error("Memory allocation failed: %s", ft_get(idx)->name);
+            count_failure(false);
+            continue;
+        }
+        job->file_idx = idx;
+        job->out_fd = -1;
+        job->timing.started = monotonic_seconds();
+        job->timing.file = job->input;
+
+        bool parked = false;
+        int encoding = stage_busy(p, STAGE_ENCODE, 1);
+        // Last files of the run: split the cores among the encodes left
+        if (wq_drained(p->source)) job->core_share = g_budget.total / encoding;
+        bool next = stage_encode(job, &parked);
+        stage_busy(p, STAGE_ENCODE, -1);
+
+        if (next) {
+            sq_push(&p->verify_q, job);
+        } else if (!parked) {
+            job_done(p, job);
+        }
+    }
+
+    sq_producer_done(&p->verify_q);
+    return NULL;
+}
+
+static void *verify_worker(void *arg) {
+    Pipeline *p = ((StageArg *)arg)->pipe;
+    Job *job;
+
+    while ((job = sq_pop(&p->verify_q)) != NULL) {
+        stage_busy(p, STAGE_VERIFY, 1);
+        bool next = stage_verify(job);
+        stage_busy(p, STAGE_VERIFY, -1);
+
+        if (next) {
+            sq_push(&p->finalize_q, job);
+        } else {
+            job_done(p, job);
+        }
+    }
+
+    sq_producer_done(&p->finalize_q);
+    return NULL;
+}
+
+static void *finalize_worker(void *arg) {
+    Pipeline *p = ((StageArg *)arg)->pipe;
+    Job *job;
+
+    while ((job = sq_pop(&p->finalize_q)) != NULL) {
+        stage_busy(p, STAGE_FINALIZE, 1);
+        stage_finalize(job);
+        stage_busy(p, STAGE_FINALIZE, -1);
+        job_done(p, job);
+    }
+    return NULL;
+}
+
+// Redraws progress every PROGRESS_TTY_INTERVAL on a terminal, or logs a
+// plain line every PROGRESS_LOG_INTERVAL when stdout is captured
+static void *report_worker(void *arg) {
+    Pipeline *p = (Pipeline *)arg;
+    double interval = g_config.progress_tty ? PROGRESS_TTY_INTERVAL : PROGRESS_LOG_INTERVAL;
+    char name[MAX_PATH_LEN];
+    ProgressMeter meter;
+    progress_meter_init(&meter);
+
+    pthread_mutex_lock(&p->mutex);
+    while (p->reporting) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long ns = deadline.tv_nsec + (long)((interval - (long)interval) * 1e9);
+        deadline.tv_sec += (time_t)interval + ns / 1000000000L;
+        deadline.tv_nsec = ns % 1000000000L;
+        int rc = 0;
+        while (p->reporting && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&p->report_cond, &p->mutex, &deadline);
+        }
+        if (!p->reporting) break;
+        memcpy(name, p->last_input, sizeof(name));
+        pthread_mutex_unlock(&p->mutex);
+
+        Progress pr;
+        progress_sample(&meter, &pr);
+        if (pr.total > 0) show_progress(&pr, name[0] ? name : NULL, p);
+
+        pthread_mutex_lock(&p->mutex);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return NULL;
+}
+
+// Snapshot of one stage for the progress line
+void pipeline_stage_status(Pipeline *p, StageId stage, int *busy, int *workers, int *queued) {
+    pthread_mutex_lock(&p->mutex);
+    *busy = p->busy[stage];
+    pthread_mutex_unlock(&p->mutex);
+    *workers = p->workers[stage];
+
+    switch (stage) {
+        case STAGE_ENCODE:   *queued = wq_pending(p->source); break;
+        case STAGE_VERIFY:   *queued = sq_depth(&p->verify_q); break;
+        case STAGE_FINALIZE: *queued = sq_depth(&p->finalize_q); break;
+        default:             *queued = 0; break;
+    }
+}
+
+// Runs every stage until `source` is closed and drained
+bool pipeline_run(WorkQueue *source, int encode_workers, int verify_workers, int finalize_workers) {
+    Pipeline p;
+    memset(&p, 0, sizeof(p));
+    p.source = source;
+    p.workers[STAGE_ENCODE] = encode_workers;
+    p.workers[STAGE_VERIFY] = verify_workers;
+    p.workers[STAGE_FINALIZE] = finalize_workers;
+    pthread_mutex_init(&p.mutex, NULL);
+    pthread_cond_init(&p.report_cond, NULL);
+
+    if (!sq_init(&p.verify_q, g_config.queue_depth, encode_workers)) return false;
+    if (!sq_init(&p.finalize_q, g_config.queue_depth, verify_workers)) {
+        sq_destroy(&p.verify_q);
+        return false;
+    }
+
+    int total = encode_workers + verify_workers + finalize_workers;
+    pthread_t *threads = malloc(sizeof(pthread_t) * total);
+    StageArg *args = malloc(sizeof(StageArg) * total);
+    if (!threads || !args) {
+        free(threads);
+        free(args);
+        sq_destroy(&p.verify_q);
+        sq_destroy(&p.finalize_q);
+        return false;
+    }
+
+    pthread_t reporter;
+    p.reporting = true;
+    if (pthread_create(&reporter, NULL, report_worker, &p) != 0) p.reporting = false;
+
+    int t = 0;
+    for (int i = 0; i < encode_workers; i++, t++) {
+        args[t] = (StageArg){ &p, i };
+        pthread_create(&threads[t], NULL, encode_worker, &args[t]);
+    }
+    for (int i = 0; i < verify_workers; i++, t++) {
+        args[t] = (StageArg){ &p, i };
+        pthread_create(&threads[t], NULL, verify_worker, &args[t]);
+    }
+    for (int i = 0; i < finalize_workers; i++, t++) {
+        args[t] = (StageArg){ &p, i };
+        pthread_create(&threads[t], NULL, finalize_worker, &args[t]);
+    }
+
+    for (int i = 0; i < total; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    output_sync_flush();
+    if (p.reporting) {
+        pthread_mutex_lock(&p.mutex);
+        p.reporting = false;
+        pthread_cond_signal(&p.report_cond);
+        pthread_mutex_unlock(&p.mutex);
+        pthread_join(reporter, NULL);
+    }
+
+    free(threads);
+    free(args);
+    sq_destroy(&p.verify_q);
+    sq_destroy(&p.finalize_q);
+    pthread_cond_destroy(&p.report_cond);
+    pthread_mutex_destroy(&p.mutex);
+    return true;
+}
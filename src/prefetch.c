@@ -0,0 +1,395 @@
+/**
+ * prefetch.c - Source read-ahead (--prefetch)
+ *
+ * While a worker encodes one file, the next files in its deque are pulled
+ * into the page cache, so source_open() finds them resident instead of
+ * faulting them in one round trip at a time from network storage. A hint
+ * opens the file, asks the kernel to read up to PREFETCH_MAX_BYTES of it
+ * (fadvise WILLNEED) and closes it again. Nothing is held: a file that is
+ * stolen by another worker, or reached before its hint completes, costs
+ * nothing extra. Hints are dropped, never waited for, when the queue is
+ * full.
+ *
+ * On Linux the hints go through one io_uring. The submitter thread turns
+ * each into an openat and, once the descriptor is known, a fadvise
+ * hard-linked to its close, with up to PREFETCH_INFLIGHT files in flight
+ * and no thread parked per file. It sleeps in io_uring_enter() and is
+ * woken by an eventfd poll for new hints. Everywhere else - macOS, kernels
+ * without the opcodes, io_uring blocked by a seccomp policy - a few
+ * threads do the same with open / posix_fadvise (F_RDADVISE on macOS) /
+ * close.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_FAST_POLL       // Header new enough for OPENAT/FADVISE/CLOSE (5.6+)
+#define PREFETCH_URING 1
+#endif
+#endif
+
+#include "static2jxl.h"
+
+// Hints waiting for a free slot (a ring of paths)
+static char g_hints[PREFETCH_QUEUE][MAX_PATH_LEN];
+static int g_hint_head = 0;
+static int g_hint_count = 0;
+static bool g_stopping = false;
+static pthread_mutex_t g_hint_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_hint_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t g_threads[PREFETCH_THREADS];
+static int g_thread_count = 0;
+static const char *g_backend = "off";
+
+// Takes the oldest hint into `path`; call with g_hint_mutex held
+static bool hint_take(char *path) {
+    if (g_hint_count == 0) return false;
+    strcpy(path, g_hints[g_hint_head]);
+    g_hint_head = (g_hint_head + 1) % PREFETCH_QUEUE;
+    g_hint_count--;
+    return true;
+}
+
+// ============================================================================
+// Thread-pool backend
+// ============================================================================
+
+static void advise_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+#ifdef __APPLE__
+    struct radvisory ra = { .ra_offset = 0, .ra_count = PREFETCH_MAX_BYTES };
+    fcntl(fd, F_RDADVISE, &ra);
+#else
+    posix_fadvise(fd, 0, PREFETCH_MAX_BYTES, POSIX_FADV_WILLNEED);
+#endif
+    close(fd);
+    stat_add(STAT_PREFETCHED, 1);
+}
+
+static void *pool_worker(void *arg) {
+    (void)arg;
+    char path[MAX_PATH_LEN];
+    pthread_mutex_lock(&g_hint_mutex);
+    for (;;) {
+        while (g_hint_count == 0 && !g_stopping) pthread_cond_wait(&g_hint_cond, &g_hint_mutex);
+        if (g_stopping) break;
+        hint_take(path);
+        pthread_mutex_unlock(&g_hint_mutex);
+        advise_file(path);
+        pthread_mutex_lock(&g_hint_mutex);
+    }
+    pthread_mutex_unlock(&g_hint_mutex);
+    return NULL;
+}
+
+// ============================================================================
+// io_uring backend (Linux)
+// ============================================================================
+
+#ifdef PREFETCH_URING
+
+#define URING_WAKE UINT64_MAX      // user_data of the eventfd poll
+
+typedef enum { OP_OPEN, OP_ADVISE, OP_CLOSE } UringOp;
+
+typedef struct {
+    char path[MAX_PATH_LEN];       // openat reads it asynchronously: stable until done
+    bool busy;
+} UringSlot;
+
+static struct {
+    int fd;
+    int wake_fd;                   // eventfd: a hint arrived or we are stopping
+    uint64_t wake_value;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned to_submit;
+    UringSlot slots[PREFETCH_INFLIGHT];
+    int in_flight;
+} g_ring = { .fd = -1, .wake_fd = -1 };
+
+static int uring_enter(unsigned submit, unsigned wait) {
+    return (int)syscall(__NR_io_uring_enter, g_ring.fd, submit, wait,
+                        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Next free SQE (the ring is sized so that one always exists)
+static struct io_uring_sqe *uring_sqe(void) {
+    unsigned tail = *g_ring.sq_tail + g_ring.to_submit;
+    unsigned index = tail & *g_ring.sq_mask;
+    struct io_uring_sqe *sqe = &g_ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    g_ring.sq_array[index] = index;
+    g_ring.to_submit++;
+    return sqe;
+}
+
+static void uring_submit(unsigned wait) {
+    __atomic_store_n(g_ring.sq_tail, *g_ring.sq_tail + g_ring.to_submit, __ATOMIC_RELEASE);
+    unsigned submit = g_ring.to_submit;
+    g_ring.to_submit = 0;
+    while (uring_enter(submit, wait) < 0 && errno == EINTR) submit = 0;
+}
+
+static void uring_wake(void) {
+    if (g_ring.wake_fd < 0) return;
+    uint64_t one = 1;
+    ssize_t n = write(g_ring.wake_fd, &one, sizeof(one));
+    (void)n;                       // EAGAIN: a wake-up is already pending
+}
+
+static void arm_wake(void) {
+    struct io_uring_sqe *sqe = uring_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = g_ring.wake_fd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = URING_WAKE;
+}
+
+static uint64_t slot_data(int slot, UringOp op) {
+    return (uint64_t)op << 32 | (uint32_t)slot;
+}
+
+static void submit_open(int slot) {
+    struct io_uring_sqe *sqe = uring_sqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)g_ring.slots[slot].path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = slot_data(slot, OP_OPEN);
+}
+
+// The close is hard-linked: it runs even when the fadvise fails
+static void submit_advise_close(int slot, int fd) {
+    struct io_uring_sqe *sqe = uring_sqe();
+    sqe->opcode = IORING_OP_FADVISE;
+    sqe->fd = fd;
+    sqe->len = PREFETCH_MAX_BYTES;
+    sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+    sqe->flags = IOSQE_IO_HARDLINK;
+    sqe->user_data = slot_data(slot, OP_ADVISE);
+
+    sqe = uring_sqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = slot_data(slot, OP_CLOSE);
+}
+
+// Returns true when the eventfd fired
+static bool reap(void) {
+    bool woken = false;
+    unsigned head = *g_ring.cq_head;
+    unsigned tail = __atomic_load_n(g_ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &g_ring.cqes[head & *g_ring.cq_mask];
+        if (cqe->user_data == URING_WAKE) {
+            woken = true;
+            continue;
+        }
+        int slot = (int)(uint32_t)cqe->user_data;
+        UringOp op = (UringOp)(cqe->user_data >> 32);
+        if (op == OP_OPEN && cqe->res >= 0) {
+            submit_advise_close(slot, cqe->res);
+        } else if (op == OP_OPEN || op == OP_CLOSE) {
+            if (op == OP_CLOSE) stat_add(STAT_PREFETCHED, 1);
+            g_ring.slots[slot].busy = false;
+            g_ring.in_flight--;
+        }
+    }
+    __atomic_store_n(g_ring.cq_head, head, __ATOMIC_RELEASE);
+    return woken;
+}
+
+static void *uring_worker(void *arg) {
+    (void)arg;
+    arm_wake();
+    bool stopping = false;
+    while (!stopping || g_ring.in_flight > 0) {
+        // Move queued hints into free slots
+        pthread_mutex_lock(&g_hint_mutex);
+        stopping = g_stopping;
+        for (int s = 0; s < PREFETCH_INFLIGHT && !stopping; s++) {
+            if (g_ring.slots[s].busy || !hint_take(g_ring.slots[s].path)) continue;
+            g_ring.slots[s].busy = true;
+            g_ring.in_flight++;
+            submit_open(s);
+        }
+        pthread_mutex_unlock(&g_hint_mutex);
+        if (stopping && g_ring.in_flight == 0) break;
+
+        uring_submit(1);
+        if (reap()) {
+            ssize_t n = read(g_ring.wake_fd, &g_ring.wake_value, sizeof(g_ring.wake_value));
+            (void)n;               // EAGAIN: drained by an earlier wake-up
+            arm_wake();
+        }
+    }
+    return NULL;
+}
+
+static void uring_unmap(void) {
+    if (g_ring.sqes) munmap(g_ring.sqes, g_ring.sqes_size);
+    if (g_ring.cq_ring && g_ring.cq_ring != g_ring.sq_ring) munmap(g_ring.cq_ring, g_ring.cq_ring_size);
+    if (g_ring.sq_ring) munmap(g_ring.sq_ring, g_ring.sq_ring_size);
+    if (g_ring.fd >= 0) close(g_ring.fd);
+    if (g_ring.wake_fd >= 0) close(g_ring.wake_fd);
+    g_ring.sqes = NULL;
+    g_ring.sq_ring = g_ring.cq_ring = NULL;
+    g_ring.fd = g_ring.wake_fd = -1;
+}
+
+// Every opcode a hint uses must be there (IORING_REGISTER_PROBE, 5.6+)
+static bool uring_supports(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (!probe) return false;
+    bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    const int needed[] = { IORING_OP_OPENAT, IORING_OP_FADVISE, IORING_OP_CLOSE, IORING_OP_POLL_ADD };
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        ok = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+static bool uring_open(void) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // Each slot needs up to two SQEs at once, plus the eventfd poll
+    g_ring.fd = (int)syscall(__NR_io_uring_setup, 2 * PREFETCH_INFLIGHT + 2, &p);
+    if (g_ring.fd < 0) return false;
+    if (!(p.features & IORING_FEAT_NODROP) || !uring_supports(g_ring.fd)) goto fail;
+    g_ring.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (g_ring.wake_fd < 0) goto fail;
+
+    g_ring.sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    g_ring.cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (g_ring.cq_ring_size > g_ring.sq_ring_size) g_ring.sq_ring_size = g_ring.cq_ring_size;
+    }
+    g_ring.sq_ring = mmap(NULL, g_ring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          g_ring.fd, IORING_OFF_SQ_RING);
+    if (g_ring.sq_ring == MAP_FAILED) {
+        g_ring.sq_ring = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        g_ring.cq_ring = g_ring.sq_ring;
+    } else {
+        g_ring.cq_ring = mmap(NULL, g_ring.cq_ring_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, g_ring.fd, IORING_OFF_CQ_RING);
+        if (g_ring.cq_ring == MAP_FAILED) {
+            g_ring.cq_ring = NULL;
+            goto fail;
+        }
+    }
+    g_ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    g_ring.sqes = mmap(NULL, g_ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       g_ring.fd, IORING_OFF_SQES);
+    if (g_ring.sqes == MAP_FAILED) {
+        g_ring.sqes = NULL;
+        goto fail;
+    }
+
+    uint8_t *sq = g_ring.sq_ring;
+    uint8_t *cq = g_ring.cq_ring;
+    g_ring.sq_head = (unsigned *)(sq + p.sq_off.head);
+    g_ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    g_ring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    g_ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+    g_ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+    g_ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    g_ring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    g_ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+
+fail:
+    uring_unmap();
+    return false;
+}
+
+#endif
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void prefetch_start(void) {
+    if (g_config.prefetch <= 0) return;
+    g_stopping = false;
+#ifdef PREFETCH_URING
+    if (uring_open()) {
+        if (pthread_create(&g_threads[0], NULL, uring_worker, NULL) == 0) {
+            g_thread_count = 1;
+            g_backend = "io_uring";
+            return;
+        }
+        uring_unmap();
+    }
+#endif
+    for (int i = 0; i < PREFETCH_THREADS; i++) {
+        if (pthread_create(&g_threads[g_thread_count], NULL, pool_worker, NULL) == 0) g_thread_count++;
+    }
+    g_backend = g_thread_count > 0 ? "threads" : "off";
+}
+
+const char *prefetch_backend(void) {
+    return g_backend;
+}
+
+// Queue `path` for read-ahead; dropped if the queue is full or stopped
+void prefetch_hint(const char *path) {
+    if (g_thread_count == 0) return;
+    pthread_mutex_lock(&g_hint_mutex);
+    bool queued = !g_stopping && g_hint_count < PREFETCH_QUEUE;
+    if (queued) {
+        snprintf(g_hints[(g_hint_head + g_hint_count) % PREFETCH_QUEUE], MAX_PATH_LEN, "%s", path);
+        g_hint_count++;
+        pthread_cond_signal(&g_hint_cond);
+    }
+    pthread_mutex_unlock(&g_hint_mutex);
+#ifdef PREFETCH_URING
+    if (queued) uring_wake();
+#endif
+}
+
+// Drops queued hints and waits for those in flight
+void prefetch_stop(void) {
+    if (g_thread_count == 0) return;
+    pthread_mutex_lock(&g_hint_mutex);
+    g_stopping = true;
+    g_hint_count = 0;
+    pthread_cond_broadcast(&g_hint_cond);
+    pthread_mutex_unlock(&g_hint_mutex);
+#ifdef PREFETCH_URING
+    uring_wake();
+#endif
+    for (int i = 0; i < g_thread_count; i++) pthread_join(g_threads[i], NULL);
+    g_thread_count = 0;
+#ifdef PREFETCH_URING
+    uring_unmap();
+#endif
+}
@@ -0,0 +1,213 @@
+/**
+ * scanner.c - Parallel streaming directory scanner
+ *
+ * Several walker threads share a stack of directories still to be read.
+ * Each walker opens one directory, lists it with readdir(), classifies
+ * entries by d_type (falling back to fstatat() relative to the directory
+ * fd for DT_UNKNOWN and symlinks) and pushes subdirectories back onto the
+ * stack. Files are appended to the file table and, when a sink is given,
+ * pushed straight into the work queue, so encoding starts while the rest
+ * of the tree is still being scanned.
+ *
+ * The scan ends when the stack is empty and no walker is inside a
+ * directory; the first walker to notice closes the sink (with --ledger,
+ * once other hosts are done with the files they hold).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+// A directory waiting to be walked
+typedef struct ScanDir {
+    struct ScanDir *next;
+    char path[];
+} ScanDir;
+
+static bool push_dir(Scanner *s, const char *path) {
+    size_t len = strlen(path);
+    ScanDir *dir = malloc(sizeof(ScanDir) + len + 1);
+    if (!dir) return false;
+    memcpy(dir->path, path, len + 1);
+
+    pthread_mutex_lock(&s->mutex);
+    dir->next = s->pending;
+    s->pending = dir;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    return true;
+}
+
+// Enter a found file into the table and, with a sink, the work queue.
+// False only when the file table is out of memory.
+bool scan_queue_file(WorkQueue *sink, int dir, const char *path, const char *name,
+                     size_t size, int64_t mtime_ns) {
+    // Unchanged since the last run: never enters the table or the pipeline
+    if (mtime_ns != 0 && manifest_lookup(path, size, mtime_ns, NULL) != OUTCOME_NONE) {
+        stat_add(STAT_SKIPPED_MANIFEST, 1);
+        return true;
+    }
+
+    int idx = ft_add_file(dir, name, size, mtime_ns);
+    if (idx < 0) return false;
+
+    stat_add(STAT_TOTAL, 1);
+    if (mtime_ns != 0) {           // stat'ed: the progress ETA can weigh it by size
+        stat_add(STAT_FILES_SIZED, 1);
+        stat_add(STAT_BYTES_SCANNED, size);
+    }
+
+    if (sink) wq_push(sink, idx);
+    return true;
+}
+
+static void add_file(Scanner *s, int dir, const char *path, const char *name,
+                     size_t size, int64_t mtime_ns) {
+    if (!scan_queue_file(s->sink, dir, path, name, size, mtime_ns)) {
+        if (!s->failed) log_error("Memory allocation failed: file table is full");
+        s->failed = true;
+    }
+}
+
+static void walk_dir(Scanner *s, const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *d = (fd >= 0) ? fdopendir(fd) : NULL;
+    if (!d) {
+        if (fd >= 0) close(fd);
+        log_error("Cannot open directory: %s", dir);
+        return;
+    }
+
+    // Interned lazily: directories without files cost nothing
+    int dir_idx = -1;
+    struct dirent *entry;
+    char path[MAX_PATH_LEN];
+
+    while (!g_interrupted && !s->failed && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        int n = snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (n < 0 || (size_t)n >= sizeof(path)) continue;
+
+        bool is_dir = (entry->d_type == DT_DIR);
+        bool is_reg = (entry->d_type == DT_REG);
+        size_t size = 0;
+        int64_t mtime_ns = 0;
+
+        // stat only when d_type can't answer, or sizes are needed up front
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK || (is_reg && s->need_sizes)) {
+            struct stat st;
+            if (fstatat(dirfd(d), entry->d_name, &st, 0) != 0) continue;
+            is_dir = S_ISDIR(st.st_mode);
+            is_reg = S_ISREG(st.st_mode);
+            size = (size_t)st.st_size;
+            mtime_ns = STAT_MTIME_NS(st);
+        }
+
+        if (is_dir) {
+            if (s->recursive && !push_dir(s, path)) log_error("Memory allocation failed: %s", path);
+        } else if (is_reg) {
+            if (dir_idx < 0 && (dir_idx = ft_add_dir(dir)) < 0) {
+                log_error("Memory allocation failed: %s", dir);
+                s->failed = true;
+                break;
+            }
+            add_file(s, dir_idx, path, entry->d_name, size, mtime_ns);
+        }
+    }
+    closedir(d);
+}
+
+static void *scan_worker(void *arg) {
+    Scanner *s = (Scanner *)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&s->mutex);
+        while (!s->pending && s->active > 0 && !g_interrupted) {
+            pthread_cond_wait(&s->cond, &s->mutex);
+        }
+        if (!s->pending || g_interrupted) {
+            // Tree exhausted (or interrupted): wake the other walkers too
+            pthread_cond_broadcast(&s->cond);
+            pthread_mutex_unlock(&s->mutex);
+            if (s->sink) ledger_close_sink(s->sink);   // Nothing more will be pushed
+            break;
+        }
+        ScanDir *dir = s->pending;
+        s->pending = dir->next;
+        s->active++;
+        pthread_mutex_unlock(&s->mutex);
+
+        walk_dir(s, dir->path);
+        free(dir);
+
+        pthread_mutex_lock(&s->mutex);
+        s->active--;
+        if (s->active == 0 && !s->pending) pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->mutex);
+    }
+    return NULL;
+}
+
+// Starts `threads` walkers on `root`. With a `sink`, files are queued as
+// they are found and the sink is closed when the scan finishes.
+bool scanner_start(Scanner *s, const char *root, bool recursive, WorkQueue *sink, int threads) {
+    memset(s, 0, sizeof(*s));
+    s->sink = sink;
+    s->recursive = recursive;
+    // Collect-only callers sort by size; the manifest needs size + mtime
+    s->need_sizes = (sink == NULL) || manifest_enabled();
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    if (threads < 1) threads = 1;
+    s->threads = malloc(sizeof(pthread_t) * threads);
+    if (!s->threads || !push_dir(s, root)) {
+        free(s->threads);
+        s->threads = NULL;
+        return false;
+    }
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&s->threads[i], NULL, scan_worker, s) != 0) break;
+        s->num_threads++;
+    }
+    if (s->num_threads == 0) {
+        scan_worker(s);   // No threads available: walk on the caller's thread
+    }
+    return true;
+}
+
+// Waits for the scan to finish; returns the number of files found
+int scanner_wait(Scanner *s) {
+    for (int i = 0; i < s->num_threads; i++) {
+        pthread_join(s->threads[i], NULL);
+    }
+
+    // Only left over after an interrupt
+    while (s->pending) {
+        ScanDir *next = s->pending->next;
+        free(s->pending);
+        s->pending = next;
+    }
+    free(s->threads);
+    s->threads = NULL;
+    pthread_mutex_destroy(&s->mutex);
+    pthread_cond_destroy(&s->cond);
+    return ft_count();
+}
+
+// Synchronous scan into the file table (dry run, --largest-first)
+int collect_files(const char *dir, bool recursive) {
+    Scanner s;
+    if (!scanner_start(&s, dir, recursive, NULL, g_config.scan_threads)) return -1;
+    return scanner_wait(&s);
+}
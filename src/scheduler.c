@@ -0,0 +1,402 @@
+/**
+ * scheduler.c - Work-stealing file scheduler
+ *
+ * Every worker owns a deque of file indices. Workers pop from the front of
+ * their own deque and, once it runs dry, steal from the back of the others,
+ * so a worker that drew a folder of huge TIFFs no longer leaves the rest
+ * idle at the end of a run.
+ *
+ * `pending` counts queued items not yet claimed by a worker. A worker
+ * reserves an item by decrementing it under the queue lock, which
+ * guarantees at least one item exists in some deque for it to take.
+ *
+ * The core budget hands out encoder threads: each encode asks for as many
+ * threads as its size warrants and gets at most what is free, so file-level
+ * and encoder-level parallelism together never exceed the core count.
+ * Once the queue is closed and empty, the files still starting may ask for
+ * an even split of all cores instead, so the last few large files pick up
+ * the cores that finished workers leave idle.
+ * The memory budget does the same for estimated encoder RSS: a large file
+ * is admitted only once enough of it is free, in arrival order so small
+ * files can't starve it, and a file bigger than the whole budget runs alone.
+ *
+ * The effort planner decides which adaptive-mode files get a second,
+ * full-effort encode. It learns how much slower the full effort is and how
+ * many bytes it saves, and once half of a CPU-time budget is spent it only
+ * escalates files expected to save at least the running bytes-per-second.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+#define DEQUE_INITIAL_CAPACITY 64
+
+static bool deque_init(WorkDeque *d) {
+    d->items = malloc(sizeof(int) * DEQUE_INITIAL_CAPACITY);
+    if (!d->items) return false;
+    d->capacity = DEQUE_INITIAL_CAPACITY;
+    d->head = 0;
+    d->count = 0;
+    pthread_mutex_init(&d->mutex, NULL);
+    return true;
+}
+
+static void deque_destroy(WorkDeque *d) {
+    free(d->items);
+    d->items = NULL;
+    pthread_mutex_destroy(&d->mutex);
+}
+
+static bool deque_push_back(WorkDeque *d, int idx) {
+    pthread_mutex_lock(&d->mutex);
+    if (d->count == d->capacity) {
+        int new_capacity = d->capacity * 2;
+        int *grown = malloc(sizeof(int) * new_capacity);
+        if (!grown) {
+            pthread_mutex_unlock(&d->mutex);
+            return false;
+        }
+        // Unwrap the ring into the new buffer
+        for (int i = 0; i < d->count; i++) {
+            grown[i] = d->items[(d->head + i) % d->capacity];
+        }
+        free(d->items);
+        d->items = grown;
+        d->capacity = new_capacity;
+        d->head = 0;
+    }
+    d->items[(d->head + d->count) % d->capacity] = idx;
+    d->count++;
+    pthread_mutex_unlock(&d->mutex);
+    return true;
+}
+
+// Owner side: oldest item first (preserves the push order, e.g. largest-first)
+static bool deque_pop_front(WorkDeque *d, int *idx) {
+    bool found = false;
+    pthread_mutex_lock(&d->mutex);
+    if (d->count > 0) {
+        *idx = d->items[d->head];
+        d->head = (d->head + 1) % d->capacity;
+        d->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return found;
+}
+
+// Thief side: take from the opposite end to stay out of the owner's way
+static bool deque_steal_back(WorkDeque *d, int *idx) {
+    bool found = false;
+    pthread_mutex_lock(&d->mutex);
+    if (d->count > 0) {
+        d->count--;
+        *idx = d->items[(d->head + d->count) % d->capacity];
+        found = true;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return found;
+}
+
+bool wq_init(WorkQueue *q, int num_workers) {
+    memset(q, 0, sizeof(*q));
+    q->deques = calloc(num_workers, sizeof(WorkDeque));
+    if (!q->deques) return false;
+
+    for (int i = 0; i < num_workers; i++) {
+        if (!deque_init(&q->deques[i])) {
+            for (int j = 0; j < i; j++) deque_destroy(&q->deques[j]);
+            free(q->deques);
+            q->deques = NULL;
+            return false;
+        }
+    }
+    q->num_workers = num_workers;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    return true;
+}
+
+void wq_destroy(WorkQueue *q) {
+    if (!q->deques) return;
+    for (int i = 0; i < q->num_workers; i++) deque_destroy(&q->deques[i]);
+    free(q->deques);
+    q->deques = NULL;
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cond);
+}
+
+// Distribute round-robin so each deque gets a mix of the push order
+bool wq_push(WorkQueue *q, int idx) {
+    pthread_mutex_lock(&q->mutex);
+    int target = q->next_push;
+    q->next_push = (q->next_push + 1) % q->num_workers;
+    pthread_mutex_unlock(&q->mutex);
+
+    if (!deque_push_back(&q->deques[target], idx)) return false;
+
+    pthread_mutex_lock(&q->mutex);
+    q->pending++;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return true;
+}
+
+// No more pushes will follow; wakes workers waiting on an empty queue
+void wq_close(WorkQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    q->closed = true;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+// Blocks until an item is available; false once closed and drained
+bool wq_pop(WorkQueue *q, int worker, int *idx) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->pending == 0 && !q->closed && !g_interrupted) {
+        pthread_cond_wait(&q->cond, &q->mutex);
+    }
+    if (q->pending == 0 || g_interrupted) {
+        pthread_mutex_unlock(&q->mutex);
+        return false;
+    }
+    q->pending--;
+    pthread_mutex_unlock(&q->mutex);
+
+    // An item is reserved for us - own deque first, then steal
+    for (;;) {
+        if (deque_pop_front(&q->deques[worker], idx)) return true;
+        for (int i = 1; i < q->num_workers; i++) {
+            int victim = (worker + i) % q->num_workers;
+            if (deque_steal_back(&q->deques[victim], idx)) return true;
+        }
+    }
+}
+
+int wq_pending(WorkQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    int pending = q->pending;
+    pthread_mutex_unlock(&q->mutex);
+    return pending;
+}
+
+// Copies up to `max` of the items `worker` will pop next, without taking
+// them (another worker may still steal them)
+int wq_peek(WorkQueue *q, int worker, int *out, int max) {
+    WorkDeque *d = &q->deques[worker];
+    pthread_mutex_lock(&d->mutex);
+    int n = d->count < max ? d->count : max;
+    for (int i = 0; i < n; i++) out[i] = d->items[(d->head + i) % d->capacity];
+    pthread_mutex_unlock(&d->mutex);
+    return n;
+}
+
+// Closed with nothing left to hand out: every remaining file is in flight
+bool wq_drained(WorkQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    bool drained = q->closed && q->pending == 0;
+    pthread_mutex_unlock(&q->mutex);
+    return drained;
+}
+
+int detect_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return DEFAULT_THREADS;
+    if (n > MAX_CORES) return MAX_CORES;
+    return (int)n;
+}
+
+void budget_init(CoreBudget *b, int total) {
+    b->total = total;
+    b->available = total;
+    pthread_mutex_init(&b->mutex, NULL);
+    pthread_cond_init(&b->cond, NULL);
+}
+
+void budget_destroy(CoreBudget *b) {
+    pthread_mutex_destroy(&b->mutex);
+    pthread_cond_destroy(&b->cond);
+}
+
+// Waits for at least one free core, then grants up to `want` of them.
+// Never blocks for the full request, so a large file can't starve.
+int budget_acquire(CoreBudget *b, int want) {
+    if (want < 1) want = 1;
+    pthread_mutex_lock(&b->mutex);
+    while (b->available == 0) {
+        pthread_cond_wait(&b->cond, &b->mutex);
+    }
+    int granted = (want < b->available) ? want : b->available;
+    b->available -= granted;
+    pthread_mutex_unlock(&b->mutex);
+    return granted;
+}
+
+void budget_release(CoreBudget *b, int granted) {
+    pthread_mutex_lock(&b->mutex);
+    b->available += granted;
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->mutex);
+}
+
+// ============================================================================
+// Memory budget
+// ============================================================================
+
+size_t detect_physical_memory(void) {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) return 0;
+    return (size_t)pages * (size_t)page_size;
+}
+
+void memory_init(MemoryBudget *m, size_t total) {
+    memset(m, 0, sizeof(*m));
+    m->total = total;
+    m->available = total;
+    pthread_mutex_init(&m->mutex, NULL);
+    pthread_cond_init(&m->cond, NULL);
+}
+
+void memory_destroy(MemoryBudget *m) {
+    pthread_mutex_destroy(&m->mutex);
+    pthread_cond_destroy(&m->cond);
+}
+
+// Blocks until `want` bytes are free and every earlier request was
+// admitted. Requests above the total are clamped to it (they wait until
+// nothing else is running). Returns the amount to hand to memory_release().
+size_t memory_acquire(MemoryBudget *m, size_t want) {
+    if (m->total == 0) return 0;   // No limit
+    if (want > m->total) want = m->total;
+
+    pthread_mutex_lock(&m->mutex);
+    unsigned long ticket = m->next_ticket++;
+    while (ticket != m->serving || m->available < want) {
+        pthread_cond_wait(&m->cond, &m->mutex);
+    }
+    m->available -= want;
+    m->serving++;
+    pthread_cond_broadcast(&m->cond);   // Next ticket may fit as well
+    pthread_mutex_unlock(&m->mutex);
+    return want;
+}
+
+void memory_release(MemoryBudget *m, size_t granted) {
+    if (granted == 0) return;
+    pthread_mutex_lock(&m->mutex);
+    m->available += granted;
+    pthread_cond_broadcast(&m->cond);
+    pthread_mutex_unlock(&m->mutex);
+}
+
+// Rough pixel count from the file size: JPEG averages ~1/3 byte per pixel,
+// PNG ~1.5 bytes and uncompressed BMP/TIFF/TGA/PPM ~3 bytes per pixel.
+static size_t estimate_pixels(const FileEntry *entry) {
+    switch (entry->type) {
+        case FILE_TYPE_JPEG: return entry->size * 3;
+        case FILE_TYPE_PNG:  return entry->size * 2 / 3;
+        default:             return entry->size / 3;
+    }
+}
+
+// Peak memory of a full-frame encode (cjxl or in-process)
+size_t encode_memory_for(const FileEntry *entry) {
+    size_t per_pixel = (entry->type == FILE_TYPE_JPEG) ? ENCODE_MEMORY_PER_PIXEL_JPEG
+                                                       : ENCODE_MEMORY_PER_PIXEL;
+    return estimate_pixels(entry) * per_pixel;
+}
+
+// Threads one encode should ask for: one per PIXELS_PER_ENCODER_THREAD of
+// `pixels` (0 = estimate from the file size). A tail `share` raises that
+// as far as one thread per group, the most the encoder can keep busy.
+int encoder_threads_for(const FileEntry *entry, size_t pixels, int budget, int share) {
+    if (pixels == 0) pixels = estimate_pixels(entry);
+    size_t threads = 1 + pixels / PIXELS_PER_ENCODER_THREAD;
+    if (share > 0 && (size_t)share > threads) {
+        size_t groups = (pixels + PIXELS_PER_ENCODER_GROUP - 1) / PIXELS_PER_ENCODER_GROUP;
+        threads = (size_t)share < groups ? (size_t)share : groups;
+        if (threads < 1) threads = 1;
+    }
+    if (threads > (size_t)budget) threads = (size_t)budget;
+    return (int)threads;
+}
+
+// ============================================================================
+// Adaptive effort planner
+// ============================================================================
+
+static double ewma(double avg, double sample) {
+    return avg + EFFORT_EWMA_ALPHA * (sample - avg);
+}
+
+void effort_plan_init(EffortPlanner *p, double budget_seconds) {
+    memset(p, 0, sizeof(*p));
+    p->budget_seconds = budget_seconds;
+    p->cost_ratio = EFFORT_COST_RATIO_INITIAL;
+    pthread_mutex_init(&p->mutex, NULL);
+}
+
+void effort_plan_destroy(EffortPlanner *p) {
+    pthread_mutex_destroy(&p->mutex);
+}
+
+// Whether a low-effort result of `low_out` bytes (from `in_size`, costing
+// `low_cost` CPU-seconds) deserves a full-effort encode. On true, the
+// expected cost is reserved in `*reserved` and must be settled with
+// effort_plan_record().
+bool effort_plan_escalate(EffortPlanner *p, size_t in_size, size_t low_out,
+                          double low_cost, double *reserved) {
+    *reserved = 0;
+    double ratio = (double)low_out / in_size;
+    bool near_threshold = ratio >= 1.0 - g_config.escalate_margin;
+    bool large = g_config.escalate_size > 0 && in_size >= g_config.escalate_size;
+    // Far above the input size: more effort won't rescue it
+    if (ratio > 1.0 + g_config.escalate_margin || !(near_threshold || large)) return false;
+
+    pthread_mutex_lock(&p->mutex);
+    double cost = low_cost * p->cost_ratio;
+    bool ok = true;
+    if (p->budget_seconds > 0) {
+        if (p->spent_seconds + cost > p->budget_seconds) {
+            ok = false;
+        } else if (p->samples >= EFFORT_WARMUP_SAMPLES && p->spent_seconds > p->budget_seconds / 2) {
+            // Second half of the budget: only files that beat the average so far
+            double expected_gain = p->gain_fraction * low_out;
+            ok = cost > 0 && expected_gain / cost >= p->gain_rate;
+        }
+    }
+    if (ok) {
+        p->spent_seconds += cost;
+        *reserved = cost;
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return ok;
+}
+
+// Settle a reservation with the measured cost and what it saved
+void effort_plan_record(EffortPlanner *p, double reserved, double cost,
+                        double low_cost, size_t saved, size_t low_out) {
+    pthread_mutex_lock(&p->mutex);
+    p->spent_seconds += cost - reserved;
+    if (low_cost > 0 && low_out > 0) {
+        double fraction = (double)saved / low_out;
+        double rate = cost > 0 ? saved / cost : 0;
+        if (p->samples == 0) {
+            p->cost_ratio = cost / low_cost;
+            p->gain_fraction = fraction;
+            p->gain_rate = rate;
+        } else {
+            p->cost_ratio = ewma(p->cost_ratio, cost / low_cost);
+            p->gain_fraction = ewma(p->gain_fraction, fraction);
+            p->gain_rate = ewma(p->gain_rate, rate);
+        }
+        p->samples++;
+    }
+    pthread_mutex_unlock(&p->mutex);
+}
@@ -0,0 +1,114 @@
+/**
+ * spawn.c - One-shot tools without a shell
+ *
+ * cjxl, djxl and a one-shot exiftool used to run through system() and
+ * popen(): a /bin/sh per call, plus a command line assembled in a
+ * MAX_PATH_LEN * 3 stack buffer with every path quoted by hand (and broken
+ * by a path containing a quote). They are now posix_spawnp()'ed with an
+ * argv, stdin and stderr on /dev/null, stdout discarded or counted.
+ *
+ * Tool lookups walk PATH with access() instead of running `which`.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE                // pipe2()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "static2jxl.h"
+
+extern char **environ;
+
+// A pipe whose ends no spawned process inherits. Tools and daemons start
+// concurrently from several threads: a child holding another child's
+// stdout write end keeps that pipe from reaching EOF for as long as it
+// lives. adddup2() onto 0/1 clears the flag for the child's own copy.
+int pipe_cloexec(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if (pipe(fds) != 0) return -1;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
+// Newlines on `fd` until EOF
+static int count_lines(int fd) {
+    char buf[4096];
+    int lines = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n; i++) lines += (buf[i] == '\n');
+    }
+    return lines;
+}
+
+// Runs argv[0] (looked up in PATH) and waits for it. Returns its exit
+// status (0 = success), -1 when it couldn't be started or was killed.
+// With `lines_out` the lines it writes to stdout are counted.
+int run_tool(const char *const argv[], int *lines_out) {
+    int out[2] = { -1, -1 };
+    if (lines_out) {
+        if (pipe_cloexec(out) != 0) return -1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    if (lines_out) {
+        posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, out[1]);
+    } else {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    pid_t pid;
+    int rc = posix_spawnp(&pid, argv[0], &actions, NULL, (char *const *)argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (lines_out) {
+        close(out[1]);
+        *lines_out = rc == 0 ? count_lines(out[0]) : 0;
+        close(out[0]);
+    }
+    if (rc != 0) return -1;
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Whether `name` is an executable somewhere in PATH
+bool tool_available(const char *name) {
+    const char *path = getenv("PATH");
+    if (!path) return false;
+    char candidate[MAX_PATH_LEN];
+    while (*path) {
+        size_t len = strcspn(path, ":");
+        const char *dir = len ? path : ".";       // An empty entry is the working directory
+        int dir_len = len ? (int)len : 1;
+        if (snprintf(candidate, sizeof(candidate), "%.*s/%s", dir_len, dir, name) < (int)sizeof(candidate) &&
+            access(candidate, X_OK) == 0) {
+            return true;
+        }
+        path += len;
+        if (*path == ':') path++;
+    }
+    return false;
+}
@@ -21,9 +21,80 @@
 
 // Limits
 #define MAX_PATH_LEN 4096
-#define MAX_FILES 100000
 #define MAX_THREADS 32
-#define DEFAULT_THREADS 4
+#define DEFAULT_QUEUE_DEPTH 32     // Jobs buffered between pipeline stages
+#define DEFAULT_THREADS 4          // Fallback when the core count can't be detected
+#define MAX_CORES 256
+#define MAX_SCAN_THREADS 8         // Default cap on directory walkers
+
+// Core budget: estimated pixels one encoder thread should own
+// (libjxl parallelises over 256x256 groups, so this is ~64 groups/thread)
+#define PIXELS_PER_ENCODER_THREAD (4 * 1000 * 1000)
+#define PIXELS_PER_ENCODER_GROUP (256 * 256)
+
+// Memory budget: estimated peak RSS per encode, admitted against a global limit
+#define ENCODE_MEMORY_PER_PIXEL 32          // Full-frame lossless (decoded image + encoder state)
+#define ENCODE_MEMORY_PER_PIXEL_JPEG 8      // JPEG transcode (coefficients, no pixels)
+#define STREAMING_BAND_ROWS 2048            // Rows a chunked libjxl encode keeps in flight
+#define DEFAULT_MEMORY_FRACTION 0.6         // Of physical RAM when --mem-limit isn't given
+
+// Predictive skip: effort-1 trial on TRIAL_BANDS bands of TRIAL_BAND_ROWS rows
+#define TRIAL_BANDS 8
+#define TRIAL_BAND_ROWS 64
+#define DEFAULT_PREDICT_MARGIN 0.25   // Skip when the trial exceeds input by 25%
+
+// Adaptive effort: encode at a low effort, escalate only where it pays
+#define DEFAULT_EFFORT_LOW 3
+#define DEFAULT_ESCALATE_MARGIN 0.10          // Low result within 10% of the input size
+#define DEFAULT_ESCALATE_SIZE (32 * 1024 * 1024)  // Or the source is at least this big
+#define EFFORT_COST_RATIO_INITIAL 4.0         // Guess for high/low encode time until measured
+#define EFFORT_EWMA_ALPHA 0.2
+#define EFFORT_WARMUP_SAMPLES 4               // Escalations before the gain rate is trusted
+
+// Progress reporter: redraw interval on a terminal, line interval in logs
+#define PROGRESS_TTY_INTERVAL 0.5
+#define PROGRESS_LOG_INTERVAL 30.0
+#define PROGRESS_EWMA_SECONDS 20.0     // Time constant of the throughput averages
+
+// --durability batch: directory fsyncs deferred until this many files or dirs
+#define DURABILITY_BATCH_FILES 256
+#define DURABILITY_BATCH_DIRS 64
+
+// --ledger: heartbeat interval, and how stale a node's heartbeat must be
+// before its claims are taken over (beyond NFS attribute caching)
+#define LEDGER_HEARTBEAT_SECONDS 10
+#define LEDGER_LEASE_SECONDS 120
+
+// --watch: a file is queued this long after its writer closed it, or once
+// its size and mtime are unchanged over WATCH_SETTLE_SECONDS (watch.c)
+#define WATCH_CLOSE_DELAY 0.25
+#define WATCH_SETTLE_SECONDS 2.0
+#define WATCH_TICK_MS 250
+#define WATCH_BUCKETS 1024
+
+// --prefetch: files read ahead per encode worker; each hint asks for at
+// most PREFETCH_MAX_BYTES of its file (prefetch.c)
+#define DEFAULT_PREFETCH 2
+#define MAX_PREFETCH 16
+#define PREFETCH_MAX_BYTES (64u * 1024 * 1024)
+#define PREFETCH_QUEUE 64          // Hints waiting to be issued (more are dropped)
+#define PREFETCH_INFLIGHT 16       // Files in flight in the io_uring
+#define PREFETCH_THREADS 4         // Fallback backend without io_uring
+
+// Buffer pool (ingest.c): power-of-two classes from 64 KB to 64 MB, at
+// most BUFFER_POOL_PER_CLASS idle buffers per class and
+// BUFFER_POOL_IDLE_BYTES idle in all
+#define BUFFER_CLASS_MIN_SHIFT 16
+#define BUFFER_CLASS_MAX_SHIFT 26
+#define BUFFER_POOL_PER_CLASS (2 * MAX_THREADS)
+#define BUFFER_POOL_IDLE_BYTES ((size_t)256 * 1024 * 1024)
+
+// Extended attribute names and values up to this size are copied from the
+// stack; longer ones (resource forks) get a heap buffer
+#define XATTR_STACK_BYTES 4096
+
+// Latency histograms: log-scale buckets, 4 per octave of microseconds (timing.c)
+#define TIMING_BUCKETS 160
 
 // Size threshold for lossless formats (1.25MB)
 #define MIN_LOSSLESS_SIZE (1280 * 1024)
@@ -55,32 +126,237 @@ typedef enum {
     TIFF_COMPRESSION_LZW = 5,       // LZW - good for JXL
     TIFF_COMPRESSION_JPEG = 7,      // JPEG - skip (already lossy)
     TIFF_COMPRESSION_DEFLATE = 8,   // Deflate - good for JXL
+    TIFF_COMPRESSION_PACKBITS = 32773, // PackBits RLE - good for JXL
     TIFF_COMPRESSION_OTHER = 99     // Other - skip
 } TiffCompression;
 
+// Encoder backends
+typedef enum {
+    ENCODER_AUTO = 0,      // libjxl when built in, cjxl otherwise
+    ENCODER_LIBJXL,        // In-process libjxl (JxlEncoder API)
+    ENCODER_CJXL           // Spawn cjxl per file
+} EncoderBackend;
+
+// Health check depth (validate.c)
+typedef enum {
+    VALIDATE_NONE = 0,     // --skip-health-check
+    VALIDATE_HEADER,       // Container boxes + codestream SizeHeader
+    VALIDATE_STRUCTURAL,   // + every frame header and TOC, no pixels
+    VALIDATE_FULL          // + full decode, JPEG reconstruction matched to the source
+} ValidateLevel;
+
+// When finished outputs are flushed to stable storage (output.c)
+typedef enum {
+    DURABILITY_NONE = 0,   // Leave it to the kernel (default)
+    DURABILITY_FILE,       // fsync each output, then its directory
+    DURABILITY_BATCH       // fsync each output; directories once per batch
+} Durability;
+
+// Result of an encode attempt
+typedef enum {
+    ENCODE_OK = 0,
+    ENCODE_FAILED,
+    ENCODE_UNSUPPORTED     // Backend can't ingest this input - fall back to cjxl
+} EncodeResult;
+
+// Result of an exiftool daemon command
+typedef enum {
+    EXIFTOOL_OK = 0,
+    EXIFTOOL_FAILED,
+    EXIFTOOL_UNAVAILABLE   // No daemon usable - fall back to a one-shot exiftool
+} ExifToolResult;
+
+// Per-file outcome remembered by the manifest
+typedef enum {
+    OUTCOME_NONE = 0,
+    OUTCOME_CONVERTED,
+    OUTCOME_LARGER,        // Rolled back: JXL was larger
+    OUTCOME_FAILED,
+    OUTCOME_SKIPPED,       // Not a candidate (type, size threshold, JPEG-in-TIFF)
+    OUTCOME_PREDICTED      // Skipped by the effort-1 trial (predicted larger)
+} FileOutcome;
+
+// Modification time in nanoseconds from a struct stat
+#ifdef __APPLE__
+#define STAT_MTIME_NS(st) ((int64_t)(st).st_mtimespec.tv_sec * 1000000000 + (st).st_mtimespec.tv_nsec)
+#else
+#define STAT_MTIME_NS(st) ((int64_t)(st).st_mtim.tv_sec * 1000000000 + (st).st_mtim.tv_nsec)
+#endif
+
+// Decoded (or mapped) pixels handed to the in-process encoder (decoders.c)
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;             // 1 = gray, 3 = RGB (+1 when alpha)
+    uint32_t bits;                 // Significant bits per sample
+    uint32_t bytes_per_sample;     // 1 or 2
+    bool big_endian;               // Byte order of 16-bit samples
+    bool alpha;                    // Last channel is alpha
+    bool alpha_premultiplied;
+    const uint8_t *pixels;         // Interleaved, tightly packed rows (NULL when read via `rows`)
+    size_t size;                   // Bytes of the packed image
+    const uint8_t **rows;          // Row table into the source (BMP, TGA, strip TIFF), or NULL
+    uint32_t row_pixel_bytes;      // Bytes per pixel in `rows` (4 for BGRX)
+    bool bgr;                      // `rows` hold B,G,R(,A/X): swizzled as they are read
+    uint8_t *owned;                // Decoded buffer to free (NULL: pixels point into the source)
+    size_t owned_capacity;         // ... as buffer_get() returned it
+} JxlImage;
+
+// TIFF image directory parsed from the source bytes (tiff.c)
+typedef struct {
+    const uint8_t *base;           // Whole file
+    size_t size;
+    bool big_endian;               // File byte order (IFDs and 16-bit samples)
+    uint32_t width;
+    uint32_t height;
+    uint32_t samples;              // SamplesPerPixel
+    uint32_t bits;                 // BitsPerSample (0 when samples differ)
+    uint32_t compression;          // Tag 259 value
+    uint32_t photometric;
+    uint32_t planar;               // 1 = chunky, 2 = one plane per sample
+    uint32_t predictor;            // 1 = none, 2 = horizontal differencing
+    uint32_t sample_format;        // 1 = unsigned integer
+    uint32_t alpha;                // ExtraSamples: 0 none, 1 associated, 2 unassociated
+    bool tiled;
+    uint32_t seg_width;            // Strip: image width; tile: TileWidth
+    uint32_t seg_height;           // Strip: RowsPerStrip; tile: TileLength
+    uint32_t segments;             // Strips/tiles listed in the offsets array
+    size_t offsets_pos;            // Strip/TileOffsets array in the file
+    size_t counts_pos;             // Strip/TileByteCounts array
+    uint32_t count_entries;        // ... and its length (at least `segments`)
+    uint16_t offsets_type;         // 3 = SHORT, 4 = LONG
+    uint16_t counts_type;
+    uint32_t pages;                // Full-resolution images in the IFD chain
+} TiffImage;
+
+// JPEG frame header (SOFn), see metadata.c
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+} JpegFrame;
+
+// A source file read once (mmap or pooled buffer, see ingest.c)
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    int64_t mtime_ns;
+    bool mapped;                   // data is an mmap of the whole file
+    uint8_t *pooled;               // data is this pooled read buffer
+    size_t pooled_capacity;
+} SourceBuffer;
+
+// Metadata found in a source file (see metadata.c). Pointers may alias the
+// source buffer; `icc` and `xmp_owned` are heap copies.
+typedef struct {
+    const uint8_t *exif;           // TIFF-structured EXIF (no "Exif\0\0" prefix)
+    size_t exif_size;
+    const uint8_t *xmp;            // XMP packet
+    size_t xmp_size;
+    uint8_t *xmp_owned;            // Set when the XMP had to be inflated
+    uint8_t *icc;                  // Reassembled / inflated ICC profile
+    size_t icc_size;
+    bool has_other;                // Metadata only exiftool can migrate
+} SourceMetadata;
+
 // Configuration
 typedef struct {
     char target_dir[MAX_PATH_LEN];
     bool in_place;
-    bool skip_health_check;
+    ValidateLevel validate;        // Health check depth (after validate_init)
     bool recursive;
     bool verbose;
     bool dry_run;
     bool force_lossless;           // Force lossless even for JPEG
-    int num_threads;
+    int num_threads;               // Concurrent files (0 = one per core)
+    int cores;                     // Core budget shared by all encoders (0 = detect)
     double jxl_distance;           // Override distance
     int jxl_effort;
+    EncoderBackend encoder;
+    bool largest_first;            // Schedule biggest files first
+    int verify_workers;            // Health check stage (0 = auto)
+    int finalize_workers;          // Metadata/finalize stage (0 = auto)
+    int queue_depth;               // Bound of each inter-stage queue
+    int scan_threads;              // Directory walkers (0 = auto)
+    char manifest_path[MAX_PATH_LEN];  // Incremental run manifest ("" = off)
+    bool retry_failed;             // Re-try files the manifest recorded as failed
+    double predict_margin;         // Predictive skip threshold (< 0 = off)
+    bool adaptive_effort;          // Low effort first, -e only where it pays
+    int effort_low;                // First-pass effort in adaptive mode
+    double escalate_margin;        // Escalate when within this of the rollback threshold
+    size_t escalate_size;          // Always consider sources at least this big
+    double effort_budget;          // Extra CPU-seconds for escalations (0 = unlimited)
+    size_t mem_limit;              // Encoder memory budget in bytes (0 = detect)
+    bool dedup;                    // Encode byte-identical sources once
+    bool progress_tty;             // stdout is a terminal: redraw progress in place
+    char stats_json_path[MAX_PATH_LEN]; // Per-file timing records, JSONL ("" = off)
+    char trace_path[MAX_PATH_LEN]; // Chrome trace-event file ("" = off)
+    Durability durability;         // fsync policy for finished outputs
+    bool watch;                    // Keep running and convert files as they arrive
+    char ledger_path[MAX_PATH_LEN];// Shared multi-host work ledger ("" = off)
+    char files_from[MAX_PATH_LEN]; // Read paths from this list ("-" = stdin) instead of scanning
+    int prefetch;                  // Files read ahead per encode worker (0 = off)
 } Config;
 
-// File entry for processing queue
+// File entry for processing queue (see filetable.c)
 typedef struct {
-    char path[MAX_PATH_LEN];
+    const char *name;              // Basename, interned in the path arena
     size_t size;
+    int64_t mtime_ns;              // 0 until stat'ed (scan with manifest, or ingest)
+    uint32_t dir;                  // Directory index in the file table
     FileType type;
     bool use_lossless;             // Whether to use lossless mode
+    uint8_t prefetched;            // Read-ahead issued (atomic, see prefetch.c)
 } FileEntry;
 
-// Processing statistics
+// Statistics counters, bumped with stat_add() (stats.c)
+typedef enum {
+    STAT_TOTAL = 0,
+    STAT_PROCESSED,
+    STAT_SUCCESS,
+    STAT_FAILED,
+    STAT_SKIPPED,
+    STAT_HEALTH_PASSED,
+    STAT_HEALTH_FAILED,
+    STAT_BYTES_INPUT,
+    STAT_BYTES_OUTPUT,
+    STAT_JPEG,
+    STAT_PNG,
+    STAT_BMP,
+    STAT_TIFF,
+    STAT_TGA,
+    STAT_PPM,
+    STAT_SKIPPED_RAW,
+    STAT_SKIPPED_SMALL,
+    STAT_SKIPPED_TIFF_JPEG,
+    STAT_SKIPPED_LARGER,
+    STAT_SKIPPED_UNSUPPORTED,
+    STAT_SKIPPED_MANIFEST,
+    STAT_SKIPPED_MULTIPAGE,
+    STAT_PREDICTED_LARGER,
+    STAT_ESCALATED,
+    STAT_ESCALATED_KEPT,
+    STAT_ESCALATED_SAVED,
+    STAT_METADATA_NATIVE,
+    STAT_METADATA_EXIFTOOL,
+    STAT_DEDUPLICATED,
+    STAT_DEDUP_BYTES,
+    STAT_DEDUP_USEC,
+    STAT_FILES_SIZED,              // Files whose size the scan already knew
+    STAT_BYTES_SCANNED,            // ... and their bytes
+    STAT_BYTES_DONE,               // Source bytes of files that left the pipeline
+    STAT_FILE_SYNCS,               // Outputs fsync'ed (--durability)
+    STAT_DIR_SYNCS,                // Directory fsyncs (--durability)
+    STAT_LEDGER_CLAIMED,           // Files this node claimed (--ledger)
+    STAT_LEDGER_BUSY,              // Skipped: claimed or done by another node
+    STAT_LEDGER_RECOVERED,         // Taken over from dead nodes
+    STAT_PREFETCHED,               // Sources read ahead (--prefetch)
+    STAT_ENCODERS_REUSED,          // Encodes on a recycled JxlEncoder (JxlEncoderReset)
+    STAT_RUNNER_THREADS_SAVED,     // Per-file runner threads the shared runner replaced
+    STAT_BUFFERS_REUSED,           // Buffers served from the pool instead of malloc()
+    STAT_COUNT
+} StatCounter;
+
+// Processing statistics: a snapshot summed from every thread's counters
 typedef struct {
     int total;
     int processed;
@@ -89,10 +365,9 @@ typedef struct {
     int skipped;
     int health_passed;
     int health_failed;
-    size_t bytes_input;
-    size_t bytes_output;
+    uint64_t bytes_input;
+    uint64_t bytes_output;
     time_t start_time;
-    pthread_mutex_t mutex;
     // Per-type statistics
     int jpeg_count;
     int png_count;
@@ -104,53 +379,230 @@ typedef struct {
     int skipped_small;
     int skipped_tiff_jpeg;
     int skipped_larger;      // Files where JXL was larger (rollback)
+    int skipped_unsupported; // Not an image we convert (detected in the worker)
+    int skipped_manifest;    // Unchanged since a previous run (manifest)
+    int skipped_multipage;   // Multi-page TIFF (one JXL would drop pages)
+    int predicted_larger;    // Skipped by the low-effort trial (no full encode)
+    int escalated;           // Adaptive mode: re-encoded at the full effort
+    int escalated_kept;      // ... where the full-effort result was smaller
+    uint64_t escalated_saved; // Bytes saved by kept escalations
     int metadata_full;       // Files with full metadata preserved
     int metadata_partial;    // Files with partial metadata
+    int metadata_native;     // Internal metadata written at encode time
+    int metadata_exiftool;   // Internal metadata migrated by exiftool
+    int deduplicated;        // Copies that took their leader's outcome (--dedup)
+    uint64_t dedup_bytes;    // ... source bytes they didn't re-encode
+    double dedup_seconds;    // ... encoder CPU-seconds that saved
+    int file_syncs;          // Outputs flushed (--durability)
+    int dir_syncs;           // Directory flushes (--durability)
+    int ledger_claimed;      // Claimed by this node (--ledger)
+    int ledger_busy;         // Left to other nodes
+    int ledger_recovered;    // Taken over from dead nodes
+    int prefetched;          // Sources read ahead
+    int encoders_reused;     // JxlEncoder instances recycled
+    int runner_threads_saved; // Runner threads not created per file
+    int buffers_reused;      // Pool hits instead of malloc()
 } Stats;
 
+// One progress reading (stats.c)
+typedef struct {
+    int processed;
+    int total;
+    double files_per_sec;          // EWMA throughput
+    double in_per_sec;             // Source bytes/s through the pipeline
+    double out_per_sec;            // Output bytes/s written
+    double eta_seconds;            // < 0 until something has finished
+    bool eta_exact;                // Remaining bytes known from the scan (else estimated)
+} Progress;
+
+// Running state behind successive Progress readings
+typedef struct {
+    double start;
+    double last;
+    uint64_t files, in, out;       // Counters at `last`
+    double files_rate, in_rate, out_rate;
+    bool primed;                   // A file has finished: the ETA means something
+} ProgressMeter;
+
+// Per-worker deque of file table indices (ring buffer)
+typedef struct {
+    int *items;
+    int capacity;
+    int head;                      // Owner pops here, thieves take from the tail
+    int count;
+    pthread_mutex_t mutex;
+} WorkDeque;
+
+// Work-stealing queue shared by all workers
+typedef struct {
+    WorkDeque *deques;             // One per worker
+    int num_workers;
+    int next_push;                 // Round-robin push target
+    int pending;                   // Queued items not yet claimed
+    bool closed;                   // No more pushes will follow
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} WorkQueue;
+
+// Core budget shared by all in-flight encodes (one token = one thread)
+typedef struct {
+    int total;
+    int available;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} CoreBudget;
+
+// Memory budget shared by all in-flight encodes (bytes, admitted in FIFO order)
+typedef struct {
+    size_t total;
+    size_t available;
+    unsigned long next_ticket;     // Handed to each arriving request
+    unsigned long serving;         // Ticket allowed to admit next
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} MemoryBudget;
+
+// Adaptive effort planner: spends the escalation time budget (scheduler.c)
+typedef struct {
+    double budget_seconds;         // Extra CPU-seconds allowed (0 = unlimited)
+    double spent_seconds;          // Reserved + measured escalation cost
+    double cost_ratio;             // EWMA of high-effort / low-effort encode time
+    double gain_fraction;          // EWMA of bytes saved / low-effort output size
+    double gain_rate;              // EWMA of bytes saved per extra CPU-second
+    int samples;
+    pthread_mutex_t mutex;
+} EffortPlanner;
+
+// Pipeline stages after scanning
+typedef enum {
+    STAGE_ENCODE = 0,
+    STAGE_VERIFY,
+    STAGE_FINALIZE,
+    STAGE_COUNT
+} StageId;
+
+// Timed phases of one file, in pipeline order (timing.c)
+typedef enum {
+    PHASE_READ = 0,                // Source ingest (mmap / pooled read)
+    PHASE_DETECT,                  // Content hash, manifest lookup, type detection, TIFF probe
+    PHASE_ADMIT,                   // Waiting on the memory and core budgets
+    PHASE_PREDICT,                 // Effort-1 trial
+    PHASE_ENCODE,                  // Including an adaptive escalation
+    PHASE_SIZE_CHECK,              // Output size, rollback
+    PHASE_VERIFY,                  // Health check
+    PHASE_XATTR,                   // Metadata layer 1
+    PHASE_INTERNAL,                // EXIF/XMP/ICC via exiftool (layer 2)
+    PHASE_TIMESTAMPS,              // mtime/atime (layer 3)
+    PHASE_CREATION_TIME,           // macOS birthtime (layer 4)
+    PHASE_RENAME,                  // Link/rename into place (+ unlink of the original)
+    PHASE_COUNT
+} TimingPhase;
+
+typedef struct {
+    double started;                // Entered the pipeline (monotonic seconds)
+    const char *file;              // For trace events
+    double seconds[PHASE_COUNT];
+} JobTiming;
+
+// One file in flight between stages
+struct DedupGroup;
+typedef struct Job {
+    int file_idx;                  // Index into the file table
+    char input[MAX_PATH_LEN];      // Full source path
+    char output[MAX_PATH_LEN];     // Final .jxl path
+    char temp_output[MAX_PATH_LEN];// Where the encoder wrote
+    int out_fd;                    // Anonymous (O_TMPFILE) output behind temp_output, else -1
+    size_t out_size;
+    bool metadata_native;          // EXIF/XMP/ICC fully written by the encoder
+    uint64_t content_hash;         // XXH64 of the source (manifest/dedup runs only)
+    bool jpeg_transcode;           // Output must reconstruct the source JPEG
+    size_t jpeg_size;              // Source a full validation compares the
+    uint64_t jpeg_hash;            // reconstruction against (full level only)
+    FileOutcome outcome;           // How it left the pipeline (set by record_outcome)
+    double encode_seconds;         // Encoder CPU-seconds spent on it
+    struct DedupGroup *dedup_group;// Set on the leader of a group of identical sources
+    bool cloned;                   // Output cloned from the leader: already verified
+    bool ledger_claimed;           // Holds a --ledger claim until job_done
+    int core_share;                // Taken in the tail of the run: cores / encodes in flight
+    struct Job *dedup_next;        // Copies parked on a leader
+    JobTiming timing;
+} Job;
+
+// Byte-identical sources (dedup.c)
+typedef struct DedupGroup {
+    size_t size;
+    uint64_t hash;                 // XXH64, seed 0
+    uint64_t hash2;                // XXH64, second seed
+    bool resolved;                 // The leader has left the pipeline
+    FileOutcome outcome;           // ... this way
+    char *output;                  // Its final output (converted only)
+    bool metadata_native;
+    double encode_seconds;
+    Job *waiters;                  // Copies parked until it resolves
+} DedupGroup;
+
+typedef enum {
+    DEDUP_UNIQUE = 0,              // Not tracked (out of memory): encode normally
+    DEDUP_LEADER,                  // First of its content: encode
+    DEDUP_PARKED,                  // Leader in flight: the leader owns the job now
+    DEDUP_RESOLVED                 // Leader done: copy its outcome
+} DedupRole;
+
+// Bounded MPMC queue between two stages
+typedef struct {
+    Job **items;
+    int capacity;
+    int head;
+    int count;
+    int producers;                 // Upstream workers still running
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} StageQueue;
+
+typedef struct {
+    WorkQueue *source;             // Scan → encode
+    StageQueue verify_q;           // Encode → verify
+    StageQueue finalize_q;         // Verify → metadata/finalize
+    int workers[STAGE_COUNT];
+    int busy[STAGE_COUNT];         // Workers currently inside the stage
+    char last_input[MAX_PATH_LEN]; // Most recent file to leave the pipeline
+    bool reporting;                // Reporter thread keeps running
+    pthread_cond_t report_cond;    // Wakes the reporter early to stop
+    pthread_mutex_t mutex;         // Guards busy[], last_input, reporting
+} Pipeline;
+
+// Parallel directory scanner (scanner.c)
+struct ScanDir;
+typedef struct {
+    WorkQueue *sink;               // Files are queued here as found (NULL: collect only)
+    bool recursive;
+    bool need_sizes;               // stat every file during the scan
+    bool failed;                   // File table out of memory
+    pthread_t *threads;
+    int num_threads;
+    struct ScanDir *pending;       // Directories not yet walked
+    int active;                    // Walkers inside a directory
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} Scanner;
+
 // Global state
 extern Config g_config;
-extern Stats g_stats;
-extern FileEntry *g_files;
-extern int g_file_count;
 extern volatile bool g_interrupted;
-
-// Dangerous directories (safety check)
-static const char *DANGEROUS_DIRS[] = {
-    "/",
-    "/etc",
-    "/bin",
-    "/sbin",
-    "/usr",
-    "/var",
-    "/System",
-    "/Library",
-    "/Applications",
-    "/private",
-    NULL
-};
-
-// File type names for display
-static const char *FILE_TYPE_NAMES[] = {
-    "Unknown",
-    "JPEG",
-    "PNG",
-    "BMP",
-    "TIFF",
-    "TGA",
-    "PPM/PBM/PGM",
-    "RAW",
-    "JXL"
-};
+extern CoreBudget g_budget;
+extern EffortPlanner g_effort;
+extern MemoryBudget g_memory;
 
 // Function prototypes
 
 // Initialization
 void init_config(Config *config);
-void init_stats(Stats *stats);
 
 // File type detection (by magic bytes)
 FileType detect_file_type(const char *path);
+FileType detect_file_type_mem(const uint8_t *buf, size_t n, const char *path);
+bool classify_file(FileEntry *entry, const char *path, const SourceBuffer *src);
 const char *get_file_type_name(FileType type);
 bool is_supported_file(const char *path);
 bool is_lossless_source(FileType type);
@@ -158,32 +610,218 @@ bool should_use_lossless(const FileEntry *entry);
 
 // TIFF specific
 TiffCompression detect_tiff_compression(const char *path);
+TiffCompression detect_tiff_compression_mem(const uint8_t *buf, size_t size);
 bool is_tiff_suitable_for_jxl(const char *path);
 
 // File operations
 int collect_files(const char *dir, bool recursive);
 bool file_exists(const char *path);
 size_t get_file_size(const char *path);
-char *get_output_path(const char *input);
+bool get_output_path(const char *input, char *output, size_t size);
 
 // Safety
 bool is_dangerous_directory(const char *path);
 bool check_dependencies(void);
 
 // Conversion
-bool convert_to_jxl(const char *input, const char *output, bool lossless);
-bool migrate_metadata(const char *source, const char *dest);
-bool preserve_timestamps(const char *source, const char *dest);
-bool health_check_jxl(const char *path);
+bool convert_to_jxl(const char *input, const SourceBuffer *src, const char *output,
+                    bool is_jpeg, int effort, int threads, bool *metadata_native);
+size_t encode_pixels_estimate(const FileEntry *entry, const SourceBuffer *src);
+size_t encode_memory_estimate(const FileEntry *entry, const SourceBuffer *src);
+bool predict_lossless_size(const char *input, const SourceBuffer *src, const char *trial_output,
+                           int threads, size_t *predicted);
+bool migrate_metadata(const char *source, const char *dest, int dest_fd, bool internal_done,
+                      JobTiming *timing);
+struct stat;
+bool preserve_timestamps(const struct stat *src, const char *dest, int dest_fd);
+
+// One-shot tools (spawn.c)
+int run_tool(const char *const argv[], int *lines_out);
+bool tool_available(const char *name);
+int pipe_cloexec(int fds[2]);
+
+// Persistent exiftool daemons (exiftool.c)
+void exiftool_pool_init(int size);
+void exiftool_pool_shutdown(void);
+ExifToolResult exiftool_exec(const char *const *args, int nargs, bool is_write, int *lines_out);
+
+// In-process encoder (jxl_encoder.c)
+bool jxl_encoder_available(void);
+EncodeResult jxl_encode_buffer(const uint8_t *in, size_t in_size, const char *output,
+                               bool is_jpeg, int effort, int threads, bool *metadata_native);
+size_t jxl_encode_memory(const uint8_t *in, size_t in_size);
+void jxl_encoder_shutdown(void);
+EncodeResult jxl_estimate_lossless(const uint8_t *in, size_t in_size, int threads,
+                                   size_t *predicted);
+
+// Output validation (validate.c)
+const char *validate_level_name(ValidateLevel level);
+bool validate_parse_level(const char *name, ValidateLevel *level);
+ValidateLevel validate_init(ValidateLevel requested, bool have_djxl);
+bool jxl_parse_size_header(const uint8_t *cs, size_t size, uint32_t *width, uint32_t *height);
+bool health_check_jxl(const Job *job);
+
+// Content deduplication (dedup.c)
+DedupRole dedup_claim(Job *job, const SourceBuffer *src, DedupGroup **group);
+Job *dedup_resolve(const Job *leader);
+bool dedup_clone(const char *source, const char *dest);
+void dedup_destroy(void);
+
+// Output placement and durability (output.c)
+bool durability_parse(const char *name, Durability *level);
+const char *durability_name(Durability level);
+void output_prepare(Job *job);
+void output_discard(Job *job);
+bool output_materialize(Job *job);
+bool output_candidate(const Job *job, char *path, size_t size, int *fd);
+void output_candidate_discard(const char *path, int fd);
+bool output_adopt(Job *job, const char *path, int fd);
+bool output_place(Job *job);
+void output_sync_dir(const char *path);
+void output_sync_flush(void);
+
+// Native image decoders (decoders.c)
+bool decode_image(const uint8_t *buf, size_t size, JxlImage *img, bool header_only);
+void image_copy_rows(const JxlImage *img, size_t x, size_t y, size_t w, size_t h, uint8_t *dst);
+const uint8_t *image_window(const JxlImage *img, size_t x, size_t y, size_t w, size_t h,
+                            size_t *row_offset);
+void image_free(JxlImage *img);
+void delta_decode_8(uint8_t *row, size_t n, uint32_t stride);
+
+// TIFF reader (tiff.c)
+bool tiff_parse(const uint8_t *buf, size_t size, TiffImage *tif);
+size_t tiff_segment_offset(const TiffImage *tif, uint32_t index);
+size_t tiff_segment_size(const TiffImage *tif, uint32_t index);
+bool tiff_streamable(const TiffImage *tif);
+bool tiff_decode(const TiffImage *tif, JxlImage *img);
+
+// Single-read ingestion (ingest.c)
+bool source_open(const char *path, SourceBuffer *src);
+void source_close(SourceBuffer *src);
+void ingest_pool_destroy(void);
+void *buffer_get(size_t size, size_t *capacity);
+void buffer_put(void *buf, size_t capacity);
+
+// Native metadata reader (metadata.c)
+bool parse_source_metadata(const uint8_t *buf, size_t size, SourceMetadata *md);
+void free_source_metadata(SourceMetadata *md);
+bool jpeg_frame_info(const uint8_t *buf, size_t size, JpegFrame *frame);
+
+// Statistics (stats.c)
+void stat_add(StatCounter counter, uint64_t n);
+uint64_t stat_read(StatCounter counter);
+void stats_read(Stats *out);
+void stats_start_clock(void);
+time_t stats_start_time(void);
+void stats_destroy(void);
+void progress_meter_init(ProgressMeter *m);
+void progress_sample(ProgressMeter *m, Progress *out);
+
+// Timing instrumentation (timing.c)
+bool timing_open(const char *json_path, const char *trace_path);
+void timing_close(void);
+double timing_end(JobTiming *t, TimingPhase phase, double since);
+void timing_file_done(const Job *job, FileType type, size_t in_size, size_t out_size);
+void timing_print_summary(void);
 
 // Progress
-void show_progress(int current, int total, const char *filename);
+void show_progress(const Progress *pr, const char *filename, Pipeline *pipe);
+void progress_clear(void);
 void print_summary(void);
 
-// Threading
-void *worker_thread(void *arg);
+// Pipeline (pipeline.c)
+bool pipeline_run(WorkQueue *source, int encode_workers, int verify_workers, int finalize_workers);
+void pipeline_stage_status(Pipeline *p, StageId stage, int *busy, int *workers, int *queued);
+int sq_depth(StageQueue *q);
+
+// Run manifest (manifest.c)
+bool manifest_open(const char *path);
+void manifest_close(void);
+bool manifest_enabled(void);
+FileOutcome manifest_lookup(const char *path, uint64_t size, int64_t mtime_ns,
+                            const uint64_t *content_hash);
+void manifest_record(const char *path, uint64_t size, int64_t mtime_ns,
+                     uint64_t content_hash, FileOutcome outcome);
+
+// Hashing (hash.c)
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+
+// File table (filetable.c)
+int ft_add_dir(const char *path);
+int ft_intern_dir(const char *path);
+int ft_add_file(int dir, const char *name, size_t size, int64_t mtime_ns);
+FileEntry *ft_get(int idx);
+int ft_count(void);
+const char *ft_path(const FileEntry *entry, char *buf, size_t len);
+void ft_destroy(void);
+
+// Directory scanner (scanner.c)
+bool scanner_start(Scanner *s, const char *root, bool recursive, WorkQueue *sink, int threads);
+int scanner_wait(Scanner *s);
+bool scan_queue_file(WorkQueue *sink, int dir, const char *path, const char *name,
+                     size_t size, int64_t mtime_ns);
+
+// Multi-host work ledger (ledger.c)
+bool ledger_open(const char *dir, const char *root);
+bool ledger_enabled(void);
+const char *ledger_node(void);
+bool ledger_claim(const char *path);
+void ledger_release(const char *path, FileOutcome outcome);
+void ledger_set_sink(WorkQueue *sink);
+void ledger_close_sink(WorkQueue *sink);
+void ledger_close(void);
+
+// Watch mode (watch.c)
+bool watch_start(const char *root, bool recursive, WorkQueue *sink);
+int watch_wait(void);
+
+// Source read-ahead (prefetch.c)
+void prefetch_start(void);
+const char *prefetch_backend(void);
+void prefetch_hint(const char *path);
+void prefetch_stop(void);
+
+// File-list input (filelist.c)
+bool filelist_start(const char *path, WorkQueue *sink);
+int filelist_wait(void);
+int collect_file_list(const char *path);
+
+// Work-stealing scheduler (scheduler.c)
+bool wq_init(WorkQueue *q, int num_workers);
+void wq_destroy(WorkQueue *q);
+bool wq_push(WorkQueue *q, int idx);
+void wq_close(WorkQueue *q);
+bool wq_pop(WorkQueue *q, int worker, int *idx);
+int wq_pending(WorkQueue *q);
+bool wq_drained(WorkQueue *q);
+int wq_peek(WorkQueue *q, int worker, int *out, int max);
+
+// Core budget (scheduler.c)
+int detect_cpu_count(void);
+void budget_init(CoreBudget *b, int total);
+void budget_destroy(CoreBudget *b);
+int budget_acquire(CoreBudget *b, int want);
+void budget_release(CoreBudget *b, int granted);
+int encoder_threads_for(const FileEntry *entry, size_t pixels, int budget, int share);
+
+// Memory budget (scheduler.c)
+size_t detect_physical_memory(void);
+void memory_init(MemoryBudget *m, size_t total);
+void memory_destroy(MemoryBudget *m);
+size_t memory_acquire(MemoryBudget *m, size_t want);
+void memory_release(MemoryBudget *m, size_t granted);
+size_t encode_memory_for(const FileEntry *entry);
+
+// Adaptive effort (scheduler.c)
+void effort_plan_init(EffortPlanner *p, double budget_seconds);
+void effort_plan_destroy(EffortPlanner *p);
+bool effort_plan_escalate(EffortPlanner *p, size_t in_size, size_t low_out,
+                          double low_cost, double *reserved);
+void effort_plan_record(EffortPlanner *p, double reserved, double cost,
+                        double low_cost, size_t saved, size_t low_out);
 
 // Utilities
+double monotonic_seconds(void);
 void log_info(const char *fmt, ...);
 void log_success(const char *fmt, ...);
 void log_warn(const char *fmt, ...);
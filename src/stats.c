@@ -0,0 +1,200 @@
+/**
+ * stats.c - Lock-free run statistics
+ *
+ * Every thread that bumps a counter gets its own block of StatCounter
+ * slots, padded to whole cache lines, on first use. Only the owner writes a
+ * block (relaxed atomic stores, no lock prefix and no shared lines), so the
+ * encode/verify/finalize hot paths never contend. Blocks are linked into a
+ * registry and outlive their threads; readers (progress line, summary) sum
+ * them. Counters are 64-bit, so byte totals can't wrap on multi-TB runs.
+ *
+ * The progress meter turns successive readings into throughput figures:
+ * time-weighted EWMAs of files/s and bytes/s in and out, which follow the
+ * run average until the run is older than their time constant. The ETA
+ * divides the bytes still to go (exact when the scan sized every file,
+ * else the remaining files at the average size so far) by the input rate,
+ * so one huge TIFF weighs what it costs rather than counting as one file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "static2jxl.h"
+
+#define STAT_CACHE_LINE 64
+
+typedef struct StatBlock {
+    uint64_t value[STAT_COUNT];
+    struct StatBlock *next;
+} StatBlock;
+
+static StatBlock *g_blocks = NULL;             // Registry, newest first
+static pthread_mutex_t g_blocks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread StatBlock *t_block = NULL;
+static time_t g_start_time;
+
+// First counter bump on this thread: allocate and register its block
+static StatBlock *block_register(void) {
+    size_t size = (sizeof(StatBlock) + STAT_CACHE_LINE - 1) & ~(size_t)(STAT_CACHE_LINE - 1);
+    void *mem = NULL;
+    if (posix_memalign(&mem, STAT_CACHE_LINE, size) != 0) return NULL;
+    StatBlock *b = memset(mem, 0, size);
+
+    pthread_mutex_lock(&g_blocks_mutex);
+    b->next = g_blocks;
+    g_blocks = b;
+    pthread_mutex_unlock(&g_blocks_mutex);
+    return b;
+}
+
+void stat_add(StatCounter counter, uint64_t n) {
+    StatBlock *b = t_block;
+    if (!b) {
+        b = t_block = block_register();
+        if (!b) return;            // Out of memory: the count is lost, not the run
+    }
+    uint64_t v = __atomic_load_n(&b->value[counter], __ATOMIC_RELAXED);
+    __atomic_store_n(&b->value[counter], v + n, __ATOMIC_RELAXED);
+}
+
+uint64_t stat_read(StatCounter counter) {
+    uint64_t sum = 0;
+    pthread_mutex_lock(&g_blocks_mutex);
+    for (StatBlock *b = g_blocks; b; b = b->next) {
+        sum += __atomic_load_n(&b->value[counter], __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&g_blocks_mutex);
+    return sum;
+}
+
+// Sum every block into a Stats snapshot
+void stats_read(Stats *out) {
+    uint64_t v[STAT_COUNT] = { 0 };
+    pthread_mutex_lock(&g_blocks_mutex);
+    for (StatBlock *b = g_blocks; b; b = b->next) {
+        for (int c = 0; c < STAT_COUNT; c++) {
+            v[c] += __atomic_load_n(&b->value[c], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&g_blocks_mutex);
+
+    memset(out, 0, sizeof(*out));
+    out->total = (int)v[STAT_TOTAL];
+    out->processed = (int)v[STAT_PROCESSED];
+    out->success = (int)v[STAT_SUCCESS];
+    out->failed = (int)v[STAT_FAILED];
+    out->skipped = (int)v[STAT_SKIPPED];
+    out->health_passed = (int)v[STAT_HEALTH_PASSED];
+    out->health_failed = (int)v[STAT_HEALTH_FAILED];
+    out->bytes_input = v[STAT_BYTES_INPUT];
+    out->bytes_output = v[STAT_BYTES_OUTPUT];
+    out->start_time = g_start_time;
+    out->jpeg_count = (int)v[STAT_JPEG];
+    out->png_count = (int)v[STAT_PNG];
+    out->bmp_count = (int)v[STAT_BMP];
+    out->tiff_count = (int)v[STAT_TIFF];
+    out->tga_count = (int)v[STAT_TGA];
+    out->ppm_count = (int)v[STAT_PPM];
+    out->skipped_raw = (int)v[STAT_SKIPPED_RAW];
+    out->skipped_small = (int)v[STAT_SKIPPED_SMALL];
+    out->skipped_tiff_jpeg = (int)v[STAT_SKIPPED_TIFF_JPEG];
+    out->skipped_larger = (int)v[STAT_SKIPPED_LARGER];
+    out->skipped_unsupported = (int)v[STAT_SKIPPED_UNSUPPORTED];
+    out->skipped_manifest = (int)v[STAT_SKIPPED_MANIFEST];
+    out->skipped_multipage = (int)v[STAT_SKIPPED_MULTIPAGE];
+    out->predicted_larger = (int)v[STAT_PREDICTED_LARGER];
+    out->escalated = (int)v[STAT_ESCALATED];
+    out->escalated_kept = (int)v[STAT_ESCALATED_KEPT];
+    out->escalated_saved = v[STAT_ESCALATED_SAVED];
+    out->metadata_native = (int)v[STAT_METADATA_NATIVE];
+    out->metadata_exiftool = (int)v[STAT_METADATA_EXIFTOOL];
+    out->deduplicated = (int)v[STAT_DEDUPLICATED];
+    out->dedup_bytes = v[STAT_DEDUP_BYTES];
+    out->dedup_seconds = v[STAT_DEDUP_USEC] / 1e6;
+    out->file_syncs = (int)v[STAT_FILE_SYNCS];
+    out->dir_syncs = (int)v[STAT_DIR_SYNCS];
+    out->ledger_claimed = (int)v[STAT_LEDGER_CLAIMED];
+    out->ledger_busy = (int)v[STAT_LEDGER_BUSY];
+    out->ledger_recovered = (int)v[STAT_LEDGER_RECOVERED];
+    out->prefetched = (int)v[STAT_PREFETCHED];
+    out->encoders_reused = (int)v[STAT_ENCODERS_REUSED];
+    out->runner_threads_saved = (int)v[STAT_RUNNER_THREADS_SAVED];
+    out->buffers_reused = (int)v[STAT_BUFFERS_REUSED];
+}
+
+void progress_meter_init(ProgressMeter *m) {
+    memset(m, 0, sizeof(*m));
+    m->start = m->last = monotonic_seconds();
+}
+
+void progress_sample(ProgressMeter *m, Progress *out) {
+    double now = monotonic_seconds();
+    uint64_t files = stat_read(STAT_PROCESSED);
+    uint64_t in = stat_read(STAT_BYTES_DONE);
+    uint64_t out_bytes = stat_read(STAT_BYTES_OUTPUT);
+    uint64_t total = stat_read(STAT_TOTAL);
+    uint64_t sized = stat_read(STAT_FILES_SIZED);
+    uint64_t scanned = stat_read(STAT_BYTES_SCANNED);
+
+    double dt = now - m->last;
+    if (dt > 0) {
+        // Weighted by elapsed time (~1 - e^(-dt/tau)) so the average doesn't
+        // depend on how often it is sampled; while the run is younger than
+        // tau this is the plain run average instead of a pull towards zero
+        double alpha = dt / (PROGRESS_EWMA_SECONDS + dt);
+        double warmup = dt / (now - m->start);
+        if (warmup > alpha) alpha = warmup;
+        m->files_rate += alpha * ((files - m->files) / dt - m->files_rate);
+        m->in_rate += alpha * ((in - m->in) / dt - m->in_rate);
+        m->out_rate += alpha * ((out_bytes - m->out) / dt - m->out_rate);
+    }
+    if (files > 0) m->primed = true;
+    m->last = now;
+    m->files = files;
+    m->in = in;
+    m->out = out_bytes;
+
+    out->processed = (int)files;
+    out->total = (int)total;
+    out->files_per_sec = m->files_rate;
+    out->in_per_sec = m->in_rate;
+    out->out_per_sec = m->out_rate;
+    out->eta_exact = total > 0 && sized == total;
+    out->eta_seconds = -1;
+    if (m->primed && m->in_rate > 0) {
+        double remaining;
+        if (out->eta_exact) {
+            remaining = scanned > in ? (double)(scanned - in) : 0;
+        } else {
+            remaining = (double)(total - files) * in / files;
+        }
+        out->eta_seconds = remaining / m->in_rate;
+    }
+}
+
+void stats_start_clock(void) {
+    g_start_time = time(NULL);
+}
+
+time_t stats_start_time(void) {
+    return g_start_time;
+}
+
+// Only once every counting thread has been joined
+void stats_destroy(void) {
+    pthread_mutex_lock(&g_blocks_mutex);
+    StatBlock *b = g_blocks;
+    g_blocks = NULL;
+    pthread_mutex_unlock(&g_blocks_mutex);
+    while (b) {
+        StatBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+    t_block = NULL;
+}
@@ -0,0 +1,460 @@
+/**
+ * tiff.c - In-tree TIFF reader
+ *
+ * Parses the full image directory of a TIFF from the ingested bytes and
+ * decodes it to interleaved pixels for the in-process encoder:
+ *   - every IFD of the chain is walked (bounded, cycle-safe) to count the
+ *     full-resolution pages; reduced-resolution IFDs (thumbnails) are ignored
+ *   - strips and tiles, chunky and planar layouts
+ *   - uncompressed, LZW, Deflate (with zlib) and PackBits segments
+ *   - horizontal differencing (Predictor 2); 8-bit rows share the SSE2
+ *     prefix sum of the PNG Sub filter (delta_decode_8, decoders.c)
+ *   - 8/16-bit gray and RGB, with an optional alpha sample
+ *
+ * Anything else (JPEG, palette, CMYK, float samples, ...) is reported as
+ * undecodable and keeps going to cjxl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "static2jxl.h"
+
+#define TIFF_MAX_IFDS 65536                 // Bound on the IFD chain walk
+#define TIFF_MAX_DIMENSION (1u << 20)       // Per side, well inside JXL's limit
+
+// TIFF LZW: 9-12 bit codes, MSB first, "early change" code width
+#define LZW_CLEAR 256
+#define LZW_EOI 257
+#define LZW_FIRST 258
+#define LZW_MAX_CODES 4096
+
+static uint32_t tiff_get(const TiffImage *tif, size_t pos, int bytes) {
+    const uint8_t *p = tif->base + pos;
+    if (bytes == 2) return tif->big_endian ? (uint32_t)(p[0] << 8 | p[1]) : (uint32_t)(p[1] << 8 | p[0]);
+    return tif->big_endian ? (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]
+                           : (uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+}
+
+static int type_size(uint32_t type) {
+    return (type == 3) ? 2 : (type == 4) ? 4 : 0;   // SHORT / LONG
+}
+
+// NewSubfileType bit 0: a reduced-resolution copy of another image.
+// Tags are in ascending order (TIFF 6.0), so 254 is one of the first
+// entries and the walk stops at the first tag past it; long EXIF-laden
+// IFDs of a page chain are not read to the end. An unsorted IFD that
+// hides 254 further on counts as a page, which only errs towards the
+// multi-page skip.
+static bool ifd_is_reduced(const TiffImage *tif, size_t ifd, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        size_t e = ifd + 2 + (size_t)i * 12;
+        uint32_t tag = tiff_get(tif, e, 2);
+        if (tag == 254) return (tiff_get(tif, e + 8, 4) & 1) != 0;
+        if (tag > 254) break;
+    }
+    return false;
+}
+
+bool tiff_parse(const uint8_t *buf, size_t size, TiffImage *tif) {
+    memset(tif, 0, sizeof(*tif));
+    if (size < 8) return false;
+    if (buf[0] == 'I' && buf[1] == 'I') tif->big_endian = false;
+    else if (buf[0] == 'M' && buf[1] == 'M') tif->big_endian = true;
+    else return false;
+    tif->base = buf;
+    tif->size = size;
+    if (tiff_get(tif, 2, 2) != 42) return false;
+
+    size_t ifd = tiff_get(tif, 4, 4);
+    if (ifd < 8 || ifd + 2 > size) return false;
+    uint32_t count = tiff_get(tif, ifd, 2);
+    if (ifd + 2 + (size_t)count * 12 + 4 > size) return false;
+
+    // TIFF 6.0 defaults for absent tags
+    tif->bits = 1;
+    tif->samples = 1;
+    tif->compression = 1;
+    tif->planar = 1;
+    tif->predictor = 1;
+    tif->sample_format = 1;
+    tif->photometric = UINT32_MAX;
+    uint32_t rows_per_strip = UINT32_MAX;
+    uint32_t extra_samples = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        size_t e = ifd + 2 + (size_t)i * 12;
+        uint32_t tag = tiff_get(tif, e, 2);
+        uint32_t type = tiff_get(tif, e + 2, 2);
+        uint32_t n = tiff_get(tif, e + 4, 4);
+        int bytes = type_size(type);
+        if (bytes == 0 || n == 0) continue;        // No tag we need uses other types
+        size_t data = ((size_t)n * bytes <= 4) ? e + 8 : tiff_get(tif, e + 8, 4);
+        if (data + (size_t)n * bytes > size) return false;
+        uint32_t value = tiff_get(tif, data, bytes);
+
+        switch (tag) {
+            case 256: tif->width = value; break;
+            case 257: tif->height = value; break;
+            case 258:   // BitsPerSample: one per sample, all must match
+                tif->bits = value;
+                for (uint32_t k = 1; k < n; k++) {
+                    if (tiff_get(tif, data + (size_t)k * bytes, bytes) != value) tif->bits = 0;
+                }
+                break;
+            case 259: tif->compression = value; break;
+            case 262: tif->photometric = value; break;
+            case 273: case 324:   // StripOffsets / TileOffsets
+                tif->offsets_pos = data;
+                tif->offsets_type = (uint16_t)type;
+                tif->segments = n;
+                tif->tiled = (tag == 324);
+                break;
+            case 279: case 325:   // StripByteCounts / TileByteCounts
+                tif->counts_pos = data;
+                tif->counts_type = (uint16_t)type;
+                tif->count_entries = n;
+                break;
+            case 277: tif->samples = value; break;
+            case 278: rows_per_strip = value; break;
+            case 284: tif->planar = value; break;
+            case 317: tif->predictor = value; break;
+            case 322: tif->seg_width = value; break;
+            case 323: tif->seg_height = value; break;
+            case 338:
+                extra_samples = n;
+                tif->alpha = value;   // 1 = associated, 2 = unassociated
+                break;
+            case 339: tif->sample_format = value; break;
+        }
+    }
+
+    if (tif->width == 0 || tif->height == 0 || tif->segments == 0 || tif->counts_pos == 0) return false;
+    // Every segment needs its byte count: tiff_segment_size() indexes both arrays
+    if (tif->count_entries < tif->segments) return false;
+    if (extra_samples > 1 || (extra_samples == 1 && tif->alpha != 1 && tif->alpha != 2)) {
+        tif->alpha = UINT32_MAX;   // Unknown extra samples: not decodable
+    }
+    if (!tif->tiled) {
+        tif->seg_width = tif->width;
+        tif->seg_height = (rows_per_strip == 0 || rows_per_strip > tif->height) ? tif->height
+                                                                                : rows_per_strip;
+    }
+    if (tif->seg_width == 0 || tif->seg_height == 0) return false;
+
+    // Walk the rest of the chain for further full-resolution images
+    tif->pages = ifd_is_reduced(tif, ifd, count) ? 0 : 1;
+    size_t next = tiff_get(tif, ifd + 2 + (size_t)count * 12, 4);
+    for (int walked = 1; next != 0 && walked < TIFF_MAX_IFDS; walked++) {
+        if (next + 2 > size) break;
+        uint32_t n = tiff_get(tif, next, 2);
+        if (next + 2 + (size_t)n * 12 + 4 > size) break;
+        if (!ifd_is_reduced(tif, next, n)) tif->pages++;
+        size_t following = tiff_get(tif, next + 2 + (size_t)n * 12, 4);
+        if (following == next) break;
+        next = following;
+    }
+    if (tif->pages == 0) tif->pages = 1;   // Only thumbnails: IFD0 is the image
+    return true;
+}
+
+static size_t segment_field(const TiffImage *tif, size_t pos, uint16_t type, uint32_t index) {
+    int bytes = type_size(type);
+    return tiff_get(tif, pos + (size_t)index * bytes, bytes);
+}
+
+size_t tiff_segment_offset(const TiffImage *tif, uint32_t index) {
+    return segment_field(tif, tif->offsets_pos, tif->offsets_type, index);
+}
+
+size_t tiff_segment_size(const TiffImage *tif, uint32_t index) {
+    return segment_field(tif, tif->counts_pos, tif->counts_type, index);
+}
+
+static uint32_t color_samples(const TiffImage *tif) {
+    return tif->samples - (tif->alpha ? 1 : 0);
+}
+
+static bool compression_supported(uint32_t compression) {
+    switch (compression) {
+        case 1: case 5: case 32773: return true;
+#ifdef HAVE_ZLIB
+        case 8: case 32946: return true;
+#endif
+        default: return false;
+    }
+}
+
+// Gray/RGB (+ alpha) unsigned 8/16-bit in a layout we can decode
+static bool tiff_decodable(const TiffImage *tif) {
+    if (tif->bits != 8 && tif->bits != 16) return false;
+    if (tif->sample_format != 1 || tif->alpha == UINT32_MAX) return false;
+    if (tif->planar != 1 && tif->planar != 2) return false;
+    if (tif->predictor != 1 && tif->predictor != 2) return false;
+    if (tif->width > TIFF_MAX_DIMENSION || tif->height > TIFF_MAX_DIMENSION) return false;
+    if (tif->tiled && (tif->seg_width % 16 || tif->seg_height % 16)) return false;
+    uint32_t color = color_samples(tif);
+    bool gray = (tif->photometric == 0 || tif->photometric == 1) && color == 1;
+    bool rgb = tif->photometric == 2 && color == 3;
+    return (gray || rgb) && compression_supported(tif->compression);
+}
+
+// Strips the encoder can read in place: no decoding needed at all
+bool tiff_streamable(const TiffImage *tif) {
+    return tiff_decodable(tif) && tif->compression == 1 && tif->predictor == 1 &&
+           tif->planar == 1 && !tif->tiled && tif->alpha == 0 && tif->photometric != 0;
+}
+
+// ============================================================================
+// Segment decompression
+// ============================================================================
+
+// Returns bytes written to `out` (at most `cap`), or 0 on a corrupt stream
+static size_t lzw_decode(const uint8_t *in, size_t in_size, uint8_t *out, size_t cap) {
+    static __thread uint32_t entry_pos[LZW_MAX_CODES];
+    static __thread uint16_t entry_len[LZW_MAX_CODES];
+
+    // Old-style (LSB-first) LZW from pre-6.0 writers
+    if (in_size >= 2 && in[0] == 0 && (in[1] & 1)) return 0;
+
+    uint32_t bitbuf = 0;
+    int nbits = 0, width = 9;
+    uint32_t next = LZW_FIRST;
+    size_t pos = 0, in_pos = 0;
+    size_t prev_pos = 0, prev_len = 0;
+    bool have_prev = false;
+
+    while (pos < cap) {
+        while (nbits < width) {
+            if (in_pos >= in_size) return pos;   // Missing EOI is common
+            bitbuf = (bitbuf << 8) | in[in_pos++];
+            nbits += 8;
+        }
+        uint32_t code = (bitbuf >> (nbits - width)) & ((1u << width) - 1);
+        nbits -= width;
+
+        if (code == LZW_EOI) break;
+        if (code == LZW_CLEAR) {
+            width = 9;
+            next = LZW_FIRST;
+            have_prev = false;
+            continue;
+        }
+
+        size_t start = pos;
+        size_t len;
+        if (code < 256) {
+            out[pos++] = (uint8_t)code;
+            len = 1;
+        } else if (code < next && have_prev) {
+            // Strings live in the output already: copy the earlier occurrence
+            len = entry_len[code];
+            if (len > cap - pos) len = cap - pos;
+            memcpy(out + pos, out + entry_pos[code], len);
+            pos += len;
+        } else if (code == next && have_prev) {
+            // KwKwK: previous string plus its own first byte
+            len = prev_len + 1;
+            if (len > cap - pos) len = cap - pos;
+            memmove(out + pos, out + prev_pos, len > prev_len ? prev_len : len);
+            if (len > prev_len) out[pos + prev_len] = out[prev_pos];
+            pos += len;
+        } else {
+            return 0;
+        }
+
+        // New entry = previous string + first byte of this one, which
+        // directly follows it in the output
+        if (have_prev && next < LZW_MAX_CODES) {
+            entry_pos[next] = (uint32_t)prev_pos;
+            entry_len[next] = (uint16_t)(prev_len + 1);
+            next++;
+            if (next + 1 >= (1u << width) && width < 12) width++;
+        }
+        prev_pos = start;
+        prev_len = len;
+        have_prev = true;
+        if (pos > UINT32_MAX) return 0;   // Entry positions are 32-bit
+    }
+    return pos;
+}
+
+static size_t packbits_decode(const uint8_t *in, size_t in_size, uint8_t *out, size_t cap) {
+    size_t i = 0, pos = 0;
+    while (i < in_size && pos < cap) {
+        int8_t n = (int8_t)in[i++];
+        if (n >= 0) {
+            size_t run = (size_t)n + 1;
+            if (run > in_size - i || run > cap - pos) return 0;
+            memcpy(out + pos, in + i, run);
+            i += run;
+            pos += run;
+        } else if (n != -128) {
+            size_t run = (size_t)(1 - n);
+            if (i >= in_size || run > cap - pos) return 0;
+            memset(out + pos, in[i++], run);
+            pos += run;
+        }
+    }
+    return pos;
+}
+
+#ifdef HAVE_ZLIB
+static size_t deflate_decode(const uint8_t *in, size_t in_size, uint8_t *out, size_t cap) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) return 0;
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = (uInt)in_size;
+    zs.next_out = out;
+    zs.avail_out = (uInt)cap;
+    int rc = inflate(&zs, Z_FINISH);
+    size_t written = zs.total_out;
+    inflateEnd(&zs);
+    return (rc == Z_STREAM_END || written == cap) ? written : 0;
+}
+#endif
+
+// Decompress one segment into `out`; true when all `expected` bytes arrived
+static bool decode_segment(const TiffImage *tif, const uint8_t *in, size_t in_size,
+                           uint8_t *out, size_t expected) {
+    size_t written = 0;
+    switch (tif->compression) {
+        case 1:
+            written = in_size < expected ? in_size : expected;
+            memcpy(out, in, written);
+            break;
+        case 5:
+            written = lzw_decode(in, in_size, out, expected);
+            break;
+        case 32773:
+            written = packbits_decode(in, in_size, out, expected);
+            break;
+#ifdef HAVE_ZLIB
+        case 8: case 32946:
+            written = deflate_decode(in, in_size, out, expected);
+            break;
+#endif
+    }
+    return written == expected;
+}
+
+// ============================================================================
+// Predictor 2: horizontal differencing
+// ============================================================================
+
+static void undo_predictor_16(uint8_t *row, size_t n, uint32_t stride, bool big_endian) {
+    for (size_t i = stride; i < n; i++) {
+        uint8_t *cur = row + i * 2;
+        const uint8_t *left = row + (i - stride) * 2;
+        uint16_t a = big_endian ? (uint16_t)(cur[0] << 8 | cur[1]) : (uint16_t)(cur[1] << 8 | cur[0]);
+        uint16_t b = big_endian ? (uint16_t)(left[0] << 8 | left[1]) : (uint16_t)(left[1] << 8 | left[0]);
+        uint16_t v = (uint16_t)(a + b);
+        cur[big_endian ? 0 : 1] = (uint8_t)(v >> 8);
+        cur[big_endian ? 1 : 0] = (uint8_t)v;
+    }
+}
+
+// ============================================================================
+// Full decode
+// ============================================================================
+
+// Decode all segments to interleaved, tightly packed rows in file byte
+// order. The buffer is returned in img->owned (released by image_free).
+bool tiff_decode(const TiffImage *tif, JxlImage *img) {
+    memset(img, 0, sizeof(*img));
+    if (!tiff_decodable(tif)) return false;
+
+    uint32_t bps = tif->bits / 8;
+    uint32_t planes = (tif->planar == 2) ? tif->samples : 1;
+    uint32_t seg_samples = (tif->planar == 2) ? 1 : tif->samples;   // Samples per pixel in a segment
+    uint32_t across = (tif->width + tif->seg_width - 1) / tif->seg_width;
+    uint32_t down = (tif->height + tif->seg_height - 1) / tif->seg_height;
+    uint64_t per_plane = (uint64_t)across * down;
+    if (per_plane * planes > tif->segments) return false;
+
+    size_t pixel_bytes = (size_t)tif->samples * bps;
+    size_t out_stride = (size_t)tif->width * pixel_bytes;
+    size_t seg_stride = (size_t)tif->seg_width * seg_samples * bps;
+    size_t pixels_capacity, seg_capacity;
+    uint8_t *pixels = buffer_get(out_stride * tif->height, &pixels_capacity);
+    uint8_t *seg = buffer_get(seg_stride * tif->seg_height, &seg_capacity);
+    bool ok = pixels && seg;
+
+    for (uint32_t plane = 0; ok && plane < planes; plane++) {
+        for (uint32_t s = 0; ok && s < per_plane; s++) {
+            uint32_t index = (uint32_t)(plane * per_plane + s);
+            uint32_t x0 = (s % across) * tif->seg_width;
+            uint32_t y0 = (s / across) * tif->seg_height;
+            // Strips are cut at the image bottom; tiles are always full size
+            uint32_t rows = tif->seg_height;
+            if (!tif->tiled && y0 + rows > tif->height) rows = tif->height - y0;
+
+            size_t offset = tiff_segment_offset(tif, index);
+            size_t length = tiff_segment_size(tif, index);
+            if (offset > tif->size || length > tif->size - offset ||
+                !decode_segment(tif, tif->base + offset, length, seg, seg_stride * rows)) {
+                ok = false;
+                break;
+            }
+
+            uint32_t cols = (x0 + tif->seg_width > tif->width) ? tif->width - x0 : tif->seg_width;
+            uint32_t visible = (y0 + rows > tif->height) ? tif->height - y0 : rows;
+            for (uint32_t r = 0; r < visible; r++) {
+                uint8_t *src = seg + (size_t)r * seg_stride;
+                if (tif->predictor == 2) {
+                    size_t n = (size_t)tif->seg_width * seg_samples;
+                    if (bps == 1) delta_decode_8(src, n, seg_samples);
+                    else undo_predictor_16(src, n, seg_samples, tif->big_endian);
+                }
+                uint8_t *dst = pixels + (size_t)(y0 + r) * out_stride + (size_t)x0 * pixel_bytes;
+                if (planes == 1) {
+                    memcpy(dst, src, (size_t)cols * pixel_bytes);
+                } else {
+                    for (uint32_t x = 0; x < cols; x++) {
+                        memcpy(dst + x * pixel_bytes + plane * bps, src + (size_t)x * bps, bps);
+                    }
+                }
+            }
+        }
+    }
+    buffer_put(seg, seg_capacity);
+    if (!ok) {
+        buffer_put(pixels, pixels_capacity);
+        return false;
+    }
+
+    // WhiteIsZero: flip to the usual black-is-zero gray
+    if (tif->photometric == 0) {
+        size_t count = out_stride * tif->height;
+        if (bps == 1) {
+            for (size_t i = 0; i < count; i += pixel_bytes) pixels[i] = (uint8_t)~pixels[i];
+        } else {
+            for (size_t i = 0; i < count; i += pixel_bytes) {
+                pixels[i] = (uint8_t)~pixels[i];
+                pixels[i + 1] = (uint8_t)~pixels[i + 1];
+            }
+        }
+    }
+
+    img->width = tif->width;
+    img->height = tif->height;
+    img->channels = tif->samples;
+    img->bits = tif->bits;
+    img->bytes_per_sample = bps;
+    img->big_endian = tif->big_endian;
+    img->alpha = tif->alpha != 0;
+    img->alpha_premultiplied = tif->alpha == 1;
+    img->pixels = pixels;
+    img->owned = pixels;
+    img->owned_capacity = pixels_capacity;
+    img->size = out_stride * tif->height;
+    return true;
+}
@@ -0,0 +1,331 @@
+/**
+ * validate.c - In-process JXL health check
+ *
+ * Replaces a `djxl file /dev/null` pixel decode (and a `which djxl` probe)
+ * per output with three levels:
+ *   - header:     box layout of the container (signature, ftyp, one jxlc
+ *                 or an ordered jxlp run, jbrd for JPEG transcodes) and
+ *                 the codestream signature + SizeHeader
+ *   - structural: header, then libjxl walks every frame header and TOC and
+ *                 checks that all sections are present, without
+ *                 reconstructing pixels
+ *   - full:       header, then a complete libjxl decode; JPEG transcodes
+ *                 are reconstructed and must match the source size and
+ *                 XXH64, a bit-exact reversibility check
+ *
+ * Without libjxl the frame-level checks fall back to djxl, probed once at
+ * startup: structural becomes full, or header when djxl is missing. JPEG
+ * transcodes are rebuilt in a private directory under $TMPDIR.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "static2jxl.h"
+
+#ifdef HAVE_LIBJXL
+#include <jxl/decode.h>
+#endif
+
+#define JXL_MAX_DIMENSION (1u << 30)        // Codestream limit per side
+
+static const char *LEVEL_NAMES[] = { "none", "header", "structural", "full" };
+
+static uint32_t be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+const char *validate_level_name(ValidateLevel level) {
+    return LEVEL_NAMES[level];
+}
+
+bool validate_parse_level(const char *name, ValidateLevel *level) {
+    for (int i = VALIDATE_NONE; i <= VALIDATE_FULL; i++) {
+        if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+            *level = (ValidateLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Level actually run for `requested`, given the tools this build has
+ValidateLevel validate_init(ValidateLevel requested, bool have_djxl) {
+#ifdef HAVE_LIBJXL
+    (void)have_djxl;   // Every level runs in process
+#else
+    if (requested >= VALIDATE_STRUCTURAL) {
+        if (have_djxl) {
+            // djxl can only decode everything
+            if (requested < VALIDATE_FULL) {
+                log_warn("libjxl not built in: health check upgraded from %s to full (djxl decode)",
+                         LEVEL_NAMES[requested]);
+            }
+            return VALIDATE_FULL;
+        }
+        log_warn("djxl not found and libjxl not built in: health check limited to headers");
+        return VALIDATE_HEADER;
+    }
+#endif
+    return requested;
+}
+
+// ============================================================================
+// Header level
+// ============================================================================
+
+// LSB-first bit reader over the first bytes of the codestream
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t bit;
+} BitReader;
+
+static uint32_t read_bits(BitReader *br, int n) {
+    uint32_t v = 0;
+    for (int i = 0; i < n; i++, br->bit++) {
+        size_t byte = br->bit / 8;
+        if (byte >= br->size) continue;   // Past the end: callers check br->bit
+        v |= (uint32_t)((br->data[byte] >> (br->bit % 8)) & 1) << i;
+    }
+    return v;
+}
+
+// SizeHeader dimension: U32(1 + u(9), 1 + u(13), 1 + u(18), 1 + u(30))
+static uint32_t read_size(BitReader *br) {
+    static const int bits[4] = { 9, 13, 18, 30 };
+    return 1 + read_bits(br, bits[read_bits(br, 2)]);
+}
+
+// Codestream signature and SizeHeader (ISO/IEC 18181-1 D.2)
+bool jxl_parse_size_header(const uint8_t *cs, size_t size, uint32_t *width, uint32_t *height) {
+    static const uint32_t ratio[8][2] = { {0, 0}, {1, 1}, {12, 10}, {4, 3}, {3, 2}, {16, 9}, {5, 4}, {2, 1} };
+    if (size < 3 || cs[0] != 0xff || cs[1] != 0x0a) return false;
+
+    BitReader br = { cs + 2, size - 2, 0 };
+    bool small = read_bits(&br, 1);
+    uint64_t h = small ? (read_bits(&br, 5) + 1) * 8 : read_size(&br);
+    uint32_t r = read_bits(&br, 3);
+    uint64_t w;
+    if (r != 0) {
+        w = h * ratio[r][0] / ratio[r][1];
+    } else {
+        w = small ? (read_bits(&br, 5) + 1) * 8 : read_size(&br);
+    }
+    if (br.bit > br.size * 8) return false;
+    if (w == 0 || h == 0 || w > JXL_MAX_DIMENSION || h > JXL_MAX_DIMENSION) return false;
+    *width = (uint32_t)w;
+    *height = (uint32_t)h;
+    return true;
+}
+
+// Box layout of a JXL file. `head` gets the first codestream bytes (which
+// may span several jxlp boxes) for the SizeHeader.
+typedef struct {
+    uint8_t head[16];
+    size_t head_size;
+    bool has_jbrd;
+} JxlLayout;
+
+static void layout_append(JxlLayout *layout, const uint8_t *data, size_t size) {
+    size_t room = sizeof(layout->head) - layout->head_size;
+    size_t n = size < room ? size : room;
+    memcpy(layout->head + layout->head_size, data, n);
+    layout->head_size += n;
+}
+
+static bool parse_layout(const uint8_t *data, size_t size, JxlLayout *layout) {
+    static const uint8_t SIGNATURE_BOX[12] = { 0, 0, 0, 12, 'J', 'X', 'L', ' ', 0x0d, 0x0a, 0x87, 0x0a };
+    memset(layout, 0, sizeof(*layout));
+
+    if (size >= 2 && data[0] == 0xff && data[1] == 0x0a) {
+        layout_append(layout, data, size);   // Bare codestream
+        return true;
+    }
+    if (size < 12 || memcmp(data, SIGNATURE_BOX, 12) != 0) return false;
+
+    size_t pos = 12;
+    int boxes = 0, jxlc = 0;
+    uint32_t next_part = 0;
+    bool last_part = false;
+    while (pos < size) {
+        if (size - pos < 8) return false;
+        uint64_t box_size = be32(data + pos);
+        const uint8_t *type = data + pos + 4;
+        size_t header = 8;
+        if (box_size == 1) {
+            if (size - pos < 16) return false;
+            box_size = ((uint64_t)be32(data + pos + 8) << 32) | be32(data + pos + 12);
+            header = 16;
+        } else if (box_size == 0) {
+            box_size = size - pos;   // Runs to the end of the file
+        }
+        if (box_size < header || box_size > size - pos) return false;
+        const uint8_t *payload = data + pos + header;
+        size_t payload_size = (size_t)box_size - header;
+
+        if (boxes++ == 0) {
+            // ftyp must follow the signature
+            if (memcmp(type, "ftyp", 4) != 0 || payload_size < 4 || memcmp(payload, "jxl ", 4) != 0) {
+                return false;
+            }
+        } else if (!memcmp(type, "jxlc", 4)) {
+            if (jxlc++ || next_part) return false;
+            layout_append(layout, payload, payload_size);
+        } else if (!memcmp(type, "jxlp", 4)) {
+            if (jxlc || last_part || payload_size < 4) return false;
+            uint32_t index = be32(payload);
+            if ((index & 0x7fffffff) != next_part++) return false;
+            last_part = (index & 0x80000000) != 0;
+            layout_append(layout, payload + 4, payload_size - 4);
+        } else if (!memcmp(type, "jbrd", 4)) {
+            layout->has_jbrd = true;
+        }
+        pos += (size_t)box_size;
+    }
+    return jxlc == 1 || (next_part > 0 && last_part);
+}
+
+static bool check_header(const uint8_t *data, size_t size, const Job *job) {
+    JxlLayout layout;
+    uint32_t width, height;
+    if (!parse_layout(data, size, &layout)) return false;
+    if (job->jpeg_transcode && !layout.has_jbrd) return false;   // Not reversible
+    return jxl_parse_size_header(layout.head, layout.head_size, &width, &height);
+}
+
+// ============================================================================
+// Structural / full level
+// ============================================================================
+
+#ifdef HAVE_LIBJXL
+
+static void discard_pixels(void *opaque, size_t x, size_t y, size_t num_pixels, const void *pixels) {
+    (void)opaque;
+    (void)x;
+    (void)y;
+    (void)num_pixels;
+    (void)pixels;
+}
+
+// Structural: frame headers and TOCs only; libjxl skips each frame's
+// sections by their TOC sizes and fails if any is missing. Full: every
+// pixel, plus the JPEG reconstruction of transcodes.
+static bool check_frames(const uint8_t *data, size_t size, ValidateLevel level, const Job *job) {
+    JxlDecoder *dec = JxlDecoderCreate(NULL);
+    if (!dec) return false;
+
+    bool reconstruct = (level == VALIDATE_FULL && job->jpeg_transcode);
+    int events = JXL_DEC_BASIC_INFO | (level == VALIDATE_FULL ? JXL_DEC_FULL_IMAGE : JXL_DEC_FRAME);
+    if (reconstruct) events |= JXL_DEC_JPEG_RECONSTRUCTION;
+
+    JxlBasicInfo info;
+    memset(&info, 0, sizeof(info));
+    uint8_t *jpeg = NULL;
+    bool jpeg_matched = false;
+    bool ok = JxlDecoderSubscribeEvents(dec, events) == JXL_DEC_SUCCESS &&
+              JxlDecoderSetInput(dec, data, size) == JXL_DEC_SUCCESS;
+    if (ok) JxlDecoderCloseInput(dec);
+
+    while (ok) {
+        JxlDecoderStatus status = JxlDecoderProcessInput(dec);
+        if (status == JXL_DEC_SUCCESS) break;
+
+        switch (status) {
+            case JXL_DEC_BASIC_INFO:
+                ok = JxlDecoderGetBasicInfo(dec, &info) == JXL_DEC_SUCCESS;
+                break;
+            case JXL_DEC_FRAME:
+                break;
+            case JXL_DEC_JPEG_RECONSTRUCTION:
+                // One spare byte: a longer reconstruction shows up as NEED_MORE_OUTPUT
+                jpeg = malloc(job->jpeg_size + 1);
+                ok = jpeg && JxlDecoderSetJPEGBuffer(dec, jpeg, job->jpeg_size + 1) == JXL_DEC_SUCCESS;
+                break;
+            case JXL_DEC_NEED_IMAGE_OUT_BUFFER: {
+                JxlPixelFormat format = {
+                    .num_channels = info.num_color_channels + (info.alpha_bits ? 1 : 0),
+                    .data_type = info.bits_per_sample > 8 ? JXL_TYPE_UINT16 : JXL_TYPE_UINT8,
+                    .endianness = JXL_NATIVE_ENDIAN,
+                    .align = 0
+                };
+                ok = JxlDecoderSetImageOutCallback(dec, &format, discard_pixels, NULL) == JXL_DEC_SUCCESS;
+                break;
+            }
+            case JXL_DEC_FULL_IMAGE:
+                if (jpeg) {
+                    size_t produced = job->jpeg_size + 1 - JxlDecoderReleaseJPEGBuffer(dec);
+                    jpeg_matched = produced == job->jpeg_size &&
+                                   xxh64(jpeg, produced, 0) == job->jpeg_hash;
+                    ok = jpeg_matched;
+                }
+                break;
+            default:
+                // Error, truncated input (the input is closed) or an
+                // unexpected request such as a longer JPEG than the source
+                ok = false;
+                break;
+        }
+    }
+    if (ok && reconstruct) ok = jpeg_matched;
+
+    free(jpeg);
+    JxlDecoderDestroy(dec);
+    return ok;
+}
+
+#else  // !HAVE_LIBJXL
+
+// Full decode through djxl; transcodes are reconstructed to a file and compared
+static bool check_frames(const uint8_t *data, size_t size, ValidateLevel level, const Job *job) {
+    (void)data;
+    (void)size;
+    (void)level;
+    if (!job->jpeg_transcode) {
+        const char *argv[] = { "djxl", job->temp_output, "/dev/null", NULL };
+        return run_tool(argv, NULL) == 0;
+    }
+
+    // Rebuilt in a private directory under $TMPDIR, never beside the output
+    // in the tree being converted (djxl picks the format by extension)
+    const char *tmp = getenv("TMPDIR");
+    char dir[MAX_PATH_LEN], reconstructed[MAX_PATH_LEN + 16];
+    if (snprintf(dir, sizeof(dir), "%s/static2jxl-XXXXXX", tmp && tmp[0] ? tmp : "/tmp") >=
+            (int)sizeof(dir) || !mkdtemp(dir)) {
+        return false;
+    }
+    snprintf(reconstructed, sizeof(reconstructed), "%s/rec.jpg", dir);
+    const char *argv[] = { "djxl", job->temp_output, reconstructed, NULL };
+    bool ok = run_tool(argv, NULL) == 0;
+
+    SourceBuffer rec;
+    if (ok && source_open(reconstructed, &rec)) {
+        ok = rec.size == job->jpeg_size && xxh64(rec.data, rec.size, 0) == job->jpeg_hash;
+        source_close(&rec);
+    } else {
+        ok = false;
+    }
+    unlink(reconstructed);
+    rmdir(dir);
+    return ok;
+}
+
+#endif  // HAVE_LIBJXL
+
+// Health check of a finished output at g_config.validate
+bool health_check_jxl(const Job *job) {
+    ValidateLevel level = g_config.validate;
+    if (level == VALIDATE_NONE) return true;
+
+    SourceBuffer out;
+    if (!source_open(job->temp_output, &out)) return false;
+
+    bool ok = out.size > 0 && check_header(out.data, out.size, job);
+    if (ok && level >= VALIDATE_STRUCTURAL) ok = check_frames(out.data, out.size, level, job);
+    source_close(&out);
+    return ok;
+}
@@ -0,0 +1,559 @@
+/**
+ * watch.c - Watch mode (--watch)
+ *
+ * Instead of a cron job rescanning the whole tree, the process keeps
+ * running: the encode workers, exiftool daemons and ingest pool stay warm,
+ * and one watcher thread queues files as they arrive. Linux uses inotify
+ * (a watch per directory, added as directories appear); macOS uses one
+ * FSEvents stream with per-file events.
+ *
+ * A file is queued once it has quiesced: WATCH_CLOSE_DELAY after its writer
+ * closed it (IN_CLOSE_WRITE, or renamed into place), or - when no close is
+ * seen (FSEvents, writers that keep the file open) - once two looks
+ * WATCH_SETTLE_SECONDS apart find the same size and mtime. Events only
+ * touch a pending table; deciding what is ready is done every tick.
+ *
+ * Files already in the tree are found by the watcher's own walk, made after
+ * each directory's watch is in place so nothing can land unseen between
+ * the two; files older than the settle time are queued straight away.
+ * Our own scratch files (x.jxl, x.jxl.tmp, x.jxl.trial ...) are ignored.
+ * Ctrl-C closes the queue: work in flight finishes as in a normal run.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#elif defined(__APPLE__)
+#include <CoreServices/CoreServices.h>
+#endif
+
+#include "static2jxl.h"
+
+// A file seen changing, not yet queued
+typedef struct Pending {
+    struct Pending *next;
+    double due;                    // Monotonic time of the next look
+    bool closed;                   // Writer is done: ready at `due`
+    bool sized;                    // size/mtime hold the previous look
+    size_t size;
+    int64_t mtime_ns;
+    char path[];
+} Pending;
+
+static Pending *g_pending[WATCH_BUCKETS];
+static pthread_mutex_t g_pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static WorkQueue *g_sink = NULL;
+static char g_root[MAX_PATH_LEN];
+static bool g_recursive = true;
+static bool g_failed = false;
+static int g_queued = 0;
+static pthread_t g_thread;
+static bool g_started = false;
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+static size_t bucket_of(const char *path) {
+    return xxh64(path, strlen(path), 0) & (WATCH_BUCKETS - 1);
+}
+
+static int64_t wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Hidden files, and everything the pipeline itself writes next to a source
+static bool name_ignored(const char *name) {
+    if (name[0] == '.' || name[0] == '\0') return true;
+    size_t len = strlen(name);
+    if (len >= 4 && (strcasecmp(name + len - 4, ".jxl") == 0 || strcmp(name + len - 4, ".tmp") == 0)) {
+        return true;
+    }
+    return strstr(name, ".jxl.") != NULL;     // .jxl.tmp, .jxl.trial, .jxl.hi, .jxl.rec.jpg
+}
+
+// A pending file is ready once its writer closed it, or once the second of
+// two looks WATCH_SETTLE_SECONDS apart sees the size and mtime unchanged
+static bool settle_ready(const Pending *p, size_t size, int64_t mtime_ns) {
+    if (p->closed) return true;
+    return p->sized && p->size == size && p->mtime_ns == mtime_ns;
+}
+
+static void queue_file(const char *path, size_t size, int64_t mtime_ns) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) return;
+    char dir[MAX_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+
+    int idx = ft_intern_dir(dir);
+    if (idx < 0 || !scan_queue_file(g_sink, idx, path, slash + 1, size, mtime_ns)) {
+        if (!g_failed) log_error("Memory allocation failed: file table is full");
+        g_failed = true;
+        return;
+    }
+    g_queued++;
+    if (g_config.verbose) log_info("👀 Queued: %s", path);
+}
+
+// ============================================================================
+// Pending table
+// ============================================================================
+
+static Pending **pending_find(const char *path) {
+    Pending **p = &g_pending[bucket_of(path)];
+    while (*p && strcmp((*p)->path, path) != 0) p = &(*p)->next;
+    return p;
+}
+
+// An event for `path`: (re)start its quiet period
+static void pending_touch(const char *path, bool closed) {
+    double now = monotonic_seconds();
+    pthread_mutex_lock(&g_pending_mutex);
+    Pending **slot = pending_find(path);
+    Pending *p = *slot;
+    if (!p) {
+        size_t len = strlen(path);
+        p = calloc(1, sizeof(Pending) + len + 1);
+        if (p) {
+            memcpy(p->path, path, len + 1);
+            *slot = p;
+        }
+    }
+    if (p) {
+        p->closed = closed;
+        p->due = now + (closed ? WATCH_CLOSE_DELAY : WATCH_SETTLE_SECONDS);
+    }
+    pthread_mutex_unlock(&g_pending_mutex);
+}
+
+static bool pending_has(const char *path) {
+    pthread_mutex_lock(&g_pending_mutex);
+    bool found = *pending_find(path) != NULL;
+    pthread_mutex_unlock(&g_pending_mutex);
+    return found;
+}
+
+static void walk_tree(const char *dir, int64_t since_ns);
+
+// Queue every pending file whose quiet period is over
+static void settle_pending(void) {
+    double now = monotonic_seconds();
+    Pending *due = NULL;
+
+    pthread_mutex_lock(&g_pending_mutex);
+    for (int b = 0; b < WATCH_BUCKETS; b++) {
+        for (Pending **p = &g_pending[b]; *p;) {
+            if ((*p)->due <= now) {
+                Pending *e = *p;
+                *p = e->next;
+                e->next = due;
+                due = e;
+            } else {
+                p = &(*p)->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_pending_mutex);
+
+    while (due) {
+        Pending *e = due;
+        due = e->next;
+
+        struct stat st;
+        if (stat(e->path, &st) != 0) {            // Gone (or converted in place)
+            free(e);
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {                // FSEvents: a directory arrived
+            if (g_recursive) walk_tree(e->path, 0);
+            free(e);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            free(e);
+            continue;
+        }
+
+        int64_t mtime_ns = STAT_MTIME_NS(st);
+        if (settle_ready(e, (size_t)st.st_size, mtime_ns)) {
+            queue_file(e->path, (size_t)st.st_size, mtime_ns);
+            free(e);
+            continue;
+        }
+
+        // Still changing (or first look): look again later, unless a newer
+        // event re-added it meanwhile
+        e->sized = true;
+        e->size = (size_t)st.st_size;
+        e->mtime_ns = mtime_ns;
+        e->due = now + WATCH_SETTLE_SECONDS;
+        pthread_mutex_lock(&g_pending_mutex);
+        Pending **slot = pending_find(e->path);
+        if (*slot) {
+            free(e);
+        } else {
+            e->next = NULL;
+            *slot = e;
+        }
+        pthread_mutex_unlock(&g_pending_mutex);
+    }
+}
+
+static void pending_destroy(void) {
+    for (int b = 0; b < WATCH_BUCKETS; b++) {
+        while (g_pending[b]) {
+            Pending *next = g_pending[b]->next;
+            free(g_pending[b]);
+            g_pending[b] = next;
+        }
+    }
+}
+
+// ============================================================================
+// Platform watches
+// ============================================================================
+
+#ifdef __linux__
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY)
+
+static int g_inotify = -1;
+static char **g_wd_paths = NULL;   // Watch descriptor -> directory path
+static int g_wd_capacity = 0;
+static bool g_limit_warned = false;
+
+static const char *wd_path(int wd) {
+    return wd >= 0 && wd < g_wd_capacity ? g_wd_paths[wd] : NULL;
+}
+
+static bool wd_set(int wd, const char *path) {
+    if (wd >= g_wd_capacity) {
+        int capacity = g_wd_capacity ? g_wd_capacity : 256;
+        while (capacity <= wd) capacity *= 2;
+        char **grown = realloc(g_wd_paths, sizeof(char *) * capacity);
+        if (!grown) return false;
+        memset(grown + g_wd_capacity, 0, sizeof(char *) * (capacity - g_wd_capacity));
+        g_wd_paths = grown;
+        g_wd_capacity = capacity;
+    }
+    char *copy = strdup(path);
+    if (!copy) return false;
+    free(g_wd_paths[wd]);
+    g_wd_paths[wd] = copy;
+    return true;
+}
+
+// Watch `dir`; true if it was already watched (moved within the tree)
+static bool watch_dir(const char *dir) {
+    int wd = inotify_add_watch(g_inotify, dir, WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0) {
+        if (errno == ENOSPC && !g_limit_warned) {
+            log_warn("⚠️  inotify watch limit reached (fs.inotify.max_user_watches): "
+                     "new files under %s are not seen", dir);
+            g_limit_warned = true;
+        }
+        return false;
+    }
+    bool known = wd_path(wd) != NULL;
+    if (!wd_set(wd, dir)) log_error("Memory allocation failed: %s", dir);
+    return known;
+}
+
+static bool platform_open(void) {
+    g_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (g_inotify < 0) {
+        log_error("Cannot start inotify: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static void platform_close(void) {
+    if (g_inotify >= 0) close(g_inotify);
+    g_inotify = -1;
+    for (int i = 0; i < g_wd_capacity; i++) free(g_wd_paths[i]);
+    free(g_wd_paths);
+    g_wd_paths = NULL;
+    g_wd_capacity = 0;
+}
+
+static void handle_event(const struct inotify_event *ev, int64_t since_ns) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        // Events were lost: look again at whatever changed since the last read
+        log_warn("⚠️  inotify queue overflowed, rescanning recent changes");
+        walk_tree(g_root, since_ns);
+        return;
+    }
+    const char *dir = wd_path(ev->wd);
+    if (!dir) return;
+    if (ev->mask & IN_IGNORED) {   // Directory deleted or unmounted
+        free(g_wd_paths[ev->wd]);
+        g_wd_paths[ev->wd] = NULL;
+        return;
+    }
+    if (ev->len == 0 || name_ignored(ev->name)) return;
+
+    char path[MAX_PATH_LEN];
+    int n = snprintf(path, sizeof(path), "%s/%s", dir, ev->name);
+    if (n < 0 || (size_t)n >= sizeof(path)) return;
+
+    if (ev->mask & IN_ISDIR) {
+        if (g_recursive && (ev->mask & (IN_CREATE | IN_MOVED_TO))) walk_tree(path, 0);
+        return;
+    }
+    pending_touch(path, (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0);
+}
+
+static void platform_run(void) {
+    // inotify_event is followed by its name; align the buffer for it
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = { .fd = g_inotify, .events = POLLIN };
+    int64_t last_read_ns = wall_ns();
+    double next_tick = 0;
+
+    while (!g_interrupted && !g_failed) {
+        if (poll(&pfd, 1, WATCH_TICK_MS) > 0) {
+            ssize_t n;
+            while ((n = read(g_inotify, buf, sizeof(buf))) > 0) {
+                int64_t since_ns = last_read_ns - (int64_t)(WATCH_SETTLE_SECONDS * 1e9);
+                for (char *p = buf; p < buf + n;) {
+                    const struct inotify_event *ev = (const struct inotify_event *)p;
+                    handle_event(ev, since_ns);
+                    p += sizeof(*ev) + ev->len;
+                }
+                last_read_ns = wall_ns();
+            }
+        }
+        double now = monotonic_seconds();
+        if (now >= next_tick) {
+            settle_pending();
+            next_tick = now + WATCH_TICK_MS / 1000.0;
+        }
+    }
+}
+
+#elif defined(__APPLE__)
+
+static FSEventStreamRef g_stream = NULL;
+static dispatch_queue_t g_dispatch = NULL;
+static volatile bool g_rescan = false;
+
+// FSEvents watches the whole tree from one stream: nothing to add per dir
+static bool watch_dir(const char *dir) {
+    (void)dir;
+    return false;
+}
+
+// Runs on g_dispatch: only records events, the watcher thread decides
+static void fsevents_callback(ConstFSEventStreamRef stream, void *info, size_t count,
+                              void *event_paths, const FSEventStreamEventFlags flags[],
+                              const FSEventStreamEventId ids[]) {
+    (void)stream;
+    (void)info;
+    (void)ids;
+    char **paths = event_paths;
+    size_t root_len = strlen(g_root);
+
+    for (size_t i = 0; i < count; i++) {
+        if (flags[i] & (kFSEventStreamEventFlagMustScanSubDirs | kFSEventStreamEventFlagUserDropped |
+                        kFSEventStreamEventFlagKernelDropped)) {
+            g_rescan = true;
+            continue;
+        }
+        const char *slash = strrchr(paths[i], '/');
+        if (!slash || name_ignored(slash + 1)) continue;
+        // --no-recursive: only entries directly in the root
+        if (!g_recursive && ((size_t)(slash - paths[i]) != root_len)) continue;
+
+        FSEventStreamEventFlags changed = kFSEventStreamEventFlagItemCreated |
+                                          kFSEventStreamEventFlagItemRenamed |
+                                          kFSEventStreamEventFlagItemModified;
+        if (!(flags[i] & changed)) continue;
+        if ((flags[i] & kFSEventStreamEventFlagItemIsDir) && !g_recursive) continue;
+        // No close event on macOS: files settle by size
+        pending_touch(paths[i], false);
+    }
+}
+
+static bool platform_open(void) {
+    CFStringRef root = CFStringCreateWithCString(NULL, g_root, kCFStringEncodingUTF8);
+    CFArrayRef roots = root ? CFArrayCreate(NULL, (const void **)&root, 1, &kCFTypeArrayCallBacks) : NULL;
+    if (roots) {
+        g_stream = FSEventStreamCreate(NULL, fsevents_callback, NULL, roots, kFSEventStreamEventIdSinceNow,
+                                       WATCH_CLOSE_DELAY,
+                                       kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagNoDefer);
+        CFRelease(roots);
+    }
+    if (root) CFRelease(root);
+    if (!g_stream) {
+        log_error("Cannot start FSEvents stream: %s", g_root);
+        return false;
+    }
+    g_dispatch = dispatch_queue_create("static2jxl.watch", DISPATCH_QUEUE_SERIAL);
+    FSEventStreamSetDispatchQueue(g_stream, g_dispatch);
+    if (!FSEventStreamStart(g_stream)) {
+        log_error("Cannot start FSEvents stream: %s", g_root);
+        FSEventStreamInvalidate(g_stream);
+        FSEventStreamRelease(g_stream);
+        g_stream = NULL;
+        dispatch_release(g_dispatch);
+        return false;
+    }
+    return true;
+}
+
+static void platform_close(void) {
+    if (!g_stream) return;
+    FSEventStreamStop(g_stream);
+    FSEventStreamInvalidate(g_stream);
+    FSEventStreamRelease(g_stream);
+    g_stream = NULL;
+    dispatch_release(g_dispatch);
+}
+
+static void platform_run(void) {
+    int64_t last_rescan_ns = wall_ns();
+    while (!g_interrupted && !g_failed) {
+        usleep(WATCH_TICK_MS * 1000);
+        if (g_rescan) {
+            g_rescan = false;
+            log_warn("⚠️  FSEvents dropped events, rescanning recent changes");
+            int64_t since_ns = last_rescan_ns - (int64_t)(WATCH_SETTLE_SECONDS * 1e9);
+            last_rescan_ns = wall_ns();
+            walk_tree(g_root, since_ns);
+        }
+        settle_pending();
+    }
+}
+
+#else
+
+static bool watch_dir(const char *dir) {
+    (void)dir;
+    return false;
+}
+
+static bool platform_open(void) {
+    log_error("--watch is not supported on this platform (needs inotify or FSEvents)");
+    return false;
+}
+
+static void platform_close(void) {}
+static void platform_run(void) {}
+
+#endif
+
+// ============================================================================
+// Tree walk
+// ============================================================================
+
+// Watch `dir` (and below, when recursive), then look at its files. All of
+// them when `since_ns` is 0, else only those modified since then. Files in
+// a directory that was already watched (moved within the tree) were seen.
+static void walk_tree(const char *dir, int64_t since_ns) {
+    bool known = watch_dir(dir);
+    if (known && since_ns == 0) return;
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *d = (fd >= 0) ? fdopendir(fd) : NULL;
+    if (!d) {
+        if (fd >= 0) close(fd);
+        log_error("Cannot open directory: %s", dir);
+        return;
+    }
+
+    int64_t settled_ns = wall_ns() - (int64_t)(WATCH_SETTLE_SECONDS * 1e9);
+    struct dirent *entry;
+    char path[MAX_PATH_LEN];
+    while (!g_interrupted && !g_failed && (entry = readdir(d)) != NULL) {
+        if (name_ignored(entry->d_name)) continue;
+        int n = snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (n < 0 || (size_t)n >= sizeof(path)) continue;
+
+        struct stat st;
+        if (fstatat(dirfd(d), entry->d_name, &st, 0) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (g_recursive) walk_tree(path, since_ns);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode)) continue;
+
+        int64_t mtime_ns = STAT_MTIME_NS(st);
+        if (mtime_ns < since_ns || pending_has(path)) continue;
+        if (mtime_ns <= settled_ns) {
+            queue_file(path, (size_t)st.st_size, mtime_ns);
+        } else {
+            pending_touch(path, false);            // May still be being written
+        }
+    }
+    closedir(d);
+}
+
+// ============================================================================
+// Watcher thread
+// ============================================================================
+
+static void *watch_thread(void *arg) {
+    (void)arg;
+    walk_tree(g_root, 0);
+    if (!g_interrupted && !g_failed) {
+        log_info("👀 %d existing files queued, watching for new ones (Ctrl-C to stop)", g_queued);
+        platform_run();
+    }
+    // Workers drain what is queued, then the pipeline winds down
+    ledger_close_sink(g_sink);
+    return NULL;
+}
+
+// Start watching `root` and feeding `sink`; the sink is closed on Ctrl-C
+bool watch_start(const char *root, bool recursive, WorkQueue *sink) {
+    g_sink = sink;
+    g_recursive = recursive;
+    g_failed = false;
+    g_queued = 0;
+#ifdef __APPLE__
+    // FSEvents reports resolved paths (/private/var/...); match them
+    if (!realpath(root, g_root)) snprintf(g_root, sizeof(g_root), "%s", root);
+#else
+    snprintf(g_root, sizeof(g_root), "%s", root);
+#endif
+    size_t len = strlen(g_root);
+    while (len > 1 && g_root[len - 1] == '/') g_root[--len] = '\0';
+
+    if (!platform_open()) return false;
+    if (pthread_create(&g_thread, NULL, watch_thread, NULL) != 0) {
+        platform_close();
+        return false;
+    }
+    g_started = true;
+    return true;
+}
+
+// Wait for the watcher to stop; returns the number of files queued
+int watch_wait(void) {
+    if (g_started) pthread_join(g_thread, NULL);
+    g_started = false;
+    platform_close();
+    pending_destroy();
+    return ft_count();
+}
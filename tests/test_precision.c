@@ -13,7 +13,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <math.h>
 #include <assert.h>
 
@@ -531,6 +533,1070 @@ TEST(consistency_skip_logic) {
     ASSERT_TRUE(!is_lossless_source(FT_JXL));
 }
 
+// ============================================================
+// Core Budget Tests (裁判机制)
+// ============================================================
+
+// Mirrors encoder_threads_for() in scheduler.c
+#define PIXELS_PER_ENCODER_THREAD (4 * 1000 * 1000)
+
+int threads_for(size_t file_size, bool is_jpeg, bool is_png, int budget) {
+    size_t pixels = is_jpeg ? file_size * 3 : (is_png ? file_size * 2 / 3 : file_size / 3);
+    size_t threads = 1 + pixels / PIXELS_PER_ENCODER_THREAD;
+    if (threads > (size_t)budget) threads = (size_t)budget;
+    return (int)threads;
+}
+
+// Mirrors budget_acquire(): grant what is free, never more
+int budget_grant(int want, int available) {
+    if (want < 1) want = 1;
+    return (want < available) ? want : available;
+}
+
+TEST(budget_small_jpeg_one_thread) {
+    // 200 KB JPEG ≈ 0.6 MP → a single encoder thread
+    ASSERT_EQ(threads_for(200 * 1024, true, false, 16), 1);
+}
+
+TEST(budget_large_tiff_many_threads) {
+    // 100 MP uncompressed RGB TIFF (300 MB) → whole 16-core budget
+    ASSERT_EQ(threads_for(300ULL * 1000 * 1000, false, false, 16), 16);
+}
+
+TEST(budget_never_exceeds_available) {
+    ASSERT_EQ(budget_grant(8, 3), 3);
+    ASSERT_EQ(budget_grant(2, 16), 2);
+    ASSERT_EQ(budget_grant(0, 4), 1);
+}
+
+// ============================================================
+// Predictive Skip Tests (预测跳过)
+// ============================================================
+
+// Mirrors jxl_estimate_lossless() band placement and predict threshold
+#define TRIAL_BANDS 8
+#define TRIAL_BAND_ROWS 64
+
+size_t trial_band_start(uint32_t height, uint32_t band) {
+    return (size_t)(height - TRIAL_BAND_ROWS) * band / (TRIAL_BANDS - 1);
+}
+
+bool predicted_skip(size_t predicted, size_t input, double margin) {
+    return margin >= 0 && predicted > input * (1.0 + margin);
+}
+
+TEST(predict_bands_cover_top_and_bottom) {
+    // First band starts at row 0, last band ends on the last row
+    ASSERT_EQ(trial_band_start(4000, 0), 0);
+    ASSERT_EQ(trial_band_start(4000, TRIAL_BANDS - 1) + TRIAL_BAND_ROWS, 4000);
+}
+
+TEST(predict_margin_threshold) {
+    // 25% margin: 1.30x predicted skips, 1.20x still gets the full encode
+    ASSERT_TRUE(predicted_skip(1300, 1000, 0.25));
+    ASSERT_TRUE(!predicted_skip(1200, 1000, 0.25));
+    ASSERT_TRUE(!predicted_skip(5000, 1000, -1.0));  // --no-predict
+}
+
+// Mirrors manifest_lookup() for a predictive skip: honored only while the
+// trial runs with the margin it was recorded under
+static bool predicted_record_honored(uint32_t base, double recorded_margin, double margin) {
+    uint32_t stored = base | 1u << 17 | (uint32_t)(recorded_margin * 100 + 0.5) << 18;
+    uint32_t now = base | (margin >= 0 ? 1u << 17 | (uint32_t)(margin * 100 + 0.5) << 18 : 0);
+    return margin >= 0 && stored == now;
+}
+
+TEST(predict_manifest_follows_margin) {
+    ASSERT_TRUE(predicted_record_honored(7, 0.25, 0.25));
+    ASSERT_TRUE(!predicted_record_honored(7, 0.25, 0.40));   // New margin: retried
+    ASSERT_TRUE(!predicted_record_honored(7, 0.25, -1.0));   // --no-predict: retried
+    ASSERT_TRUE(!predicted_record_honored(7, 0.0, -1.0));
+    ASSERT_TRUE(predicted_record_honored(7, 0.0, 0.0));
+}
+
+// ============================================================
+// Adaptive Effort Tests
+// ============================================================
+
+// Mirrors effort_plan_escalate(): candidate selection + budget gate
+typedef struct {
+    double budget, spent, cost_ratio, gain_fraction, gain_rate;
+    int samples;
+} TestPlanner;
+
+static bool plan_escalate(TestPlanner *p, size_t in_size, size_t low_out, double low_cost,
+                          double margin, size_t big) {
+    double ratio = (double)low_out / in_size;
+    bool near = ratio >= 1.0 - margin;
+    bool large = big > 0 && in_size >= big;
+    if (ratio > 1.0 + margin || !(near || large)) return false;
+    double cost = low_cost * p->cost_ratio;
+    if (p->budget > 0) {
+        if (p->spent + cost > p->budget) return false;
+        if (p->samples >= 4 && p->spent > p->budget / 2 &&
+            !(p->gain_fraction * low_out / cost >= p->gain_rate)) return false;
+    }
+    p->spent += cost;
+    return true;
+}
+
+TEST(adaptive_escalates_near_threshold_or_large) {
+    TestPlanner p = {0, 0, 4.0, 0, 0, 0};
+    size_t mb = 1024 * 1024;
+    ASSERT_TRUE(plan_escalate(&p, 10 * mb, 95 * mb / 10, 1.0, 0.10, 32 * mb));   // 95%: near
+    ASSERT_TRUE(!plan_escalate(&p, 10 * mb, 5 * mb, 1.0, 0.10, 32 * mb));        // 50%: fine as is
+    ASSERT_TRUE(plan_escalate(&p, 64 * mb, 32 * mb, 1.0, 0.10, 32 * mb));        // Large source
+    ASSERT_TRUE(!plan_escalate(&p, 64 * mb, 80 * mb, 1.0, 0.10, 32 * mb));       // Hopeless
+}
+
+TEST(adaptive_budget_prefers_high_gain_rate) {
+    // Past half the budget, escalations so far saved 300 bytes/CPU-second
+    TestPlanner p = {100.0, 60.0, 2.0, 0.10, 300.0, 8};
+    size_t in = 100000;
+    ASSERT_TRUE(!plan_escalate(&p, in, 95000, 20.0, 0.10, 0));   // 9500 B / 40 s < rate
+    ASSERT_TRUE(plan_escalate(&p, in, 95000, 10.0, 0.10, 0));    // 9500 B / 20 s >= rate
+    ASSERT_NEAR(p.spent, 80.0, 0.001);
+    ASSERT_TRUE(!plan_escalate(&p, in, 95000, 15.0, 0.10, 0));   // Would exceed the budget
+}
+
+// ============================================================
+// Memory Budget Tests
+// ============================================================
+
+// Mirrors memory_acquire(): FIFO tickets, requests clamped to the total
+typedef struct {
+    size_t total, available;
+    unsigned long next_ticket, serving;
+} TestMemory;
+
+static bool memory_try_admit(TestMemory *m, unsigned long ticket, size_t *want) {
+    if (*want > m->total) *want = m->total;
+    if (ticket != m->serving || m->available < *want) return false;
+    m->available -= *want;
+    m->serving++;
+    return true;
+}
+
+TEST(memory_budget_fifo_and_clamp) {
+    size_t gb = 1024UL * 1024 * 1024;
+    TestMemory m = {8 * gb, 8 * gb, 0, 0};
+    size_t a = 6 * gb, big = 40 * gb, small = 1 * gb;
+    ASSERT_TRUE(memory_try_admit(&m, 0, &a));
+    ASSERT_TRUE(!memory_try_admit(&m, 1, &big));     // Clamped to 8 GB, only 2 free
+    ASSERT_EQ(big, 8 * gb);
+    ASSERT_TRUE(!memory_try_admit(&m, 2, &small));   // Fits, but must not overtake
+    m.available += a;                                // First encode finishes
+    ASSERT_TRUE(memory_try_admit(&m, 1, &big));      // Oversized file runs alone
+    ASSERT_EQ(m.available, 0);
+}
+
+// Mirrors the chunked TIFF feeder: which strip and row a request starts in,
+// and whether it can be served from the mapping without a copy
+static bool strip_window(uint32_t rows_per_strip, size_t ypos, size_t ysize,
+                         uint32_t *strip, size_t *row) {
+    *strip = (uint32_t)(ypos / rows_per_strip);
+    *row = ypos - (size_t)*strip * rows_per_strip;
+    return ypos + ysize <= (size_t)(*strip + 1) * rows_per_strip;
+}
+
+TEST(tiff_strip_window_mapping) {
+    uint32_t strip;
+    size_t row;
+    ASSERT_TRUE(strip_window(256, 256, 256, &strip, &row));      // Exactly one strip
+    ASSERT_EQ(strip, 1);
+    ASSERT_EQ(row, 0);
+    ASSERT_TRUE(!strip_window(37, 256, 256, &strip, &row));      // Straddles: copied
+    ASSERT_EQ(strip, 6);
+    ASSERT_EQ(row, 34);
+    ASSERT_TRUE(strip_window(4096, 2048, 256, &strip, &row));    // Inside a tall strip
+    ASSERT_EQ(row, 2048);
+}
+
+// ============================================================
+// TIFF Reader Tests
+// ============================================================
+
+// Mirrors the LZW decoder's "early change": width grows one code before
+// the table fills the current width
+static int lzw_width_after(uint32_t next_code) {
+    int width = 9;
+    for (uint32_t next = 258; next < next_code; ) {
+        next++;
+        if (next + 1 >= (1u << width) && width < 12) width++;
+    }
+    return width;
+}
+
+TEST(tiff_lzw_early_change) {
+    ASSERT_EQ(lzw_width_after(510), 9);
+    ASSERT_EQ(lzw_width_after(511), 10);
+    ASSERT_EQ(lzw_width_after(1023), 11);
+    ASSERT_EQ(lzw_width_after(2047), 12);
+    ASSERT_EQ(lzw_width_after(4095), 12);
+}
+
+// Mirrors the SSE2 predictor undo: log-step lane prefix sums over a block
+// plus a carry must equal the scalar row[i] += row[i - S]
+static void prefix_sum_blocks(uint8_t *row, size_t n, uint32_t s) {
+    uint8_t carry[16] = {0};
+    for (size_t i = 0; i + 16 <= n; i += 16) {
+        uint8_t v[16];
+        memcpy(v, row + i, 16);
+        for (uint32_t shift = s; shift < 16; shift *= 2) {
+            uint8_t shifted[16] = {0};
+            memcpy(shifted + shift, v, 16 - shift);
+            for (int k = 0; k < 16; k++) v[k] = (uint8_t)(v[k] + shifted[k]);
+        }
+        for (int k = 0; k < 16; k++) row[i + k] = (uint8_t)(v[k] + carry[k]);
+        for (int k = 0; k < 16; k++) carry[k] = row[i + 16 - s + (k % s)];
+    }
+}
+
+TEST(tiff_predictor_prefix_sum) {
+    const uint32_t strides[] = {1, 2, 4};
+    for (int t = 0; t < 3; t++) {
+        uint8_t a[64], b[64];
+        for (int i = 0; i < 64; i++) a[i] = b[i] = (uint8_t)(i * 37 + 11);
+        for (int i = (int)strides[t]; i < 64; i++) a[i] = (uint8_t)(a[i] + a[i - strides[t]]);
+        prefix_sum_blocks(b, 64, strides[t]);
+        ASSERT_EQ(memcmp(a, b, 64), 0);
+    }
+}
+
+// ============================================================
+// Native Decoder Tests
+// ============================================================
+
+// Mirrors the PNG Paeth predictor: ties go to left, then up
+static uint8_t paeth_predict(int a, int b, int c) {
+    int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+    if (pa <= pb && pa <= pc) return (uint8_t)a;
+    return (uint8_t)(pb <= pc ? b : c);
+}
+
+TEST(png_paeth_predictor) {
+    ASSERT_EQ(paeth_predict(10, 20, 10), 20);    // Horizontal edge: up wins
+    ASSERT_EQ(paeth_predict(20, 10, 10), 20);    // Vertical edge: left wins
+    ASSERT_EQ(paeth_predict(7, 7, 7), 7);
+    ASSERT_EQ(paeth_predict(200, 50, 100), 200); // Left ties upper-left: left
+    ASSERT_EQ(paeth_predict(100, 200, 150), 150); // Gradient through c: upper-left
+    ASSERT_EQ(paeth_predict(100, 50, 200), 50);
+    ASSERT_EQ(paeth_predict(0, 0, 255), 0);
+}
+
+// Mirrors the BMP row table: rows pad to 4 bytes, positive height is bottom-up
+static size_t bmp_row_offset(uint32_t width, uint32_t bpp, int32_t height, uint32_t y) {
+    size_t stride = ((size_t)width * bpp + 31) / 32 * 4;
+    uint32_t rows = (height < 0) ? (uint32_t)-height : (uint32_t)height;
+    return (size_t)(height > 0 ? rows - 1 - y : y) * stride;
+}
+
+TEST(bmp_row_table) {
+    ASSERT_EQ(bmp_row_offset(1, 24, -3, 1), 4);      // 3 bytes pad to 4
+    ASSERT_EQ(bmp_row_offset(5, 24, -3, 2), 32);     // 15 bytes pad to 16
+    ASSERT_EQ(bmp_row_offset(5, 24, 3, 0), 32);      // Bottom-up: top row is last
+    ASSERT_EQ(bmp_row_offset(5, 24, 3, 2), 0);
+    ASSERT_EQ(bmp_row_offset(7, 32, 2, 0), 28);      // 32-bit rows never pad
+}
+
+// ============================================================
+// Validation Tests
+// ============================================================
+
+// Mirrors the SizeHeader reader: LSB-first bits after the FF 0A signature
+static uint32_t sh_bits(const uint8_t *p, size_t *bit, int n) {
+    uint32_t v = 0;
+    for (int i = 0; i < n; i++, (*bit)++) v |= (uint32_t)((p[*bit / 8] >> (*bit % 8)) & 1) << i;
+    return v;
+}
+
+static void size_header(const uint8_t *p, uint32_t *w, uint32_t *h) {
+    static const uint32_t ratio[8][2] = { {0, 0}, {1, 1}, {12, 10}, {4, 3}, {3, 2}, {16, 9}, {5, 4}, {2, 1} };
+    static const int dist[4] = { 9, 13, 18, 30 };
+    size_t bit = 0;
+    bool small = sh_bits(p, &bit, 1);
+    *h = small ? (sh_bits(p, &bit, 5) + 1) * 8 : 1 + sh_bits(p, &bit, dist[sh_bits(p, &bit, 2)]);
+    uint32_t r = sh_bits(p, &bit, 3);
+    if (r) *w = (uint32_t)((uint64_t)*h * ratio[r][0] / ratio[r][1]);
+    else *w = small ? (sh_bits(p, &bit, 5) + 1) * 8 : 1 + sh_bits(p, &bit, dist[sh_bits(p, &bit, 2)]);
+}
+
+TEST(jxl_size_header) {
+    uint32_t w, h;
+    const uint8_t square[] = { 0x4f, 0x00 };        // small, 64 rows, ratio 1:1
+    size_header(square, &w, &h);
+    ASSERT_EQ(w, 64);
+    ASSERT_EQ(h, 64);
+    const uint8_t wide[] = { 0x4f, 0x01 };          // small, 64 rows, ratio 16:9
+    size_header(wide, &w, &h);
+    ASSERT_EQ(w, 113);
+    const uint8_t explicit_width[] = { 0x3a, 0x1f, 0x60, 0x25 };   // 1 + u(13) rows, 1 + u(9) columns
+    size_header(explicit_width, &w, &h);
+    ASSERT_EQ(h, 1000);
+    ASSERT_EQ(w, 300);
+    const uint8_t three_two[] = { 0x3a, 0x1f, 0x04 };              // 1000 rows, ratio 3:2
+    size_header(three_two, &w, &h);
+    ASSERT_EQ(w, 1500);
+}
+
+// Mirrors the jxlp rule: indices count up from 0, the last one flagged
+static bool jxlp_run_valid(const uint32_t *index, int n) {
+    bool last = false;
+    for (int i = 0; i < n; i++) {
+        if (last || (index[i] & 0x7fffffff) != (uint32_t)i) return false;
+        last = (index[i] & 0x80000000) != 0;
+    }
+    return n > 0 && last;
+}
+
+TEST(jxl_partial_codestream_boxes) {
+    const uint32_t ok[] = { 0, 1, 0x80000002 };
+    const uint32_t gap[] = { 0, 2, 0x80000003 };
+    const uint32_t unterminated[] = { 0, 1, 2 };
+    const uint32_t after_last[] = { 0x80000000, 1 };
+    ASSERT_TRUE(jxlp_run_valid(ok, 3));
+    ASSERT_TRUE(!jxlp_run_valid(gap, 3));
+    ASSERT_TRUE(!jxlp_run_valid(unterminated, 3));
+    ASSERT_TRUE(!jxlp_run_valid(after_last, 2));
+}
+
+// ============================================================
+// Dedup Tests
+// ============================================================
+
+// Mirrors the group table: probe on the first hash, match size + both hashes
+typedef struct { bool used; size_t size; uint64_t hash, hash2; } TestGroup;
+
+static int group_slot(TestGroup *slots, size_t capacity, size_t size, uint64_t hash, uint64_t hash2) {
+    size_t i = hash & (capacity - 1);
+    while (slots[i].used &&
+           !(slots[i].size == size && slots[i].hash == hash && slots[i].hash2 == hash2)) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return (int)i;
+}
+
+TEST(dedup_group_key) {
+    TestGroup slots[8] = { { false, 0, 0, 0 } };
+    int a = group_slot(slots, 8, 100, 0x13, 7);
+    slots[a] = (TestGroup){ true, 100, 0x13, 7 };
+    ASSERT_EQ(group_slot(slots, 8, 100, 0x13, 7), a);          // Identical copy joins
+    ASSERT_TRUE(group_slot(slots, 8, 100, 0x13, 8) != a);      // First hash collides only
+    ASSERT_TRUE(group_slot(slots, 8, 101, 0x13, 7) != a);      // Different size
+    ASSERT_EQ(group_slot(slots, 8, 100, 0x13, 8), (a + 1) % 8);
+}
+
+// Mirrors the clone fallback chain: reflink, copy_file_range, read/write
+typedef enum { CLONE_REFLINK, CLONE_KERNEL_COPY, CLONE_READ_WRITE, CLONE_FAILED } TestCloneMethod;
+
+static TestCloneMethod clone_method(bool reflink_ok, long copied, long size) {
+    if (reflink_ok) return CLONE_REFLINK;
+    if (copied == size) return CLONE_KERNEL_COPY;
+    if (copied > 0) return CLONE_FAILED;        // Don't mix methods mid-file
+    return CLONE_READ_WRITE;
+}
+
+TEST(dedup_clone_fallback) {
+    ASSERT_EQ(clone_method(true, 0, 4096), CLONE_REFLINK);
+    ASSERT_EQ(clone_method(false, 4096, 4096), CLONE_KERNEL_COPY);
+    ASSERT_EQ(clone_method(false, 0, 4096), CLONE_READ_WRITE);   // EXDEV / ENOSYS
+    ASSERT_EQ(clone_method(false, 1024, 4096), CLONE_FAILED);
+    ASSERT_EQ(clone_method(false, 0, 0), CLONE_KERNEL_COPY);     // Empty file
+}
+
+// ============================================================
+// Statistics Tests
+// ============================================================
+
+// Mirrors block_register: blocks are rounded up to whole cache lines
+static size_t stat_block_size(size_t counters) {
+    size_t raw = counters * sizeof(uint64_t) + sizeof(void *);
+    return (raw + 63) & ~(size_t)63;
+}
+
+TEST(stats_blocks_padded_to_cache_lines) {
+    ASSERT_EQ(stat_block_size(7), 64);                // 56 + 8 fits one line exactly
+    ASSERT_EQ(stat_block_size(8), 128);
+    ASSERT_EQ(stat_block_size(31), 256);
+    ASSERT_EQ(stat_block_size(31) % 64, 0);
+}
+
+// Mirrors stats_read: per-thread 64-bit counters summed on read
+TEST(stats_sum_across_threads_64bit) {
+    uint64_t blocks[3][2] = { { 3, 3000000000ULL }, { 1, 2500000000ULL }, { 0, 0 } };
+    uint64_t files = 0, bytes = 0;
+    for (int t = 0; t < 3; t++) {
+        files += blocks[t][0];
+        bytes += blocks[t][1];
+    }
+    ASSERT_EQ(files, 4);
+    ASSERT_TRUE(bytes == 5500000000ULL);             // Past 32 bits, no wrap
+}
+
+// ============================================================
+// Progress Tests
+// ============================================================
+
+// Mirrors progress_sample: time-weighted EWMA that tracks the run average while young
+static double rate_update(double rate, double delta, double dt, double age, double tau) {
+    double alpha = dt / (tau + dt);
+    double warmup = dt / age;
+    if (warmup > alpha) alpha = warmup;
+    return rate + alpha * (delta / dt - rate);
+}
+
+TEST(progress_ewma_warmup) {
+    // First tick: alpha = 1, the rate is exactly what was observed
+    ASSERT_NEAR(rate_update(0, 50, 0.5, 0.5, 20.0), 100.0, 1e-9);
+    // Young run: equals the run average (100 units/s over 1s, then 0 over 1s)
+    ASSERT_NEAR(rate_update(100.0, 0, 1.0, 2.0, 20.0), 50.0, 1e-9);
+    // Old run: a quiet second only nudges the average
+    double r = rate_update(100.0, 0, 1.0, 600.0, 20.0);
+    ASSERT_TRUE(r > 95.0 && r < 96.0);
+}
+
+// Mirrors the ETA: remaining bytes (exact from the scan, else files x average) / rate
+static double eta_seconds(uint64_t total, uint64_t files, uint64_t sized, uint64_t scanned,
+                          uint64_t done_bytes, double in_rate) {
+    double remaining = (sized == total) ? (double)(scanned - done_bytes)
+                                        : (double)(total - files) * done_bytes / files;
+    return remaining / in_rate;
+}
+
+TEST(progress_eta_weighted_by_bytes) {
+    // 9 of 10 files done but the last one is 900 of 1000 MB: 90s at 10 MB/s, not 1/9 of elapsed
+    ASSERT_NEAR(eta_seconds(10, 9, 10, 1000, 100, 10.0), 90.0, 1e-9);
+    // Sizes unknown (streaming scan): remaining files at the average size so far
+    ASSERT_NEAR(eta_seconds(10, 5, 0, 0, 50, 10.0), 5.0, 1e-9);
+}
+
+// ============================================================
+// ⌛ Timing (per-stage latency histograms)
+// ============================================================
+
+// Mirrors timing.c: bucket 4k + s holds [2^k, 2^(k+1)) us in four steps
+#define T_BUCKETS 160
+
+static int t_bucket_of(double seconds) {
+    uint64_t us = seconds > 0 ? (uint64_t)(seconds * 1e6) : 0;
+    if (us < 4) return (int)us;
+    int k = 63 - __builtin_clzll(us);
+    int b = 4 * k + (int)((us >> (k - 2)) & 3);
+    return b < T_BUCKETS ? b : T_BUCKETS - 1;
+}
+
+static double t_bucket_ms(int b) {
+    if (b < 8) return b / 1000.0;
+    int k = b / 4;
+    double low = (double)(1ULL << k) + (b % 4) * (double)(1ULL << (k - 2));
+    return (low + (double)(1ULL << (k - 2)) / 2) / 1000.0;
+}
+
+static double t_percentile(const uint32_t *h, uint64_t count, double q) {
+    uint64_t rank = (uint64_t)(q * count + 0.999999);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < T_BUCKETS; b++) {
+        seen += h[b];
+        if (seen >= rank) return t_bucket_ms(b);
+    }
+    return t_bucket_ms(T_BUCKETS - 1);
+}
+
+TEST(timing_buckets_within_resolution) {
+    // Every duration from 4us to an hour is reported within 12.5%
+    double samples[] = { 4e-6, 1e-3, 0.0173, 0.25, 1.0, 42.0, 3600.0 };
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        double ms = samples[i] * 1e3;
+        double got = t_bucket_ms(t_bucket_of(samples[i]));
+        ASSERT_TRUE(fabs(got - ms) <= ms * 0.125);
+    }
+    // Monotonic, and days still land in range
+    ASSERT_TRUE(t_bucket_of(0.002) > t_bucket_of(0.001));
+    ASSERT_EQ(t_bucket_of(1e7), T_BUCKETS - 1);
+}
+
+TEST(timing_percentile_rank) {
+    // 90 fast files (1ms) and 10 slow ones (500ms): p50 is fast, p95/p99 slow
+    uint32_t h[T_BUCKETS] = { 0 };
+    h[t_bucket_of(0.001)] = 90;
+    h[t_bucket_of(0.5)] = 10;
+    ASSERT_NEAR(t_percentile(h, 100, 0.50), t_bucket_ms(t_bucket_of(0.001)), 1e-9);
+    ASSERT_NEAR(t_percentile(h, 100, 0.90), t_bucket_ms(t_bucket_of(0.001)), 1e-9);
+    ASSERT_NEAR(t_percentile(h, 100, 0.95), t_bucket_ms(t_bucket_of(0.5)), 1e-9);
+    ASSERT_NEAR(t_percentile(h, 100, 0.99), t_bucket_ms(t_bucket_of(0.5)), 1e-9);
+}
+
+// ============================================================
+// 🏁 Benchmark Corpus (bench/gen_corpus.c)
+// ============================================================
+
+// Mirrors the generator's JPEG Huffman code construction (Annex C)
+static void bench_huff_build(const uint8_t *bits, const uint8_t *vals, uint16_t *code, uint8_t *length) {
+    int c = 0, k = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++, k++) {
+            code[vals[k]] = (uint16_t)c++;
+            length[vals[k]] = (uint8_t)len;
+        }
+        c <<= 1;
+    }
+}
+
+TEST(bench_jpeg_huffman_codes) {
+    // Annex K.3 luminance DC table: category 0 is '00', category 11 is '111111110'
+    static const uint8_t dc_bits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+    static const uint8_t dc_vals[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+    uint16_t code[256] = { 0 };
+    uint8_t length[256] = { 0 };
+    bench_huff_build(dc_bits, dc_vals, code, length);
+    ASSERT_EQ(length[0], 2);
+    ASSERT_EQ(code[0], 0x0);
+    ASSERT_EQ(length[11], 9);
+    ASSERT_EQ(code[11], 0x1FE);
+    // AC table prefix: 0x01 '00', 0x02 '01', 0x03 '100', EOB (0x00) '1010'
+    static const uint8_t ac_vals[6] = { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11 };
+    static const uint8_t bits_head[16] = { 0, 2, 1, 3 };    // First six symbols of K.5
+    bench_huff_build(bits_head, ac_vals, code, length);
+    ASSERT_EQ(code[0x03], 0x4);
+    ASSERT_EQ(length[0x03], 3);
+    ASSERT_EQ(code[0x00], 0xA);
+    ASSERT_EQ(length[0x00], 4);
+}
+
+// Mirrors the generator's PNG checksums
+static uint32_t bench_crc32(const uint8_t *p, size_t n) {
+    uint32_t crc = 0xFFFFFFFFu;
+    while (n--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+    }
+    return ~crc;
+}
+
+static uint32_t bench_adler32(const uint8_t *p, size_t n) {
+    uint32_t s1 = 1, s2 = 0;
+    for (size_t i = 0; i < n; i++) {
+        s1 = (s1 + p[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+    return (s2 << 16) | s1;
+}
+
+TEST(bench_png_checksums) {
+    // Every PNG ends in the same IEND chunk: CRC over the type is AE426082
+    ASSERT_EQ(bench_crc32((const uint8_t *)"IEND", 4), 0xAE426082u);
+    ASSERT_EQ(bench_crc32((const uint8_t *)"123456789", 9), 0xCBF43926u);
+    ASSERT_EQ(bench_adler32((const uint8_t *)"Wikipedia", 9), 0x11E60398u);
+}
+
+// ============================================================
+// 💾 Output Placement (output.c)
+// ============================================================
+
+// Mirrors dir_of(): the directory an anonymous output is created in
+static void out_dir_of(const char *path, char *out, size_t size) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        snprintf(out, size, ".");
+    } else if (slash == path) {
+        snprintf(out, size, "/");
+    } else {
+        snprintf(out, size, "%.*s", (int)(slash - path), path);
+    }
+}
+
+TEST(output_dir_of) {
+    char dir[256];
+    out_dir_of("/photos/2020/a.jxl", dir, sizeof(dir));
+    ASSERT_TRUE(strcmp(dir, "/photos/2020") == 0);
+    out_dir_of("/a.jxl", dir, sizeof(dir));
+    ASSERT_TRUE(strcmp(dir, "/") == 0);
+    out_dir_of("a.jxl", dir, sizeof(dir));
+    ASSERT_TRUE(strcmp(dir, ".") == 0);
+}
+
+// Mirrors --durability batch: dirty directories deduplicated, flushed after
+// BATCH_FILES files or once BATCH_DIRS distinct directories are dirty
+#define OUT_BATCH_FILES 256
+#define OUT_BATCH_DIRS 64
+
+typedef struct {
+    int dirs[OUT_BATCH_DIRS];
+    int count;
+    int files;
+    int flushes;
+    int dir_syncs;
+} OutBatch;
+
+static void out_batch_flush(OutBatch *b) {
+    b->dir_syncs += b->count;
+    b->flushes++;
+    b->count = 0;
+    b->files = 0;
+}
+
+static void out_batch_add(OutBatch *b, int dir) {
+    bool found = false;
+    for (int i = 0; i < b->count && !found; i++) found = b->dirs[i] == dir;
+    if (!found && b->count == OUT_BATCH_DIRS) out_batch_flush(b);
+    if (!found) b->dirs[b->count++] = dir;
+    if (++b->files >= OUT_BATCH_FILES || b->count == OUT_BATCH_DIRS) out_batch_flush(b);
+}
+
+TEST(output_batch_dir_syncs) {
+    // 1000 files in 4 directories: one sync per directory per 256 files
+    OutBatch b = { 0 };
+    for (int i = 0; i < 1000; i++) out_batch_add(&b, i % 4);
+    ASSERT_EQ(b.flushes, 3);
+    ASSERT_EQ(b.dir_syncs, 12);
+    ASSERT_EQ(b.count, 4);             // The rest goes at the end of the run
+    // 64 files in 64 directories: flushed as soon as the set is full
+    OutBatch w = { 0 };
+    for (int i = 0; i < 64; i++) out_batch_add(&w, i);
+    ASSERT_EQ(w.flushes, 1);
+    ASSERT_EQ(w.dir_syncs, 64);
+}
+
+// Mirrors name_ignored(): hidden files and the pipeline's own scratch files
+static bool watch_name_ignored(const char *name) {
+    if (name[0] == '.' || name[0] == '\0') return true;
+    size_t len = strlen(name);
+    if (len >= 4 && (strcasecmp(name + len - 4, ".jxl") == 0 || strcmp(name + len - 4, ".tmp") == 0)) {
+        return true;
+    }
+    return strstr(name, ".jxl.") != NULL;
+}
+
+TEST(watch_ignores_scratch_files) {
+    ASSERT_TRUE(!watch_name_ignored("IMG_0001.jpg"));
+    ASSERT_TRUE(!watch_name_ignored("scan.tiff"));
+    ASSERT_TRUE(watch_name_ignored(".IMG_0001.jpg.aBc123"));    // rsync in progress
+    ASSERT_TRUE(watch_name_ignored("IMG_0001.jxl"));
+    ASSERT_TRUE(watch_name_ignored("IMG_0001.JXL"));
+    ASSERT_TRUE(watch_name_ignored("IMG_0001.jpg.jxl.tmp"));     // In-place temp
+    ASSERT_TRUE(watch_name_ignored("IMG_0001.jxl.trial"));
+    ASSERT_TRUE(watch_name_ignored("IMG_0001.jxl.rec.jpg"));     // Reconstructed for the health check
+}
+
+// Mirrors settle_ready(): closed by its writer, or two equal looks in a row
+typedef struct {
+    bool closed;
+    bool sized;
+    size_t size;
+    int64_t mtime_ns;
+} WatchPending;
+
+static bool watch_settle(WatchPending *p, size_t size, int64_t mtime_ns) {
+    if (p->closed || (p->sized && p->size == size && p->mtime_ns == mtime_ns)) return true;
+    p->sized = true;               // Look again one settle period later
+    p->size = size;
+    p->mtime_ns = mtime_ns;
+    return false;
+}
+
+TEST(watch_settle_stable_size) {
+    // A writer that never closes: growing for two looks, then still
+    WatchPending p = { false, false, 0, 0 };
+    ASSERT_TRUE(!watch_settle(&p, 1000, 1));     // First look only records
+    ASSERT_TRUE(!watch_settle(&p, 5000, 2));
+    ASSERT_TRUE(!watch_settle(&p, 5000, 3));     // Same size, rewritten in place
+    ASSERT_TRUE(watch_settle(&p, 5000, 3));
+    // IN_CLOSE_WRITE: ready at the first look
+    WatchPending c = { true, false, 0, 0 };
+    ASSERT_TRUE(watch_settle(&c, 42, 7));
+}
+
+// Mirrors relative_path(): ledger keys don't depend on the mount point
+static const char *ledger_relative(const char *root, const char *path) {
+    size_t len = strlen(root);
+    if (len > 0 && strncmp(path, root, len) == 0 && path[len] == '/') return path + len + 1;
+    return path;
+}
+
+TEST(ledger_keys_relative_to_root) {
+    ASSERT_TRUE(strcmp(ledger_relative("/mnt/nas/photos", "/mnt/nas/photos/2020/a.jpg"), "2020/a.jpg") == 0);
+    ASSERT_TRUE(strcmp(ledger_relative("/Volumes/photos", "/Volumes/photos/2020/a.jpg"), "2020/a.jpg") == 0);
+    // A sibling directory sharing the prefix is not under the root
+    ASSERT_TRUE(strcmp(ledger_relative("/mnt/nas/photos", "/mnt/nas/photos2/a.jpg"), "/mnt/nas/photos2/a.jpg") == 0);
+    // --files-from has no root: the listed path is the key
+    ASSERT_TRUE(strcmp(ledger_relative("", "/mnt/nas/a.jpg"), "/mnt/nas/a.jpg") == 0);
+}
+
+// Mirrors ledger_claim() for an existing claim: the owner's heartbeat is
+// judged against our own heartbeat's mtime (the file server's clock)
+typedef enum { LEDGER_MINE, LEDGER_DEFER, LEDGER_TAKE_OVER, LEDGER_DONE } LedgerDecision;
+
+static LedgerDecision ledger_decide(bool done, bool owner_is_me, bool has_heartbeat,
+                                    int64_t heartbeat_s, int64_t server_now_s, int64_t lease_s) {
+    if (done) return LEDGER_DONE;
+    if (owner_is_me) return LEDGER_MINE;
+    if (has_heartbeat && heartbeat_s >= server_now_s - lease_s) return LEDGER_DEFER;
+    return LEDGER_TAKE_OVER;
+}
+
+TEST(ledger_claim_decisions) {
+    int64_t now = 1700000000;
+    ASSERT_EQ(ledger_decide(true, false, true, now, now, 120), LEDGER_DONE);
+    ASSERT_EQ(ledger_decide(false, true, true, now - 500, now, 120), LEDGER_MINE);
+    ASSERT_EQ(ledger_decide(false, false, true, now - 119, now, 120), LEDGER_DEFER);
+    ASSERT_EQ(ledger_decide(false, false, true, now - 121, now, 120), LEDGER_TAKE_OVER);
+    ASSERT_EQ(ledger_decide(false, false, false, 0, now, 120), LEDGER_TAKE_OVER);   // Heartbeat gone
+}
+
+// Mirrors feed()/end_record() in filelist.c: records split on NUL or
+// newline (decided by the first block), may span blocks
+typedef struct {
+    int delim;
+    char record[64];
+    size_t len;
+    char out[8][64];
+    int count;
+} ListSplit;
+
+static void list_end(ListSplit *l) {
+    size_t len = l->len;
+    if (l->delim == '\n' && len > 0 && l->record[len - 1] == '\r') len--;
+    l->record[len] = '\0';
+    if (len > 0 && l->count < 8) strcpy(l->out[l->count++], l->record);
+    l->len = 0;
+}
+
+static void list_feed(ListSplit *l, const char *buf, size_t n) {
+    if (l->delim < 0) l->delim = memchr(buf, '\0', n) ? '\0' : '\n';
+    while (n > 0) {
+        const char *end = memchr(buf, l->delim, n);
+        size_t take = end ? (size_t)(end - buf) : n;
+        memcpy(l->record + l->len, buf, take);
+        l->len += take;
+        if (!end) break;
+        list_end(l);
+        buf = end + 1;
+        n -= take + 1;
+    }
+}
+
+TEST(filelist_delimiter_detection) {
+    // find -print0: a newline inside a name is part of the name
+    ListSplit z = { .delim = -1 };
+    list_feed(&z, "a/x.jpg\0b/odd\nname.png\0", 23);
+    ASSERT_EQ(z.count, 2);
+    ASSERT_TRUE(strcmp(z.out[1], "b/odd\nname.png") == 0);
+    // Newline list from Windows: CR dropped, blank lines skipped
+    ListSplit n = { .delim = -1 };
+    list_feed(&n, "a.jpg\r\n\r\n\nb.png\n", 16);
+    ASSERT_EQ(n.count, 2);
+    ASSERT_TRUE(strcmp(n.out[0], "a.jpg") == 0);
+    ASSERT_TRUE(strcmp(n.out[1], "b.png") == 0);
+}
+
+TEST(filelist_records_span_blocks) {
+    ListSplit l = { .delim = -1 };
+    list_feed(&l, "dir/lo", 6);
+    list_feed(&l, "ng.jpg\ndir/b", 12);
+    ASSERT_EQ(l.count, 1);
+    ASSERT_TRUE(strcmp(l.out[0], "dir/long.jpg") == 0);
+    // Last entry without a final newline is still taken at EOF
+    if (l.len > 0) list_end(&l);
+    ASSERT_EQ(l.count, 2);
+    ASSERT_TRUE(strcmp(l.out[1], "dir/b") == 0);
+}
+
+// Mirrors jpeg_frame_info(): dimensions from the SOFn before the first scan
+static bool jpeg_frame_dims(const uint8_t *buf, size_t size, uint32_t *w, uint32_t *h) {
+    if (size < 4 || buf[0] != 0xFF || buf[1] != 0xD8) return false;
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (buf[pos] != 0xFF) return false;
+        uint8_t marker = buf[pos + 1];
+        if (marker == 0xFF) { pos++; continue; }
+        if (marker == 0xDA || marker == 0xD9) return false;
+        size_t len = (size_t)(buf[pos + 2] << 8 | buf[pos + 3]);
+        if (len < 2 || pos + 2 + len > size) return false;
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (len < 8) return false;
+            *h = (uint32_t)(buf[pos + 5] << 8 | buf[pos + 6]);
+            *w = (uint32_t)(buf[pos + 7] << 8 | buf[pos + 8]);
+            return *w > 0 && *h > 0;
+        }
+        pos += 2 + len;
+    }
+    return false;
+}
+
+TEST(jpeg_frame_before_scan) {
+    // SOI, APP0, DHT (C4 is not a frame), fill byte, SOF2 8000x6000, SOS
+    const uint8_t jpg[] = {
+        0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x04, 0x00, 0x00,
+        0xFF, 0xC4, 0x00, 0x03, 0x00,
+        0xFF, 0xFF, 0xC2, 0x00, 0x08, 0x08, 0x17, 0x70, 0x1F, 0x40, 0x03,
+        0xFF, 0xDA, 0x00, 0x02,
+    };
+    uint32_t w = 0, h = 0;
+    ASSERT_TRUE(jpeg_frame_dims(jpg, sizeof(jpg), &w, &h));
+    ASSERT_EQ(w, 8000);
+    ASSERT_EQ(h, 6000);
+    // Truncated before the frame header
+    ASSERT_TRUE(!jpeg_frame_dims(jpg, 12, &w, &h));
+}
+
+// Mirrors encoder_threads_for(): a tail share lifts the request up to one
+// thread per 256x256 group, never past the budget
+static int tail_threads_for(size_t pixels, int budget, int share) {
+    size_t threads = 1 + pixels / PIXELS_PER_ENCODER_THREAD;
+    if (share > 0 && (size_t)share > threads) {
+        size_t groups = (pixels + 256 * 256 - 1) / (256 * 256);
+        threads = (size_t)share < groups ? (size_t)share : groups;
+        if (threads < 1) threads = 1;
+    }
+    if (threads > (size_t)budget) threads = (size_t)budget;
+    return (int)threads;
+}
+
+TEST(tail_share_threads) {
+    size_t mp48 = 8000 * 6000;
+    ASSERT_EQ(tail_threads_for(mp48, 32, 0), 13);       // Mid-run: sized by pixels
+    ASSERT_EQ(tail_threads_for(mp48, 32, 32), 32);      // Last file: every core
+    ASSERT_EQ(tail_threads_for(mp48, 32, 8), 13);       // Share below the estimate: no change
+    ASSERT_EQ(tail_threads_for(300 * 200, 32, 32), 1);  // One group: more threads can't help
+    ASSERT_EQ(tail_threads_for(1000 * 1000, 32, 32), 16);
+}
+
+// Mirrors the SIGNATURES table in main.c: one masked 64-bit compare per
+// format must agree with the byte-by-byte chain above
+#define SIG_WORD(b0, b1, b2, b3, b4, b5, b6, b7) \
+    ((uint64_t)(b0) | (uint64_t)(b1) << 8 | (uint64_t)(b2) << 16 | (uint64_t)(b3) << 24 | \
+     (uint64_t)(b4) << 32 | (uint64_t)(b5) << 40 | (uint64_t)(b6) << 48 | (uint64_t)(b7) << 56)
+
+static const struct { uint64_t magic, mask; uint8_t min_len; TestFileType type; } TEST_SIGNATURES[] = {
+    { SIG_WORD(0xFF, 0xD8, 0xFF, 0, 0, 0, 0, 0), 0xFFFFFF, 3, FT_JPEG },
+    { SIG_WORD(0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'), UINT64_MAX, 8, FT_PNG },
+    { SIG_WORD('B', 'M', 0, 0, 0, 0, 0, 0), 0xFFFF, 2, FT_BMP },
+    { SIG_WORD('I', 'I', 0x2A, 0x00, 0, 0, 0, 0), 0xFFFFFFFF, 4, FT_TIFF },
+    { SIG_WORD('M', 'M', 0x00, 0x2A, 0, 0, 0, 0), 0xFFFFFFFF, 4, FT_TIFF },
+    { SIG_WORD(0xFF, 0x0A, 0, 0, 0, 0, 0, 0), 0xFFFF, 2, FT_JXL },
+    { SIG_WORD(0x00, 0, 0, 0, 'J', 'X', 'L', 0), 0x00FFFFFF000000FF, 12, FT_JXL },
+};
+
+static TestFileType detect_signature(const unsigned char *buf, size_t n) {
+    if (n < 2) return FT_UNKNOWN;
+    uint8_t h[8] = { 0 };
+    memcpy(h, buf, n < 8 ? n : 8);
+    uint64_t word = SIG_WORD(h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
+    for (size_t i = 0; i < sizeof(TEST_SIGNATURES) / sizeof(TEST_SIGNATURES[0]); i++) {
+        if (n >= TEST_SIGNATURES[i].min_len && (word & TEST_SIGNATURES[i].mask) == TEST_SIGNATURES[i].magic) {
+            return TEST_SIGNATURES[i].type;
+        }
+    }
+    if (h[0] == 'P' && (uint8_t)(h[1] - '1') < 6) return FT_PPM;
+    return FT_UNKNOWN;
+}
+
+TEST(signature_table_matches_chain) {
+    // Every signature prefix, mutated byte by byte and cut at every length
+    const unsigned char seeds[][12] = {
+        { 0xFF, 0xD8, 0xFF, 0xE0 }, { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' },
+        { 'B', 'M' }, { 'I', 'I', 0x2A, 0x00 }, { 'M', 'M', 0x00, 0x2A }, { 0xFF, 0x0A },
+        { 0, 0, 0, 0x0C, 'J', 'X', 'L', ' ', 0x0D, 0x0A, 0x87, 0x0A }, { 'P', '6' }, { 'P', '7' },
+    };
+    int mismatches = 0;
+    for (size_t s = 0; s < sizeof(seeds) / sizeof(seeds[0]); s++) {
+        for (int pos = -1; pos < 12; pos++) {
+            for (int delta = 0; delta < 256; delta += (pos < 0 ? 256 : 37)) {
+                unsigned char buf[12];
+                memcpy(buf, seeds[s], 12);
+                if (pos >= 0) buf[pos] = (unsigned char)(buf[pos] + delta);
+                for (size_t n = 0; n <= 12; n++) {
+                    if (detect_signature(buf, n) != detect_magic(buf, n)) mismatches++;
+                }
+            }
+        }
+    }
+    ASSERT_EQ(mismatches, 0);
+}
+
+// Mirrors ifd_is_reduced() in tiff.c: ascending tags, stop past 254
+static int ifd_reduced_reads(const uint16_t *tags, const uint32_t *values, int count, bool *reduced) {
+    *reduced = false;
+    for (int i = 0; i < count; i++) {
+        if (tags[i] == 254) { *reduced = (values[i] & 1) != 0; return i + 1; }
+        if (tags[i] > 254) return i + 1;
+    }
+    return count;
+}
+
+TEST(tiff_ifd_sorted_stop) {
+    // Thumbnail IFD: NewSubfileType first, found on the first read
+    const uint16_t thumb[] = { 254, 256, 257, 258, 259, 273 };
+    const uint32_t thumb_v[] = { 1, 160, 120, 8, 1, 4096 };
+    bool reduced;
+    ASSERT_EQ(ifd_reduced_reads(thumb, thumb_v, 6, &reduced), 1);
+    ASSERT_TRUE(reduced);
+    // A page without the tag: stops at ImageWidth instead of reading on
+    const uint16_t page[] = { 256, 257, 258, 259, 262, 273, 277, 278, 279, 33432, 34665 };
+    const uint32_t page_v[11] = { 0 };
+    ASSERT_EQ(ifd_reduced_reads(page, page_v, 11, &reduced), 1);
+    ASSERT_TRUE(!reduced);
+}
+
+// Mirrors the offsets / byte-counts check in tiff_parse(): a segment
+// without a byte count would be read past the end of the array
+static bool tiff_segment_arrays_ok(uint32_t segments, uint32_t count_entries) {
+    return segments > 0 && count_entries >= segments;
+}
+
+TEST(tiff_fewer_byte_counts_rejected) {
+    ASSERT_TRUE(tiff_segment_arrays_ok(100, 100));
+    ASSERT_TRUE(tiff_segment_arrays_ok(1, 1));
+    ASSERT_TRUE(!tiff_segment_arrays_ok(100, 1));  // 100 StripOffsets, 1 StripByteCount
+    ASSERT_TRUE(!tiff_segment_arrays_ok(4, 0));
+    ASSERT_TRUE(tiff_segment_arrays_ok(4, 5));     // Extra counts are never read
+}
+
+// Mirrors image_streams() in jxl_encoder.c: only row-table images without
+// alpha take the chunked path (alpha would be a separate extra channel)
+static bool streams_chunked(bool has_rows, bool alpha) {
+    return has_rows && !alpha;
+}
+
+TEST(alpha_row_table_encoded_whole) {
+    ASSERT_TRUE(streams_chunked(true, false));     // 24-bit BMP, gray TGA, RGB strip TIFF
+    ASSERT_TRUE(!streams_chunked(true, true));     // 32-bit BMP/TGA, RGBA strip TIFF: packed
+    ASSERT_TRUE(!streams_chunked(false, false));   // Decoded PNG / compressed TIFF
+    ASSERT_TRUE(!streams_chunked(false, true));
+}
+
+// Mirrors wq_peek(): the next items of a ring deque, oldest first
+static int deque_peek(const int *items, int capacity, int head, int count, int *out, int max) {
+    int n = count < max ? count : max;
+    for (int i = 0; i < n; i++) out[i] = items[(head + i) % capacity];
+    return n;
+}
+
+TEST(prefetch_peek_wraps) {
+    // Ring of 4 with head at 3: order is 30, 40, 50
+    const int items[4] = { 40, 50, 0, 30 };
+    int out[4] = { 0 };
+    ASSERT_EQ(deque_peek(items, 4, 3, 3, out, 2), 2);
+    ASSERT_EQ(out[0], 30);
+    ASSERT_EQ(out[1], 40);
+    ASSERT_EQ(deque_peek(items, 4, 3, 3, out, 4), 3);
+    ASSERT_EQ(out[2], 50);
+    ASSERT_EQ(deque_peek(items, 4, 0, 0, out, 2), 0);
+}
+
+// Mirrors prefetch_hint()/hint_take(): a bounded FIFO that drops, never waits
+typedef struct { int items[4]; int head, count, dropped; } HintRing;
+
+static void hint_push(HintRing *r, int v) {
+    if (r->count == 4) { r->dropped++; return; }
+    r->items[(r->head + r->count) % 4] = v;
+    r->count++;
+}
+
+static bool hint_pop(HintRing *r, int *v) {
+    if (r->count == 0) return false;
+    *v = r->items[r->head];
+    r->head = (r->head + 1) % 4;
+    r->count--;
+    return true;
+}
+
+TEST(prefetch_hints_drop_when_full) {
+    HintRing r = { .head = 0 };
+    for (int i = 1; i <= 6; i++) hint_push(&r, i);
+    ASSERT_EQ(r.dropped, 2);                       // The encoders never block on a hint
+    int v = 0;
+    ASSERT_TRUE(hint_pop(&r, &v));
+    ASSERT_EQ(v, 1);
+    hint_push(&r, 7);                              // Room again, queued behind 2..4
+    for (int want = 2; want <= 4; want++) {
+        ASSERT_TRUE(hint_pop(&r, &v));
+        ASSERT_EQ(v, want);
+    }
+    ASSERT_TRUE(hint_pop(&r, &v));
+    ASSERT_EQ(v, 7);
+    ASSERT_TRUE(!hint_pop(&r, &v));
+}
+
+// Mirrors copy_xattrs(): walk a NUL-separated name list, keeping user.* on Linux
+static int xattr_walk(const char *names, int len, const char **kept, int max) {
+    int n = 0;
+    for (const char *name = names; name < names + len; name += strlen(name) + 1) {
+        if (strncmp(name, "user.", 5) != 0) continue;
+        if (n < max) kept[n] = name;
+        n++;
+    }
+    return n;
+}
+
+TEST(xattr_names_filtered) {
+    static const char list[] = "user.a\0security.selinux\0user.xdg.origin.url\0trusted.x";
+    const char *kept[4] = { 0 };
+    ASSERT_EQ(xattr_walk(list, (int)sizeof(list), kept, 4), 2);
+    ASSERT_TRUE(strcmp(kept[0], "user.a") == 0);
+    ASSERT_TRUE(strcmp(kept[1], "user.xdg.origin.url") == 0);
+    ASSERT_EQ(xattr_walk(list, 0, kept, 4), 0);    // No attributes
+}
+
+// preserve_timestamps() used to go through utimes() with tv_usec = 0
+typedef struct { int64_t sec; long nsec; } TestTimespec;
+
+static TestTimespec old_utimes_copy(TestTimespec src) {
+    TestTimespec out = { src.sec, 0 };
+    return out;
+}
+
+TEST(timestamp_keeps_nanoseconds) {
+    TestTimespec src = { 1577934245, 123456789 };
+    TestTimespec native = src;                      // futimens()/utimensat() take it as is
+    ASSERT_EQ(native.sec, src.sec);
+    ASSERT_EQ(native.nsec, 123456789);
+    TestTimespec old = old_utimes_copy(src);
+    ASSERT_EQ(old.nsec, 0);                        // Output looked up to a second older
+    int64_t src_ns = src.sec * 1000000000LL + src.nsec;
+    ASSERT_EQ(native.sec * 1000000000LL + native.nsec, src_ns);
+    ASSERT_TRUE(old.sec * 1000000000LL + old.nsec != src_ns);
+}
+
+// Mirrors get_output_path(): only the basename's extension is replaced
+static bool output_path(const char *input, char *output, size_t size) {
+    const char *slash = strrchr(input, '/');
+    const char *ext = strrchr(slash ? slash + 1 : input, '.');
+    int stem = ext ? (int)(ext - input) : (int)strlen(input);
+    return snprintf(output, size, "%.*s.jxl", stem, input) < (int)size;
+}
+
+TEST(output_path_basename_extension) {
+    char out[32];
+    ASSERT_TRUE(output_path("a/b.png", out, sizeof(out)));
+    ASSERT_TRUE(strcmp(out, "a/b.jxl") == 0);
+    ASSERT_TRUE(output_path("d.v2/scan", out, sizeof(out)));
+    ASSERT_TRUE(strcmp(out, "d.v2/scan.jxl") == 0);   // The directory's dot is not an extension
+    ASSERT_TRUE(output_path("x.tar.tiff", out, sizeof(out)));
+    ASSERT_TRUE(strcmp(out, "x.tar.jxl") == 0);
+    char tiny[8];
+    ASSERT_TRUE(!output_path("abcdef", tiny, sizeof(tiny)));   // Refused, not truncated
+}
+
+// Mirrors buffer_class() in ingest.c: powers of two from 64 KB to 64 MB
+static int pool_class(size_t size) {
+    int c = 0;
+    while (c < 11 && ((size_t)1 << (16 + c)) < size) c++;
+    return c < 11 ? c : -1;
+}
+
+TEST(buffer_pool_size_classes) {
+    ASSERT_EQ(pool_class(1), 0);                   // Everything small shares 64 KB
+    ASSERT_EQ(pool_class(64 * 1024), 0);
+    ASSERT_EQ(pool_class(64 * 1024 + 1), 1);
+    ASSERT_EQ(pool_class(1024 * 1024), 4);         // The streaming output buffer
+    ASSERT_EQ(pool_class((size_t)64 << 20), 10);
+    ASSERT_EQ(pool_class(((size_t)64 << 20) + 1), -1);   // Plain malloc, freed on put
+    // Growing an output by doubling steps exactly one class at a time
+    for (int c = 0; c < 10; c++) ASSERT_EQ(pool_class((size_t)2 << (16 + c)), c + 1);
+}
+
 // ============================================================
 // Main
 // ============================================================
@@ -584,6 +1650,94 @@ int main(void) {
     RUN_TEST(not_lossless_jpeg);
     RUN_TEST(not_lossless_jxl);
     
+    printf("\n🧮 Core Budget Tests:\n");
+    RUN_TEST(budget_small_jpeg_one_thread);
+    RUN_TEST(budget_large_tiff_many_threads);
+    RUN_TEST(budget_never_exceeds_available);
+    
+    printf("\n🔮 Predictive Skip Tests:\n");
+    RUN_TEST(predict_bands_cover_top_and_bottom);
+    RUN_TEST(predict_margin_threshold);
+    RUN_TEST(predict_manifest_follows_margin);
+    
+    printf("\n🎚️  Adaptive Effort Tests:\n");
+    RUN_TEST(adaptive_escalates_near_threshold_or_large);
+    RUN_TEST(adaptive_budget_prefers_high_gain_rate);
+    
+    printf("\n🧮 Memory Budget Tests:\n");
+    RUN_TEST(memory_budget_fifo_and_clamp);
+    RUN_TEST(tiff_strip_window_mapping);
+    RUN_TEST(alpha_row_table_encoded_whole);
+    
+    printf("\n🗂️  TIFF Reader Tests:\n");
+    RUN_TEST(tiff_lzw_early_change);
+    RUN_TEST(tiff_predictor_prefix_sum);
+    
+    printf("\n🖼️  Native Decoder Tests:\n");
+    RUN_TEST(png_paeth_predictor);
+    RUN_TEST(bmp_row_table);
+    
+    printf("\n🩺 Validation Tests:\n");
+    RUN_TEST(jxl_size_header);
+    RUN_TEST(jxl_partial_codestream_boxes);
+    
+    printf("\n👯 Dedup Tests:\n");
+    RUN_TEST(dedup_group_key);
+    RUN_TEST(dedup_clone_fallback);
+    
+    printf("\n📈 Statistics Tests:\n");
+    RUN_TEST(stats_blocks_padded_to_cache_lines);
+    RUN_TEST(stats_sum_across_threads_64bit);
+    
+    printf("\n⏱️  Progress Tests:\n");
+    RUN_TEST(progress_ewma_warmup);
+    RUN_TEST(progress_eta_weighted_by_bytes);
+    
+    printf("\n⌛ Timing Tests:\n");
+    RUN_TEST(timing_buckets_within_resolution);
+    RUN_TEST(timing_percentile_rank);
+    
+    printf("\n🏁 Benchmark Corpus Tests:\n");
+    RUN_TEST(bench_jpeg_huffman_codes);
+    RUN_TEST(bench_png_checksums);
+    
+    printf("\n💾 Output Placement Tests:\n");
+    RUN_TEST(output_dir_of);
+    RUN_TEST(output_batch_dir_syncs);
+    
+    printf("\n👀 Watch Mode Tests:\n");
+    RUN_TEST(watch_ignores_scratch_files);
+    RUN_TEST(watch_settle_stable_size);
+    
+    printf("\n🗂️  Ledger Tests:\n");
+    RUN_TEST(ledger_keys_relative_to_root);
+    RUN_TEST(ledger_claim_decisions);
+    
+    printf("\n📄 File List Tests:\n");
+    RUN_TEST(filelist_delimiter_detection);
+    RUN_TEST(filelist_records_span_blocks);
+    
+    printf("\n🚀 Tail Scheduling Tests:\n");
+    RUN_TEST(jpeg_frame_before_scan);
+    RUN_TEST(tail_share_threads);
+    
+    printf("\n🔎 Header Sniffing Tests:\n");
+    RUN_TEST(signature_table_matches_chain);
+    RUN_TEST(tiff_ifd_sorted_stop);
+    RUN_TEST(tiff_fewer_byte_counts_rejected);
+    
+    printf("\n📥 Prefetch Tests:\n");
+    RUN_TEST(prefetch_peek_wraps);
+    RUN_TEST(prefetch_hints_drop_when_full);
+    
+    printf("\n🏷️  Native Metadata Tests:\n");
+    RUN_TEST(xattr_names_filtered);
+    RUN_TEST(timestamp_keeps_nanoseconds);
+    
+    printf("\n♻️  Reuse Tests:\n");
+    RUN_TEST(output_path_basename_extension);
+    RUN_TEST(buffer_pool_size_classes);
+    
     printf("\n🔄 Consistency Verification (一致性验证):\n");
     printf("  --- Level 1: Deterministic Output ---\n");
     RUN_TEST(consistency_size_reduction);